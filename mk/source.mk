@@ -75,6 +75,7 @@ COMMON_SRC = \
             common/vector.c \
             config/config.c \
             config/config_eeprom.c \
+            config/config_snapshot.c \
             config/config_streamer.c \
             config/feature.c \
             config/simplified_tuning.c \
@@ -364,7 +365,8 @@ FLASH_SRC += \
             drivers/flash/flash_w25m.c \
             drivers/flash/flash_w25n.c \
             drivers/flash/flash_w25q128fv.c \
-            io/flashfs.c
+            io/flashfs.c \
+            io/flashfs_index.c
 
 SDCARD_SRC += \
             drivers/sdcard.c \
@@ -378,6 +380,19 @@ INCLUDE_DIRS    := $(INCLUDE_DIRS) \
                    $(FATFS_DIR)
 VPATH           := $(VPATH):$(FATFS_DIR)
 
+else
+
+# Flash and SD card emulated in image files, see target/SITL
+FLASH_SRC += \
+            drivers/flash/flash.c \
+            io/flashfs.c \
+            io/flashfs_index.c
+
+SDCARD_SRC += \
+            drivers/sdcard.c \
+            io/asyncfatfs/asyncfatfs.c \
+            io/asyncfatfs/fat_standard.c
+
 endif
 
 COMMON_DEVICE_SRC = \
@@ -503,6 +518,7 @@ SIZE_OPTIMISED_SRC := $(SIZE_OPTIMISED_SRC) \
             fc/init.c \
             fc/board_info.c \
             config/config_eeprom.c \
+            config/config_snapshot.c \
             config/feature.c \
             config/config_streamer.c \
             config/simplified_tuning.c \
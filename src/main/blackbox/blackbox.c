@@ -272,6 +272,9 @@ static const blackboxDeltaFieldDefinition_t blackboxMainFields[] = {
 #endif /* USE_DSHOT_TELEMETRY */
 };
 
+// The frame type, up to 5 bytes per field and the tag bytes of the axisI, rcCommand, setpoint and TAG8_8SVB groups
+STATIC_ASSERT(1 + ARRAYLEN(blackboxMainFields) * 5 + 4 <= BLACKBOX_FRAME_BUFFER_SIZE, blackbox_frame_buffer_too_small);
+
 #ifdef USE_GPS
 // GPS position/vel frame
 static const blackboxConditionalFieldDefinition_t blackboxGpsGFields[] = {
@@ -722,6 +725,8 @@ static void writeIntraframe(void)
     blackboxHistory[0] = ((blackboxHistory[0] - blackboxHistoryRing + 1) % 3) + blackboxHistoryRing;
 
     blackboxLoggedAnyFrames = true;
+
+    blackboxDeviceCommitFrame();
 }
 
 static void blackboxWriteMainStateArrayUsingAveragePredictor(int arrOffsetInHistory, int count)
@@ -872,6 +877,8 @@ static void writeInterframe(void)
     blackboxHistory[0] = ((blackboxHistory[0] - blackboxHistoryRing + 1) % 3) + blackboxHistoryRing;
 
     blackboxLoggedAnyFrames = true;
+
+    blackboxDeviceCommitFrame();
 }
 
 /* Write the contents of the global "slowHistory" to the log as an "S" frame. Because this data is logged so
@@ -894,6 +901,8 @@ static void writeSlowFrame(void)
     blackboxWriteTag2_3S32(values);
 
     blackboxSlowFrameIterationTimer = 0;
+
+    blackboxDeviceCommitFrame();
 }
 
 /**
@@ -1091,6 +1100,8 @@ static void writeGPSHomeFrame(void)
     //TODO it'd be great if we could grab the GPS current time and write that too
 
     gpsHistory.GPS_home = GPS_home_llh;
+
+    blackboxDeviceCommitFrame();
 }
 
 static void writeGPSFrame(timeUs_t currentTimeUs)
@@ -1123,6 +1134,8 @@ static void writeGPSFrame(timeUs_t currentTimeUs)
 
     gpsHistory.GPS_numSat = gpsSol.numSat;
     gpsHistory.GPS_coord = gpsSol.llh;
+
+    blackboxDeviceCommitFrame();
 }
 #endif
 
@@ -1770,6 +1783,8 @@ void blackboxLogEvent(FlightLogEvent event, flightLogEventData_t *data)
     default:
         break;
     }
+
+    blackboxDeviceCommitFrame();
 }
 
 /* If an arming beep has played since it was last logged, write the time of the arming beep to the log as a synchronization point */
@@ -2058,6 +2073,9 @@ void blackboxUpdate(timeUs_t currentTimeUs)
         break;
     }
 
+    // Hand any header chunk written above to the device
+    blackboxDeviceCommitFrame();
+
     // Did we run out of room on the device? Stop!
     if (isBlackboxDeviceFull()) {
 #ifdef USE_FLASHFS
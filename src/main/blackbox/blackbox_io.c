@@ -35,7 +35,8 @@
 //
 // 0: Average output bandwidth in last 100ms
 // 1: Maximum hold of above.
-// 2: Bytes dropped due to output buffer full.
+// 2: Frames dropped due to output buffer full.
+// 3: Serial transmit buffer free space.
 //
 // Note that bandwidth usage slightly increases when DEBUG_BB_OUTPUT is enabled,
 // as output will include debug variables themselves.
@@ -51,6 +52,7 @@
 
 #include "io/asyncfatfs/asyncfatfs.h"
 #include "io/flashfs.h"
+#include "io/flashfs_index.h"
 #include "io/serial.h"
 
 #include "msp/msp_serial.h"
@@ -61,6 +63,12 @@
 
 #define BLACKBOX_SERIAL_PORT_MODE MODE_TX
 
+// Frames are encoded here and handed to the device in one piece by blackboxDeviceCommitFrame()
+static uint8_t blackboxFrameBuffer[BLACKBOX_FRAME_BUFFER_SIZE];
+static uint16_t blackboxFrameLength;
+static bool blackboxFrameDropped;
+static uint32_t blackboxDroppedFrames;
+
 // How many bytes can we transmit per loop iteration when writing headers?
 static uint8_t blackboxMaxHeaderBytesPerIteration;
 
@@ -86,6 +94,10 @@ static struct {
         BLACKBOX_SDCARD_READY_TO_CREATE_LOG,
         BLACKBOX_SDCARD_READY_TO_LOG
     } state;
+
+    // The rest of a frame afatfs_fwrite() only took part of, written ahead of the next frame
+    uint8_t frameTail[BLACKBOX_FRAME_BUFFER_SIZE];
+    uint16_t frameTailLength;
 } blackboxSDCard;
 
 #define LOGFILE_PREFIX "LOG"
@@ -101,53 +113,76 @@ void blackboxOpen(void)
     }
 }
 
+#ifdef USE_SDCARD
+// Returns true once the file holds the whole of the last frame
+static bool blackboxSdcardWriteFrameTail(void)
+{
+    if (blackboxSDCard.frameTailLength) {
+        const uint32_t written = afatfs_fwrite(blackboxSDCard.logFile, blackboxSDCard.frameTail, blackboxSDCard.frameTailLength);
+        blackboxSDCard.frameTailLength -= written;
+        memmove(blackboxSDCard.frameTail, blackboxSDCard.frameTail + written, blackboxSDCard.frameTailLength);
+    }
+
+    return blackboxSDCard.frameTailLength == 0;
+}
+#endif
+
 #ifdef DEBUG_BB_OUTPUT
 static uint32_t bbBits;
 static timeMs_t bbLastclearMs;
 static uint16_t bbRateMax;
-static uint32_t bbDrops;
 #endif
 
-void blackboxWrite(uint8_t value)
+// Returns false if the device has no room for the whole buffer, in which case nothing is written
+static bool blackboxDeviceWriteBuffer(const uint8_t *buffer, uint16_t length)
 {
-#ifdef DEBUG_BB_OUTPUT
-    bbBits += 8;
-#endif
-
     switch (blackboxConfig()->device) {
 #ifdef USE_FLASHFS
     case BLACKBOX_DEVICE_FLASH:
-        flashfsWriteByte(value); // Write byte asynchronously
+        if (length > flashfsGetWriteBufferFreeSpace()) {
+            return false;
+        }
+        flashfsWrite(buffer, length, false); // Write asynchronously
         break;
 #endif
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
-        afatfs_fputc(blackboxSDCard.logFile, value);
+        // Only start a frame the cache has room for, so that the file holds whole frames
+        if (!blackboxSdcardWriteFrameTail() || length > afatfs_getFreeBufferSpace()) {
+            return false;
+        }
+        {
+            const uint32_t written = afatfs_fwrite(blackboxSDCard.logFile, buffer, length);
+            if (written == 0) {
+                return false;
+            }
+            // The write stops at a sector whose cluster is still being allocated, the rest follows once it is
+            blackboxSDCard.frameTailLength = length - written;
+            memcpy(blackboxSDCard.frameTail, buffer + written, blackboxSDCard.frameTailLength);
+        }
         break;
 #endif
     case BLACKBOX_DEVICE_SERIAL:
     default:
         {
-            int txBytesFree = serialTxBytesFree(blackboxPort);
+            const uint32_t txBytesFree = serialTxBytesFree(blackboxPort);
 
 #ifdef DEBUG_BB_OUTPUT
-            bbBits += 2;
+            bbBits += 2 * length;
             DEBUG_SET(DEBUG_BLACKBOX_OUTPUT, 3, txBytesFree);
 #endif
 
-            if (txBytesFree == 0) {
-#ifdef DEBUG_BB_OUTPUT
-                ++bbDrops;
-                DEBUG_SET(DEBUG_BLACKBOX_OUTPUT, 2, bbDrops);
-#endif
-                return;
+            if (txBytesFree < length) {
+                return false;
             }
-            serialWrite(blackboxPort, value);
+            serialWriteBuf(blackboxPort, buffer, length);
         }
         break;
     }
 
 #ifdef DEBUG_BB_OUTPUT
+    bbBits += 8 * length;
+
     timeMs_t now = millis();
 
     if (now > bbLastclearMs + 100) {  // Debug log every 100[msec]
@@ -161,43 +196,61 @@ void blackboxWrite(uint8_t value)
         bbBits = 0;
     }
 #endif
+
+    return true;
+}
+
+static void blackboxFrameBufferFlush(void)
+{
+    // Once part of a frame has been dropped the rest of it is worthless
+    if (blackboxFrameLength && !blackboxFrameDropped) {
+        blackboxFrameDropped = !blackboxDeviceWriteBuffer(blackboxFrameBuffer, blackboxFrameLength);
+    }
+    blackboxFrameLength = 0;
+}
+
+void blackboxWrite(uint8_t value)
+{
+    // only header output, which the device has room for, gets here
+    if (blackboxFrameLength == BLACKBOX_FRAME_BUFFER_SIZE) {
+        blackboxFrameBufferFlush();
+    }
+    blackboxFrameBuffer[blackboxFrameLength++] = value;
 }
 
 // Print the null-terminated string 's' to the blackbox device and return the number of bytes written
 int blackboxWriteString(const char *s)
 {
-    int length;
-    const uint8_t *pos;
-
-    switch (blackboxConfig()->device) {
+    const char *pos = s;
 
-#ifdef USE_FLASHFS
-    case BLACKBOX_DEVICE_FLASH:
-        length = strlen(s);
-        flashfsWrite((const uint8_t*) s, length, false); // Write asynchronously
-        break;
-#endif // USE_FLASHFS
+    while (*pos) {
+        blackboxWrite(*pos);
+        pos++;
+    }
 
-#ifdef USE_SDCARD
-    case BLACKBOX_DEVICE_SDCARD:
-        length = strlen(s);
-        afatfs_fwrite(blackboxSDCard.logFile, (const uint8_t*) s, length); // Ignore failures due to buffers filling up
-        break;
-#endif // USE_SDCARD
+    return pos - s;
+}
 
-    case BLACKBOX_DEVICE_SERIAL:
-    default:
-        pos = (uint8_t*) s;
-        while (*pos) {
-            blackboxWrite(*pos);
-            pos++;
-        }
+/**
+ * Hand the frame encoded since the last commit to the blackbox device. If the device can't take all of it the
+ * whole frame is discarded and counted as dropped.
+ */
+void blackboxDeviceCommitFrame(void)
+{
+    blackboxFrameBufferFlush();
 
-        length = pos - (uint8_t*) s;
-        break;
+    if (blackboxFrameDropped) {
+        blackboxFrameDropped = false;
+        ++blackboxDroppedFrames;
+#ifdef DEBUG_BB_OUTPUT
+        DEBUG_SET(DEBUG_BLACKBOX_OUTPUT, 2, blackboxDroppedFrames);
+#endif
     }
+}
 
-    return length;
+uint32_t blackboxGetDroppedFrameCount(void)
+{
+    return blackboxDroppedFrames;
 }
 
 /**
@@ -207,6 +260,8 @@ int blackboxWriteString(const char *s)
  */
 void blackboxDeviceFlush(void)
 {
+    blackboxDeviceCommitFrame();
+
     switch (blackboxConfig()->device) {
 #ifdef USE_FLASHFS
         /*
@@ -215,6 +270,7 @@ void blackboxDeviceFlush(void)
          */
     case BLACKBOX_DEVICE_FLASH:
         flashfsFlushAsync(false);
+        flashfsEraseAhead();
         break;
 #endif // USE_FLASHFS
 
@@ -230,6 +286,8 @@ void blackboxDeviceFlush(void)
  */
 bool blackboxDeviceFlushForce(void)
 {
+    blackboxDeviceCommitFrame();
+
     switch (blackboxConfig()->device) {
     case BLACKBOX_DEVICE_SERIAL:
         // Nothing to speed up flushing on serial, as serial is continuously being drained out of its buffer
@@ -247,7 +305,7 @@ bool blackboxDeviceFlushForce(void)
         // However the "flush" only queues one dirty sector each time and the process is asynchronous. So after
         // the last dirty sector is queued the flush returns true even though the sector may not actually have
         // been physically written to the SD card yet.
-        return afatfs_flush();
+        return blackboxSdcardWriteFrameTail() && afatfs_flush();
 #endif // USE_SDCARD
 
     default:
@@ -262,7 +320,7 @@ bool blackboxDeviceFlushForceComplete(void)
     switch (blackboxConfig()->device) {
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
-        if (afatfs_sectorCacheInSync()) {
+        if (blackboxSDCard.frameTailLength == 0 && afatfs_sectorCacheInSync()) {
             return true;
         } else {
             blackboxDeviceFlushForce();
@@ -280,6 +338,13 @@ bool blackboxDeviceFlushForceComplete(void)
  */
 bool blackboxDeviceOpen(void)
 {
+    blackboxFrameLength = 0;
+    blackboxFrameDropped = false;
+    blackboxDroppedFrames = 0;
+#ifdef USE_SDCARD
+    blackboxSDCard.frameTailLength = 0;
+#endif
+
     switch (blackboxConfig()->device) {
     case BLACKBOX_DEVICE_SERIAL:
         {
@@ -426,9 +491,18 @@ void blackboxDeviceClose(void)
         break;
 #ifdef USE_FLASHFS
     case BLACKBOX_DEVICE_FLASH:
+    {
+        // The log ends before the padding flashfsClose() adds on page based devices
+        const uint32_t logEnd = flashfsGetOffset();
         // Some flash device, e.g., NAND devices, require explicit close to flush internally buffered data.
         flashfsClose();
+#ifdef USE_FLASHFS_INDEX
+        flashfsIndexLogEnd(logEnd);
+#else
+        UNUSED(logEnd);
+#endif
         break;
+    }
 #endif
     default:
         ;
@@ -565,6 +639,17 @@ bool blackboxDeviceBeginLog(void)
     case BLACKBOX_DEVICE_SDCARD:
         return blackboxSDCardBeginLog();
 #endif // USE_SDCARD
+#ifdef USE_FLASHFS
+    case BLACKBOX_DEVICE_FLASH:
+        // In ring mode, the log starts once there is erased space ahead
+        if (!flashfsEraseAhead()) {
+            return false;
+        }
+#ifdef USE_FLASHFS_INDEX
+        flashfsIndexLogBegin(flashfsGetOffset());
+#endif
+        return true;
+#endif
     default:
         return true;
     }
@@ -584,6 +669,8 @@ bool blackboxDeviceEndLog(bool retainLog)
     UNUSED(retainLog);
 #endif
 
+    blackboxDeviceCommitFrame();
+
     switch (blackboxConfig()->device) {
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
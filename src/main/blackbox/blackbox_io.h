@@ -38,11 +38,19 @@ typedef enum {
  */
 #define BLACKBOX_TARGET_HEADER_BUDGET_PER_ITERATION 64
 
+/*
+ * Frames are staged in RAM and written to the device in one go, so this holds the largest main frame (checked in
+ * blackbox.c). Only header output, which is written within blackboxHeaderBudget, is passed on in pieces:
+ */
+#define BLACKBOX_FRAME_BUFFER_SIZE 336
+
 extern int32_t blackboxHeaderBudget;
 
 void blackboxOpen(void);
 void blackboxWrite(uint8_t value);
 int blackboxWriteString(const char *s);
+void blackboxDeviceCommitFrame(void);
+uint32_t blackboxGetDroppedFrameCount(void);
 
 void blackboxDeviceFlush(void);
 bool blackboxDeviceFlushForce(void);
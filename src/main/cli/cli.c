@@ -56,6 +56,7 @@ bool cliMode = false;
 
 #include "config/config.h"
 #include "config/config_eeprom.h"
+#include "config/config_snapshot.h"
 #include "config/feature.h"
 #include "config/simplified_tuning.h"
 
@@ -178,10 +179,22 @@ static serialPort_t *cliPort = NULL;
 
 // Space required to set array parameters
 #define CLI_IN_BUFFER_SIZE 256
-#define CLI_OUT_BUFFER_SIZE 64
+// Output is collected and written to the port in blocks of up to this size
+#ifndef CLI_OUT_BUFFER_SIZE
+#define CLI_OUT_BUFFER_SIZE 1024
+#endif
+
+// valueTable entries looked at for each step of a dump, the time a dump may take of each serial task run, and the
+// rate the serial task runs at until the dump is done
+#define CLI_DUMP_VALUES_PER_STEP 32
+#define CLI_DUMP_SLICE_US 500
+// Output is dropped, and a dump abandoned, once the port has taken none of it for this long
+#define CLI_WRITE_STALL_MS 100
+#define CLI_OUTPUT_RATE_HZ 1000
 
 static bufWriter_t cliWriterDesc;
 static bufWriter_t *cliWriter = NULL;
+static timeMs_t cliOutputSentAtMs;      // when the port last took some of the output, or had none waiting
 static bufWriter_t *cliErrorWriter = NULL;
 static uint8_t cliWriteBuffer[CLI_OUT_BUFFER_SIZE];
 
@@ -343,7 +356,6 @@ static void cliPrintInternal(bufWriter_t *writer, const char *str)
         while (*str) {
             bufWriterAppend(writer, *str++);
         }
-        cliWriterFlushInternal(writer);
     }
 }
 
@@ -352,6 +364,40 @@ static void cliWriterFlush(void)
     cliWriterFlushInternal(cliWriter);
 }
 
+// Hand the port as much of the output as its transmit buffer has room for, returning true once all of it has gone
+static bool cliWriterFlushAvailable(void)
+{
+    const int count = cliWriter->at;
+    const int kept = bufWriterFlushUpTo(cliWriter, serialTxBytesFree(cliPort));
+    if (kept == 0 || kept < count) {
+        cliOutputSentAtMs = millis();
+    }
+
+    return kept == 0;
+}
+
+/*
+ * Hand the output to the port no faster than its transmit buffer makes room, as that may be smaller than the CLI's.
+ * This only waits for the port when a command prints more than CLI_OUT_BUFFER_SIZE, or has to see its output go before
+ * it blocks, eg. to reboot. cliProcess() otherwise only gives the port what it has room for.
+ */
+static void cliWriteBufShim(void *arg, void *data, int count)
+{
+    serialPort_t *port = arg;
+    const uint8_t *ptr = data;
+    timeMs_t writtenAtMs = millis();
+
+    while (count > 0 && cmp32(millis(), writtenAtMs) < CLI_WRITE_STALL_MS) {
+        const int length = MIN((uint32_t)count, serialTxBytesFree(port));
+        if (length > 0) {
+            serialWriteBuf(port, ptr, length);
+            ptr += length;
+            count -= length;
+            writtenAtMs = millis();
+        }
+    }
+}
+
 void cliPrint(const char *str)
 {
     cliPrintInternal(cliWriter, str);
@@ -387,7 +433,6 @@ static void cliPrintfva(const char *format, va_list va)
 {
     if (cliWriter) {
         tfp_format(cliWriter, cliPutp, format, va);
-        cliWriterFlush();
     }
 }
 
@@ -806,17 +851,17 @@ static const char *dumpPgValue(const char *cmdName, const clivalue_t *value, dum
     return headingStr;
 }
 
-static void dumpAllValues(const char *cmdName, uint16_t valueSection, dumpFlags_t dumpMask, const char *headingStr)
+// Dump the values of a section from valueTable[start] up to valueTable[end - 1], returning the heading if not yet printed
+static const char *dumpValues(const char *cmdName, uint16_t valueSection, dumpFlags_t dumpMask, const char *headingStr, uint32_t start, uint32_t end)
 {
-    headingStr = cliPrintSectionHeading(dumpMask, false, headingStr);
-
-    for (uint32_t i = 0; i < valueTableEntryCount; i++) {
+    for (uint32_t i = start; i < end; i++) {
         const clivalue_t *value = &valueTable[i];
-        cliWriterFlush();
         if ((value->type & VALUE_SECTION_MASK) == valueSection || ((valueSection == MASTER_VALUE) && (value->type & VALUE_SECTION_MASK) == HARDWARE_VALUE)) {
             headingStr = dumpPgValue(cmdName, value, dumpMask, headingStr);
         }
     }
+
+    return headingStr;
 }
 
 static void cliPrintVar(const char *cmdName, const clivalue_t *var, bool full)
@@ -1611,6 +1656,7 @@ static void cliSerialPassthrough(const char *cmdName, char *cmdline)
     }
 #endif
 
+    cliWriterFlush();
     serialPassthrough(ports[0].port, ports[1].port, NULL, NULL);
 }
 #endif
@@ -3530,6 +3576,8 @@ static void cliRebootEx(rebootTarget_e rebootTarget)
     cliWriterFlush();
     waitForSerialPortToFinishTransmitting(cliPort);
     motorShutdown();
+    // don't lose a save that is still being written
+    finishEepromWrite();
 
     switch (rebootTarget) {
     case REBOOT_TARGET_BOOTLOADER_ROM:
@@ -3603,6 +3651,7 @@ static void cliGpsPassthrough(const char *cmdName, char *cmdline)
     UNUSED(cmdName);
     UNUSED(cmdline);
 
+    cliWriterFlush();
     if (!gpsPassthrough(cliPort)) {
         cliPrintErrorLinef(cmdName, "GPS forwarding failed");
     }
@@ -3963,6 +4012,7 @@ static void cliEscPassthrough(const char *cmdName, char *cmdline)
         pch = strtok_r(NULL, " ", &saveptr);
     }
 
+    cliWriterFlush();
     if (!escEnablePassthrough(cliPort, &motorConfig()->dev, escIndex, mode)) {
         cliPrintErrorLinef(cmdName, "Error starting ESC connection");
     }
@@ -4127,44 +4177,6 @@ static void cliRateProfile(const char *cmdName, char *cmdline)
     }
 }
 
-static void cliDumpPidProfile(const char *cmdName, uint8_t pidProfileIndex, dumpFlags_t dumpMask)
-{
-    if (pidProfileIndex >= PID_PROFILE_COUNT) {
-        // Faulty values
-        return;
-    }
-
-    pidProfileIndexToUse = pidProfileIndex;
-
-    cliPrintLinefeed();
-    cliProfile(cmdName, "");
-
-    char profileStr[10];
-    tfp_sprintf(profileStr, "profile %d", pidProfileIndex);
-    dumpAllValues(cmdName, PROFILE_VALUE, dumpMask, profileStr);
-
-    pidProfileIndexToUse = CURRENT_PROFILE_INDEX;
-}
-
-static void cliDumpRateProfile(const char *cmdName, uint8_t rateProfileIndex, dumpFlags_t dumpMask)
-{
-    if (rateProfileIndex >= CONTROL_RATE_PROFILE_COUNT) {
-        // Faulty values
-        return;
-    }
-
-    rateProfileIndexToUse = rateProfileIndex;
-
-    cliPrintLinefeed();
-    cliRateProfile(cmdName, "");
-
-    char rateProfileStr[14];
-    tfp_sprintf(rateProfileStr, "rateprofile %d", rateProfileIndex);
-    dumpAllValues(cmdName, PROFILE_RATE_VALUE, dumpMask, rateProfileStr);
-
-    rateProfileIndexToUse = CURRENT_PROFILE_INDEX;
-}
-
 #ifdef USE_CLI_BATCH
 static void cliPrintCommandBatchWarning(const char *cmdName, const char *warning)
 {
@@ -4397,15 +4409,8 @@ static uint8_t getWordLength(const char *bufBegin, const char *bufEnd)
 
 uint16_t cliGetSettingIndex(const char *name, size_t length)
 {
-    for (uint32_t i = 0; i < valueTableEntryCount; i++) {
-        const char *settingName = valueTable[i].name;
-
-        // ensure exact match when setting to prevent setting variables with longer names
-        if (strncasecmp(name, settingName, length) == 0 && length == strlen(settingName)) {
-            return i;
-        }
-    }
-    return valueTableEntryCount;
+    // exact match only, to prevent setting variables with longer names
+    return valueTableFindByName(name, length);
 }
 
 STATIC_UNIT_TESTED void cliSet(const char *cmdName, char *cmdline)
@@ -4846,11 +4851,69 @@ if (buildKey) {
     cliPrintLinefeed();
 }
 
+#ifdef USE_TASK_HISTOGRAMS
+static void cliTaskHistogramRow(const char *label, const uint32_t *buckets)
+{
+    // pad to the width of the header
+    cliPrint(label);
+    for (int i = strlen(label); i < 29; i++) {
+        cliWrite(' ');
+    }
+    for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+        cliPrintf(" %8u", buckets[i]);
+    }
+    cliPrintLinefeed();
+}
+
+static void cliTaskHistograms(const char *cmdName, char *cmdline)
+{
+    if (strcasecmp(cmdline, "reset") == 0) {
+        for (taskId_e taskId = 0; taskId < TASK_COUNT; taskId++) {
+            schedulerResetTaskHistogram(taskId);
+        }
+        return;
+    } else if (!isEmpty(cmdline)) {
+        cliShowParseError(cmdName);
+        return;
+    }
+
+    cliPrint("Task list                  us");
+    for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+        cliPrintf(i == TASK_HISTOGRAM_BUCKET_COUNT - 1 ? " %7d+" : " %8d", i ? 1 << (i - 1) : 0);
+    }
+    cliPrintLinefeed();
+
+    for (taskId_e taskId = 0; taskId < TASK_COUNT; taskId++) {
+        taskInfo_t taskInfo;
+        getTaskInfo(taskId, &taskInfo);
+        // one snapshot per task, so that both rows cover the same runs
+        taskHistogram_t histogram;
+        if (taskInfo.isEnabled && getTaskHistogram(taskId, &histogram)) {
+            // tfp_sprintf has no precision, so cut longer task names to the 15 characters of the column
+            char taskName[16];
+            strncpy(taskName, taskInfo.taskName, sizeof(taskName) - 1);
+            taskName[sizeof(taskName) - 1] = '\0';
+            char label[30];
+            tfp_sprintf(label, "%02d - (%15s) exec", taskId, taskName);
+            cliTaskHistogramRow(label, histogram.executionTimeUs);
+            cliTaskHistogramRow("                     jitter", histogram.startJitterUs);
+        }
+    }
+}
+#endif
+
 static void cliTasks(const char *cmdName, char *cmdline)
 {
+    int averageLoadSum = 0;
+
+#ifdef USE_TASK_HISTOGRAMS
+    if (strncasecmp(cmdline, "hist", 4) == 0 && (cmdline[4] == '\0' || cmdline[4] == ' ')) {
+        cliTaskHistograms(cmdName, skipSpace(cmdline + 4));
+        return;
+    }
+#endif
     UNUSED(cmdName);
     UNUSED(cmdline);
-    int averageLoadSum = 0;
 
 #ifndef MINIMAL_CLI
     if (systemConfig()->task_statistics) {
@@ -6186,40 +6249,164 @@ static void cliDshotTelemetryInfo(const char *cmdName, char *cmdline)
 
 #endif
 
-static void printConfig(const char *cmdName, char *cmdline, bool doDiff)
+typedef enum {
+    DUMP_STEP_IDLE = 0,
+    DUMP_STEP_HEADER,
+    DUMP_STEP_RESOURCE,
+    DUMP_STEP_TIMER,
+    DUMP_STEP_DMA,
+    DUMP_STEP_FEATURE,
+    DUMP_STEP_MIXER,
+    DUMP_STEP_BEEPER,
+    DUMP_STEP_LED,
+    DUMP_STEP_COLOR,
+    DUMP_STEP_MODE_COLOR,
+    DUMP_STEP_AUX,
+    DUMP_STEP_ADJRANGE,
+    DUMP_STEP_RXRANGE,
+    DUMP_STEP_VTX,
+    DUMP_STEP_RXFAIL,
+    DUMP_STEP_MASTER_VALUES,
+    DUMP_STEP_PID_PROFILES,
+    DUMP_STEP_RATE_PROFILES,
+    DUMP_STEP_FOOTER,
+    DUMP_STEP_SEND,             // what is left of the output
+} dumpStep_e;
+
+// A dump or diff is printed a step at a time from cliProcess(), so a long one doesn't hold up the scheduler
+typedef struct dumpState_s {
+    const char *cmdName;
+    dumpFlags_t dumpMask;
+    dumpStep_e step;
+    uint8_t profileIndex;       // of the profile being dumped with DUMP_ALL, otherwise the current one is
+    uint16_t valueIndex;        // of the next entry of valueTable to dump
+    const char *headingStr;     // not yet printed for the values being dumped
+    char headingBuf[16];
+#ifdef USE_CLI_BATCH
+    bool batchModeEnabled;
+#endif
+} dumpState_t;
+
+static dumpState_t dumpState;
+
+static bool cliDumpInProgress(void)
 {
-    dumpFlags_t dumpMask = DUMP_MASTER;
-    char *options;
-    if ((options = checkCommand(cmdline, "master"))) {
-        dumpMask = DUMP_MASTER; // only
-    } else if ((options = checkCommand(cmdline, "profile"))) {
-        dumpMask = DUMP_PROFILE; // only
-    } else if ((options = checkCommand(cmdline, "rates"))) {
-        dumpMask = DUMP_RATES; // only
-    } else if ((options = checkCommand(cmdline, "hardware"))) {
-        dumpMask = DUMP_MASTER | HARDWARE_ONLY;   // Show only hardware related settings (useful to generate unified target configs).
-    } else if ((options = checkCommand(cmdline, "all"))) {
-        dumpMask = DUMP_ALL;   // all profiles and rates
-    } else {
-        options = cmdline;
+    return dumpState.step != DUMP_STEP_IDLE;
+}
+
+static void cliDumpSetStep(dumpStep_e step)
+{
+    dumpState.step = step;
+    dumpState.profileIndex = 0;
+    dumpState.valueIndex = 0;
+}
+
+// Dump the next CLI_DUMP_VALUES_PER_STEP entries of valueTable, returning true once they are all done
+static bool cliDumpValues(uint16_t valueSection, const char *headingStr)
+{
+    if (dumpState.valueIndex == 0) {
+        dumpState.headingStr = cliPrintSectionHeading(dumpState.dumpMask, false, headingStr);
     }
 
-    if (doDiff) {
-        dumpMask = dumpMask | DO_DIFF;
+    const uint32_t end = MIN(dumpState.valueIndex + CLI_DUMP_VALUES_PER_STEP, valueTableEntryCount);
+    dumpState.headingStr = dumpValues(dumpState.cmdName, valueSection, dumpState.dumpMask, dumpState.headingStr, dumpState.valueIndex, end);
+    dumpState.valueIndex = end;
+
+    return dumpState.valueIndex >= valueTableEntryCount;
+}
+
+static void cliDumpPidProfiles(void)
+{
+    const char *cmdName = dumpState.cmdName;
+    const dumpFlags_t dumpMask = dumpState.dumpMask;
+
+    pidProfileIndexToUse = (dumpMask & DUMP_ALL) ? dumpState.profileIndex : systemConfig_Copy.pidProfileIndex;
+
+    if (dumpState.valueIndex == 0) {
+        cliPrintLinefeed();
+        cliProfile(cmdName, "");
+        tfp_sprintf(dumpState.headingBuf, "profile %d", pidProfileIndexToUse);
     }
 
-    if (checkCommand(options, "defaults")) {
-        dumpMask = dumpMask | SHOW_DEFAULTS;   // add default values as comments for changed values
-    } else if (checkCommand(options, "bare")) {
-        dumpMask = dumpMask | BARE;   // show the diff / dump without extra commands and board specific data
+    if (cliDumpValues(PROFILE_VALUE, dumpState.headingBuf)) {
+        if ((dumpMask & DUMP_ALL) && dumpState.profileIndex + 1 < PID_PROFILE_COUNT) {
+            dumpState.profileIndex++;
+            dumpState.valueIndex = 0;
+        } else {
+            if ((dumpMask & DUMP_ALL) && !(dumpMask & BARE)) {
+                pidProfileIndexToUse = systemConfig_Copy.pidProfileIndex;
+
+                cliPrintHashLine("restore original profile selection");
+
+                cliProfile(cmdName, "");
+            }
+
+            cliDumpSetStep((dumpMask & (DUMP_MASTER | DUMP_ALL)) ? DUMP_STEP_RATE_PROFILES : DUMP_STEP_FOOTER);
+        }
     }
 
-    backupAndResetConfigs();
+    pidProfileIndexToUse = CURRENT_PROFILE_INDEX;
+}
+
+static void cliDumpRateProfiles(void)
+{
+    const char *cmdName = dumpState.cmdName;
+    const dumpFlags_t dumpMask = dumpState.dumpMask;
+
+    rateProfileIndexToUse = (dumpMask & DUMP_ALL) ? dumpState.profileIndex : systemConfig_Copy.activeRateProfile;
+
+    if (dumpState.valueIndex == 0) {
+        cliPrintLinefeed();
+        cliRateProfile(cmdName, "");
+        tfp_sprintf(dumpState.headingBuf, "rateprofile %d", rateProfileIndexToUse);
+    }
+
+    if (cliDumpValues(PROFILE_RATE_VALUE, dumpState.headingBuf)) {
+        if ((dumpMask & DUMP_ALL) && dumpState.profileIndex + 1 < CONTROL_RATE_PROFILE_COUNT) {
+            dumpState.profileIndex++;
+            dumpState.valueIndex = 0;
+        } else {
+            if ((dumpMask & DUMP_ALL) && !(dumpMask & BARE)) {
+                rateProfileIndexToUse = systemConfig_Copy.activeRateProfile;
+
+                cliPrintHashLine("restore original rateprofile selection");
+
+                cliRateProfile(cmdName, "");
 
+                cliPrintHashLine("save configuration");
+                cliPrint("save");
 #ifdef USE_CLI_BATCH
-    bool batchModeEnabled = false;
+                dumpState.batchModeEnabled = false;
 #endif
-    if ((dumpMask & DUMP_MASTER) || (dumpMask & DUMP_ALL)) {
+            }
+
+            cliDumpSetStep(DUMP_STEP_FOOTER);
+        }
+    }
+
+    rateProfileIndexToUse = CURRENT_PROFILE_INDEX;
+}
+
+// Send the prompt after the rest of the output
+static void cliDumpEnd(void)
+{
+    cliPrompt();
+    cliDumpSetStep(DUMP_STEP_SEND);
+}
+
+/*
+ * Print the next step of the dump, with the configs backed up and reset to defaults for differencing. They are put
+ * back before the step returns, as the other tasks run between steps.
+ */
+static void cliDumpStep(void)
+{
+    const char *cmdName = dumpState.cmdName;
+    const dumpFlags_t dumpMask = dumpState.dumpMask;
+
+    backupAndResetConfigs();
+
+    switch (dumpState.step) {
+    case DUMP_STEP_HEADER:
         cliPrintHashLine("version");
         printVersion(false);
 
@@ -6227,7 +6414,7 @@ static void printConfig(const char *cmdName, char *cmdline, bool doDiff)
 #ifdef USE_CLI_BATCH
             cliPrintHashLine("start the command batch");
             cliPrintLine("batch start");
-            batchModeEnabled = true;
+            dumpState.batchModeEnabled = true;
 #endif
 
             if ((dumpMask & (DUMP_ALL | DO_DIFF)) == (DUMP_ALL | DO_DIFF)) {
@@ -6253,22 +6440,44 @@ static void printConfig(const char *cmdName, char *cmdline, bool doDiff)
             printCraftName(dumpMask, &pilotConfig_Copy);
         }
 
+        cliDumpSetStep(DUMP_STEP_RESOURCE);
+
+        break;
+    case DUMP_STEP_RESOURCE:
 #ifdef USE_RESOURCE_MGMT
         printResource(dumpMask, "resources");
-#if defined(USE_TIMER_MGMT)
+#endif
+
+        cliDumpSetStep(DUMP_STEP_TIMER);
+
+        break;
+    case DUMP_STEP_TIMER:
+#if defined(USE_RESOURCE_MGMT) && defined(USE_TIMER_MGMT)
         printTimer(dumpMask, "timer");
 #endif
-#ifdef USE_DMA_SPEC
+
+        cliDumpSetStep(DUMP_STEP_DMA);
+
+        break;
+    case DUMP_STEP_DMA:
+#if defined(USE_RESOURCE_MGMT) && defined(USE_DMA_SPEC)
         printDmaopt(dumpMask, "dma");
 #endif
-#endif
 
+        cliDumpSetStep(DUMP_STEP_FEATURE);
+
+        break;
+    case DUMP_STEP_FEATURE:
         printFeature(dumpMask, featureConfig_Copy.enabledFeatures, featureConfig()->enabledFeatures, "feature");
 
         printSerial(dumpMask, &serialConfig_Copy, serialConfig(), "serial");
 
-        if (!(dumpMask & HARDWARE_ONLY)) {
+        cliDumpSetStep((dumpMask & HARDWARE_ONLY) ? DUMP_STEP_MASTER_VALUES : DUMP_STEP_MIXER);
+
+        break;
+    case DUMP_STEP_MIXER:
 #ifndef USE_QUAD_MIXER_ONLY
+        {
             const char *mixerHeadingStr = "mixer";
             const bool equalsDefault = mixerConfig_Copy.mixerMode == mixerConfig()->mixerMode;
             mixerHeadingStr = cliPrintSectionHeading(dumpMask, !equalsDefault, mixerHeadingStr);
@@ -6291,103 +6500,191 @@ static void printConfig(const char *cmdName, char *cmdline, bool doDiff)
             }
             printServoMix(dumpMask, customServoMixers_CopyArray, customServoMixers(0), servoMixHeadingStr);
 #endif
+        }
 #endif
 
+        cliDumpSetStep(DUMP_STEP_BEEPER);
+
+        break;
+    case DUMP_STEP_BEEPER:
 #if defined(USE_BEEPER)
-            printBeeper(dumpMask, beeperConfig_Copy.beeper_off_flags, beeperConfig()->beeper_off_flags, "beeper", BEEPER_ALLOWED_MODES, "beeper");
+        printBeeper(dumpMask, beeperConfig_Copy.beeper_off_flags, beeperConfig()->beeper_off_flags, "beeper", BEEPER_ALLOWED_MODES, "beeper");
 
 #if defined(USE_DSHOT)
-            printBeeper(dumpMask, beeperConfig_Copy.dshotBeaconOffFlags, beeperConfig()->dshotBeaconOffFlags, "beacon", DSHOT_BEACON_ALLOWED_MODES, "beacon");
+        printBeeper(dumpMask, beeperConfig_Copy.dshotBeaconOffFlags, beeperConfig()->dshotBeaconOffFlags, "beacon", DSHOT_BEACON_ALLOWED_MODES, "beacon");
 #endif
 #endif // USE_BEEPER
 
-            printMap(dumpMask, &rxConfig_Copy, rxConfig(), "map");
+        printMap(dumpMask, &rxConfig_Copy, rxConfig(), "map");
+
+        cliDumpSetStep(DUMP_STEP_LED);
+
+        break;
+    case DUMP_STEP_LED:
+#ifdef USE_LED_STRIP_STATUS_MODE
+        printLed(dumpMask, ledStripStatusModeConfig_Copy.ledConfigs, ledStripStatusModeConfig()->ledConfigs, "led");
+#endif
+
+        cliDumpSetStep(DUMP_STEP_COLOR);
 
+        break;
+    case DUMP_STEP_COLOR:
 #ifdef USE_LED_STRIP_STATUS_MODE
-            printLed(dumpMask, ledStripStatusModeConfig_Copy.ledConfigs, ledStripStatusModeConfig()->ledConfigs, "led");
+        printColor(dumpMask, ledStripStatusModeConfig_Copy.colors, ledStripStatusModeConfig()->colors, "color");
+#endif
 
-            printColor(dumpMask, ledStripStatusModeConfig_Copy.colors, ledStripStatusModeConfig()->colors, "color");
+        cliDumpSetStep(DUMP_STEP_MODE_COLOR);
 
-            printModeColor(dumpMask, &ledStripStatusModeConfig_Copy, ledStripStatusModeConfig(), "mode_color");
+        break;
+    case DUMP_STEP_MODE_COLOR:
+#ifdef USE_LED_STRIP_STATUS_MODE
+        printModeColor(dumpMask, &ledStripStatusModeConfig_Copy, ledStripStatusModeConfig(), "mode_color");
 #endif
 
-            printAux(dumpMask, modeActivationConditions_CopyArray, modeActivationConditions(0), "aux");
+        cliDumpSetStep(DUMP_STEP_AUX);
 
-            printAdjustmentRange(dumpMask, adjustmentRanges_CopyArray, adjustmentRanges(0), "adjrange");
+        break;
+    case DUMP_STEP_AUX:
+        printAux(dumpMask, modeActivationConditions_CopyArray, modeActivationConditions(0), "aux");
 
-            printRxRange(dumpMask, rxChannelRangeConfigs_CopyArray, rxChannelRangeConfigs(0), "rxrange");
+        cliDumpSetStep(DUMP_STEP_ADJRANGE);
 
+        break;
+    case DUMP_STEP_ADJRANGE:
+        printAdjustmentRange(dumpMask, adjustmentRanges_CopyArray, adjustmentRanges(0), "adjrange");
+
+        cliDumpSetStep(DUMP_STEP_RXRANGE);
+
+        break;
+    case DUMP_STEP_RXRANGE:
+        printRxRange(dumpMask, rxChannelRangeConfigs_CopyArray, rxChannelRangeConfigs(0), "rxrange");
+
+        cliDumpSetStep(DUMP_STEP_VTX);
+
+        break;
+    case DUMP_STEP_VTX:
 #ifdef USE_VTX_TABLE
-            printVtxTable(dumpMask, &vtxTableConfig_Copy, vtxTableConfig(), "vtxtable");
+        printVtxTable(dumpMask, &vtxTableConfig_Copy, vtxTableConfig(), "vtxtable");
 #endif
 
 #ifdef USE_VTX_CONTROL
-            printVtx(dumpMask, &vtxConfig_Copy, vtxConfig(), "vtx");
+        printVtx(dumpMask, &vtxConfig_Copy, vtxConfig(), "vtx");
 #endif
 
-            printRxFailsafe(dumpMask, rxFailsafeChannelConfigs_CopyArray, rxFailsafeChannelConfigs(0), "rxfail");
-        }
+        cliDumpSetStep(DUMP_STEP_RXFAIL);
 
+        break;
+    case DUMP_STEP_RXFAIL:
+        printRxFailsafe(dumpMask, rxFailsafeChannelConfigs_CopyArray, rxFailsafeChannelConfigs(0), "rxfail");
+
+        cliDumpSetStep(DUMP_STEP_MASTER_VALUES);
+
+        break;
+    case DUMP_STEP_MASTER_VALUES:
         if (dumpMask & HARDWARE_ONLY) {
-            dumpAllValues(cmdName, HARDWARE_VALUE, dumpMask, "master");
-        } else {
-            dumpAllValues(cmdName, MASTER_VALUE, dumpMask, "master");
+            if (cliDumpValues(HARDWARE_VALUE, "master")) {
+                cliDumpSetStep(DUMP_STEP_FOOTER);
+            }
+        } else if (cliDumpValues(MASTER_VALUE, "master")) {
+            cliDumpSetStep(DUMP_STEP_PID_PROFILES);
+        }
 
-            if (dumpMask & DUMP_ALL) {
-                for (uint32_t pidProfileIndex = 0; pidProfileIndex < PID_PROFILE_COUNT; pidProfileIndex++) {
-                    cliDumpPidProfile(cmdName, pidProfileIndex, dumpMask);
-                }
+        break;
+    case DUMP_STEP_PID_PROFILES:
+        cliDumpPidProfiles();
 
-                pidProfileIndexToUse = systemConfig_Copy.pidProfileIndex;
+        break;
+    case DUMP_STEP_RATE_PROFILES:
+        cliDumpRateProfiles();
+
+        break;
+    case DUMP_STEP_FOOTER:
+#ifdef USE_CLI_BATCH
+        if (dumpState.batchModeEnabled) {
+            cliPrintHashLine("end the command batch");
+            cliPrintLine("batch end");
+        }
+#endif
 
-                if (!(dumpMask & BARE)) {
-                    cliPrintHashLine("restore original profile selection");
+        cliDumpEnd();
 
-                    cliProfile(cmdName, "");
-                }
+        break;
+    case DUMP_STEP_SEND:
 
-                pidProfileIndexToUse = CURRENT_PROFILE_INDEX;
+        break;
+    default:
+        cliDumpEnd();
 
-                for (uint32_t rateIndex = 0; rateIndex < CONTROL_RATE_PROFILE_COUNT; rateIndex++) {
-                    cliDumpRateProfile(cmdName, rateIndex, dumpMask);
-                }
+        break;
+    }
 
-                rateProfileIndexToUse = systemConfig_Copy.activeRateProfile;
+    restoreConfigs(0);
+}
 
-                if (!(dumpMask & BARE)) {
-                    cliPrintHashLine("restore original rateprofile selection");
 
-                    cliRateProfile(cmdName, "");
+/*
+ * Print the dump in steps until it is done or CLI_DUMP_SLICE_US have passed. The port is only given as much of the
+ * output as it has room for, and no step is printed until it has taken all of it, so the serial task doesn't wait for
+ * a slow port. The steps are kept small enough for their output to fit in CLI_OUT_BUFFER_SIZE, past which the writer
+ * has to wait for the port. Returns true once all the output has gone.
+ */
+static bool cliDumpContinue(void)
+{
+    const timeUs_t startTimeUs = micros();
 
-                    cliPrintHashLine("save configuration");
-                    cliPrint("save");
-#ifdef USE_CLI_BATCH
-                    batchModeEnabled = false;
-#endif
-                }
+    bool outputSent = cliWriterFlushAvailable();
+    while (outputSent && dumpState.step != DUMP_STEP_SEND && cmpTimeUs(micros(), startTimeUs) < CLI_DUMP_SLICE_US) {
+        cliDumpStep();
+        outputSent = cliWriterFlushAvailable();
+    }
 
-                rateProfileIndexToUse = CURRENT_PROFILE_INDEX;
-            } else {
-                cliDumpPidProfile(cmdName, systemConfig_Copy.pidProfileIndex, dumpMask);
+    if (outputSent && dumpState.step == DUMP_STEP_SEND) {
+        cliDumpSetStep(DUMP_STEP_IDLE);
+    }
 
-                cliDumpRateProfile(cmdName, systemConfig_Copy.activeRateProfile, dumpMask);
-            }
-        }
-    } else if (dumpMask & DUMP_PROFILE) {
-        cliDumpPidProfile(cmdName, systemConfig_Copy.pidProfileIndex, dumpMask);
-    } else if (dumpMask & DUMP_RATES) {
-        cliDumpRateProfile(cmdName, systemConfig_Copy.activeRateProfile, dumpMask);
+    return outputSent;
+}
+
+static void printConfig(const char *cmdName, char *cmdline, bool doDiff)
+{
+    dumpFlags_t dumpMask = DUMP_MASTER;
+    char *options;
+    if ((options = checkCommand(cmdline, "master"))) {
+        dumpMask = DUMP_MASTER; // only
+    } else if ((options = checkCommand(cmdline, "profile"))) {
+        dumpMask = DUMP_PROFILE; // only
+    } else if ((options = checkCommand(cmdline, "rates"))) {
+        dumpMask = DUMP_RATES; // only
+    } else if ((options = checkCommand(cmdline, "hardware"))) {
+        dumpMask = DUMP_MASTER | HARDWARE_ONLY;   // Show only hardware related settings (useful to generate unified target configs).
+    } else if ((options = checkCommand(cmdline, "all"))) {
+        dumpMask = DUMP_ALL;   // all profiles and rates
+    } else {
+        options = cmdline;
     }
 
-#ifdef USE_CLI_BATCH
-    if (batchModeEnabled) {
-        cliPrintHashLine("end the command batch");
-        cliPrintLine("batch end");
+    if (doDiff) {
+        dumpMask = dumpMask | DO_DIFF;
     }
-#endif
 
-    // restore configs from copies
-    restoreConfigs(0);
+    if (checkCommand(options, "defaults")) {
+        dumpMask = dumpMask | SHOW_DEFAULTS;   // add default values as comments for changed values
+    } else if (checkCommand(options, "bare")) {
+        dumpMask = dumpMask | BARE;   // show the diff / dump without extra commands and board specific data
+    }
+
+    memset(&dumpState, 0, sizeof(dumpState));
+    dumpState.cmdName = cmdName;
+    dumpState.dumpMask = dumpMask;
+
+    // the steps are printed by cliProcess(), which prints the prompt after the last one
+    if (dumpMask & (DUMP_MASTER | DUMP_ALL)) {
+        cliDumpSetStep(DUMP_STEP_HEADER);
+    } else if (dumpMask & DUMP_PROFILE) {
+        cliDumpSetStep(DUMP_STEP_PID_PROFILES);
+    } else if (dumpMask & DUMP_RATES) {
+        cliDumpSetStep(DUMP_STEP_RATE_PROFILES);
+    }
 }
 
 static void cliDump(const char *cmdName, char *cmdline)
@@ -6600,7 +6897,11 @@ const clicmd_t cmdTable[] = {
         "\treverse <servo> <source> r|n", cliServoMix),
 #endif
     CLI_COMMAND_DEF("status", "show status", NULL, cliStatus),
+#ifdef USE_TASK_HISTOGRAMS
+    CLI_COMMAND_DEF("tasks", "show task stats", "[hist [reset]]", cliTasks),
+#else
     CLI_COMMAND_DEF("tasks", "show task stats", NULL, cliTasks),
+#endif
 #ifdef USE_TIMER_MGMT
     CLI_COMMAND_DEF("timer", "show/set timers", "<> | <pin> list | <pin> [af<alternate function>|none|<option(deprecated)>] | list | show", cliTimer),
 #endif
@@ -6699,7 +7000,10 @@ static void processCharacter(const char c)
             return;
         }
 
-        cliPrompt();
+        // a dump prints the prompt once it is complete
+        if (!cliDumpInProgress()) {
+            cliPrompt();
+        }
     } else if (bufferIndex < sizeof(cliBuffer) && c >= 32 && c <= 126) {
         if (!bufferIndex && c == ' ')
             return; // Ignore leading spaces
@@ -6766,20 +7070,35 @@ static void processCharacterInteractive(const char c)
     }
 }
 
+// The output waits in cliWriter for the port to have room for it, and the input waits for the output to have gone
 void cliProcess(void)
 {
     if (!cliWriter) {
         return;
     }
 
-    // Flush the buffer to get rid of any MSP data polls sent by configurator after CLI was invoked
-    cliWriterFlush();
+    bool outputSent = cliWriterFlushAvailable();
 
-    while (serialRxBytesWaiting(cliPort)) {
+    while (outputSent && !cliDumpInProgress() && serialRxBytesWaiting(cliPort)) {
         uint8_t c = serialRead(cliPort);
 
         processCharacterInteractive(c);
+
+        outputSent = cliWriterFlushAvailable();
+    }
+
+    if (cliDumpInProgress()) {
+        outputSent = cliDumpContinue();
+    }
+
+    if (!outputSent && cmp32(millis(), cliOutputSentAtMs) >= CLI_WRITE_STALL_MS) {
+        // the port has gone away, the output is dropped
+        bufWriterInit(cliWriter, cliWriteBuffer, sizeof(cliWriteBuffer), cliWriteBufShim, cliPort);
+        cliDumpSetStep(DUMP_STEP_IDLE);
+        outputSent = true;
     }
+
+    rescheduleTask(TASK_SELF, TASK_PERIOD_HZ(outputSent && !cliDumpInProgress() ? serialConfig()->serial_update_rate_hz : CLI_OUTPUT_RATE_HZ));
 }
 
 void cliEnter(serialPort_t *serialPort)
@@ -6787,7 +7106,7 @@ void cliEnter(serialPort_t *serialPort)
     cliMode = true;
     cliPort = serialPort;
     setPrintfSerialPort(cliPort);
-    bufWriterInit(&cliWriterDesc, cliWriteBuffer, sizeof(cliWriteBuffer), (bufWrite_t)serialWriteBufShim, serialPort);
+    bufWriterInit(&cliWriterDesc, cliWriteBuffer, sizeof(cliWriteBuffer), cliWriteBufShim, serialPort);
     cliErrorWriter = cliWriter = &cliWriterDesc;
 
 #ifndef MINIMAL_CLI
@@ -6796,8 +7115,11 @@ void cliEnter(serialPort_t *serialPort)
     cliPrintLine("\r\nCLI");
 #endif
     setArmingDisabled(ARMING_DISABLED_CLI);
+    // the CLI works in the PG copies that a restore over MSP is staged in
+    configSnapshotRestoreAbort();
 
     cliPrompt();
+    cliOutputSentAtMs = millis();
 
 #ifdef USE_CLI_BATCH
     resetCommandBatch();
@@ -20,6 +20,8 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <strings.h>
 
 #include "platform.h"
 
@@ -1711,6 +1713,9 @@ const clivalue_t valueTable[] = {
 #ifdef USE_FLASH_SPI
     { "flash_spi_bus", VAR_UINT8 | HARDWARE_VALUE, .config.minmaxUnsigned = { 0, SPIDEV_COUNT }, PG_FLASH_CONFIG, offsetof(flashConfig_t, spiDevice) },
 #endif
+#ifdef USE_FLASHFS
+    { "flash_ring_erase_ahead", VAR_UINT8 | MASTER_VALUE, .config.minmaxUnsigned = { 0, 255 }, PG_FLASH_CONFIG, offsetof(flashConfig_t, ringEraseAheadSectors) },
+#endif
 // RCDEVICE
 #ifdef USE_RCDEVICE
     { "rcdevice_init_dev_attempts", VAR_UINT8 | MASTER_VALUE, .config.minmaxUnsigned = { 0, 10 }, PG_RCDEVICE_CONFIG, offsetof(rcdeviceConfig_t, initDeviceAttempts) },
@@ -1843,4 +1848,86 @@ const clivalue_t valueTable[] = {
 
 const uint16_t valueTableEntryCount = ARRAYLEN(valueTable);
 
+#ifdef USE_CLI_SETTING_NAME_INDEX
+// valueTable indices in case-insensitive name order, built on first lookup
+static uint16_t valueTableNameIndex[ARRAYLEN(valueTable)];
+static bool valueTableNameIndexBuilt = false;
+
+static int valueTableNameCompare(const char *name, size_t length, const char *settingName)
+{
+    const int result = strncasecmp(name, settingName, length);
+    if (result != 0) {
+        return result;
+    }
+    // a name that is a prefix of settingName sorts before it
+    return settingName[length] ? -1 : 0;
+}
+
+static bool valueTableNameIndexLess(uint16_t a, uint16_t b)
+{
+    const int result = strcasecmp(valueTable[a].name, valueTable[b].name);
+    // keep duplicates in table order so the first one is found, as with a linear search
+    return result < 0 || (result == 0 && a < b);
+}
+
+static void valueTableBuildNameIndex(void)
+{
+    for (unsigned i = 0; i < ARRAYLEN(valueTable); i++) {
+        valueTableNameIndex[i] = i;
+    }
+
+    // Shell sort, small and quick enough for a one-off sort of a few hundred names
+    for (unsigned gap = ARRAYLEN(valueTable) / 2; gap > 0; gap /= 2) {
+        for (unsigned i = gap; i < ARRAYLEN(valueTable); i++) {
+            const uint16_t index = valueTableNameIndex[i];
+            unsigned j = i;
+            for (; j >= gap && valueTableNameIndexLess(index, valueTableNameIndex[j - gap]); j -= gap) {
+                valueTableNameIndex[j] = valueTableNameIndex[j - gap];
+            }
+            valueTableNameIndex[j] = index;
+        }
+    }
+
+    valueTableNameIndexBuilt = true;
+}
+
+// Returns the valueTable index of the setting whose whole name matches the first length characters of name,
+// ignoring case, or valueTableEntryCount if there is none
+uint16_t valueTableFindByName(const char *name, size_t length)
+{
+    if (!valueTableNameIndexBuilt) {
+        valueTableBuildNameIndex();
+    }
+
+    // binary search for the first entry not less than name
+    unsigned low = 0;
+    unsigned high = ARRAYLEN(valueTable);
+    while (low < high) {
+        const unsigned mid = (low + high) / 2;
+        if (valueTableNameCompare(name, length, valueTable[valueTableNameIndex[mid]].name) > 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low < ARRAYLEN(valueTable) && valueTableNameCompare(name, length, valueTable[valueTableNameIndex[low]].name) == 0) {
+        return valueTableNameIndex[low];
+    }
+    return valueTableEntryCount;
+}
+#else
+// As above, by a linear search on targets without the RAM for the index
+uint16_t valueTableFindByName(const char *name, size_t length)
+{
+    for (unsigned i = 0; i < ARRAYLEN(valueTable); i++) {
+        const char *settingName = valueTable[i].name;
+        if (strncasecmp(name, settingName, length) == 0 && length == strlen(settingName)) {
+            return i;
+        }
+    }
+    return valueTableEntryCount;
+}
+#endif
+
 STATIC_ASSERT(LOOKUP_TABLE_COUNT == ARRAYLEN(lookupTables), LOOKUP_TABLE_COUNT_incorrect);
@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "pg/pg.h"
@@ -249,6 +250,8 @@ extern const uint16_t valueTableEntryCount;
 extern const clivalue_t valueTable[];
 //extern const uint8_t lookupTablesEntryCount;
 
+uint16_t valueTableFindByName(const char *name, size_t length);
+
 extern const char * const lookupTableGyroHardware[];
 
 extern const char * const lookupTableAccHardware[];
@@ -274,6 +274,48 @@ FAST_CODE float biquadFilterApply(biquadFilter_t *filter, float input)
     return result;
 }
 
+// Biquad cascade
+
+// sections must already be initialised, e.g. with biquadFilterInit()
+void biquadCascadeInit(biquadCascade_t *cascade, biquadFilter_t *sections, int count, biquadFilterForm_e form)
+{
+    cascade->sections = sections;
+    cascade->count = count;
+    cascade->form = form;
+}
+
+/* Computes all sections of a biquadCascade_t on a sample, same results as biquadFilterApplyDF1() or biquadFilterApply() on each section in turn */
+FAST_CODE float biquadCascadeApply(biquadCascade_t *cascade, float input)
+{
+    biquadFilter_t *section = cascade->sections;
+    const biquadFilter_t *end = section + cascade->count;
+
+    if (cascade->form == BIQUAD_FORM_DF1) {
+        for (; section < end; section++) {
+            const float result = section->b0 * input + section->b1 * section->x1 + section->b2 * section->x2 - section->a1 * section->y1 - section->a2 * section->y2;
+
+            section->x2 = section->x1;
+            section->x1 = input;
+
+            section->y2 = section->y1;
+            section->y1 = result;
+
+            input = result;
+        }
+    } else {
+        for (; section < end; section++) {
+            const float result = section->b0 * input + section->x1;
+
+            section->x1 = section->b1 * input - section->a1 * result + section->x2;
+            section->x2 = section->b2 * input - section->a2 * result;
+
+            input = result;
+        }
+    }
+
+    return input;
+}
+
 
 // Phase Compensator (Lead-Lag-Compensator)
 
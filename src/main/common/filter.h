@@ -65,6 +65,18 @@ typedef struct biquadFilter_s {
     float weight;
 } biquadFilter_t;
 
+typedef enum {
+    BIQUAD_FORM_DF1 = 0,    // direct form 1, copes with coefficients changing between samples
+    BIQUAD_FORM_DF2T,       // transposed direct form 2, higher precision with fixed coefficients
+} biquadFilterForm_e;
+
+/* a chain of biquad sections applied one after the other, sections are kept in an array owned by the caller */
+typedef struct biquadCascade_s {
+    biquadFilter_t *sections;
+    uint8_t count;
+    uint8_t form;
+} biquadCascade_t;
+
 typedef struct phaseComp_s {
     float b0, b1, a1;
     float x1, y1;
@@ -125,6 +137,9 @@ float biquadFilterApplyDF1(biquadFilter_t *filter, float input);
 float biquadFilterApplyDF1Weighted(biquadFilter_t *filter, float input);
 float biquadFilterApply(biquadFilter_t *filter, float input);
 
+void biquadCascadeInit(biquadCascade_t *cascade, biquadFilter_t *sections, int count, biquadFilterForm_e form);
+float biquadCascadeApply(biquadCascade_t *cascade, float input);
+
 void phaseCompInit(phaseComp_t *filter, const float centerFreq, const float centerPhase, const uint32_t looptimeUs);
 void phaseCompUpdate(phaseComp_t *filter, const float centerFreq, const float centerPhase, const uint32_t looptimeUs);
 float phaseCompApply(phaseComp_t *filter, const float input);
@@ -22,6 +22,8 @@
 
 #ifdef USE_HUFFMAN
 
+#include "common/maths.h"
+
 #include "huffman.h"
 
 
@@ -101,4 +103,167 @@ int huffmanEncodeBufStreaming(huffmanState_t *state, const uint8_t *inBuf, int i
     return 0;
 }
 
+// Shell sort symbols by ascending (count, symbol), which is the order the code length calculation expects
+static void huffmanAdaptiveSortSymbols(huffmanAdaptive_t *model)
+{
+    for (int i = 0; i < HUFFMAN_ADAPTIVE_SYMBOL_COUNT; i++) {
+        model->order[i] = i;
+    }
+
+    for (int gap = HUFFMAN_ADAPTIVE_SYMBOL_COUNT / 2; gap > 0; gap /= 2) {
+        for (int i = gap; i < HUFFMAN_ADAPTIVE_SYMBOL_COUNT; i++) {
+            const uint8_t symbol = model->order[i];
+            const uint32_t key = ((uint32_t)model->counts[symbol] << 8) | symbol;
+            int j = i;
+            while (j >= gap && (((uint32_t)model->counts[model->order[j - gap]] << 8) | model->order[j - gap]) > key) {
+                model->order[j] = model->order[j - gap];
+                j -= gap;
+            }
+            model->order[j] = symbol;
+        }
+    }
+}
+
+// In-place minimum redundancy code lengths (Moffat and Katajainen) of ascending weights.
+// On return weights[i] holds the code length of the i-th weight, the longest code is weights[0].
+static void huffmanCodeLengths(uint16_t *weights, const int count)
+{
+    int root = 0;
+    int leaf = 2;
+
+    // first pass, left to right, setting parent pointers
+    weights[0] += weights[1];
+    for (int next = 1; next < count - 1; next++) {
+        // select first item for a pairing
+        if (leaf >= count || weights[root] < weights[leaf]) {
+            weights[next] = weights[root];
+            weights[root++] = next;
+        } else {
+            weights[next] = weights[leaf++];
+        }
+        // add on the second item
+        if (leaf >= count || (root < next && weights[root] < weights[leaf])) {
+            weights[next] += weights[root];
+            weights[root++] = next;
+        } else {
+            weights[next] += weights[leaf++];
+        }
+    }
+
+    // second pass, right to left, setting internal depths
+    weights[count - 2] = 0;
+    for (int next = count - 3; next >= 0; next--) {
+        weights[next] = weights[weights[next]] + 1;
+    }
+
+    // third pass, right to left, setting leaf depths
+    int available = 1;
+    int used = 0;
+    int depth = 0;
+    int next = count - 1;
+    root = count - 2;
+    while (available > 0) {
+        while (root >= 0 && weights[root] == depth) {
+            used++;
+            root--;
+        }
+        while (available > used) {
+            weights[next--] = depth;
+            available--;
+        }
+        available = 2 * used;
+        depth++;
+        used = 0;
+    }
+}
+
+static void huffmanAdaptiveBuild(huffmanAdaptive_t *model)
+{
+    huffmanAdaptiveSortSymbols(model);
+
+    // Flatten the distribution until the longest code fits. Scaling keeps the sort order valid.
+    for (int shift = 0; ; shift++) {
+        for (int i = 0; i < HUFFMAN_ADAPTIVE_SYMBOL_COUNT; i++) {
+            const uint16_t weight = model->counts[model->order[i]] >> shift;
+            model->weights[i] = weight ? weight : 1;
+        }
+        huffmanCodeLengths(model->weights, HUFFMAN_ADAPTIVE_SYMBOL_COUNT);
+        if (model->weights[0] <= HUFFMAN_ADAPTIVE_CODE_LEN_MAX) {
+            break;
+        }
+    }
+
+    uint8_t lengthCount[HUFFMAN_ADAPTIVE_CODE_LEN_MAX + 1] = { 0 };
+    for (int i = 0; i < HUFFMAN_ADAPTIVE_SYMBOL_COUNT; i++) {
+        model->table[model->order[i]].codeLen = model->weights[i];
+        lengthCount[model->weights[i]]++;
+    }
+
+    // canonical code, first code of each length
+    uint16_t nextCode[HUFFMAN_ADAPTIVE_CODE_LEN_MAX + 1];
+    uint16_t code = 0;
+    nextCode[0] = 0;
+    for (int len = 1; len <= HUFFMAN_ADAPTIVE_CODE_LEN_MAX; len++) {
+        code = (code + lengthCount[len - 1]) << 1;
+        nextCode[len] = code;
+    }
+
+    for (int symbol = 0; symbol < HUFFMAN_ADAPTIVE_SYMBOL_COUNT; symbol++) {
+        const int len = model->table[symbol].codeLen;
+        // codes are stored left aligned in 12 bits, as in huffmanTable
+        model->table[symbol].code = nextCode[len]++ << (HUFFMAN_ADAPTIVE_CODE_LEN_MAX - len);
+    }
+}
+
+void huffmanAdaptiveInit(huffmanAdaptive_t *model, const huffmanTable_t *seedTable)
+{
+    model->countTotal = 0;
+    model->blockBytes = 0;
+    for (int symbol = 0; symbol < HUFFMAN_ADAPTIVE_SYMBOL_COUNT; symbol++) {
+        // a code of length n stands for a probability of 2^-n
+        const int seedLen = seedTable[symbol].codeLen;
+        const int len = MIN(seedLen, HUFFMAN_ADAPTIVE_CODE_LEN_MAX);
+        model->counts[symbol] = 1 << (HUFFMAN_ADAPTIVE_CODE_LEN_MAX - len);
+        model->countTotal += model->counts[symbol];
+    }
+    huffmanAdaptiveBuild(model);
+}
+
+// Account for coded bytes, the code is rebuilt after each HUFFMAN_ADAPTIVE_BLOCK_SIZE bytes
+void huffmanAdaptiveUpdate(huffmanAdaptive_t *model, const uint8_t *inBuf, int inLen)
+{
+    for (int ii = 0; ii < inLen; ++ii) {
+        model->counts[inBuf[ii]] += HUFFMAN_ADAPTIVE_INCREMENT;
+        model->countTotal += HUFFMAN_ADAPTIVE_INCREMENT;
+        if (model->countTotal >= HUFFMAN_ADAPTIVE_COUNT_LIMIT) {
+            model->countTotal = 0;
+            for (int symbol = 0; symbol < HUFFMAN_ADAPTIVE_SYMBOL_COUNT; symbol++) {
+                model->counts[symbol] = (model->counts[symbol] + 1) / 2;
+                model->countTotal += model->counts[symbol];
+            }
+        }
+
+        if (++model->blockBytes == HUFFMAN_ADAPTIVE_BLOCK_SIZE) {
+            model->blockBytes = 0;
+            huffmanAdaptiveBuild(model);
+        }
+    }
+}
+
+// Same as huffmanEncodeBufStreaming(), switching to the rebuilt code at each block boundary
+int huffmanAdaptiveEncodeBufStreaming(huffmanState_t *state, huffmanAdaptive_t *model, const uint8_t *inBuf, int inLen)
+{
+    while (inLen > 0) {
+        const int segmentLen = MIN(inLen, HUFFMAN_ADAPTIVE_BLOCK_SIZE - model->blockBytes);
+        if (huffmanEncodeBufStreaming(state, inBuf, segmentLen, model->table) == -1) {
+            return -1;
+        }
+        huffmanAdaptiveUpdate(model, inBuf, segmentLen);
+        inBuf += segmentLen;
+        inLen -= segmentLen;
+    }
+
+    return 0;
+}
+
 #endif
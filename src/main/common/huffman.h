@@ -43,5 +43,29 @@ struct huffmanInfo_s {
 
 #define HUFFMAN_INFO_SIZE sizeof(struct huffmanInfo_s)
 
+// Block adaptive canonical Huffman code.
+// The encoder and decoder start from the same model, seeded from the code lengths of a static table,
+// and rebuild the code from the symbol counts seen so far after every HUFFMAN_ADAPTIVE_BLOCK_SIZE bytes.
+// Within a code length, codes are assigned in symbol order (canonical code) so that a decoder only
+// needs to replicate the code lengths.
+#define HUFFMAN_ADAPTIVE_SYMBOL_COUNT   256
+#define HUFFMAN_ADAPTIVE_CODE_LEN_MAX   12      // limited by huffmanTable_t.code
+#define HUFFMAN_ADAPTIVE_BLOCK_SIZE     1024
+#define HUFFMAN_ADAPTIVE_INCREMENT      4       // weight of an observed byte relative to the seed counts
+#define HUFFMAN_ADAPTIVE_COUNT_LIMIT    32768   // counts are halved when their total reaches this
+
+typedef struct huffmanAdaptive_s {
+    huffmanTable_t table[HUFFMAN_ADAPTIVE_SYMBOL_COUNT];
+    uint16_t    counts[HUFFMAN_ADAPTIVE_SYMBOL_COUNT];
+    uint32_t    countTotal;
+    uint16_t    blockBytes;
+    // scratch space for rebuilding the code
+    uint16_t    weights[HUFFMAN_ADAPTIVE_SYMBOL_COUNT];
+    uint8_t     order[HUFFMAN_ADAPTIVE_SYMBOL_COUNT];
+} huffmanAdaptive_t;
+
 int huffmanEncodeBuf(uint8_t *outBuf, int outBufLen, const uint8_t *inBuf, int inLen, const huffmanTable_t *huffmanTable);
 int huffmanEncodeBufStreaming(huffmanState_t *state, const uint8_t *inBuf, int inLen, const huffmanTable_t *huffmanTable);
+void huffmanAdaptiveInit(huffmanAdaptive_t *model, const huffmanTable_t *seedTable);
+void huffmanAdaptiveUpdate(huffmanAdaptive_t *model, const uint8_t *inBuf, int inLen);
+int huffmanAdaptiveEncodeBufStreaming(huffmanState_t *state, huffmanAdaptive_t *model, const uint8_t *inBuf, int inLen);
@@ -18,6 +18,7 @@
  * If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <complex.h>
 #include <math.h>
 #include <stdbool.h>
 
@@ -32,7 +33,9 @@ static FAST_DATA_ZERO_INIT float     rPowerN;  // SDFT_R to the power of SDFT_SA
 static FAST_DATA_ZERO_INIT bool      isInitialized;
 static FAST_DATA_ZERO_INIT complex_t twiddle[SDFT_BIN_COUNT];
 
+static int sdftMidBin(const sdft_t *sdft);
 static void applySqrt(const sdft_t *sdft, float *data);
+static void peakHeapPush(sdftPeak_t *heap, const int count, const int bin, const float value);
 static void updateEdges(sdft_t *sdft, const float value, const int batchIdx);
 
 
@@ -165,6 +168,126 @@ FAST_CODE void sdftWinSq(const sdft_t *sdft, float *output)
 }
 
 
+// Same as sdftWinSq(), but also selects the peakCount highest local maxima strictly inside the
+// active range in the same pass, so the spectrum never has to be walked a second time.
+// peaks[] is returned in ascending bin order, unused entries (bin 0) are left at the end.
+// Equal peaks are resolved in favour of the lower bin. Returns the sum of output[] over the active range.
+FAST_CODE float sdftWinSqPeaks(const sdft_t *sdft, float *output, sdftPeak_t *peaks, const int peakCount)
+{
+    return sdftWinSqPeaksHigh(sdft, output, peaks, peakCount, sdftWinSqPeaksLow(sdft, output, peaks, peakCount));
+}
+
+
+// First part of sdftWinSqPeaks(), which windows the lower half of the active range and searches it for peaks.
+// Returns the sum of output[] over that half, which is to be passed to sdftWinSqPeaksHigh().
+FAST_CODE float sdftWinSqPeaksLow(const sdft_t *sdft, float *output, sdftPeak_t *peaks, const int peakCount)
+{
+    complex_t val;
+    float re;
+    float im;
+    float sum;
+
+    // peaks[] is kept as a min-heap while scanning, with the weakest peak at its root
+    for (int p = 0; p < peakCount; p++) {
+        peaks[p].bin = 0;
+        peaks[p].value = 0.0f;
+    }
+
+    // Apply window at the lower edge of active range
+    if (sdft->startBin == 0) {
+        val = sdft->data[sdft->startBin] - sdft->data[sdft->startBin + 1];
+    } else {
+        val = sdft->data[sdft->startBin] - 0.5f * (sdft->data[sdft->startBin - 1] + sdft->data[sdft->startBin + 1]);
+    }
+    re = crealf(val);
+    im = cimagf(val);
+    output[sdft->startBin] = re * re + im * im;
+    sum = output[sdft->startBin];
+
+    // Bin i - 1 is a peak once it turns out to be above both neighbours. The lower edge can't be a peak.
+    float prev = output[sdft->startBin];
+    bool rising = false;
+    for (int i = (sdft->startBin + 1); i < sdftMidBin(sdft); i++) {
+        val = sdft->data[i] - 0.5f * (sdft->data[i - 1] + sdft->data[i + 1]);
+        re = crealf(val);
+        im = cimagf(val);
+        const float power = re * re + im * im;
+        output[i] = power;
+        sum += power;
+
+        if (rising && prev > power) {
+            peakHeapPush(peaks, peakCount, i - 1, prev);
+        }
+        rising = power > prev;
+        prev = power;
+    }
+
+    return sum;
+}
+
+
+// Second part of sdftWinSqPeaks(), which windows the upper half of the active range, searches it for peaks
+// and sorts them. lowSum is what sdftWinSqPeaksLow() returned.
+FAST_CODE float sdftWinSqPeaksHigh(const sdft_t *sdft, float *output, sdftPeak_t *peaks, const int peakCount, const float lowSum)
+{
+    complex_t val;
+    float re;
+    float im;
+    float sum = lowSum;
+
+    // Carry on from where sdftWinSqPeaksLow() stopped
+    const int midBin = sdftMidBin(sdft);
+    float prev = output[MAX(midBin - 1, sdft->startBin)];
+    bool rising = midBin - 1 > sdft->startBin && output[midBin - 1] > output[midBin - 2];
+    for (int i = midBin; i < sdft->endBin; i++) {
+        val = sdft->data[i] - 0.5f * (sdft->data[i - 1] + sdft->data[i + 1]);
+        re = crealf(val);
+        im = cimagf(val);
+        const float power = re * re + im * im;
+        output[i] = power;
+        sum += power;
+
+        if (rising && prev > power) {
+            peakHeapPush(peaks, peakCount, i - 1, prev);
+        }
+        rising = power > prev;
+        prev = power;
+    }
+
+    // Apply window at the upper edge of active range
+    if (sdft->endBin == SDFT_BIN_COUNT - 1) {
+        val = sdft->data[sdft->endBin] - sdft->data[sdft->endBin - 1];
+    } else {
+        val = sdft->data[sdft->endBin] - 0.5f * (sdft->data[sdft->endBin - 1] + sdft->data[sdft->endBin + 1]);
+    }
+    re = crealf(val);
+    im = cimagf(val);
+    output[sdft->endBin] = re * re + im * im;
+
+    if (sdft->endBin == sdft->startBin) {
+        sum = output[sdft->endBin];
+    } else {
+        sum += output[sdft->endBin];
+        if (rising && prev > output[sdft->endBin]) {
+            peakHeapPush(peaks, peakCount, sdft->endBin - 1, prev);
+        }
+    }
+
+    // Sort selected peaks in ascending bin order with void peaks last (example: 3, 8, 25, 0, 0, ..., 0)
+    for (int p = 1; p < peakCount; p++) {
+        const sdftPeak_t peak = peaks[p];
+        int k = p;
+        while (k > 0 && peak.bin != 0 && (peaks[k - 1].bin == 0 || peaks[k - 1].bin > peak.bin)) {
+            peaks[k] = peaks[k - 1];
+            k--;
+        }
+        peaks[k] = peak;
+    }
+
+    return sum;
+}
+
+
 // Get magnitude of frequency spectrum with Hann window applied (slower)
 FAST_CODE void sdftWindow(const sdft_t *sdft, float *output)
 {
@@ -173,6 +296,13 @@ FAST_CODE void sdftWindow(const sdft_t *sdft, float *output)
 }
 
 
+// First bin of the upper half of the active range, which sdftWinSqPeaksHigh() starts at
+static FAST_CODE int sdftMidBin(const sdft_t *sdft)
+{
+    return sdft->startBin + (sdft->endBin - sdft->startBin + 1) / 2;
+}
+
+
 // Apply square root to the whole sdft range
 static FAST_CODE void applySqrt(const sdft_t *sdft, float *data)
 {
@@ -182,6 +312,37 @@ static FAST_CODE void applySqrt(const sdft_t *sdft, float *data)
 }
 
 
+// Offer a peak to the min-heap of the count biggest peaks found so far.
+// Bins arrive in ascending order, so a later peak only displaces the root if it is strictly bigger.
+static FAST_CODE void peakHeapPush(sdftPeak_t *heap, const int count, const int bin, const float value)
+{
+    if (count <= 0 || value <= heap[0].value) {
+        return;
+    }
+
+    // Replace the weakest peak and sift it down. Among equal values the higher bin is the weaker one.
+    int parent = 0;
+    for (;;) {
+        int child = 2 * parent + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count &&
+            (heap[child + 1].value < heap[child].value ||
+            (heap[child + 1].value == heap[child].value && heap[child + 1].bin > heap[child].bin))) {
+            child++;
+        }
+        if (value < heap[child].value || (value == heap[child].value && bin > heap[child].bin)) {
+            break;
+        }
+        heap[parent] = heap[child];
+        parent = child;
+    }
+    heap[parent].bin = bin;
+    heap[parent].value = value;
+}
+
+
 // Needed for proper windowing at the edges of active range
 static FAST_CODE void updateEdges(sdft_t *sdft, const float value, const int batchIdx)
 {
@@ -23,12 +23,12 @@
 
 #pragma once
 
-#include <complex.h>
-#undef I  // avoid collision of imaginary unit I with variable I in pid.h
-typedef float complex complex_t; // Better readability for type "float complex"
-
 #include "common/utils.h"
 
+// The C99 keyword rather than the "complex" of <complex.h>, which would also bring its imaginary unit I to every
+// includer (colliding with variable I in pid.h) and is no C header at all to a C++ includer
+typedef float _Complex complex_t;
+
 #define SDFT_SAMPLE_SIZE 72
 #define SDFT_BIN_COUNT   (SDFT_SAMPLE_SIZE / 2)
 
@@ -42,6 +42,11 @@ typedef struct sdft_s {
     complex_t data[SDFT_BIN_COUNT];    // complex frequency spectrum
 } sdft_t;
 
+typedef struct sdftPeak_s {
+    int bin;                           // 0 marks an unused entry
+    float value;
+} sdftPeak_t;
+
 STATIC_ASSERT(SDFT_SAMPLE_SIZE % 2 == 0, sdft_sample_size_not_even);
 STATIC_ASSERT(SDFT_BIN_COUNT >= 2, sdft_bin_count_too_small);
 
@@ -52,3 +57,6 @@ void sdftMagSq(const sdft_t *sdft, float *output);
 void sdftMagnitude(const sdft_t *sdft, float *output);
 void sdftWinSq(const sdft_t *sdft, float *output);
 void sdftWindow(const sdft_t *sdft, float *output);
+float sdftWinSqPeaks(const sdft_t *sdft, float *output, sdftPeak_t *peaks, const int peakCount);
+float sdftWinSqPeaksLow(const sdft_t *sdft, float *output, sdftPeak_t *peaks, const int peakCount);
+float sdftWinSqPeaksHigh(const sdft_t *sdft, float *output, sdftPeak_t *peaks, const int peakCount, const float lowSum);
@@ -99,6 +99,8 @@ static bool configIsDirty; /* someone indicated that the config is modified and
 static bool rebootRequired = false;  // set if a config change requires a reboot to take effect
 
 static bool eepromWriteInProgress = false;
+static bool eepromWriteRewrite = false;    // the whole config is to be rewritten, which blocks, so it waits for the disarm
+static eepromWriteCallbackFn *eepromWriteCallback;
 
 pidProfile_t *currentPidProfile;
 
@@ -684,18 +686,94 @@ void validateAndFixBlackBox(void) {
 }
 #endif // USE_BLACKBOX
 
-bool readEEPROM(void)
+static void completeEepromWrite(void)
 {
-    suspendRxSignal();
+    eepromWriteInProgress = false;
+    eepromWriteRewrite = false;
+    unsetArmingDisabled(ARMING_DISABLED_EEPROM_WRITE);
 
-    // Sanity check, read flash
-    bool success = loadEEPROM();
+    // writeConfigToEEPROM() doesn't return from a failed write, the background save leaves a torn journal
+    const bool success = isEEPROMVersionValid() && isEEPROMStructureValid();
+
+    eepromWriteCallbackFn *callback = eepromWriteCallback;
+    eepromWriteCallback = NULL;
+    if (callback) {
+        callback(success);
+    }
+}
+
+// Program the next part of a save started by writeEEPROMInBackground()
+void eepromWriteUpdate(timeUs_t currentTimeUs)
+{
+    UNUSED(currentTimeUs);
+
+    if (!eepromWriteRewrite) {
+        const configWriteStatus_e status = writeConfigToEEPROMContinue();
+        if (status == CONFIG_WRITE_IN_PROGRESS) {
+            return;
+        }
+        // The next save rewrites everything, make it as soon as possible so the config is not lost
+        eepromWriteRewrite = (status == CONFIG_WRITE_FAILED);
+    }
+
+    if (eepromWriteRewrite) {
+        if (ARMING_FLAG(ARMED)) {
+            return;
+        }
+        schedulerIgnoreTaskExecTime();
+        writeConfigToEEPROM();
+    }
 
+    setTaskEnabled(TASK_EEPROM_WRITE, false);
+
+    completeEepromWrite();
+}
+
+// Block until a save running in the background is stored
+void finishEepromWrite(void)
+{
+    if (!eepromWriteInProgress) {
+        return;
+    }
+
+    if (!eepromWriteRewrite) {
+        configWriteStatus_e status;
+        do {
+            status = writeConfigToEEPROMContinue();
+        } while (status == CONFIG_WRITE_IN_PROGRESS);
+
+        eepromWriteRewrite = (status == CONFIG_WRITE_FAILED);
+    }
+
+    setTaskEnabled(TASK_EEPROM_WRITE, false);
+
+    if (eepromWriteRewrite) {
+        writeConfigToEEPROM();
+    }
+
+    completeEepromWrite();
+}
+
+// Apply the config in memory, as readEEPROM() does after loading it
+void applyConfig(void)
+{
     featureInit();
 
     validateAndFixConfig();
 
     activateConfig();
+}
+
+bool readEEPROM(void)
+{
+    finishEepromWrite();
+
+    suspendRxSignal();
+
+    // Sanity check, read flash
+    bool success = loadEEPROM();
+
+    applyConfig();
 
     resumeRxSignal();
 
@@ -704,6 +782,8 @@ bool readEEPROM(void)
 
 void writeUnmodifiedConfigToEEPROM(void)
 {
+    finishEepromWrite();
+
     validateAndFixConfig();
 
     suspendRxSignal();
@@ -724,6 +804,44 @@ void writeEEPROM(void)
     writeUnmodifiedConfigToEEPROM();
 }
 
+/*
+ * Save the config like writeEEPROM(), but without holding up the scheduler while it is programmed. The changes are
+ * copied when the save starts, and callback (if any) is called once they are stored. Saves which can't be made in
+ * the background are made immediately, or once disarmed. Arming is disabled until the save is stored.
+ */
+void writeEEPROMInBackground(eepromWriteCallbackFn *callback)
+{
+    finishEepromWrite();
+
+#ifdef USE_RX_SPI
+    rxSpiStop(); // some rx spi protocols use hardware timer, which needs to be stopped before writing to eeprom
+#endif
+    systemConfigMutable()->configurationState = CONFIGURATION_STATE_CONFIGURED;
+
+    validateAndFixConfig();
+
+    const bool background = writeConfigToEEPROMBegin();
+    if (!background && !ARMING_FLAG(ARMED)) {
+        // The write to EEPROM will cause a big delay in the current task, so ignore
+        schedulerIgnoreTaskExecTime();
+
+        writeEEPROM();
+        if (callback) {
+            callback(isEEPROMVersionValid() && isEEPROMStructureValid());
+        }
+        return;
+    }
+
+    // Until the save is stored, so the FC doesn't arm with half of it or block on the rewrite in flight
+    setArmingDisabled(ARMING_DISABLED_EEPROM_WRITE);
+
+    eepromWriteInProgress = true;
+    eepromWriteRewrite = !background;
+    eepromWriteCallback = callback;
+    setTaskEnabled(TASK_EEPROM_WRITE, true);
+    configIsDirty = false;
+}
+
 bool resetEEPROM(void)
 {
     resetConfig();
@@ -23,6 +23,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "common/time.h"
+
 #include "pg/pg.h"
 
 #define MAX_NAME_LENGTH 16u
@@ -61,8 +63,13 @@ extern struct pidProfile_s *currentPidProfile;
 void initEEPROM(void);
 bool resetEEPROM(void);
 bool readEEPROM(void);
+void applyConfig(void);
 void writeEEPROM(void);
 void writeUnmodifiedConfigToEEPROM(void);
+typedef void eepromWriteCallbackFn(bool success);
+void writeEEPROMInBackground(eepromWriteCallbackFn *callback);
+void eepromWriteUpdate(timeUs_t currentTimeUs);
+void finishEepromWrite(void);
 void ensureEEPROMStructureIsValid(void);
 
 void saveConfigAndNotify(void);
@@ -27,6 +27,7 @@
 #include "build/build_config.h"
 
 #include "common/crc.h"
+#include "common/maths.h"
 #include "common/utils.h"
 
 #include "config/config_eeprom.h"
@@ -43,6 +44,15 @@
 
 static uint16_t eepromConfigSize;
 
+/*
+ * Saves only append the PGs that changed to a journal following the snapshot of all PGs, the snapshot is only
+ * rewritten (compacting the journal) when the journal is full or the stored config is unusable.
+ */
+static uint16_t journalStart;           // offset of the first journal entry, just past the snapshot (the journal ends within 64K)
+static uint16_t journalCrc;             // CRC of the last journal entry, or the snapshot's stored CRC
+static bool journalCompactionRequired;  // some PG could not be restored from the journal, rewrite them all
+static bool journalEndIsBlank;          // nothing has been programmed after the last entry
+
 typedef enum {
     CR_CLASSICATION_SYSTEM   = 0,
     CR_CLASSICATION_PROFILE_LAST = CR_CLASSICATION_SYSTEM,
@@ -77,6 +87,13 @@ typedef struct {
 } PG_PACKED configFooter_t;
 // checksum is appended just after footer. It is not included in footer to make checksum calculation consistent
 
+/*
+ * Journal entries are a configRecord_t followed by the CRC of the record, seeded with the CRC of the entry before
+ * it. Chaining the CRCs stops the scan at data left behind by an older journal as well as at erased storage.
+ * Entries are padded to the streamer's write size so each one can be programmed without touching the last.
+ */
+#define JOURNAL_ENTRY_ALIGNMENT CONFIG_STREAMER_BUFFER_SIZE
+
 // Used to check the compiler packing at build time.
 typedef struct {
     uint8_t byte;
@@ -318,6 +335,39 @@ void initEEPROM(void)
 #endif
 }
 
+static uint32_t journalEntryAlign(uint32_t offset)
+{
+    return (offset + JOURNAL_ENTRY_ALIGNMENT - 1) & ~(JOURNAL_ENTRY_ALIGNMENT - 1);
+}
+
+static uint32_t journalEntrySize(uint32_t pgSize)
+{
+    return journalEntryAlign(sizeof(configRecord_t) + pgSize + sizeof(uint16_t));
+}
+
+// Returns the size of the journal entry at p, or zero at the end of the journal. crc is chained on to the entry.
+static uint32_t journalEntryCheck(const uint8_t *p, uint16_t *crc)
+{
+    const configRecord_t *record = (const configRecord_t *)p;
+
+    if (p + sizeof(*record) > &__config_end
+        || record->size < sizeof(*record)
+        || p + journalEntrySize(record->size - sizeof(*record)) > &__config_end) {
+        return 0;
+    }
+
+    uint16_t storedCrc;
+    memcpy(&storedCrc, p + record->size, sizeof(storedCrc));
+
+    const uint16_t entryCrc = crc16_ccitt_update(*crc, record, record->size);
+    if (storedCrc != entryCrc) {
+        return 0;
+    }
+
+    *crc = entryCrc;
+    return journalEntrySize(record->size - sizeof(*record));
+}
+
 bool isEEPROMVersionValid(void)
 {
     const uint8_t *p = &__config_start;
@@ -369,12 +419,31 @@ bool isEEPROMStructureValid(void)
     // include stored CRC in the CRC calculation
     const uint16_t *storedCrc = (const uint16_t *)p;
     crc = crc16_ccitt_update(crc, storedCrc, sizeof(*storedCrc));
-    p += sizeof(storedCrc);
+    p += sizeof(*storedCrc);
 
     eepromConfigSize = p - &__config_start;
 
     // CRC has the property that if the CRC itself is included in the calculation the resulting CRC will have constant value
-    return crc == CRC_CHECK_VALUE;
+    if (crc != CRC_CHECK_VALUE) {
+        return false;
+    }
+
+    // The journal continues from the snapshot, up to the first entry that isn't valid
+    journalStart = journalEntryAlign(eepromConfigSize);
+    journalCrc = *storedCrc;
+
+    p = &__config_start + journalStart;
+    for (uint32_t entrySize; (entrySize = journalEntryCheck(p, &journalCrc)) != 0; p += entrySize);
+
+    eepromConfigSize = MAX(eepromConfigSize, p - &__config_start);
+
+    // Anything but erased storage after the last entry is a torn write, which can't be programmed over
+    journalEndIsBlank = p + sizeof(configRecord_t) <= &__config_end;
+    for (const uint8_t *blank = p; journalEndIsBlank && blank < p + sizeof(configRecord_t); blank++) {
+        journalEndIsBlank = *blank == 0xFF;
+    }
+
+    return true;
 }
 
 uint16_t getEEPROMConfigSize(void)
@@ -420,7 +489,8 @@ static const configRecord_t *findEEPROM(const pgRegistry_t *reg, configRecordFla
 
 // Initialize all PG records from EEPROM.
 // This functions processes all PGs sequentially, scanning EEPROM for each one. This is suboptimal,
-//   but each PG is loaded/initialized exactly once and in defined order.
+//   but each PG is initialized exactly once and in defined order. PGs saved to the journal since are then
+//   loaded again from their latest entry.
 bool loadEEPROM(void)
 {
     bool success = true;
@@ -440,26 +510,107 @@ bool loadEEPROM(void)
         *reg->fnv_hash = fnv_update(FNV_OFFSET_BASIS, reg->address, pgSize(reg));
     }
 
+    // Replay the changes saved since the snapshot (checked by isEEPROMStructureValid), the last entry for a PG wins
+    for (const uint8_t *p = &__config_start + journalStart; journalStart && p < &__config_start + eepromConfigSize; ) {
+        const configRecord_t *record = (const configRecord_t *)p;
+        const pgRegistry_t *reg = pgFind(record->pgn);
+
+        if (reg && (record->flags & CR_CLASSIFICATION_MASK) == CR_CLASSICATION_SYSTEM) {
+            if (!pgLoad(reg, record->pg, record->size - offsetof(configRecord_t, pg), record->version)) {
+                success = false;
+            }
+            *reg->fnv_hash = fnv_update(FNV_OFFSET_BASIS, reg->address, pgSize(reg));
+        }
+
+        p += journalEntrySize(record->size - sizeof(*record));
+    }
+
+    // PGs which had to be reset are only written out by a full save
+    journalCompactionRequired = !success;
+
     return success;
 }
 
+static bool isPGDirty(const pgRegistry_t *reg)
+{
+    return *reg->fnv_hash != fnv_update(FNV_OFFSET_BASIS, reg->address, pgSize(reg));
+}
+
+// Size of the entries a save would append to the journal
+static uint32_t journalAppendSize(void)
+{
+    uint32_t size = 0;
+    PG_FOREACH(reg) {
+        if (isPGDirty(reg)) {
+            size += journalEntrySize(pgSize(reg));
+        }
+    }
+    return size;
+}
+
+static bool journalHasSpaceFor(uint32_t size)
+{
+    return eepromConfigSize + size <= MIN((uint32_t)(&__config_end - &__config_start), (uint32_t)UINT16_MAX);
+}
+
+// Append an entry for each PG that changed since it was loaded to the end of the journal
+static bool writeSettingsToJournal(void)
+{
+    config_streamer_t streamer;
+    config_streamer_init(&streamer);
+
+    config_streamer_start(&streamer, (uintptr_t)&__config_start + eepromConfigSize, &__config_end - &__config_start - eepromConfigSize);
+
+    uint16_t crc = journalCrc;
+    PG_FOREACH(reg) {
+        if (!isPGDirty(reg)) {
+            continue;
+        }
+
+        const uint16_t regSize = pgSize(reg);
+        configRecord_t record = {
+            .size = sizeof(configRecord_t) + regSize,
+            .pgn = pgN(reg),
+            .version = pgVersion(reg),
+            .flags = CR_CLASSICATION_SYSTEM,
+        };
+
+        config_streamer_write(&streamer, (uint8_t *)&record, sizeof(record));
+        crc = crc16_ccitt_update(crc, (uint8_t *)&record, sizeof(record));
+        config_streamer_write(&streamer, reg->address, regSize);
+        crc = crc16_ccitt_update(crc, reg->address, regSize);
+        config_streamer_write(&streamer, (uint8_t *)&crc, sizeof(crc));
+
+        // pad the entry out to JOURNAL_ENTRY_ALIGNMENT
+        config_streamer_flush(&streamer);
+    }
+
+    return (config_streamer_finish(&streamer) == 0);
+}
+
 static bool writeSettingsToEEPROM(void)
 {
-    bool dirtyConfig = !isEEPROMVersionValid() || !isEEPROMStructureValid();
+    bool dirtyConfig = !isEEPROMVersionValid() || !isEEPROMStructureValid() || !journalEndIsBlank || journalCompactionRequired;
 
     configHeader_t header = {
         .eepromConfigVersion =  EEPROM_CONF_VERSION,
         .magic_be =             0xBE,
     };
 
-    PG_FOREACH(reg) {
-        if (*reg->fnv_hash != fnv_update(FNV_OFFSET_BASIS, reg->address, pgSize(reg))) {
-            dirtyConfig = true;
-        }
-    }
+    const uint32_t journalSize = journalAppendSize();
+
+    bool success;
+
+    if (!dirtyConfig && journalSize == 0) {
+        // Only write the config if it has changed
+        return true;
+    } else if (!dirtyConfig && journalHasSpaceFor(journalSize)) {
+        success = writeSettingsToJournal();
 
-    // Only write the config if it has changed
-    if (dirtyConfig) {
+        // a torn entry can't be programmed over, so fall back to rewriting everything
+        journalCompactionRequired = !success;
+    } else {
+        // Write a snapshot of every PG, which discards the journal
         config_streamer_t streamer;
         config_streamer_init(&streamer);
 
@@ -498,10 +649,18 @@ static bool writeSettingsToEEPROM(void)
 
         config_streamer_flush(&streamer);
 
-        return (config_streamer_finish(&streamer) == 0);
-    } else {
-        return true;
+        success = (config_streamer_finish(&streamer) == 0);
+        journalCompactionRequired = !success;
     }
+
+    if (success) {
+        // What is stored now matches memory, so the next save only journals what changes from here
+        PG_FOREACH(reg) {
+            *reg->fnv_hash = fnv_update(FNV_OFFSET_BASIS, reg->address, pgSize(reg));
+        }
+    }
+
+    return success;
 }
 
 void writeConfigToEEPROM(void)
@@ -531,3 +690,121 @@ void writeConfigToEEPROM(void)
     // Flash write failed - just die now
     failureMode(FAILURE_CONFIG_STORE_FAILURE);
 }
+
+#if defined(USE_EEPROM_BACKGROUND_WRITE) && !defined(CONFIG_IN_SDCARD) && !defined(CONFIG_IN_MEMORY_MAPPED_FLASH) && !defined(CONFIG_IN_EXTERNAL_FLASH)
+/*
+ * A save in the background appends to the journal like writeSettingsToJournal(), but the entries are copied out of
+ * the PGs into a shadow buffer up front so the PGs can keep changing while the shadow is programmed a chunk at
+ * a time. Anything that needs the snapshot rewritten is left to writeConfigToEEPROM().
+ */
+#ifndef EEPROM_WRITE_SHADOW_SIZE
+#define EEPROM_WRITE_SHADOW_SIZE 1024
+#endif
+
+// Programmed per call, so that a full shadow is stored in 32 calls rather than the 256 it takes 4 bytes at a time
+#define EEPROM_WRITE_CHUNK_SIZE 32
+STATIC_ASSERT(EEPROM_WRITE_CHUNK_SIZE % CONFIG_STREAMER_BUFFER_SIZE == 0, eeprom_write_chunk_not_whole_streamer_buffers);
+
+static uint8_t eepromWriteShadow[EEPROM_WRITE_SHADOW_SIZE];
+static uint16_t eepromWriteShadowSize;
+static uint16_t eepromWriteShadowOffset;
+static uint16_t eepromWriteJournalEnd;  // what getEEPROMConfigSize() has to be once the shadow is stored
+static config_streamer_t eepromWriteStreamer;
+static bool eepromWriteActive;
+
+bool writeConfigToEEPROMBegin(void)
+{
+    if (eepromWriteActive) {
+        return false;
+    }
+
+    if (!isEEPROMVersionValid() || !isEEPROMStructureValid() || !journalEndIsBlank || journalCompactionRequired) {
+        return false;
+    }
+
+    const uint32_t journalSize = journalAppendSize();
+    if (journalSize > sizeof(eepromWriteShadow) || !journalHasSpaceFor(journalSize)) {
+        return false;
+    }
+
+    memset(eepromWriteShadow, 0, journalSize);
+
+    uint8_t *p = eepromWriteShadow;
+    uint16_t crc = journalCrc;
+    PG_FOREACH(reg) {
+        if (!isPGDirty(reg)) {
+            continue;
+        }
+
+        const uint16_t regSize = pgSize(reg);
+        configRecord_t record = {
+            .size = sizeof(configRecord_t) + regSize,
+            .pgn = pgN(reg),
+            .version = pgVersion(reg),
+            .flags = CR_CLASSICATION_SYSTEM,
+        };
+
+        memcpy(p, &record, sizeof(record));
+        memcpy(p + sizeof(record), reg->address, regSize);
+        crc = crc16_ccitt_update(crc, p, sizeof(record) + regSize);
+        memcpy(p + sizeof(record) + regSize, &crc, sizeof(crc));
+
+        p += journalEntrySize(regSize);
+
+        // The shadow is what will be stored, so changes from here on are left for the next save
+        *reg->fnv_hash = fnv_update(FNV_OFFSET_BASIS, reg->address, regSize);
+    }
+
+    eepromWriteShadowSize = journalSize;
+    eepromWriteShadowOffset = 0;
+    eepromWriteJournalEnd = eepromConfigSize + journalSize;
+
+    config_streamer_init(&eepromWriteStreamer);
+    config_streamer_start(&eepromWriteStreamer, (uintptr_t)&__config_start + eepromConfigSize, &__config_end - &__config_start - eepromConfigSize);
+
+    eepromWriteActive = true;
+
+    return true;
+}
+
+configWriteStatus_e writeConfigToEEPROMContinue(void)
+{
+    if (!eepromWriteActive) {
+        return CONFIG_WRITE_COMPLETE;
+    }
+
+    if (eepromWriteShadowOffset < eepromWriteShadowSize) {
+        const uint16_t length = MIN(eepromWriteShadowSize - eepromWriteShadowOffset, EEPROM_WRITE_CHUNK_SIZE);
+        config_streamer_write(&eepromWriteStreamer, &eepromWriteShadow[eepromWriteShadowOffset], length);
+        eepromWriteShadowOffset += length;
+
+        return CONFIG_WRITE_IN_PROGRESS;
+    }
+
+    eepromWriteActive = false;
+
+    const bool success = (config_streamer_finish(&eepromWriteStreamer) == 0);
+
+    // Rescan to pick up the new end of the journal, which has to take in every entry of the shadow
+    if (!success || !isEEPROMStructureValid() || eepromConfigSize != eepromWriteJournalEnd) {
+        // a torn entry can't be programmed over, so the next save rewrites everything
+        journalCompactionRequired = true;
+
+        return CONFIG_WRITE_FAILED;
+    }
+
+    return CONFIG_WRITE_COMPLETE;
+}
+#else
+bool writeConfigToEEPROMBegin(void)
+{
+    // Saving rewrites all of the stored config, or on external flash the page programs would go in between those of
+    // flashfs and the blackbox. Without USE_EEPROM_BACKGROUND_WRITE there is no RAM for the shadow.
+    return false;
+}
+
+configWriteStatus_e writeConfigToEEPROMContinue(void)
+{
+    return CONFIG_WRITE_COMPLETE;
+}
+#endif
@@ -25,10 +25,18 @@
 
 #define EEPROM_CONF_VERSION 177
 
+typedef enum {
+    CONFIG_WRITE_IN_PROGRESS = 0,
+    CONFIG_WRITE_COMPLETE,
+    CONFIG_WRITE_FAILED,
+} configWriteStatus_e;
+
 bool isEEPROMVersionValid(void);
 bool isEEPROMStructureValid(void);
 bool loadEEPROM(void);
 void writeConfigToEEPROM(void);
+bool writeConfigToEEPROMBegin(void);
+configWriteStatus_e writeConfigToEEPROMContinue(void);
 
 uint16_t getEEPROMConfigSize(void);
 size_t getEEPROMStorageSize(void);
@@ -0,0 +1,271 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A binary snapshot of every parameter group, for backing up and restoring the whole config in one transfer.
+ *
+ * The snapshot is a record for each PG, a configSnapshotRecord_t followed by the PG as pgStore() would copy it, then
+ * the CRC16-CCITT of the records. It is read and restored in chunks at increasing offsets, so neither side has to
+ * hold all of it. Restored records are checked like pgLoad() does as they arrive and staged in the PGs' copies, which
+ * are only applied once the whole snapshot has been checked. PGs which aren't built into this firmware are skipped, but
+ * a version mismatch or a bad CRC fails the restore, leaving the config as it was. Arming is disabled while a restore
+ * is in progress, and a restore which stalls is abandoned.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+
+#include "common/crc.h"
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "config/config_snapshot.h"
+
+#include "drivers/time.h"
+
+#include "fc/runtime_config.h"
+
+#include "pg/pg.h"
+
+#define CONFIG_SNAPSHOT_RESTORE_TIMEOUT_MS 5000
+
+typedef struct {
+    pgn_t pgn;
+    uint8_t version;
+    uint16_t size;
+} PG_PACKED configSnapshotRecord_t;
+
+typedef struct {
+    uint32_t size;                      // of the snapshot being restored, 0 when there is none
+    uint32_t offset;                    // of the next byte expected
+    uint16_t crc;                       // of the records so far
+    configSnapshotRecord_t record;      // being restored
+    uint8_t recordHeaderBytes;          // received of the record header
+    uint16_t recordDataBytes;           // received of the record's PG
+    const pgRegistry_t *reg;            // the record is restored to, NULL while skipping an unknown PG
+    uint8_t storedCrc[sizeof(uint16_t)];
+    bool complete;
+    timeMs_t writtenAtMs;               // of the last write, for the timeout
+} configSnapshotRestore_t;
+
+static configSnapshotRestore_t restore;
+
+uint32_t configSnapshotSize(void)
+{
+    uint32_t size = sizeof(uint16_t);
+    PG_FOREACH(reg) {
+        size += sizeof(configSnapshotRecord_t) + pgSize(reg);
+    }
+    return size;
+}
+
+// Copy the part of data at *position in the snapshot that overlaps the range being read
+static void configSnapshotCopy(uint32_t *position, const void *data, uint32_t size, uint32_t offset, uint8_t *buffer, uint32_t length)
+{
+    const uint32_t start = MAX(*position, offset);
+    const uint32_t end = MIN(*position + size, offset + length);
+
+    if (start < end) {
+        memcpy(buffer + start - offset, (const uint8_t *)data + start - *position, end - start);
+    }
+
+    *position += size;
+}
+
+/*
+ * Copy up to length bytes of the snapshot from offset into buffer, returning the number copied (0 at the end). The
+ * PGs are read as they are at the time of each call.
+ */
+int configSnapshotRead(uint32_t offset, uint8_t *buffer, int length)
+{
+    const uint32_t size = configSnapshotSize();
+    if (offset >= size || length <= 0) {
+        return 0;
+    }
+    length = MIN((uint32_t)length, size - offset);
+
+    uint32_t position = 0;
+    uint16_t crc = 0;
+    PG_FOREACH(reg) {
+        const configSnapshotRecord_t record = {
+            .pgn = pgN(reg),
+            .version = pgVersion(reg),
+            .size = pgSize(reg),
+        };
+
+        configSnapshotCopy(&position, &record, sizeof(record), offset, buffer, length);
+        configSnapshotCopy(&position, reg->address, record.size, offset, buffer, length);
+
+        crc = crc16_ccitt_update(crc, &record, sizeof(record));
+        crc = crc16_ccitt_update(crc, reg->address, record.size);
+    }
+    configSnapshotCopy(&position, &crc, sizeof(crc), offset, buffer, length);
+
+    return length;
+}
+
+// Abandon the restore in progress, if any, leaving the config as it was
+void configSnapshotRestoreAbort(void)
+{
+    restore.size = 0;
+    unsetArmingDisabled(ARMING_DISABLED_CONFIG_RESTORE);
+}
+
+// Start restoring a snapshot of the given size, abandoning any restore in progress
+bool configSnapshotRestoreBegin(uint32_t size)
+{
+    configSnapshotRestoreAbort();
+    memset(&restore, 0, sizeof(restore));
+
+    if (size < sizeof(uint16_t)) {
+        return false;
+    }
+
+    // PGs which aren't in the snapshot are applied as they are now
+    PG_FOREACH(reg) {
+        memcpy(reg->copy, reg->address, pgSize(reg));
+    }
+
+    restore.size = size;
+    restore.writtenAtMs = millis();
+    setArmingDisabled(ARMING_DISABLED_CONFIG_RESTORE);
+
+    return true;
+}
+
+// Abandon a restore which hasn't been written to for a while, eg. as the configurator went away
+void configSnapshotRestoreUpdate(timeMs_t currentTimeMs)
+{
+    if (restore.size && !restore.complete && cmp32(currentTimeMs, restore.writtenAtMs) > CONFIG_SNAPSHOT_RESTORE_TIMEOUT_MS) {
+        configSnapshotRestoreAbort();
+    }
+}
+
+static bool configSnapshotRestoreRecordBegin(void)
+{
+    restore.reg = pgFind(restore.record.pgn);
+    if (!restore.reg) {
+        return true;
+    }
+
+    // Reset the staged PG and check the version as pgLoad() would, the data follows in later writes
+    pgResetCopy(restore.reg->copy, restore.record.pgn);
+
+    return restore.record.version == pgVersion(restore.reg);
+}
+
+// Put all the staged PGs in place. The hashes are kept so the PGs are still seen as changed since they were stored.
+static void configSnapshotRestoreApply(void)
+{
+    PG_FOREACH(reg) {
+        memcpy(reg->address, reg->copy, pgSize(reg));
+    }
+}
+
+// Consume up to length bytes of the records, returning the number consumed or -1 if they can't be restored
+static int configSnapshotRestoreRecords(const uint8_t *data, int length)
+{
+    int count;
+
+    if (restore.recordHeaderBytes < sizeof(restore.record)) {
+        count = MIN(length, (int)sizeof(restore.record) - restore.recordHeaderBytes);
+        memcpy((uint8_t *)&restore.record + restore.recordHeaderBytes, data, count);
+        restore.recordHeaderBytes += count;
+
+        if (restore.recordHeaderBytes == sizeof(restore.record) && !configSnapshotRestoreRecordBegin()) {
+            return -1;
+        }
+    } else {
+        count = MIN(length, restore.record.size - restore.recordDataBytes);
+        if (restore.reg && restore.recordDataBytes < pgSize(restore.reg)) {
+            // anything beyond the size of the PG in this firmware is dropped, as pgLoad() does
+            const int take = MIN(count, pgSize(restore.reg) - restore.recordDataBytes);
+            memcpy(restore.reg->copy + restore.recordDataBytes, data, take);
+        }
+        restore.recordDataBytes += count;
+    }
+
+    if (restore.recordHeaderBytes == sizeof(restore.record) && restore.recordDataBytes == restore.record.size) {
+        restore.recordHeaderBytes = 0;
+        restore.recordDataBytes = 0;
+    }
+
+    restore.crc = crc16_ccitt_update(restore.crc, data, count);
+
+    return count;
+}
+
+/*
+ * Stage the next length bytes of the snapshot, which must follow on from the last write, applying all the PGs once the
+ * last byte has been checked. Returns false, abandoning the restore, if they don't or can't be applied.
+ */
+bool configSnapshotRestoreWrite(uint32_t offset, const uint8_t *data, int length)
+{
+    if (!restore.size || restore.complete || offset != restore.offset || length < 0 || offset + length > restore.size) {
+        configSnapshotRestoreAbort();
+        return false;
+    }
+    restore.writtenAtMs = millis();
+
+    const uint32_t recordsSize = restore.size - sizeof(restore.storedCrc);
+    while (length > 0) {
+        int count;
+        if (restore.offset < recordsSize) {
+            count = configSnapshotRestoreRecords(data, MIN((uint32_t)length, recordsSize - restore.offset));
+            if (count < 0) {
+                configSnapshotRestoreAbort();
+                return false;
+            }
+        } else {
+            count = 1;
+            restore.storedCrc[restore.offset - recordsSize] = *data;
+        }
+
+        data += count;
+        length -= count;
+        restore.offset += count;
+    }
+
+    if (restore.offset == restore.size) {
+        uint16_t storedCrc;
+        memcpy(&storedCrc, restore.storedCrc, sizeof(storedCrc));
+
+        // The last record must be complete too
+        if (restore.recordHeaderBytes || storedCrc != restore.crc) {
+            configSnapshotRestoreAbort();
+            return false;
+        }
+
+        configSnapshotRestoreApply();
+        restore.complete = true;
+        unsetArmingDisabled(ARMING_DISABLED_CONFIG_RESTORE);
+    }
+
+    return true;
+}
+
+bool configSnapshotRestoreIsComplete(void)
+{
+    return restore.size && restore.complete;
+}
@@ -0,0 +1,36 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/time.h"
+
+uint32_t configSnapshotSize(void);
+int configSnapshotRead(uint32_t offset, uint8_t *buffer, int length);
+
+bool configSnapshotRestoreBegin(uint32_t size);
+bool configSnapshotRestoreWrite(uint32_t offset, const uint8_t *data, int length);
+bool configSnapshotRestoreIsComplete(void);
+void configSnapshotRestoreAbort(void);
+void configSnapshotRestoreUpdate(timeMs_t currentTimeMs);
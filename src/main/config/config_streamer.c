@@ -48,7 +48,8 @@ void config_streamer_init(config_streamer_t *c)
 
 void config_streamer_start(config_streamer_t *c, uintptr_t base, int size)
 {
-    // base must start at FLASH_PAGE_SIZE boundary when using embedded flash.
+    // base must start at FLASH_PAGE_SIZE boundary when using embedded flash, unless appending to what is already there.
+    c->start = base;
     c->address = base;
     c->size = size;
     if (!c->unlocked) {
@@ -402,10 +403,10 @@ static int write_word(config_streamer_t *c, config_streamer_buffer_align_type_t
     uint32_t bufferSizes[1];
 
     bool onPageBoundary = (flashAddress % flashPageSize == 0);
-    if (onPageBoundary) {
+    bool firstWord = (c->address == c->start);
+    if (onPageBoundary || firstWord) {
 
-        bool firstPage = (flashAddress == flashStartAddress);
-        if (!firstPage) {
+        if (!firstWord) {
             flashPageProgramFinish();
         }
 
@@ -423,7 +424,8 @@ static int write_word(config_streamer_t *c, config_streamer_buffer_align_type_t
 
 #elif defined(CONFIG_IN_RAM) || defined(CONFIG_IN_SDCARD) || defined(CONFIG_IN_MEMORY_MAPPED_FLASH)
     if (c->address == (uintptr_t)&eepromData[0]) {
-        memset(eepromData, 0, sizeof(eepromData));
+        // erased like flash, so that the end of the config journal is found the same way
+        memset(eepromData, 0xFF, sizeof(eepromData));
     }
 
     uint64_t *dest_addr = (uint64_t *)c->address;
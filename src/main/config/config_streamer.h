@@ -50,6 +50,7 @@ typedef uint32_t config_streamer_buffer_align_type_t;
 #endif
 
 typedef struct config_streamer_s {
+    uintptr_t start;
     uintptr_t address;
     int size;
     union {
@@ -19,9 +19,12 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include "platform.h"
 
+#include "common/maths.h"
+
 #include "buf_writer.h"
 
 void bufWriterInit(bufWriter_t *b, uint8_t *data, int size, bufWrite_t writer, void *arg)
@@ -49,3 +52,15 @@ void bufWriterFlush(bufWriter_t *b)
         b->at = 0;
     }
 }
+
+// Write no more than the first maxCount bytes, keeping the rest at the start of the buffer. Returns the number kept.
+int bufWriterFlushUpTo(bufWriter_t *b, int maxCount)
+{
+    const int count = MIN(b->at, maxCount);
+    if (count > 0) {
+        b->writer(b->arg, b->data, count);
+        memmove(b->data, b->data + count, b->at - count);
+        b->at -= count;
+    }
+    return b->at;
+}
@@ -27,11 +27,12 @@ typedef struct bufWriter_s {
     bufWrite_t writer;
     void *arg;
     uint8_t *data;
-    uint8_t capacity;
-    uint8_t at;
+    uint16_t capacity;
+    uint16_t at;
 } bufWriter_t;
 
 // Initialise a block of memory as a buffered writer.
 void bufWriterInit(bufWriter_t *b, uint8_t *data, int size, bufWrite_t writer, void *p);
 void bufWriterAppend(bufWriter_t *b, uint8_t ch);
 void bufWriterFlush(bufWriter_t *b);
+int bufWriterFlushUpTo(bufWriter_t *b, int maxCount);
@@ -34,6 +34,7 @@
 #include "drivers/flash/flash_w25n.h"
 #include "drivers/flash/flash_w25q128fv.h"
 #include "drivers/flash/flash_w25m.h"
+#include "drivers/flash/flash_virtual.h"
 #include "drivers/bus_spi.h"
 #include "drivers/bus_quadspi.h"
 #include "drivers/bus_octospi.h"
@@ -363,6 +364,8 @@ void flashPreInit(const flashConfig_t *flashConfig)
 
 bool flashDeviceInit(const flashConfig_t *flashConfig)
 {
+    UNUSED(flashConfig);
+
     bool haveFlash = false;
 
 #ifdef USE_FLASH_SPI
@@ -387,6 +390,12 @@ bool flashDeviceInit(const flashConfig_t *flashConfig)
     }
 #endif
 
+#ifdef USE_FLASH_VIRTUAL
+    if (!haveFlash) {
+        haveFlash = virtualFlashIdentify(&flashDevice);
+    }
+#endif
+
     if (haveFlash && flashDevice.vTable->configure) {
         uint32_t configurationFlags = 0;
 
@@ -469,6 +478,19 @@ MMFLASH_CODE int flashReadBytes(uint32_t address, uint8_t *buffer, uint32_t leng
     return flashDevice.vTable->readBytes(&flashDevice, address, buffer, length);
 }
 
+/*
+ * Start reading `length` bytes into `buffer`, calling `callback` with the number of bytes read once they are there.
+ * Devices which can't read in the background complete the read before returning.
+ */
+MMFLASH_CODE void flashReadBytesBegin(uint32_t address, uint8_t *buffer, uint32_t length, void (*callback)(uint32_t length))
+{
+    if (flashDevice.vTable->readBytesBegin) {
+        flashDevice.vTable->readBytesBegin(&flashDevice, address, buffer, length, callback);
+    } else {
+        callback(flashReadBytes(address, buffer, length));
+    }
+}
+
 MMFLASH_CODE void flashFlush(void)
 {
     if (flashDevice.vTable->flush) {
@@ -551,6 +573,19 @@ static void flashConfigurePartitions(void)
     startSector = 0;
 #endif
 
+#ifdef USE_FLASHFS_INDEX
+    // Log index for the FLASHFS partition, see io/flashfs_index.c. Like the partitions above it is taken from the end
+    // of the chip, so FLASHFS still starts at sector 0. Only targets that define USE_FLASHFS_INDEX reserve it.
+    if (endSector + 1 >= 8 * FLASH_PARTITION_FLASHFS_INDEX_SECTORS) {
+        startSector = (endSector + 1) - FLASH_PARTITION_FLASHFS_INDEX_SECTORS; // + 1 for inclusive
+
+        flashPartitionSet(FLASH_PARTITION_TYPE_FLASHFS_INDEX, startSector, endSector);
+
+        endSector = startSector - 1;
+        startSector = 0;
+    }
+#endif
+
 #ifdef USE_FLASHFS
     flashPartitionSet(FLASH_PARTITION_TYPE_FLASHFS, startSector, endSector);
 #endif
@@ -601,6 +636,7 @@ static const char *flashPartitionNames[] = {
     "BBMGMT   ",
     "FIRMWARE ",
     "CONFIG   ",
+    "FFSINDEX ",
 };
 
 const char *flashPartitionGetTypeName(flashPartitionType_e type)
@@ -70,6 +70,7 @@ uint32_t flashPageProgramContinue(const uint8_t **buffers, uint32_t *bufferSizes
 void flashPageProgramFinish(void);
 void flashPageProgram(uint32_t address, const uint8_t *data, uint32_t length, void (*callback)(uint32_t length));
 int flashReadBytes(uint32_t address, uint8_t *buffer, uint32_t length);
+void flashReadBytesBegin(uint32_t address, uint8_t *buffer, uint32_t length, void (*callback)(uint32_t length));
 void flashFlush(void);
 const flashGeometry_t *flashGetGeometry(void);
 
@@ -87,6 +88,9 @@ typedef struct flashPartition_s {
     flashSector_t endSector;
 } flashPartition_t;
 
+// Sectors taken from the end of the FLASHFS partition for its log index, on devices with enough of them
+#define FLASH_PARTITION_FLASHFS_INDEX_SECTORS 2
+
 #define FLASH_PARTITION_SECTOR_COUNT(partition) (partition->endSector + 1 - partition->startSector) // + 1 for inclusive, start and end sector can be the same sector.
 
 // Must be in sync with flashPartitionTypeNames[]
@@ -98,6 +102,7 @@ typedef enum {
     FLASH_PARTITION_TYPE_BADBLOCK_MANAGEMENT,
     FLASH_PARTITION_TYPE_FIRMWARE,
     FLASH_PARTITION_TYPE_CONFIG,
+    FLASH_PARTITION_TYPE_FLASHFS_INDEX,
     FLASH_MAX_PARTITIONS
 } flashPartitionType_e;
 
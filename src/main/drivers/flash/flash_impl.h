@@ -97,6 +97,8 @@ typedef struct flashDevice_s {
     flashDeviceIO_t io;
     void (*callback)(uint32_t arg);
     uint32_t callbackArg;
+    // completion of a read started by readBytesBegin, kept apart from callback which other operations replace
+    void (*readCallback)(uint32_t length);
 } flashDevice_t;
 
 typedef struct flashVTable_s {
@@ -116,6 +118,8 @@ typedef struct flashVTable_s {
     void (*flush)(flashDevice_t *fdevice);
 
     int (*readBytes)(flashDevice_t *fdevice, uint32_t address, uint8_t *buffer, uint32_t length);
+    // optional, starts a read which completes in the background calling callback with the length read
+    void (*readBytesBegin)(flashDevice_t *fdevice, uint32_t address, uint8_t *buffer, uint32_t length, void (*callback)(uint32_t length));
 
     const flashGeometry_t *(*getGeometry)(flashDevice_t *fdevice);
 } flashVTable_t;
@@ -601,6 +601,54 @@ static int m25p16_readBytes(flashDevice_t *fdevice, uint32_t address, uint8_t *b
     return length;
 }
 
+// Called in ISR context
+static busStatus_e m25p16_callbackReadComplete(uint32_t arg)
+{
+    flashDevice_t *fdevice = (flashDevice_t *)arg;
+
+    spiSetClkDivisor(fdevice->io.handle.dev, spiCalculateDivider(maxClkSPIHz));
+
+    if (fdevice->readCallback) {
+        fdevice->readCallback(fdevice->io.handle.dev->bus->curSegment->len);
+    }
+
+    return BUS_READY;
+}
+
+/**
+ * Start reading `length` bytes into the provided `buffer`, which must be suitable for DMA. The callback is called in
+ * ISR context with the length read once the transfer completes.
+ */
+static void m25p16_readBytesBegin(flashDevice_t *fdevice, uint32_t address, uint8_t *buffer, uint32_t length, void (*callback)(uint32_t length))
+{
+    // The segment list cannot be in automatic storage as this routine is non-blocking
+    STATIC_DMA_DATA_AUTO uint8_t readStatus[2] = { M25P16_INSTRUCTION_READ_STATUS_REG, 0 };
+    STATIC_DMA_DATA_AUTO uint8_t readyStatus[2];
+    STATIC_DMA_DATA_AUTO uint8_t readBytes[5] = { M25P16_INSTRUCTION_READ_BYTES };
+
+    static busSegment_t segments[] = {
+            {.u.buffers = {readStatus, readyStatus}, sizeof(readStatus), true, m25p16_callbackReady},
+            {.u.buffers = {readBytes, NULL}, 0, false, NULL},
+            {.u.buffers = {NULL, NULL}, 0, true, m25p16_callbackReadComplete},
+            {.u.link = {NULL, NULL}, 0, true, NULL},
+    };
+
+    // Ensure any prior DMA has completed before continuing
+    spiWait(fdevice->io.handle.dev);
+
+    // Patch the readBytes command and the data segment
+    segments[1].len = fdevice->isLargeFlash ? 5 : 4;
+    m25p16_setCommandAddress(&readBytes[1], address, fdevice->isLargeFlash);
+    segments[2].u.buffers.rxData = buffer;
+    segments[2].len = length;
+
+    fdevice->readCallback = callback;
+
+    spiSetClkDivisor(fdevice->io.handle.dev, spiCalculateDivider(maxReadClkSPIHz));
+
+    spiSequence(fdevice->io.handle.dev, fdevice->couldBeBusy ? &segments[0] : &segments[1]);
+}
+
 #ifdef USE_QUADSPI
 // Reading data QSPI mode
 
@@ -636,6 +684,7 @@ const flashVTable_t m25p16_vTable = {
     .pageProgramFinish = m25p16_pageProgramFinish,
     .pageProgram = m25p16_pageProgram,
     .readBytes = m25p16_readBytes,
+    .readBytesBegin = m25p16_readBytesBegin,
     .getGeometry = m25p16_getGeometry,
 };
 
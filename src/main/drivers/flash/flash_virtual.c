@@ -0,0 +1,384 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SPI NOR flash chip emulated in an image file, for SITL.
+ *
+ * Programming can only clear bits, erasing sets a whole sector to 0xFF and a page program
+ * stops at the end of the page, as on the real chip. After a program or erase the chip
+ * reports busy for as long as the timing model says a real one would, so flashfs and
+ * blackbox see the same back pressure as on hardware. Page programs are accepted while the
+ * chip is busy, like the DMA driven page programs of flash_m25p16.c, and start once the
+ * previous operation completes. Reads and erases wait for the chip.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "platform.h"
+
+#ifdef USE_FLASH_VIRTUAL
+
+#include "common/maths.h"
+#include "common/time.h"
+
+#include "drivers/flash/flash.h"
+#include "drivers/flash/flash_impl.h"
+#include "drivers/time.h"
+
+#include "drivers/flash/flash_virtual.h"
+
+#define VIRTUAL_FLASH_PAGESIZE          256
+#define VIRTUAL_FLASH_PAGES_PER_SECTOR  256     // 64KB block erase, as used by flash_m25p16.c
+#define VIRTUAL_FLASH_SECTOR_SIZE       (VIRTUAL_FLASH_PAGESIZE * VIRTUAL_FLASH_PAGES_PER_SECTOR)
+#define VIRTUAL_FLASH_COMMAND_BYTES     4       // instruction and 24 bit address
+
+typedef struct virtualFlashModel_s {
+    const char *name;
+    uint32_t jedecID;
+    uint32_t totalSize;         // of a new image
+    uint32_t spiClockKHz;       // 0 for transfers that take no time
+    uint32_t pageProgramUs;     // for a whole page, shorter programs take proportionally less
+    uint32_t sectorEraseUs;
+    uint32_t chipEraseUs;
+} virtualFlashModel_t;
+
+// Typical datasheet timings
+static const virtualFlashModel_t virtualFlashModels[] = {
+    { "w25q128", 0xEF4018, 16 * 1024 * 1024, 50000, 400, 150000, 40000000 },
+    { "m25p16",  0x202015, 2 * 1024 * 1024,  20000, 800, 600000, 13000000 },
+    { "ideal",   0xEF4018, 16 * 1024 * 1024, 0,     0,   0,      0 },
+};
+
+static virtualFlashModel_t model;
+static const char *imagePath;
+static int imageFd = -1;
+
+static timeUs_t busyUntilUs;
+
+// A read started by readBytesBegin completes once the device is no longer busy with its transfer
+static uint32_t readPendingLength;
+static bool readPending;
+
+static struct {
+    uint32_t pagePrograms;
+    uint64_t bytesProgrammed;
+    uint32_t sectorErases;
+    uint32_t chipErases;
+    uint64_t bytesRead;
+    uint64_t waitUs;
+} stats;
+
+bool virtualFlashSetImage(const char *path)
+{
+    imagePath = path;
+    return path && *path;
+}
+
+/*
+ * The model is the name of one of virtualFlashModels[] or a custom
+ * "<spi clock kHz>,<page program us>,<sector erase us>,<chip erase us>".
+ */
+bool virtualFlashSetModel(const char *name)
+{
+    for (unsigned i = 0; i < ARRAYLEN(virtualFlashModels); i++) {
+        if (strcmp(name, virtualFlashModels[i].name) == 0) {
+            model = virtualFlashModels[i];
+            return true;
+        }
+    }
+
+    model = virtualFlashModels[0];
+    model.name = "custom";
+    return sscanf(name, "%u,%u,%u,%u", &model.spiClockKHz, &model.pageProgramUs, &model.sectorEraseUs, &model.chipEraseUs) == 4;
+}
+
+static uint32_t virtualFlash_transferUs(uint32_t length)
+{
+    return model.spiClockKHz ? (VIRTUAL_FLASH_COMMAND_BYTES + length) * 8000 / model.spiClockKHz : 0;
+}
+
+static void virtualFlash_completeRead(flashDevice_t *fdevice)
+{
+    if (readPending) {
+        readPending = false;
+        if (fdevice->readCallback) {
+            fdevice->readCallback(readPendingLength);
+        }
+    }
+}
+
+static bool virtualFlash_isReady(flashDevice_t *fdevice)
+{
+    if (cmpTimeUs(busyUntilUs, micros()) > 0) {
+        return false;
+    }
+
+    virtualFlash_completeRead(fdevice);
+
+    return true;
+}
+
+static bool virtualFlash_waitForReady(flashDevice_t *fdevice)
+{
+    timeDelta_t remainingUs;
+    while ((remainingUs = cmpTimeUs(busyUntilUs, micros())) > 0) {
+        delayMicroseconds(remainingUs);
+        stats.waitUs += remainingUs;
+    }
+
+    virtualFlash_completeRead(fdevice);
+
+    return true;
+}
+
+// Queues an operation taking the given time behind the one in progress
+static void virtualFlash_setBusy(uint32_t durationUs)
+{
+    const timeUs_t nowUs = micros();
+
+    if (cmpTimeUs(busyUntilUs, nowUs) < 0) {
+        busyUntilUs = nowUs;
+    }
+    busyUntilUs += durationUs;
+}
+
+static void virtualFlash_fill(uint32_t address, uint32_t length)
+{
+    static uint8_t erased[VIRTUAL_FLASH_SECTOR_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+
+    for (uint32_t offset = 0; offset < length; offset += sizeof(erased)) {
+        if (pwrite(imageFd, erased, sizeof(erased), address + offset) != sizeof(erased)) {
+            fprintf(stderr, "[FLASH] erase of '%s' at 0x%08x failed\n", imagePath, (unsigned)(address + offset));
+            return;
+        }
+    }
+}
+
+static void virtualFlash_eraseSector(flashDevice_t *fdevice, uint32_t address)
+{
+    virtualFlash_waitForReady(fdevice);
+
+    virtualFlash_fill(address - address % fdevice->geometry.sectorSize, fdevice->geometry.sectorSize);
+    virtualFlash_setBusy(virtualFlash_transferUs(0) + model.sectorEraseUs);
+    stats.sectorErases++;
+}
+
+static void virtualFlash_eraseCompletely(flashDevice_t *fdevice)
+{
+    virtualFlash_waitForReady(fdevice);
+
+    virtualFlash_fill(0, fdevice->geometry.totalSize);
+    virtualFlash_setBusy(model.chipEraseUs);
+    stats.chipErases++;
+}
+
+static void virtualFlash_pageProgramBegin(flashDevice_t *fdevice, uint32_t address, void (*callback)(uint32_t length))
+{
+    fdevice->callback = callback;
+    fdevice->currentWriteAddress = address;
+}
+
+static void virtualFlash_program(uint32_t address, const uint8_t *data, uint32_t length)
+{
+    uint8_t page[VIRTUAL_FLASH_PAGESIZE];
+
+    while (length) {
+        const uint32_t chunk = MIN(length, (uint32_t)sizeof(page));
+
+        if (pread(imageFd, page, chunk, address) != (ssize_t)chunk) {
+            fprintf(stderr, "[FLASH] read of '%s' at 0x%08x failed\n", imagePath, (unsigned)address);
+            return;
+        }
+
+        for (uint32_t i = 0; i < chunk; i++) {
+            page[i] &= data[i];
+        }
+
+        if (pwrite(imageFd, page, chunk, address) != (ssize_t)chunk) {
+            fprintf(stderr, "[FLASH] program of '%s' at 0x%08x failed\n", imagePath, (unsigned)address);
+            return;
+        }
+
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+static uint32_t virtualFlash_pageProgramContinue(flashDevice_t *fdevice, uint8_t const **buffers, const uint32_t *bufferSizes, uint32_t bufferCount)
+{
+    uint32_t length = 0;
+
+    // flashPageProgramContinue() has already limited the buffers to the rest of the page
+    for (uint32_t i = 0; i < bufferCount; i++) {
+        virtualFlash_program(fdevice->currentWriteAddress + length, buffers[i], bufferSizes[i]);
+        length += bufferSizes[i];
+    }
+
+    virtualFlash_setBusy(virtualFlash_transferUs(length) + model.pageProgramUs * length / VIRTUAL_FLASH_PAGESIZE);
+    stats.pagePrograms++;
+    stats.bytesProgrammed += length;
+
+    fdevice->currentWriteAddress += length;
+    if (fdevice->callback) {
+        fdevice->callback(length);
+    }
+
+    return length;
+}
+
+static void virtualFlash_pageProgramFinish(flashDevice_t *fdevice)
+{
+    UNUSED(fdevice);
+}
+
+static void virtualFlash_pageProgram(flashDevice_t *fdevice, uint32_t address, const uint8_t *data, uint32_t length, void (*callback)(uint32_t length))
+{
+    virtualFlash_pageProgramBegin(fdevice, address, callback);
+
+    virtualFlash_pageProgramContinue(fdevice, &data, &length, 1);
+
+    virtualFlash_pageProgramFinish(fdevice);
+}
+
+static int virtualFlash_readBytes(flashDevice_t *fdevice, uint32_t address, uint8_t *buffer, uint32_t length)
+{
+    virtualFlash_waitForReady(fdevice);
+
+    // Reads block for the SPI transfer, as they do on hardware
+    const uint32_t transferUs = virtualFlash_transferUs(length);
+    if (transferUs) {
+        delayMicroseconds(transferUs);
+        stats.waitUs += transferUs;
+    }
+    stats.bytesRead += length;
+
+    const ssize_t result = pread(imageFd, buffer, length, address);
+
+    return result < 0 ? 0 : result;
+}
+
+// The transfer runs in the background like a DMA read, only an operation started before it finishes waits for it
+static void virtualFlash_readBytesBegin(flashDevice_t *fdevice, uint32_t address, uint8_t *buffer, uint32_t length, void (*callback)(uint32_t length))
+{
+    virtualFlash_waitForReady(fdevice);
+
+    const ssize_t result = pread(imageFd, buffer, length, address);
+
+    virtualFlash_setBusy(virtualFlash_transferUs(length));
+    stats.bytesRead += length;
+
+    fdevice->readCallback = callback;
+    readPendingLength = result < 0 ? 0 : result;
+    readPending = true;
+}
+
+static const flashGeometry_t *virtualFlash_getGeometry(flashDevice_t *fdevice)
+{
+    return &fdevice->geometry;
+}
+
+static const flashVTable_t virtualFlash_vTable = {
+    .isReady = virtualFlash_isReady,
+    .waitForReady = virtualFlash_waitForReady,
+    .eraseSector = virtualFlash_eraseSector,
+    .eraseCompletely = virtualFlash_eraseCompletely,
+    .pageProgramBegin = virtualFlash_pageProgramBegin,
+    .pageProgramContinue = virtualFlash_pageProgramContinue,
+    .pageProgramFinish = virtualFlash_pageProgramFinish,
+    .pageProgram = virtualFlash_pageProgram,
+    .readBytes = virtualFlash_readBytes,
+    .readBytesBegin = virtualFlash_readBytesBegin,
+    .getGeometry = virtualFlash_getGeometry,
+};
+
+/*
+ * Opens the image file given with virtualFlashSetImage(), or creates an erased one of
+ * the size of the model's chip. Returns false if there is no image.
+ */
+bool virtualFlashIdentify(flashDevice_t *fdevice)
+{
+    if (!imagePath) {
+        return false;
+    }
+
+    if (!model.name) {
+        model = virtualFlashModels[0];
+    }
+
+    imageFd = open(imagePath, O_RDWR | O_CREAT, 0644);
+    struct stat imageStat;
+    if (imageFd < 0 || fstat(imageFd, &imageStat) < 0) {
+        fprintf(stderr, "[FLASH] failed to open '%s'\n", imagePath);
+        return false;
+    }
+
+    uint32_t totalSize = imageStat.st_size - imageStat.st_size % VIRTUAL_FLASH_SECTOR_SIZE;
+    const bool created = totalSize == 0;
+    if (created) {
+        totalSize = model.totalSize;
+        if (ftruncate(imageFd, totalSize) < 0) {
+            fprintf(stderr, "[FLASH] failed to create '%s'\n", imagePath);
+            close(imageFd);
+            return false;
+        }
+    }
+
+    flashGeometry_t *geometry = &fdevice->geometry;
+    geometry->flashType = FLASH_TYPE_NOR;
+    geometry->pageSize = VIRTUAL_FLASH_PAGESIZE;
+    geometry->pagesPerSector = VIRTUAL_FLASH_PAGES_PER_SECTOR;
+    geometry->sectorSize = VIRTUAL_FLASH_SECTOR_SIZE;
+    geometry->sectors = totalSize / VIRTUAL_FLASH_SECTOR_SIZE;
+    geometry->totalSize = totalSize;
+    geometry->jedecId = model.jedecID;
+
+    fdevice->vTable = &virtualFlash_vTable;
+
+    if (created) {
+        virtualFlash_fill(0, totalSize);
+    }
+
+    printf("[FLASH] %s '%s', %uKB, %s timing\n", created ? "created" : "loaded", imagePath, (unsigned)(totalSize / 1024), model.name);
+
+    return true;
+}
+
+void virtualFlashPrintStats(void)
+{
+    if (imageFd < 0) {
+        return;
+    }
+
+    printf("[FLASH] %llu bytes programmed in %u page programs, %u sector erases, %u chip erases, %llu bytes read, %llums waiting for the chip\n",
+        (unsigned long long)stats.bytesProgrammed, (unsigned)stats.pagePrograms, (unsigned)stats.sectorErases, (unsigned)stats.chipErases,
+        (unsigned long long)stats.bytesRead, (unsigned long long)(stats.waitUs / 1000));
+}
+
+#endif
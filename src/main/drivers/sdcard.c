@@ -126,13 +126,24 @@ void sdcard_init(const sdcardConfig_t *config)
     case SDCARD_MODE_SDIO:
         sdcardVTable = &sdcardSdioVTable;
         break;
+#endif
+#ifdef USE_SDCARD_VIRTUAL
+    // An image file stands in for the card, with the timing of either interface
+    case SDCARD_MODE_SPI:
+    case SDCARD_MODE_SDIO:
+        sdcardVTable = &sdcardVirtualVTable;
+        break;
 #endif
     default:
         break;
     }
 
     if (sdcardVTable) {
+#ifdef USE_SPI
         sdcardVTable->sdcard_init(config, spiPinConfig(0));
+#else
+        sdcardVTable->sdcard_init(config, NULL);
+#endif
     }
 }
 
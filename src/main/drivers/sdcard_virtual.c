@@ -0,0 +1,422 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SD card emulated in an image file, for SITL.
+ *
+ * The image is a whole card, partition table included, eg. made with
+ *
+ *   truncate -s 1G sdcard.img && echo 'start=2048, type=c' | sfdisk sdcard.img && mkfs.fat -F 32 --offset 2048 sdcard.img
+ *
+ * The card goes through the same states as sdcard_spi.c, so asyncfatfs sees busy and in
+ * progress operations the way it does on hardware. Each block operation takes the command
+ * time, the card's access or programming time and the data transfer at the bus rate of the
+ * timing model. Writes have the card busy programming for longer on their own than within
+ * a multi-block write, and every so often for much longer, as cards do when they move data
+ * between their erase blocks. By default the model follows sdcard_mode, SPI or SDIO.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "platform.h"
+
+#ifdef USE_SDCARD_VIRTUAL
+
+#include "common/time.h"
+
+#include "drivers/time.h"
+
+#include "pg/bus_spi.h"
+#include "pg/sdcard.h"
+
+#include "sdcard.h"
+#include "sdcard_impl.h"
+#include "sdcard_standard.h"
+
+#include "sdcard_virtual.h"
+
+typedef struct virtualSdcardModel_s {
+    const char *name;
+    uint32_t busKBps;           // data transfer rate, 0 for transfers that take no time
+    uint32_t commandUs;         // command and response, twice to start a multi-block write
+    uint32_t readAccessUs;      // until the card starts sending a block
+    uint32_t writeBusyUs;       // card busy programming a block written on its own
+    uint32_t multiWriteBusyUs;  // and a block of a multi-block write
+    uint32_t stallBusyUs;       // extra busy time once every stallBlocks blocks written
+    uint32_t stallBlocks;
+} virtualSdcardModel_t;
+
+// Middle of the road class 10 card, on a 25MHz SPI bus or a 4 bit 48MHz SDIO bus
+static const virtualSdcardModel_t virtualSdcardModels[] = {
+    { "spi",   2900,  40, 400, 700, 120, 60000, 4096 },
+    { "sdio",  20000, 5,  250, 600, 40,  60000, 4096 },
+    { "ideal", 0,     0,  0,   0,   0,   0,     0 },
+};
+
+static virtualSdcardModel_t model;
+static const char *imagePath;
+static int imageFd = -1;
+
+static timeUs_t readyAtUs;
+static uint32_t commandPendingUs;   // multi-block write command, paid with the first block
+static uint32_t lastBlockWritten;
+
+static struct {
+    uint32_t blocksRead;
+    uint32_t blocksWritten;
+    uint32_t singleBlockWrites;
+    uint32_t multiBlockWrites;
+    uint32_t discontiguousWrites;
+    uint32_t stalls;
+    uint64_t busyUs;
+} stats;
+
+bool virtualSdcardSetImage(const char *path)
+{
+    imagePath = path;
+    return path && *path;
+}
+
+/*
+ * The model is the name of one of virtualSdcardModels[] or a custom "<bus KB/s>,<command us>,
+ * <read access us>,<write busy us>,<multi-block write busy us>,<stall us>,<blocks between stalls>".
+ */
+bool virtualSdcardSetModel(const char *name)
+{
+    for (unsigned i = 0; i < ARRAYLEN(virtualSdcardModels); i++) {
+        if (strcmp(name, virtualSdcardModels[i].name) == 0) {
+            model = virtualSdcardModels[i];
+            return true;
+        }
+    }
+
+    model.name = "custom";
+    return sscanf(name, "%u,%u,%u,%u,%u,%u,%u", &model.busKBps, &model.commandUs, &model.readAccessUs,
+        &model.writeBusyUs, &model.multiWriteBusyUs, &model.stallBusyUs, &model.stallBlocks) == 7;
+}
+
+static uint32_t virtualSdcard_transferUs(void)
+{
+    return model.busKBps ? SDCARD_BLOCK_SIZE * 1000 / model.busKBps : 0;
+}
+
+// The card works through the phases of an operation on its own, whenever the poll notices
+static void virtualSdcard_startOperation(sdcardState_e state, timeUs_t startUs, uint32_t durationUs)
+{
+    sdcard.state = state;
+    sdcard.operationStartTime = millis();
+    readyAtUs = startUs + durationUs;
+    stats.busyUs += durationUs;
+}
+
+static bool virtualSdcard_operationDone(void)
+{
+    return cmpTimeUs(readyAtUs, micros()) <= 0;
+}
+
+static void virtualSdcard_completeOperation(sdcardBlockOperation_e operation, uint8_t *buffer)
+{
+    if (sdcard.pendingOperation.callback) {
+        sdcard.pendingOperation.callback(operation, sdcard.pendingOperation.blockIndex, buffer, sdcard.pendingOperation.callbackData);
+    }
+
+#ifdef SDCARD_PROFILING
+    if (sdcard.profiler) {
+        sdcard.profiler(operation, sdcard.pendingOperation.blockIndex, micros() - sdcard.pendingOperation.profileStartTime);
+    }
+#endif
+}
+
+static bool virtualSdcard_isFunctional(void)
+{
+    return sdcard.state != SDCARD_STATE_NOT_PRESENT;
+}
+
+static void virtualSdcard_preInit(const sdcardConfig_t *config)
+{
+    UNUSED(config);
+}
+
+static void virtualSdcard_init(const sdcardConfig_t *config, const spiPinConfig_t *spiConfig)
+{
+    UNUSED(spiConfig);
+
+    sdcard.enabled = config->mode;
+    sdcard.state = SDCARD_STATE_NOT_PRESENT;
+
+    if (!sdcard.enabled || !imagePath) {
+        return;
+    }
+
+    if (!model.name) {
+        model = virtualSdcardModels[config->mode == SDCARD_MODE_SDIO ? 1 : 0];
+    }
+
+    imageFd = open(imagePath, O_RDWR);
+    struct stat imageStat;
+    if (imageFd < 0 || fstat(imageFd, &imageStat) < 0) {
+        fprintf(stderr, "[SDCARD] failed to open '%s'\n", imagePath);
+        return;
+    }
+
+    memset(&sdcard.metadata, 0, sizeof(sdcard.metadata));
+    sdcard.metadata.numBlocks = imageStat.st_size / SDCARD_BLOCK_SIZE;
+    memcpy(sdcard.metadata.productName, "SITL ", sizeof(sdcard.metadata.productName));
+
+    sdcard.highCapacity = true;
+    sdcard.multiWriteBlocksRemain = 0;
+    sdcard.failureCount = 0;
+    sdcard.state = SDCARD_STATE_READY;
+
+    printf("[SDCARD] loaded '%s', %uMB, %s timing\n", imagePath, (unsigned)(imageStat.st_size >> 20), model.name);
+}
+
+static bool virtualSdcard_transfer(uint32_t blockIndex, uint8_t *buffer, bool write)
+{
+    const off_t offset = (off_t)blockIndex * SDCARD_BLOCK_SIZE;
+    const ssize_t result = write ? pwrite(imageFd, buffer, SDCARD_BLOCK_SIZE, offset) : pread(imageFd, buffer, SDCARD_BLOCK_SIZE, offset);
+
+    return result == SDCARD_BLOCK_SIZE;
+}
+
+// A card has a fixed number of blocks, the image file may not
+static bool virtualSdcard_isValidBlock(uint32_t blockIndex)
+{
+    return blockIndex < sdcard.metadata.numBlocks;
+}
+
+static void virtualSdcard_endWriteBlocks(timeUs_t startUs)
+{
+    sdcard.multiWriteBlocksRemain = 0;
+
+    // The stop transmission token, after which the card is busy with the last block
+    virtualSdcard_startOperation(SDCARD_STATE_STOPPING_MULTIPLE_BLOCK_WRITE, startUs, model.commandUs + model.multiWriteBusyUs);
+}
+
+static bool virtualSdcard_isReady(void)
+{
+    return sdcard.state == SDCARD_STATE_READY || sdcard.state == SDCARD_STATE_WRITING_MULTIPLE_BLOCKS;
+}
+
+static bool virtualSdcard_poll(void)
+{
+    if (!sdcard.enabled) {
+        sdcard.state = SDCARD_STATE_NOT_PRESENT;
+        return false;
+    }
+
+doMore:
+    if (!virtualSdcard_operationDone()) {
+        return false;
+    }
+
+    switch (sdcard.state) {
+    case SDCARD_STATE_READING:
+        sdcard.state = SDCARD_STATE_READY;
+        stats.blocksRead++;
+
+        virtualSdcard_completeOperation(SDCARD_BLOCK_OPERATION_READ,
+            virtualSdcard_transfer(sdcard.pendingOperation.blockIndex, sdcard.pendingOperation.buffer, false) ? sdcard.pendingOperation.buffer : NULL);
+        break;
+
+    case SDCARD_STATE_SENDING_WRITE: {
+        const bool written = virtualSdcard_transfer(sdcard.pendingOperation.blockIndex, sdcard.pendingOperation.buffer, true);
+
+        // The block has been sent, the card now spends a while programming it
+        uint32_t busyUs = sdcard.multiWriteBlocksRemain ? model.multiWriteBusyUs : model.writeBusyUs;
+        stats.blocksWritten++;
+        if (sdcard.pendingOperation.blockIndex != lastBlockWritten + 1) {
+            stats.discontiguousWrites++;
+        }
+        lastBlockWritten = sdcard.pendingOperation.blockIndex;
+        if (model.stallBlocks && stats.blocksWritten % model.stallBlocks == 0) {
+            busyUs += model.stallBusyUs;
+            stats.stalls++;
+        }
+        virtualSdcard_startOperation(SDCARD_STATE_WAITING_FOR_WRITE, readyAtUs, busyUs);
+
+        virtualSdcard_completeOperation(SDCARD_BLOCK_OPERATION_WRITE, written ? sdcard.pendingOperation.buffer : NULL);
+        goto doMore;
+    }
+
+    case SDCARD_STATE_WAITING_FOR_WRITE:
+        if (sdcard.multiWriteBlocksRemain > 1) {
+            sdcard.multiWriteBlocksRemain--;
+            sdcard.multiWriteNextBlock++;
+            sdcard.state = SDCARD_STATE_WRITING_MULTIPLE_BLOCKS;
+        } else if (sdcard.multiWriteBlocksRemain == 1) {
+            virtualSdcard_endWriteBlocks(readyAtUs);
+            goto doMore;
+        } else {
+            sdcard.state = SDCARD_STATE_READY;
+        }
+        break;
+
+    case SDCARD_STATE_STOPPING_MULTIPLE_BLOCK_WRITE:
+        sdcard.state = SDCARD_STATE_READY;
+        break;
+
+    default:
+        break;
+    }
+
+    return virtualSdcard_isReady();
+}
+
+static sdcardOperationStatus_e virtualSdcard_writeBlock(uint32_t blockIndex, uint8_t *buffer, sdcard_operationCompleteCallback_c callback, uint32_t callbackData)
+{
+    uint32_t durationUs = virtualSdcard_transferUs();
+
+    switch (sdcard.state) {
+    case SDCARD_STATE_WRITING_MULTIPLE_BLOCKS:
+        if (blockIndex != sdcard.multiWriteNextBlock) {
+            virtualSdcard_endWriteBlocks(micros());
+            return SDCARD_OPERATION_BUSY;
+        }
+        durationUs += commandPendingUs;
+        commandPendingUs = 0;
+        break;
+    case SDCARD_STATE_READY:
+        durationUs += model.commandUs;
+        stats.singleBlockWrites++;
+        break;
+    default:
+        return SDCARD_OPERATION_BUSY;
+    }
+
+    if (!virtualSdcard_isValidBlock(blockIndex)) {
+        return SDCARD_OPERATION_FAILURE;
+    }
+
+#ifdef SDCARD_PROFILING
+    sdcard.pendingOperation.profileStartTime = micros();
+#endif
+
+    sdcard.pendingOperation.buffer = buffer;
+    sdcard.pendingOperation.blockIndex = blockIndex;
+    sdcard.pendingOperation.callback = callback;
+    sdcard.pendingOperation.callbackData = callbackData;
+    virtualSdcard_startOperation(SDCARD_STATE_SENDING_WRITE, micros(), durationUs);
+
+    return SDCARD_OPERATION_IN_PROGRESS;
+}
+
+static sdcardOperationStatus_e virtualSdcard_beginWriteBlocks(uint32_t blockIndex, uint32_t blockCount)
+{
+    if (sdcard.state != SDCARD_STATE_READY) {
+        if (sdcard.state == SDCARD_STATE_WRITING_MULTIPLE_BLOCKS && blockIndex == sdcard.multiWriteNextBlock) {
+            // Assume that the caller wants to continue the multi-block write they already have in progress
+            return SDCARD_OPERATION_SUCCESS;
+        }
+        if (sdcard.state == SDCARD_STATE_WRITING_MULTIPLE_BLOCKS) {
+            virtualSdcard_endWriteBlocks(micros());
+        }
+        return SDCARD_OPERATION_BUSY;
+    }
+
+    // ACMD23 and CMD25
+    commandPendingUs = 2 * model.commandUs;
+
+    sdcard.state = SDCARD_STATE_WRITING_MULTIPLE_BLOCKS;
+    sdcard.multiWriteBlocksRemain = blockCount;
+    sdcard.multiWriteNextBlock = blockIndex;
+    stats.multiBlockWrites++;
+
+    return SDCARD_OPERATION_SUCCESS;
+}
+
+static bool virtualSdcard_readBlock(uint32_t blockIndex, uint8_t *buffer, sdcard_operationCompleteCallback_c callback, uint32_t callbackData)
+{
+    if (sdcard.state != SDCARD_STATE_READY) {
+        if (sdcard.state == SDCARD_STATE_WRITING_MULTIPLE_BLOCKS) {
+            virtualSdcard_endWriteBlocks(micros());
+        }
+        return false;
+    }
+
+    if (!virtualSdcard_isValidBlock(blockIndex)) {
+        return false;
+    }
+
+#ifdef SDCARD_PROFILING
+    sdcard.pendingOperation.profileStartTime = micros();
+#endif
+
+    sdcard.pendingOperation.buffer = buffer;
+    sdcard.pendingOperation.blockIndex = blockIndex;
+    sdcard.pendingOperation.callback = callback;
+    sdcard.pendingOperation.callbackData = callbackData;
+    virtualSdcard_startOperation(SDCARD_STATE_READING, micros(), model.commandUs + model.readAccessUs + virtualSdcard_transferUs());
+
+    return true;
+}
+
+static bool virtualSdcard_isInitialized(void)
+{
+    return sdcard.state >= SDCARD_STATE_READY;
+}
+
+static const sdcardMetadata_t* virtualSdcard_getMetadata(void)
+{
+    return &sdcard.metadata;
+}
+
+#ifdef SDCARD_PROFILING
+static void virtualSdcard_setProfilerCallback(sdcard_profilerCallback_c callback)
+{
+    sdcard.profiler = callback;
+}
+#endif
+
+void virtualSdcardPrintStats(void)
+{
+    if (imageFd < 0) {
+        return;
+    }
+
+    printf("[SDCARD] %u blocks written in %u single and %u multi-block writes, %u discontiguous, %u stalls, %u blocks read, %llums busy\n",
+        (unsigned)stats.blocksWritten, (unsigned)stats.singleBlockWrites, (unsigned)stats.multiBlockWrites, (unsigned)stats.discontiguousWrites,
+        (unsigned)stats.stalls, (unsigned)stats.blocksRead, (unsigned long long)(stats.busyUs / 1000));
+}
+
+sdcardVTable_t sdcardVirtualVTable = {
+    virtualSdcard_preInit,
+    virtualSdcard_init,
+    virtualSdcard_readBlock,
+    virtualSdcard_beginWriteBlocks,
+    virtualSdcard_writeBlock,
+    virtualSdcard_poll,
+    virtualSdcard_isFunctional,
+    virtualSdcard_isInitialized,
+    virtualSdcard_getMetadata,
+#ifdef SDCARD_PROFILING
+    virtualSdcard_setProfilerCallback,
+#endif
+};
+
+#endif
@@ -28,6 +28,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 
 #include "platform.h"
 
@@ -38,7 +43,11 @@
 #include "io/serial.h"
 #include "serial_tcp.h"
 
-#define BASE_PORT 5760
+// A write to a full buffer waits this long for the client to read before the client is disconnected
+#define TCP_TX_STALL_TIMEOUT_US     100000
+#define TCP_TX_STALL_POLL_US        50
+
+static uint16_t basePort = TCP_BASE_PORT;
 
 static const struct serialPortVTable tcpVTable; // Forward
 static tcpPort_t tcpSerialPorts[SERIAL_PORT_COUNT];
@@ -48,39 +57,193 @@ bool tcpIsStart(void)
 {
     return tcpStart;
 }
-static void onData(dyad_Event *e)
+
+// UARTn listens on port base + n, which has to be set before the ports are opened
+bool tcpSetBasePort(unsigned port)
+{
+    if (port + SERIAL_PORT_COUNT > UINT16_MAX) {
+        return false;
+    }
+    basePort = port;
+    return true;
+}
+
+uint16_t tcpGetBasePort(void)
+{
+    return basePort;
+}
+
+static void tcpClose(tcpPort_t *s)
 {
-    tcpPort_t* s = (tcpPort_t*)(e->udata);
-    tcpDataIn(s, (uint8_t*)e->data, e->size);
+    const int fd = s->client.fd;
+    reactorRemove(&s->client);
+    close(fd);
+
+    // anything not sent is dropped, and the rx buffer is left for the FC loop to read
+    __atomic_store_n(&s->port.txBufferTail, __atomic_load_n(&s->port.txBufferHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    __atomic_store_n(&s->rxStalled, false, __ATOMIC_SEQ_CST);
+    s->txBlocked = false;
+    __atomic_store_n(&s->connected, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&s->txStalled, false, __ATOMIC_RELEASE);
+
+    fprintf(stderr, "[CLS]UART%u\n", s->id + 1U);
 }
-static void onClose(dyad_Event *e)
+
+static void tcpUpdateEvents(tcpPort_t *s)
 {
-    tcpPort_t* s = (tcpPort_t*)(e->udata);
-    s->clientCount--;
-    s->conn = NULL;
-    fprintf(stderr, "[CLS]UART%u: %d,%d\n", s->id + 1U, s->connected, s->clientCount);
-    if (s->clientCount == 0) {
-        s->connected = false;
+    reactorSetEvents(&s->client, (s->rxStalled ? 0 : EPOLLIN) | (s->txBlocked ? EPOLLOUT : 0));
+}
+
+// Reactor thread: read from the client until it has nothing more or rxBuffer is full
+static bool tcpReceive(tcpPort_t *s)
+{
+    const uint32_t size = s->port.rxBufferSize;
+
+    while (true) {
+        const uint32_t head = s->port.rxBufferHead;
+        const uint32_t tail = __atomic_load_n(&s->port.rxBufferTail, __ATOMIC_ACQUIRE);
+        // one byte is left free, so that a full buffer isn't seen as empty
+        const uint32_t space = head >= tail ? size - head - (tail == 0) : tail - head - 1;
+
+        if (space == 0) {
+            if (!s->rxStalled) {
+                // tcpRead() kicks once it makes space, unless it did so before seeing the stall
+                __atomic_store_n(&s->rxStalled, true, __ATOMIC_SEQ_CST);
+                if (__atomic_load_n(&s->port.rxBufferTail, __ATOMIC_SEQ_CST) != tail) {
+                    __atomic_store_n(&s->rxStalled, false, __ATOMIC_SEQ_CST);
+                    continue;
+                }
+                tcpUpdateEvents(s);
+            }
+            return true;
+        }
+
+        const ssize_t count = recv(s->client.fd, &s->rxBuffer[head], space, 0);
+        if (count > 0) {
+            __atomic_store_n(&s->port.rxBufferHead, (head + count) % size, __ATOMIC_RELEASE);
+        } else if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (s->rxStalled) {
+                __atomic_store_n(&s->rxStalled, false, __ATOMIC_SEQ_CST);
+                tcpUpdateEvents(s);
+            }
+            return true;
+        } else {
+            tcpClose(s);
+            return false;
+        }
     }
 }
-static void onAccept(dyad_Event *e)
+
+// Reactor thread: send txBuffer until it is empty or the socket is full
+static void tcpTransmit(tcpPort_t *s)
 {
-    tcpPort_t* s = (tcpPort_t*)(e->udata);
-    fprintf(stderr, "New connection on UART%u, %d\n", s->id + 1U, s->clientCount);
+    const uint32_t size = s->port.txBufferSize;
+
+    while (true) {
+        const uint32_t tail = s->port.txBufferTail;
+        const uint32_t head = __atomic_load_n(&s->port.txBufferHead, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (s->txBlocked) {
+                s->txBlocked = false;
+                tcpUpdateEvents(s);
+            }
+            return;
+        }
 
-    s->connected = true;
-    if (s->clientCount > 0) {
-        dyad_close(e->remote);
+        const ssize_t count = send(s->client.fd, &s->txBuffer[tail], head > tail ? head - tail : size - tail, MSG_NOSIGNAL);
+        if (count > 0) {
+            __atomic_store_n(&s->port.txBufferTail, (tail + count) % size, __ATOMIC_RELEASE);
+        } else if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!s->txBlocked) {
+                s->txBlocked = true;
+                tcpUpdateEvents(s);
+            }
+            return;
+        } else {
+            tcpClose(s);
+            return;
+        }
+    }
+}
+
+static void onClient(void *context, uint32_t events)
+{
+    tcpPort_t *s = (tcpPort_t *)context;
+
+    if ((events & (EPOLLERR | EPOLLHUP)) || __atomic_load_n(&s->txStalled, __ATOMIC_ACQUIRE)) {
+        tcpClose(s);
         return;
     }
-    s->clientCount++;
-    fprintf(stderr, "[NEW]UART%u: %d,%d\n", s->id + 1U, s->connected, s->clientCount);
-    s->conn = e->remote;
-    dyad_setNoDelay(e->remote, 1);
-    dyad_setTimeout(e->remote, 120);
-    dyad_addListener(e->remote, DYAD_EVENT_DATA, onData, e->udata);
-    dyad_addListener(e->remote, DYAD_EVENT_CLOSE, onClose, e->udata);
+
+    if ((events & EPOLLIN) || ((events & REACTOR_KICK) && s->rxStalled)) {
+        if (!tcpReceive(s)) {
+            return;
+        }
+    }
+
+    if (events & (EPOLLOUT | REACTOR_KICK)) {
+        tcpTransmit(s);
+    }
 }
+
+static void onAccept(void *context, uint32_t events)
+{
+    UNUSED(events);
+
+    tcpPort_t *s = (tcpPort_t *)context;
+
+    const int fd = accept4(s->listener.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    fprintf(stderr, "New connection on UART%u, %d\n", s->id + 1U, s->connected);
+    if (s->connected) {
+        close(fd);
+        return;
+    }
+
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    s->rxStalled = false;
+    s->txBlocked = false;
+    if (!reactorAdd(&s->client, fd, EPOLLIN, onClient, s)) {
+        close(fd);
+        return;
+    }
+    __atomic_store_n(&s->connected, true, __ATOMIC_RELEASE);
+    fprintf(stderr, "[NEW]UART%u\n", s->id + 1U);
+}
+
+static int tcpListen(uint16_t port)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 10) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
 static tcpPort_t* tcpReconfigure(tcpPort_t *s, int id)
 {
     if (tcpPortInitialized[id]) {
@@ -88,32 +251,18 @@ static tcpPort_t* tcpReconfigure(tcpPort_t *s, int id)
         return s;
     }
 
-    if (pthread_mutex_init(&s->txLock, NULL) != 0) {
-        fprintf(stderr, "TX mutex init failed - %d\n", errno);
-        // TODO: clean up & re-init
-        return NULL;
-    }
-    if (pthread_mutex_init(&s->rxLock, NULL) != 0) {
-        fprintf(stderr, "RX mutex init failed - %d\n", errno);
-        // TODO: clean up & re-init
-        return NULL;
-    }
-
     tcpStart = true;
     tcpPortInitialized[id] = true;
 
     s->connected = false;
-    s->clientCount = 0;
     s->id = id;
-    s->conn = NULL;
-    s->serv = dyad_newStream();
-    dyad_setNoDelay(s->serv, 1);
-    dyad_addListener(s->serv, DYAD_EVENT_ACCEPT, onAccept, s);
+    s->client.fd = -1;
 
-    if (dyad_listenEx(s->serv, NULL, BASE_PORT + id + 1, 10) == 0) {
-        fprintf(stderr, "bind port %u for UART%u\n", (unsigned)BASE_PORT + id + 1, (unsigned)id + 1);
+    const int fd = tcpListen(basePort + id + 1);
+    if (fd >= 0 && reactorAdd(&s->listener, fd, EPOLLIN, onAccept, s)) {
+        fprintf(stderr, "bind port %u for UART%u\n", (unsigned)basePort + id + 1, (unsigned)id + 1);
     } else {
-        fprintf(stderr, "bind port %u for UART%u failed!!\n", (unsigned)BASE_PORT + id + 1, (unsigned)id + 1);
+        fprintf(stderr, "bind port %u for UART%u failed!!\n", (unsigned)basePort + id + 1, (unsigned)id + 1);
     }
     return s;
 }
@@ -152,58 +301,73 @@ serialPort_t *serTcpOpen(int id, serialReceiveCallbackPtr rxCallback, void *rxCa
 
 uint32_t tcpTotalRxBytesWaiting(const serialPort_t *instance)
 {
-    tcpPort_t *s = (tcpPort_t*)instance;
-    uint32_t count;
-    pthread_mutex_lock(&s->rxLock);
-    if (s->port.rxBufferHead >= s->port.rxBufferTail) {
-        count = s->port.rxBufferHead - s->port.rxBufferTail;
+    const uint32_t head = __atomic_load_n(&instance->rxBufferHead, __ATOMIC_ACQUIRE);
+    const uint32_t tail = instance->rxBufferTail;
+
+    if (head >= tail) {
+        return head - tail;
     } else {
-        count = s->port.rxBufferSize + s->port.rxBufferHead - s->port.rxBufferTail;
+        return instance->rxBufferSize + head - tail;
     }
-    pthread_mutex_unlock(&s->rxLock);
+}
 
-    return count;
+// Have the reactor send txBuffer now, rather than when the FC loop is next idle
+static void tcpKickNow(tcpPort_t *s)
+{
+    reactorKick(&s->client);
+    reactorFlush();
+}
+
+// A caller polling the buffer again, without writing to it, is waiting for the reactor to make space
+static void tcpTxPolled(tcpPort_t *s)
+{
+    if (++s->txPolls > 1) {
+        tcpKickNow(s);
+    }
 }
 
 uint32_t tcpTotalTxBytesFree(const serialPort_t *instance)
 {
     tcpPort_t *s = (tcpPort_t*)instance;
-    uint32_t bytesUsed;
+    const uint32_t head = s->port.txBufferHead;
+    const uint32_t tail = __atomic_load_n(&s->port.txBufferTail, __ATOMIC_ACQUIRE);
 
-    pthread_mutex_lock(&s->txLock);
-    if (s->port.txBufferHead >= s->port.txBufferTail) {
-        bytesUsed = s->port.txBufferHead - s->port.txBufferTail;
+    uint32_t bytesUsed;
+    if (head >= tail) {
+        bytesUsed = head - tail;
     } else {
-        bytesUsed = s->port.txBufferSize + s->port.txBufferHead - s->port.txBufferTail;
+        bytesUsed = s->port.txBufferSize + head - tail;
+    }
+    if (bytesUsed) {
+        tcpTxPolled(s);
     }
-    uint32_t bytesFree = (s->port.txBufferSize - 1) - bytesUsed;
-    pthread_mutex_unlock(&s->txLock);
 
-    return bytesFree;
+    return (s->port.txBufferSize - 1) - bytesUsed;
 }
 
 bool isTcpTransmitBufferEmpty(const serialPort_t *instance)
 {
     tcpPort_t *s = (tcpPort_t *)instance;
-    pthread_mutex_lock(&s->txLock);
-    bool isEmpty = s->port.txBufferTail == s->port.txBufferHead;
-    pthread_mutex_unlock(&s->txLock);
+    const bool isEmpty = s->port.txBufferHead == __atomic_load_n(&s->port.txBufferTail, __ATOMIC_ACQUIRE);
+
+    if (!isEmpty) {
+        tcpTxPolled(s);
+    }
+
     return isEmpty;
 }
 
 uint8_t tcpRead(serialPort_t *instance)
 {
-    uint8_t ch;
     tcpPort_t *s = (tcpPort_t *)instance;
-    pthread_mutex_lock(&s->rxLock);
+    const uint32_t tail = s->port.rxBufferTail;
+    const uint8_t ch = s->port.rxBuffer[tail];
 
-    ch = s->port.rxBuffer[s->port.rxBufferTail];
-    if (s->port.rxBufferTail + 1 >= s->port.rxBufferSize) {
-        s->port.rxBufferTail = 0;
-    } else {
-        s->port.rxBufferTail++;
+    __atomic_store_n(&s->port.rxBufferTail, (tail + 1) % s->port.rxBufferSize, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&s->rxStalled, __ATOMIC_SEQ_CST)) {
+        reactorKick(&s->client);
     }
-    pthread_mutex_unlock(&s->rxLock);
 
     return ch;
 }
@@ -211,55 +375,39 @@ uint8_t tcpRead(serialPort_t *instance)
 void tcpWrite(serialPort_t *instance, uint8_t ch)
 {
     tcpPort_t *s = (tcpPort_t *)instance;
-    pthread_mutex_lock(&s->txLock);
 
-    s->port.txBuffer[s->port.txBufferHead] = ch;
-    if (s->port.txBufferHead + 1 >= s->port.txBufferSize) {
-        s->port.txBufferHead = 0;
-    } else {
-        s->port.txBufferHead++;
+    // like a UART with nothing on the other end, the byte is lost
+    if (!__atomic_load_n(&s->connected, __ATOMIC_ACQUIRE) || __atomic_load_n(&s->txStalled, __ATOMIC_ACQUIRE)) {
+        return;
     }
-    pthread_mutex_unlock(&s->txLock);
-
-    tcpDataOut(s);
-}
 
-void tcpDataOut(tcpPort_t *instance)
-{
-    tcpPort_t *s = (tcpPort_t *)instance;
-    if (s->conn == NULL) return;
-    pthread_mutex_lock(&s->txLock);
-
-    if (s->port.txBufferHead < s->port.txBufferTail) {
-        // send data till end of buffer
-        int chunk = s->port.txBufferSize - s->port.txBufferTail;
-        dyad_write(s->conn, (const void *)&s->port.txBuffer[s->port.txBufferTail], chunk);
-        s->port.txBufferTail = 0;
+    const uint32_t head = s->port.txBufferHead;
+    const uint32_t next = (head + 1) % s->port.txBufferSize;
+
+    if (next == __atomic_load_n(&s->port.txBufferTail, __ATOMIC_ACQUIRE)) {
+        // wait for the reactor to pass it on, as a UART would for the byte to go out
+        tcpKickNow(s);
+        uint32_t waitedUs = 0;
+        while (next == __atomic_load_n(&s->port.txBufferTail, __ATOMIC_ACQUIRE)) {
+            if (!__atomic_load_n(&s->connected, __ATOMIC_ACQUIRE)) {
+                return;
+            }
+            if (waitedUs >= TCP_TX_STALL_TIMEOUT_US) {
+                // rather than leave a gap in what the client gets, the reactor disconnects it and the rest is dropped
+                __atomic_store_n(&s->txStalled, true, __ATOMIC_RELEASE);
+                tcpKickNow(s);
+                return;
+            }
+            delayMicroseconds_real(TCP_TX_STALL_POLL_US);
+            waitedUs += TCP_TX_STALL_POLL_US;
+        }
     }
-    int chunk = s->port.txBufferHead - s->port.txBufferTail;
-    if (chunk)
-        dyad_write(s->conn, (const void*)&s->port.txBuffer[s->port.txBufferTail], chunk);
-    s->port.txBufferTail = s->port.txBufferHead;
 
-    pthread_mutex_unlock(&s->txLock);
-}
+    s->port.txBuffer[head] = ch;
+    __atomic_store_n(&s->port.txBufferHead, next, __ATOMIC_RELEASE);
+    s->txPolls = 0;
 
-void tcpDataIn(tcpPort_t *instance, uint8_t* ch, int size)
-{
-    tcpPort_t *s = (tcpPort_t *)instance;
-    pthread_mutex_lock(&s->rxLock);
-
-    while (size--) {
-//        printf("%c", *ch);
-        s->port.rxBuffer[s->port.rxBufferHead] = *(ch++);
-        if (s->port.rxBufferHead + 1 >= s->port.rxBufferSize) {
-            s->port.rxBufferHead = 0;
-        } else {
-            s->port.rxBufferHead++;
-        }
-    }
-    pthread_mutex_unlock(&s->rxLock);
-//    printf("\n");
+    reactorKick(&s->client);
 }
 
 static const struct serialPortVTable tcpVTable = {
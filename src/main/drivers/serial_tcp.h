@@ -20,33 +20,34 @@
 
 #pragma once
 
-#include <netinet/in.h>
-#include <pthread.h>
-#include "dyad.h"
+#include "target/SITL/reactor.h"
+
+#define TCP_BASE_PORT     5760    // UARTn listens on this + n by default
 
 #define RX_BUFFER_SIZE    1400
-#define TX_BUFFER_SIZE    1400
+#define TX_BUFFER_SIZE    16384
 
+/*
+ * The buffers are single producer, single consumer rings shared with the reactor thread: it fills rxBuffer and empties
+ * txBuffer, the FC loop does the opposite, and each side only moves its own end.
+ */
 typedef struct {
     serialPort_t port;
     uint8_t rxBuffer[RX_BUFFER_SIZE];
     uint8_t txBuffer[TX_BUFFER_SIZE];
 
-    dyad_Stream *serv;
-    dyad_Stream *conn;
-    pthread_mutex_t txLock;
-    pthread_mutex_t rxLock;
+    reactorSource_t listener;
+    reactorSource_t client;
     bool connected;
-    uint16_t clientCount;
+    bool rxStalled;         // the reactor stopped reading, rxBuffer being full
+    bool txBlocked;         // the reactor waits for the socket to take more
+    bool txStalled;         // the client stopped reading, so it is to be disconnected and writes are dropped
+    uint8_t txPolls;        // of a txBuffer with data waiting, since the last write
     uint8_t id;
 } tcpPort_t;
 
 serialPort_t *serTcpOpen(int id, serialReceiveCallbackPtr rxCallback, void *rxCallbackData, uint32_t baudRate, portMode_e mode, portOptions_e options);
 
-// tcpPort API
-void tcpDataIn(tcpPort_t *instance, uint8_t* ch, int size);
-void tcpDataOut(tcpPort_t *instance);
-
 bool tcpIsStart(void);
-bool* tcpGetUsed(void);
-tcpPort_t* tcpGetPool(void);
+bool tcpSetBasePort(unsigned port);
+uint16_t tcpGetBasePort(void);
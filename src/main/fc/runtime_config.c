@@ -59,6 +59,8 @@ const char *armingDisableFlagNames[]= {
     "DSHOT_BBANG",
     "NO_ACC_CAL",
     "MOTOR_PROTO",
+    "EEPROM_WRITE",
+    "CONFIG_RESTORE",
     "ARMSWITCH",
 };
 
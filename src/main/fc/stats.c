@@ -65,6 +65,14 @@ void statsInit(void)
     dispatchEnable();
 }
 
+static void statsSaved(bool success)
+{
+    UNUSED(success);
+
+    // Repeat disarming beep indicating the stats save is complete
+    beeper(BEEPER_DISARMING);
+}
+
 static void writeStats(dispatchEntry_t *self)
 {
     UNUSED(self);
@@ -78,9 +86,7 @@ static void writeStats(dispatchEntry_t *self)
                 fabsf(gyro.gyroADCf[FD_YAW]) < statsConfig()->statsSaveMoveLimit;
 
             if (gyroIsStill || statsConfig()->statsSaveMoveLimit == 0) {
-                writeEEPROM();
-                // Repeat disarming beep indicating the stats save is complete
-                beeper(BEEPER_DISARMING);
+                writeEEPROMInBackground(statsSaved);
             } else {
                 dispatchAdd(&writeStatsEntry, STATS_SAVE_DELAY_US);
             }
@@ -73,6 +73,7 @@
 // Hence to completely replace all 72 samples of the SDFT input buffer with clean new data takes 54ms.
 
 // The SDFT code is split into steps. It takes 4 PID loops to calculate the SDFT, track peaks and update the filters for one axis.
+// Windowing and peak detection share a single pass over the spectrum, which is split in two steps by bin range.
 // Since there are three axes, it takes 12 PID loops to completely update all axes.
 // At 8k, any one axis gets updated at 8000 / 12 or 666hz or every 1.5ms
 // In this time, 2 points in the SDFT buffer will have changed.
@@ -90,21 +91,14 @@
 
 typedef enum {
 
-    STEP_WINDOW,
-    STEP_DETECT_PEAKS,
+    STEP_DETECT_PEAKS_LOW,
+    STEP_DETECT_PEAKS_HIGH,
     STEP_CALC_FREQUENCIES,
     STEP_UPDATE_FILTERS,
     STEP_COUNT
 
 } step_e;
 
-typedef struct peak_s {
-
-    int bin;
-    float value;
-
-} peak_t;
-
 typedef struct state_s {
 
     // state machine step information
@@ -126,6 +120,7 @@ typedef struct dynNotch_s {
 
     timeUs_t looptimeUs;
     biquadFilter_t notch[XYZ_AXIS_COUNT][DYN_NOTCH_COUNT_MAX];
+    biquadCascade_t notchCascade[XYZ_AXIS_COUNT];
 
 } dynNotch_t;
 
@@ -142,16 +137,16 @@ static FAST_DATA_ZERO_INIT float sampleAccumulator[XYZ_AXIS_COUNT];
 static FAST_DATA_ZERO_INIT float sampleAvg[XYZ_AXIS_COUNT];
 
 // parameters for peak detection and frequency analysis
-static FAST_DATA_ZERO_INIT state_t state;
-static FAST_DATA_ZERO_INIT sdft_t  sdft[XYZ_AXIS_COUNT];
-static FAST_DATA_ZERO_INIT peak_t  peaks[DYN_NOTCH_COUNT_MAX];
-static FAST_DATA_ZERO_INIT float   sdftData[SDFT_BIN_COUNT];
-static FAST_DATA_ZERO_INIT float   sdftSampleRateHz;
-static FAST_DATA_ZERO_INIT float   sdftResolutionHz;
-static FAST_DATA_ZERO_INIT int     sdftStartBin;
-static FAST_DATA_ZERO_INIT int     sdftEndBin;
-static FAST_DATA_ZERO_INIT float   sdftNoiseThreshold;
-static FAST_DATA_ZERO_INIT float   pt1LooptimeS;
+static FAST_DATA_ZERO_INIT state_t    state;
+static FAST_DATA_ZERO_INIT sdft_t     sdft[XYZ_AXIS_COUNT];
+static FAST_DATA_ZERO_INIT sdftPeak_t peaks[DYN_NOTCH_COUNT_MAX];
+static FAST_DATA_ZERO_INIT float      sdftData[SDFT_BIN_COUNT];
+static FAST_DATA_ZERO_INIT float      sdftSampleRateHz;
+static FAST_DATA_ZERO_INIT float      sdftResolutionHz;
+static FAST_DATA_ZERO_INIT int        sdftStartBin;
+static FAST_DATA_ZERO_INIT int        sdftEndBin;
+static FAST_DATA_ZERO_INIT float      sdftNoiseThreshold;
+static FAST_DATA_ZERO_INIT float      pt1LooptimeS;
 
 
 void dynNotchInit(const dynNotchConfig_t *config, const timeUs_t targetLooptimeUs)
@@ -171,13 +166,19 @@ void dynNotchInit(const dynNotchConfig_t *config, const timeUs_t targetLooptimeU
     dynNotch.minHz = config->dyn_notch_min_hz;
     dynNotch.maxHz = MAX(dynNotch.minHz, config->dyn_notch_max_hz);
     dynNotch.maxHz = MIN(dynNotch.maxHz, nyquistHz); // Ensure to not go above the nyquist limit
-    dynNotch.count = config->dyn_notch_count;
+    dynNotch.count = MIN(config->dyn_notch_count, DYN_NOTCH_COUNT_MAX);
     dynNotch.looptimeUs = targetLooptimeUs;
     dynNotch.maxCenterFreq = 0;
 
     sampleCount = MAX(1, nyquistHz / dynNotch.maxHz); // maxHz = 600 & looprateHz = 8000 -> sampleCount = 6
     sampleCountRcp = 1.0f / sampleCount;
 
+    // restart accumulation, sampleIndex must never run past a (possibly smaller) new sampleCount
+    sampleIndex = 0;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        sampleAccumulator[axis] = 0.0f;
+    }
+
     sdftSampleRateHz = looprateHz / sampleCount;
     // eg 8k, user max 600hz, int(4000/600) = 6 (6.666), sdftSampleRateHz = 1333hz, range 666Hz
     // eg 4k, user max 600hz, int(2000/600) = 3 (3.333), sdftSampleRateHz = 1333hz, range 666Hz
@@ -201,6 +202,8 @@ void dynNotchInit(const dynNotchConfig_t *config, const timeUs_t targetLooptimeU
             dynNotch.centerFreq[axis][p] = (p + 0.5f) * (dynNotch.maxHz - dynNotch.minHz) / (float)dynNotch.count + dynNotch.minHz;
             biquadFilterInit(&dynNotch.notch[axis][p], dynNotch.centerFreq[axis][p], dynNotch.looptimeUs, dynNotch.q, FILTER_NOTCH, 1.0f);
         }
+        // the notch coefficients are updated in flight, which direct form 1 copes with
+        biquadCascadeInit(&dynNotch.notchCascade[axis], dynNotch.notch[axis], dynNotch.count, BIQUAD_FORM_DF1);
     }
 }
 
@@ -262,60 +265,20 @@ static FAST_CODE_NOINLINE void dynNotchProcess(void)
 
     switch (state.step) {
 
-        case STEP_WINDOW: // 4.1us (3-6us) @ F722
+        case STEP_DETECT_PEAKS_LOW:
         {
-            sdftWinSq(&sdft[state.axis], sdftData);
-
-            // Get total vibrational power in dyn notch range for noise floor estimate in STEP_CALC_FREQUENCIES
-            sdftNoiseThreshold = 0.0f;
-            for (int bin = sdftStartBin; bin <= sdftEndBin; bin++) {
-                sdftNoiseThreshold += sdftData[bin];  // sdftData contains power spectral density
-            }
+            // Window the lower half of the spectrum and search it for N biggest peaks in the same pass. The total vibrational
+            // power in dyn notch range is the starting point of the noise floor estimate in STEP_CALC_FREQUENCIES
+            sdftNoiseThreshold = sdftWinSqPeaksLow(&sdft[state.axis], sdftData, peaks, dynNotch.count);
 
             DEBUG_SET(DEBUG_FFT_TIME, 1, micros() - startTime);
 
             break;
         }
-        case STEP_DETECT_PEAKS: // 5.5us (4-7us) @ F722
+        case STEP_DETECT_PEAKS_HIGH:
         {
-            // Get memory ready for new peak data on current axis
-            for (int p = 0; p < dynNotch.count; p++) {
-                peaks[p].bin = 0;
-                peaks[p].value = 0.0f;
-            }
-
-            // Search for N biggest peaks in frequency spectrum
-            for (int bin = (sdftStartBin + 1); bin < sdftEndBin; bin++) {
-                // Check if bin is peak
-                if ((sdftData[bin] > sdftData[bin - 1]) && (sdftData[bin] > sdftData[bin + 1])) {
-                    // Check if peak is big enough to be one of N biggest peaks.
-                    // If so, insert peak and sort peaks in descending height order
-                    for (int p = 0; p < dynNotch.count; p++) {
-                        if (sdftData[bin] > peaks[p].value) {
-                            for (int k = dynNotch.count - 1; k > p; k--) {
-                                peaks[k] = peaks[k - 1];
-                            }
-                            peaks[p].bin = bin;
-                            peaks[p].value = sdftData[bin];
-                            break;
-                        }
-                    }
-                    bin++; // If bin is peak, next bin can't be peak => skip it
-                }
-            }
-
-            // Sort N biggest peaks in ascending bin order (example: 3, 8, 25, 0, 0, ..., 0)
-            for (int p = dynNotch.count - 1; p > 0; p--) {
-                for (int k = 0; k < p; k++) {
-                    // Swap peaks but ignore swapping void peaks (bin = 0). This leaves
-                    // void peaks at the end of peaks array without moving them
-                    if (peaks[k].bin > peaks[k + 1].bin && peaks[k + 1].bin != 0) {
-                        peak_t temp = peaks[k];
-                        peaks[k] = peaks[k + 1];
-                        peaks[k + 1] = temp;
-                    }
-                }
-            }
+            // Same for the upper half, then sort the peaks in ascending bin order
+            sdftNoiseThreshold = sdftWinSqPeaksHigh(&sdft[state.axis], sdftData, peaks, dynNotch.count, sdftNoiseThreshold);
 
             DEBUG_SET(DEBUG_FFT_TIME, 1, micros() - startTime);
 
@@ -375,7 +338,7 @@ static FAST_CODE_NOINLINE void dynNotchProcess(void)
             }
 
             if (state.axis == gyro.gyroDebugAxis) {
-                for (int p = 0; p < dynNotch.count && p < DYN_NOTCH_COUNT_MAX; p++) {
+                for (int p = 0; p < dynNotch.count && p + 1 < DEBUG16_VALUE_COUNT; p++) {
                     // debug channel 0 is reserved for pre DN gyro
                     DEBUG_SET(DEBUG_FFT_FREQ, p + 1, lrintf(dynNotch.centerFreq[state.axis][p]));
                 }
@@ -406,11 +369,7 @@ static FAST_CODE_NOINLINE void dynNotchProcess(void)
 
 FAST_CODE float dynNotchFilter(const int axis, float value)
 {
-    for (int p = 0; p < dynNotch.count; p++) {
-        value = biquadFilterApplyDF1(&dynNotch.notch[axis][p], value);
-    }
-
-    return value;
+    return biquadCascadeApply(&dynNotch.notchCascade[axis], value);
 }
 
 bool isDynNotchActive(void)
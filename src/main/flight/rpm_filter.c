@@ -20,6 +20,7 @@
 
 
 #include <math.h>
+#include <string.h>
 
 #include "platform.h"
 
@@ -45,10 +46,21 @@
 
 #define RPM_FILTER_DURATION_S    0.001f  // Maximum duration allowed to update all RPM notches once
 
+#define RPM_FILTER_NOTCH_MAX     (MAX_SUPPORTED_MOTORS * RPM_FILTER_HARMONICS_MAX)
+#define RPM_FILTER_AXIS_LANES    4       // XYZ_AXIS_COUNT rounded up to a whole vector of floats
+
+// DF1 state of one notch, with the axes side by side so that they can be filtered as one vector
+typedef struct rpmNotchState_s {
+    float x1[RPM_FILTER_AXIS_LANES];
+    float x2[RPM_FILTER_AXIS_LANES];
+    float y1[RPM_FILTER_AXIS_LANES];
+    float y2[RPM_FILTER_AXIS_LANES];
+} rpmNotchState_t;
 
 typedef struct rpmFilter_s {
 
-    int numHarmonics;
+    int numHarmonics;                           // harmonics with a non-zero weight
+    int harmonics[RPM_FILTER_HARMONICS_MAX];    // which harmonic each of them is, 0 being the fundamental
     float weights[RPM_FILTER_HARMONICS_MAX];
     float minHz;
     float maxHz;
@@ -56,7 +68,18 @@ typedef struct rpmFilter_s {
     float q;
 
     timeUs_t looptimeUs;
-    biquadFilter_t notch[XYZ_AXIS_COUNT][MAX_SUPPORTED_MOTORS][RPM_FILTER_HARMONICS_MAX];
+
+    // notch bank, notch n filters harmonics[n / numMotors] of motor n % numMotors
+    // the coefficients are shared by all axes
+    int numMotors;
+    int numNotches;
+    float b0[RPM_FILTER_NOTCH_MAX];
+    float b1[RPM_FILTER_NOTCH_MAX];
+    float b2[RPM_FILTER_NOTCH_MAX];
+    float a1[RPM_FILTER_NOTCH_MAX];
+    float a2[RPM_FILTER_NOTCH_MAX];
+    float weight[RPM_FILTER_NOTCH_MAX];
+    rpmNotchState_t state[RPM_FILTER_NOTCH_MAX];
 
 } rpmFilter_t;
 
@@ -68,11 +91,22 @@ FAST_DATA_ZERO_INIT static int notchUpdatesPerIteration;
 FAST_DATA_ZERO_INIT static int motorIndex;
 FAST_DATA_ZERO_INIT static int harmonicIndex;
 
+static void rpmNotchSetCoefficients(const int notch, const biquadFilter_t *filter)
+{
+    rpmFilter.b0[notch] = filter->b0;
+    rpmFilter.b1[notch] = filter->b1;
+    rpmFilter.b2[notch] = filter->b2;
+    rpmFilter.a1[notch] = filter->a1;
+    rpmFilter.a2[notch] = filter->a2;
+    rpmFilter.weight[notch] = filter->weight;
+}
+
 void rpmFilterInit(const rpmFilterConfig_t *config, const timeUs_t looptimeUs)
 {
     motorIndex = 0;
     harmonicIndex = 0;
     rpmFilter.numHarmonics = 0; // disable RPM Filtering
+    rpmFilter.numNotches = 0;
 
     // if bidirectional DShot is not available
     if (!useDshotTelemetry) {
@@ -85,7 +119,6 @@ void rpmFilterInit(const rpmFilterConfig_t *config, const timeUs_t looptimeUs)
     }
 
     // if we get to this point, enable and init RPM filtering
-    rpmFilter.numHarmonics = config->rpm_filter_harmonics;
     rpmFilter.minHz = config->rpm_filter_min_hz;
     rpmFilter.maxHz = 0.48f * 1e6f / looptimeUs; // don't go quite to nyquist to avoid oscillations
     rpmFilter.fadeRangeHz = config->rpm_filter_fade_range_hz;
@@ -96,17 +129,29 @@ void rpmFilterInit(const rpmFilterConfig_t *config, const timeUs_t looptimeUs)
         rpmFilter.weights[n] = constrainf(config->rpm_filter_weights[n] / 100.0f, 0.0f, 1.0f);
     }
 
-    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-        for (int motor = 0; motor < getMotorCount(); motor++) {
-            for (int i = 0; i < rpmFilter.numHarmonics; i++) {
-                biquadFilterInit(&rpmFilter.notch[axis][motor][i], rpmFilter.minHz * i, rpmFilter.looptimeUs, rpmFilter.q, FILTER_NOTCH, 0.0f);
-            }
+    // only harmonics which have an effect on filtered output get notches
+    for (int n = 0; n < config->rpm_filter_harmonics && n < RPM_FILTER_HARMONICS_MAX; n++) {
+        if (rpmFilter.weights[n] > 0.0f) {
+            rpmFilter.harmonics[rpmFilter.numHarmonics++] = n;
         }
     }
 
+    if (!rpmFilter.numHarmonics) {
+        return;
+    }
+
+    rpmFilter.numMotors = getMotorCount();
+    rpmFilter.numNotches = rpmFilter.numMotors * rpmFilter.numHarmonics;
+
+    for (int notch = 0; notch < rpmFilter.numNotches; notch++) {
+        biquadFilter_t filter;
+        biquadFilterInit(&filter, rpmFilter.minHz * rpmFilter.harmonics[notch / rpmFilter.numMotors], rpmFilter.looptimeUs, rpmFilter.q, FILTER_NOTCH, 0.0f);
+        rpmNotchSetCoefficients(notch, &filter);
+    }
+    memset(rpmFilter.state, 0, sizeof(rpmFilter.state));
+
     const float loopIterationsPerUpdate = RPM_FILTER_DURATION_S / (looptimeUs * 1e-6f);
-    const float numNotchesPerAxis = getMotorCount() * rpmFilter.numHarmonics;
-    notchUpdatesPerIteration = ceilf(numNotchesPerAxis / loopIterationsPerUpdate); // round to ceiling
+    notchUpdatesPerIteration = ceilf(rpmFilter.numNotches / loopIterationsPerUpdate); // round to ceiling
 }
 
 FAST_CODE_NOINLINE void rpmFilterUpdate(void)
@@ -126,63 +171,68 @@ FAST_CODE_NOINLINE void rpmFilterUpdate(void)
     // update RPM notches
     for (int i = 0; i < notchUpdatesPerIteration; i++) {
 
-        // Only bother updating notches which have an effect on filtered output
-        if (rpmFilter.weights[harmonicIndex] > 0.0f) {
-
-            // select current notch on ROLL
-            biquadFilter_t *template = &rpmFilter.notch[0][motorIndex][harmonicIndex];
-
-            const float frequencyHz = constrainf((harmonicIndex + 1) * getMotorFrequencyHz(motorIndex), rpmFilter.minHz, rpmFilter.maxHz);
-            const float marginHz = frequencyHz - rpmFilter.minHz;
-            float weight = 1.0f;
-
-            // fade out notch when approaching minHz (turn it off)
-            if (marginHz < rpmFilter.fadeRangeHz) {
-                weight *= marginHz / rpmFilter.fadeRangeHz;
-            }
-
-            // attenuate notches per harmonics group
-            weight *= rpmFilter.weights[harmonicIndex];
-
-            // update notch
-            biquadFilterUpdate(template, frequencyHz, rpmFilter.looptimeUs, rpmFilter.q, FILTER_NOTCH, weight);
-
-            // copy notch properties to corresponding notches on PITCH and YAW
-            for (int axis = 1; axis < XYZ_AXIS_COUNT; axis++) {
-                biquadFilter_t *dest = &rpmFilter.notch[axis][motorIndex][harmonicIndex];
-                dest->b0 = template->b0;
-                dest->b1 = template->b1;
-                dest->b2 = template->b2;
-                dest->a1 = template->a1;
-                dest->a2 = template->a2;
-                dest->weight = template->weight;
-            }
+        const int harmonic = rpmFilter.harmonics[harmonicIndex];
+        const float frequencyHz = constrainf((harmonic + 1) * getMotorFrequencyHz(motorIndex), rpmFilter.minHz, rpmFilter.maxHz);
+        const float marginHz = frequencyHz - rpmFilter.minHz;
+        float weight = 1.0f;
+
+        // fade out notch when approaching minHz (turn it off)
+        if (marginHz < rpmFilter.fadeRangeHz) {
+            weight *= marginHz / rpmFilter.fadeRangeHz;
         }
 
-        // cycle through all notches on ROLL (takes RPM_FILTER_DURATION_S at max.)
+        // attenuate notches per harmonics group
+        weight *= rpmFilter.weights[harmonic];
+
+        // update notch, the coefficients are used for all axes
+        biquadFilter_t filter;
+        biquadFilterUpdate(&filter, frequencyHz, rpmFilter.looptimeUs, rpmFilter.q, FILTER_NOTCH, weight);
+        rpmNotchSetCoefficients(harmonicIndex * rpmFilter.numMotors + motorIndex, &filter);
+
+        // cycle through all notches (takes RPM_FILTER_DURATION_S at max.)
         harmonicIndex = (harmonicIndex + 1) % rpmFilter.numHarmonics;
         if (harmonicIndex == 0) {
-            motorIndex = (motorIndex + 1) % getMotorCount();
+            motorIndex = (motorIndex + 1) % rpmFilter.numMotors;
         }
     }
 }
 
-FAST_CODE float rpmFilterApply(const int axis, float value)
+FAST_CODE void rpmFilterApply(float gyroADCf[XYZ_AXIS_COUNT])
 {
-    // Iterate over all notches on axis and apply each one to value.
-    // Order of application doesn't matter because biquads are linear time-invariant filters.
-    for (int i = 0; i < rpmFilter.numHarmonics; i++) {
-
-        if (rpmFilter.weights[i] <= 0.0f) {
-            continue;  // skip harmonics which have no effect on filtered output
-        }
+    float value[RPM_FILTER_AXIS_LANES] = { 0 };
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        value[axis] = gyroADCf[axis];
+    }
 
-        for (int motor = 0; motor < getMotorCount(); motor++) {
-            value = biquadFilterApplyDF1Weighted(&rpmFilter.notch[axis][motor][i], value);
+    // Iterate over all notches and apply each one to all axes, as biquadFilterApplyDF1Weighted() would.
+    // Order of application doesn't matter because biquads are linear time-invariant filters.
+    // The lanes are independent so the inner loop can be vectorised.
+    for (int notch = 0; notch < rpmFilter.numNotches; notch++) {
+        const float b0 = rpmFilter.b0[notch];
+        const float b1 = rpmFilter.b1[notch];
+        const float b2 = rpmFilter.b2[notch];
+        const float a1 = rpmFilter.a1[notch];
+        const float a2 = rpmFilter.a2[notch];
+        const float weight = rpmFilter.weight[notch];
+        rpmNotchState_t *state = &rpmFilter.state[notch];
+
+        for (int lane = 0; lane < RPM_FILTER_AXIS_LANES; lane++) {
+            const float input = value[lane];
+            const float result = b0 * input + b1 * state->x1[lane] + b2 * state->x2[lane] - a1 * state->y1[lane] - a2 * state->y2[lane];
+
+            state->x2[lane] = state->x1[lane];
+            state->x1[lane] = input;
+            state->y2[lane] = state->y1[lane];
+            state->y1[lane] = result;
+
+            // crossfading of input and output to turn notch on/off gradually
+            value[lane] = weight * result + (1 - weight) * input;
         }
     }
 
-    return value;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        gyroADCf[axis] = value[axis];
+    }
 }
 
 bool isRpmFilterEnabled(void)
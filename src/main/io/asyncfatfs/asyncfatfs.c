@@ -60,7 +60,17 @@
     #define ONLY_EXPOSE_FOR_TESTING static
 #endif
 
+/*
+ * Blackbox logging streams through this cache, so a deeper cache rides out longer card busy periods (and gives the
+ * flush more consecutive sectors to send as one multi-block write) on the targets that have the RAM for it.
+ */
+#ifndef AFATFS_NUM_CACHE_SECTORS
+#if defined(STM32F7) || defined(STM32H7) || defined(SIMULATOR_BUILD)
+#define AFATFS_NUM_CACHE_SECTORS 24
+#else
 #define AFATFS_NUM_CACHE_SECTORS 11
+#endif
+#endif
 
 // FAT filesystems are allowed to differ from these parameters, but we choose not to support those weird filesystems:
 #define AFATFS_SECTOR_SIZE  512
@@ -77,6 +87,12 @@
  */
 #define AFATFS_MIN_MULTIPLE_BLOCK_WRITE_COUNT 4
 
+/*
+ * How many sectors continuing a multiple block write may be flushed ahead of an older dirty sector (typically a FAT or
+ * directory sector) before that one gets its turn.
+ */
+#define AFATFS_MAX_STREAMED_SECTORS_AHEAD 16
+
 #define AFATFS_FILES_PER_DIRECTORY_SECTOR (AFATFS_SECTOR_SIZE / sizeof(fatDirectoryEntry_t))
 
 #define AFATFS_FAT32_FAT_ENTRIES_PER_SECTOR  (AFATFS_SECTOR_SIZE / sizeof(uint32_t))
@@ -469,6 +485,14 @@ typedef struct afatfs_t {
 
     int cacheDirtyEntries; // The number of cache entries in the AFATFS_CACHE_STATE_DIRTY state
     bool cacheFlushInProgress;
+    /*
+     * The sector following the last one we sent to the card. Flushing that one next lets a multi-block write in
+     * progress carry on instead of being terminated by a write somewhere else. Zero (the MBR, which we never write)
+     * when there is no such sector.
+     */
+    uint32_t cacheFlushNextSector;
+    // Sectors flushed in a row as above while an older dirty sector waited
+    uint8_t cacheFlushStreamedAhead;
 
     afatfsFile_t openFiles[AFATFS_MAX_OPEN_FILES];
 
@@ -694,6 +718,7 @@ static void afatfs_sdcardWriteComplete(sdcardBlockOperation_e operation, uint32_
                 // Write failed, remark the sector as dirty
                 afatfs.cacheDescriptor[i].state = AFATFS_CACHE_STATE_DIRTY;
                 afatfs.cacheDirtyEntries++;
+                afatfs.cacheFlushNextSector = 0;
             } else {
                 afatfs_assert(afatfs_cacheSectorGetMemory(i) == buffer);
 
@@ -704,16 +729,57 @@ static void afatfs_sdcardWriteComplete(sdcardBlockOperation_e operation, uint32_
     }
 }
 
+#ifdef AFATFS_MIN_MULTIPLE_BLOCK_WRITE_COUNT
+/**
+ * Count the dirty, flushable sectors in the cache which follow on from the given one on disk (including it), stopping
+ * at the first gap.
+ */
+static uint32_t afatfs_cacheDirtyRunLength(uint32_t sectorIndex)
+{
+    uint32_t runLength = 0;
+    bool found;
+
+    do {
+        found = false;
+
+        for (int i = 0; i < AFATFS_NUM_CACHE_SECTORS; i++) {
+            if (afatfs.cacheDescriptor[i].sectorIndex == sectorIndex + runLength
+                && afatfs.cacheDescriptor[i].state == AFATFS_CACHE_STATE_DIRTY && !afatfs.cacheDescriptor[i].locked
+            ) {
+                runLength++;
+                found = true;
+                break;
+            }
+        }
+    } while (found);
+
+    return runLength;
+}
+#endif
+
 /**
  * Attempt to flush the dirty cache entry with the given index to the SDcard.
+ *
+ * Returns true if the card accepted the sector straight away, so the caller may go on to flush another one.
  */
-static void afatfs_cacheFlushSector(int cacheIndex)
+static bool afatfs_cacheFlushSector(int cacheIndex)
 {
     afatfsCacheBlockDescriptor_t *cacheDescriptor = &afatfs.cacheDescriptor[cacheIndex];
 
 #ifdef AFATFS_MIN_MULTIPLE_BLOCK_WRITE_COUNT
     if (cacheDescriptor->consecutiveEraseBlockCount) {
         sdcard_beginWriteBlocks(cacheDescriptor->sectorIndex, cacheDescriptor->consecutiveEraseBlockCount);
+    } else {
+        /*
+         * Nobody told us this sector starts a consecutive series, but if the following sectors are already waiting in
+         * the cache we can send them all with one multi-block write rather than a command per sector (if that write is
+         * already underway, the card just carries on with it).
+         */
+        uint32_t runLength = afatfs_cacheDirtyRunLength(cacheDescriptor->sectorIndex);
+
+        if (runLength >= AFATFS_MIN_MULTIPLE_BLOCK_WRITE_COUNT) {
+            sdcard_beginWriteBlocks(cacheDescriptor->sectorIndex, runLength);
+        }
     }
 #endif
 
@@ -721,20 +787,22 @@ static void afatfs_cacheFlushSector(int cacheIndex)
         case SDCARD_OPERATION_IN_PROGRESS:
             // The card will call us back later when the buffer transmission finishes
             afatfs.cacheDirtyEntries--;
+            afatfs.cacheFlushNextSector = cacheDescriptor->sectorIndex + 1;
             cacheDescriptor->state = AFATFS_CACHE_STATE_WRITING;
             afatfs.cacheFlushInProgress = true;
-            break;
+            return false;
 
         case SDCARD_OPERATION_SUCCESS:
             // Buffer is already transmitted
             afatfs.cacheDirtyEntries--;
+            afatfs.cacheFlushNextSector = cacheDescriptor->sectorIndex + 1;
             cacheDescriptor->state = AFATFS_CACHE_STATE_IN_SYNC;
-            break;
+            return true;
 
         case SDCARD_OPERATION_BUSY:
         case SDCARD_OPERATION_FAILURE:
         default:
-            ;
+            return false;
     }
 }
 
@@ -852,23 +920,45 @@ static int afatfs_allocateCacheSector(uint32_t sectorIndex)
  */
 bool afatfs_flush(void)
 {
-    if (afatfs.cacheDirtyEntries > 0) {
-        // Flush the oldest flushable sector
+    while (afatfs.cacheDirtyEntries > 0) {
+        /*
+         * Flush the oldest flushable sector, unless one of them continues the run of sectors we've been writing. Taking
+         * that one first keeps a multi-block write streaming instead of ending it for a sector elsewhere on the disk,
+         * but only for so long, so that FAT and directory sectors still reach the disk while we log.
+         */
         uint32_t earliestSectorTime = 0xFFFFFFFF;
         int earliestSectorIndex = -1;
+        int nextSectorIndex = -1;
 
         for (int i = 0; i < AFATFS_NUM_CACHE_SECTORS; i++) {
-            if (afatfs.cacheDescriptor[i].state == AFATFS_CACHE_STATE_DIRTY && !afatfs.cacheDescriptor[i].locked
-                && (earliestSectorIndex == -1 || afatfs.cacheDescriptor[i].writeTimestamp < earliestSectorTime)
-            ) {
-                earliestSectorIndex = i;
-                earliestSectorTime = afatfs.cacheDescriptor[i].writeTimestamp;
+            if (afatfs.cacheDescriptor[i].state == AFATFS_CACHE_STATE_DIRTY && !afatfs.cacheDescriptor[i].locked) {
+                if (afatfs.cacheDescriptor[i].sectorIndex == afatfs.cacheFlushNextSector) {
+                    nextSectorIndex = i;
+                }
+
+                if (earliestSectorIndex == -1 || afatfs.cacheDescriptor[i].writeTimestamp < earliestSectorTime) {
+                    earliestSectorIndex = i;
+                    earliestSectorTime = afatfs.cacheDescriptor[i].writeTimestamp;
+                }
             }
         }
 
-        if (earliestSectorIndex > -1) {
-            afatfs_cacheFlushSector(earliestSectorIndex);
+        if (earliestSectorIndex == -1) {
+            break;
+        }
+
+        const bool streamAhead = nextSectorIndex != -1 && nextSectorIndex != earliestSectorIndex
+            && afatfs.cacheFlushStreamedAhead < AFATFS_MAX_STREAMED_SECTORS_AHEAD;
+        const int flushIndex = streamAhead ? nextSectorIndex : earliestSectorIndex;
+
+        const bool accepted = afatfs_cacheFlushSector(flushIndex);
 
+        if (afatfs.cacheDescriptor[flushIndex].state != AFATFS_CACHE_STATE_DIRTY) {
+            // The card took the sector
+            afatfs.cacheFlushStreamedAhead = streamAhead ? afatfs.cacheFlushStreamedAhead + 1 : 0;
+        }
+
+        if (!accepted) {
             // That flush will take time to complete so we may as well tell caller to come back later
             return false;
         }
@@ -937,7 +1027,8 @@ static void afatfs_fileGetCursorClusterAndSector(afatfsFilePtr_t file, uint32_t
  *     AFATFS_OPERATION_IN_PROGRESS - Card is busy, call again later
  *     AFATFS_OPERATION_FAILURE     - When the filesystem encounters a fatal error
  */
-static afatfsOperationStatus_e afatfs_cacheSector(uint32_t physicalSectorIndex, uint8_t **buffer, uint8_t sectorFlags, uint32_t eraseCount)
+ONLY_EXPOSE_FOR_TESTING
+afatfsOperationStatus_e afatfs_cacheSector(uint32_t physicalSectorIndex, uint8_t **buffer, uint8_t sectorFlags, uint32_t eraseCount)
 {
     // We never write to the MBR, so any attempt to write there is an asyncfatfs bug
     if (!afatfs_assert((sectorFlags & AFATFS_CACHE_WRITE) == 0 || physicalSectorIndex != 0)) {
@@ -28,6 +28,10 @@
  * Note that bits can only be set to 0 when writing, not back to 1 from 0. You must erase sectors in order
  * to bring bits back to 1 again.
  *
+ * With flash_ring_erase_ahead set, the volume is used as a ring instead: flashfsEraseAhead() keeps that many
+ * sectors erased ahead of the file pointer, which wraps to the start of the volume at the end, so the oldest
+ * data is overwritten and logging can start without erasing the chip first.
+ *
  * In future, we can add support for multiple different flash chips by adding a flash device driver vtable
  * and make calls through that, at the moment flashfs just calls m25p16_* routines explicitly.
  */
@@ -41,11 +45,14 @@
 #if defined(USE_FLASHFS)
 
 #include "build/debug.h"
+#include "common/maths.h"
 #include "common/printf.h"
+#include "common/utils.h"
 #include "drivers/flash/flash.h"
 #include "drivers/light_led.h"
 
 #include "io/flashfs.h"
+#include "io/flashfs_index.h"
 
 typedef enum {
     FLASHFS_IDLE,
@@ -57,6 +64,7 @@ static const flashGeometry_t *flashGeometry = NULL;
 static uint32_t flashfsSize = 0;
 static flashfsState_e flashfsState = FLASHFS_IDLE;
 static flashSector_t eraseSectorCurrent = 0;
+static flashSector_t eraseSectorEnd = 0;
 
 static DMA_DATA_ZERO_INIT uint8_t flashWriteBuffer[FLASHFS_WRITE_BUFFER_SIZE];
 
@@ -97,6 +105,106 @@ uint32_t checkFlashErrors = 0;
 // The position of the buffer's tail in the overall flash address space:
 static uint32_t tailAddress = 0;
 
+// Ring mode: bytes kept erased ahead of the tail, 0 in linear mode
+static uint32_t ringEraseAheadSize = 0;
+// and the end of the erased space ahead of the tail
+static uint32_t ringEraseHead = 0;
+
+/*
+ * Sequential reads, as made downloading a log over MSP or USB MSC, are served from two read-ahead buffers which each
+ * hold an aligned chunk of the volume. While one is copied out, the chunk after it is fetched into the other in the
+ * background on devices which can do so. Without USE_FLASHFS_READ_AHEAD every read goes to the flash.
+ */
+#ifdef USE_FLASHFS_READ_AHEAD
+
+#ifndef FLASHFS_READ_AHEAD_SIZE
+#define FLASHFS_READ_AHEAD_SIZE 1024
+#endif
+#define FLASHFS_READ_AHEAD_COUNT 2
+
+typedef enum {
+    FLASHFS_READ_AHEAD_EMPTY,
+    FLASHFS_READ_AHEAD_PENDING,
+    FLASHFS_READ_AHEAD_VALID,
+} flashfsReadAheadState_e;
+
+typedef struct flashfsReadAhead_s {
+    uint32_t address;
+    uint32_t length;
+    volatile flashfsReadAheadState_e state;
+} flashfsReadAhead_t;
+
+static DMA_DATA_ZERO_INIT uint8_t flashReadAheadBuffer[FLASHFS_READ_AHEAD_COUNT][FLASHFS_READ_AHEAD_SIZE];
+static flashfsReadAhead_t readAhead[FLASHFS_READ_AHEAD_COUNT];
+static volatile uint8_t readAheadFetching;  // index of the buffer the last fetch was into
+static uint32_t readAheadNextAddress;       // where a sequential read would continue from
+
+// Called in ISR context on devices which read in the background
+static void flashfsReadAheadCallback(uint32_t length)
+{
+    flashfsReadAhead_t *chunk = &readAhead[readAheadFetching];
+
+    if (chunk->state == FLASHFS_READ_AHEAD_PENDING) {
+        chunk->length = length;
+        chunk->state = FLASHFS_READ_AHEAD_VALID;
+    }
+}
+
+static void flashfsReadAheadWait(void)
+{
+    while (readAhead[readAheadFetching].state == FLASHFS_READ_AHEAD_PENDING) {
+        flashWaitForReady();
+    }
+}
+
+// Drop the read-ahead before the flash is changed
+static void flashfsReadAheadInvalidate(void)
+{
+    flashfsReadAheadWait();
+
+    for (int i = 0; i < FLASHFS_READ_AHEAD_COUNT; i++) {
+        readAhead[i].state = FLASHFS_READ_AHEAD_EMPTY;
+    }
+}
+
+static flashfsReadAhead_t *flashfsReadAheadFind(uint32_t chunkAddress)
+{
+    for (int i = 0; i < FLASHFS_READ_AHEAD_COUNT; i++) {
+        if (readAhead[i].state != FLASHFS_READ_AHEAD_EMPTY && readAhead[i].address == chunkAddress) {
+            return &readAhead[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Start fetching the chunk at chunkAddress into the buffer not holding the chunk at keepAddress
+static void flashfsReadAheadFetch(uint32_t chunkAddress, uint32_t keepAddress)
+{
+    flashfsReadAheadWait();
+
+    uint8_t index = 0;
+    while (index < FLASHFS_READ_AHEAD_COUNT - 1 && readAhead[index].state != FLASHFS_READ_AHEAD_EMPTY && readAhead[index].address == keepAddress) {
+        index++;
+    }
+
+    flashfsReadAhead_t *chunk = &readAhead[index];
+    chunk->address = chunkAddress;
+    chunk->length = 0;
+    chunk->state = FLASHFS_READ_AHEAD_PENDING;
+    readAheadFetching = index;
+
+    flashReadBytesBegin(chunkAddress, flashReadAheadBuffer[index], MIN(flashfsSize - chunkAddress, (uint32_t)FLASHFS_READ_AHEAD_SIZE), flashfsReadAheadCallback);
+}
+
+#else
+
+static void flashfsReadAheadInvalidate(void)
+{
+}
+
+#endif // USE_FLASHFS_READ_AHEAD
+
 static void flashfsClearBuffer(void)
 {
     bufferTail = bufferHead = 0;
@@ -109,19 +217,57 @@ static bool flashfsBufferIsEmpty(void)
 
 static void flashfsSetTailAddress(uint32_t address)
 {
+    if (ringEraseAheadSize && address >= flashfsSize) {
+        address -= flashfsSize;
+    }
+
     tailAddress = address;
 }
 
+static uint32_t flashfsRingErasedSpace(void)
+{
+    return ringEraseHead >= tailAddress ? ringEraseHead - tailAddress : ringEraseHead + flashfsSize - tailAddress;
+}
+
+static void flashfsEraseDone(void)
+{
+#ifdef USE_FLASHFS_INDEX
+    // The index describes a linear volume only
+    if (!ringEraseAheadSize) {
+        flashfsIndexFormat();
+    }
+#endif
+}
+
 void flashfsEraseCompletely(void)
 {
+    flashfsReadAheadInvalidate();
+
     if (flashGeometry->sectors > 0 && flashPartitionCount() > 0) {
-        // if there's a single FLASHFS partition and it uses the entire flash then do a full erase
-        const bool doFullErase = (flashPartitionCount() == 1) && (FLASH_PARTITION_SECTOR_COUNT(flashPartition) == flashGeometry->sectors);
+        flashSector_t endSector = flashPartition->endSector;
+        int partitionCount = 1;
+
+#ifdef USE_FLASHFS_INDEX
+        flashfsIndexInvalidate();
+
+        // The index is erased with the volume, which gives up any index sectors it held logs in, see flashfsInit()
+        const flashPartition_t *indexPartition = flashPartitionFindByType(FLASH_PARTITION_TYPE_FLASHFS_INDEX);
+        if (indexPartition) {
+            endSector = MAX(endSector, indexPartition->endSector);
+            partitionCount++;
+        }
+        flashfsSize = FLASH_PARTITION_SECTOR_COUNT(flashPartition) * flashGeometry->sectorSize;
+#endif
+
+        // if the FLASHFS partition, and its index, use the entire flash then do a full erase
+        const bool doFullErase = (flashPartitionCount() == partitionCount) && (flashPartition->startSector == 0) && (endSector + 1 == flashGeometry->sectors);
         if (doFullErase) {
             flashEraseCompletely();
+            flashfsEraseDone();
         } else {
             // start asynchronous erase of all sectors
             eraseSectorCurrent = flashPartition->startSector;
+            eraseSectorEnd = endSector;
             flashfsState = FLASHFS_ERASING;
         }
     }
@@ -129,6 +275,9 @@ void flashfsEraseCompletely(void)
     flashfsClearBuffer();
 
     flashfsSetTailAddress(0);
+
+    // The whole volume will be erased by the time it is written to
+    ringEraseHead = ringEraseAheadSize;
 }
 
 /**
@@ -151,6 +300,8 @@ void flashfsEraseRange(uint32_t start, uint32_t end)
         endSector++;
     }
 
+    flashfsReadAheadInvalidate();
+
     for (int sectorIndex = startSector; sectorIndex < endSector; sectorIndex++) {
         uint32_t sectorAddress = sectorIndex * flashGeometry->sectorSize;
         flashEraseSector(sectorAddress);
@@ -251,6 +402,15 @@ static uint32_t flashfsWriteBuffers(uint8_t const **buffers, uint32_t *bufferSiz
 
     // It's OK to overwrite the buffer addresses/lengths being passed in
 
+#ifdef USE_FLASHFS_INDEX
+    // Queued index records go ahead of the data
+    if (sync) {
+        while (!flashfsIndexFlushAsync());
+    } else if (!flashfsIndexFlushAsync()) {
+        return 0;
+    }
+#endif
+
     // If sync is true, block until the FLASH device is ready, otherwise return 0 if the device isn't ready
     if (sync) {
         while (!flashIsReady());
@@ -260,11 +420,13 @@ static uint32_t flashfsWriteBuffers(uint8_t const **buffers, uint32_t *bufferSiz
         }
     }
 
-    // Are we at EOF already? Abort.
-    if (flashfsIsEOF()) {
+    // Are we at EOF already, or out of erased space in ring mode? Abort.
+    if (flashfsIsEOF() || (ringEraseAheadSize && flashfsRingErasedSpace() == 0)) {
         return 0;
     }
 
+    flashfsReadAheadInvalidate();
+
 #ifdef CHECK_FLASH
     checkFlashPtr = tailAddress;
 #endif
@@ -337,7 +499,10 @@ uint32_t flashfsGetOffset(void)
 
     flashfsGetDirtyDataBuffers(buffers, bufferSizes);
 
-    return tailAddress + bufferSizes[0] + bufferSizes[1];
+    const uint32_t offset = tailAddress + bufferSizes[0] + bufferSizes[1];
+
+    // In ring mode the buffered data may wrap to the start of the volume
+    return (ringEraseAheadSize && offset >= flashfsSize) ? offset - flashfsSize : offset;
 }
 
 /**
@@ -416,19 +581,61 @@ void flashfsEraseAsync(void)
 {
     if (flashfsState == FLASHFS_ERASING) {
         if ((flashfsIsSupported() && flashIsReady())) {
-            if (eraseSectorCurrent <= flashPartition->endSector) {
+            if (eraseSectorCurrent <= eraseSectorEnd) {
                 // Erase sector
                 uint32_t sectorAddress = eraseSectorCurrent * flashGeometry->sectorSize;
+                flashfsReadAheadInvalidate();
                 flashEraseSector(sectorAddress);
                 eraseSectorCurrent++;
                 LED1_TOGGLE;
             } else {
                 // Done erasing
                 flashfsState = FLASHFS_IDLE;
+                flashfsEraseDone();
                 LED1_OFF;
             }
         }
     }
+#ifdef USE_FLASHFS_INDEX
+    else if (flashfsNewData()) {
+        // Between writes of the log stream, so queued index records can go in
+        flashfsIndexFlushAsync();
+    }
+#endif
+}
+
+/**
+ * In ring mode, erase the next sector ahead of the file pointer while fewer than flash_ring_erase_ahead sectors are
+ * erased, overwriting the oldest data. Call regularly while writing.
+ *
+ * A sector erase keeps the flash busy for milliseconds, so one is only started while the write buffer is empty,
+ * unless the file pointer is about to run out of erased space. Once the distance is erased, a sector is erased for
+ * every sector written, so writes don't have to wait for erases.
+ *
+ * Returns true when the distance is erased, always true in linear mode.
+ */
+bool flashfsEraseAhead(void)
+{
+    if (!ringEraseAheadSize) {
+        return true;
+    }
+
+    const uint32_t erasedSpace = flashfsRingErasedSpace();
+    if (erasedSpace >= ringEraseAheadSize) {
+        return true;
+    }
+
+    const bool urgent = erasedSpace < flashGeometry->sectorSize;
+    if (flashfsState == FLASHFS_IDLE && (urgent || flashfsBufferIsEmpty()) && flashIsReady()) {
+        flashfsReadAheadInvalidate();
+        flashEraseSector(ringEraseHead);
+        ringEraseHead += flashGeometry->sectorSize;
+        if (ringEraseHead >= flashfsSize) {
+            ringEraseHead = 0;
+        }
+    }
+
+    return false;
 }
 
 void flashfsSeekAbs(uint32_t offset)
@@ -496,8 +703,6 @@ void flashfsWrite(const uint8_t *data, unsigned int len, bool sync)
  */
 int flashfsReadAbs(uint32_t address, uint8_t *buffer, unsigned int len)
 {
-    int bytesRead;
-
     // Did caller try to read past the end of the volume?
     if (address + len > flashfsSize) {
         // Truncate their request
@@ -507,15 +712,61 @@ int flashfsReadAbs(uint32_t address, uint8_t *buffer, unsigned int len)
     // Since the read could overlap data in our dirty buffers, force a sync to clear those first
     flashfsFlushSync();
 
-    bytesRead = flashReadBytes(address, buffer, len);
+#ifdef USE_FLASHFS_READ_AHEAD
+    const bool sequential = (address == readAheadNextAddress);
+    readAheadNextAddress = address + len;
+
+    if (!sequential) {
+        // Random access, such as finding the start of each log, bypasses the read-ahead
+        flashfsReadAheadWait();
+
+        return flashReadBytes(address, buffer, len);
+    }
+
+    unsigned int bytesRead = 0;
+    while (bytesRead < len) {
+        const uint32_t chunkAddress = (address + bytesRead) - (address + bytesRead) % FLASHFS_READ_AHEAD_SIZE;
+
+        flashfsReadAhead_t *chunk = flashfsReadAheadFind(chunkAddress);
+        if (!chunk) {
+            flashfsReadAheadFetch(chunkAddress, UINT32_MAX);
+            chunk = &readAhead[readAheadFetching];
+        }
+        if (chunk->state == FLASHFS_READ_AHEAD_PENDING) {
+            flashfsReadAheadWait();
+        }
+
+        const uint32_t offset = address + bytesRead - chunkAddress;
+        if (chunk->length <= offset) {
+            break;
+        }
+
+        const uint32_t count = MIN(len - bytesRead, chunk->length - offset);
+        memcpy(buffer + bytesRead, &flashReadAheadBuffer[chunk - readAhead][offset], count);
+        bytesRead += count;
+    }
+
+    // Fetch the chunk the next read will continue into, or the one after if that's already here
+    const uint32_t nextChunkAddress = readAheadNextAddress - readAheadNextAddress % FLASHFS_READ_AHEAD_SIZE;
+    uint32_t fetchAddress = nextChunkAddress;
+    if (flashfsReadAheadFind(fetchAddress)) {
+        fetchAddress += FLASHFS_READ_AHEAD_SIZE;
+    }
+    if (fetchAddress < flashfsSize && !flashfsReadAheadFind(fetchAddress)) {
+        flashfsReadAheadFetch(fetchAddress, nextChunkAddress);
+    }
 
     return bytesRead;
+#else
+    return flashReadBytes(address, buffer, len);
+#endif
 }
 
 /**
- * Find the offset of the start of the free space on the device (or the size of the device if it is full).
+ * Find the offset of the start of the free space in the given range of the device (or the end of the range if it is
+ * full). The range must start on a block boundary.
  */
-int flashfsIdentifyStartOfFreeSpace(void)
+static uint32_t flashfsFindStartOfFreeSpace(uint32_t start, uint32_t end)
 {
     /* Find the start of the free space on the device by examining the beginning of blocks with a binary search,
      * looking for ones that appear to be erased. We can achieve this with good accuracy because an erased block
@@ -544,8 +795,8 @@ int flashfsIdentifyStartOfFreeSpace(void)
         uint32_t ints[FREE_BLOCK_TEST_SIZE_INTS];
     } testBuffer;
 
-    int left = 0; // Smallest block index in the search region
-    int right = flashfsSize / FREE_BLOCK_SIZE; // One past the largest block index in the search region
+    int left = start / FREE_BLOCK_SIZE; // Smallest block index in the search region
+    int right = end / FREE_BLOCK_SIZE; // One past the largest block index in the search region
     int mid;
     int result = right;
     int i;
@@ -583,12 +834,85 @@ int flashfsIdentifyStartOfFreeSpace(void)
     return result * FREE_BLOCK_SIZE;
 }
 
+/**
+ * Find the offset of the start of the free space on the device (or the size of the device if it is full).
+ */
+int flashfsIdentifyStartOfFreeSpace(void)
+{
+    return flashfsFindStartOfFreeSpace(0, flashfsSize);
+}
+
+static bool flashfsSectorIsErased(uint32_t sector)
+{
+    uint32_t testBuffer[4];
+
+    if (flashReadBytes(sector * flashGeometry->sectorSize, (uint8_t *)testBuffer, sizeof(testBuffer)) < (int)sizeof(testBuffer)) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < ARRAYLEN(testBuffer); i++) {
+        if (testBuffer[i] != 0xFFFFFFFF) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * In ring mode, the last session stopped writing in the last written sector before a run of erased ones. Continue
+ * there, with the erased sectors that follow ahead of the file pointer.
+ */
+static void flashfsRingInit(void)
+{
+    const uint32_t sectorSize = flashGeometry->sectorSize;
+    const uint32_t sectorCount = flashfsSize / sectorSize;
+
+    // A blank volume starts at 0, as does one that is completely written
+    uint32_t tail = 0;
+    uint32_t eraseSector = 0;
+
+    bool previousErased = flashfsSectorIsErased(sectorCount - 1);
+    const bool lastErased = previousErased;
+    bool found = false;
+    for (uint32_t sector = 0; sector < sectorCount; sector++) {
+        const bool erased = flashfsSectorIsErased(sector);
+        if (erased && !previousErased) {
+            const uint32_t previousSector = (sector + sectorCount - 1) % sectorCount;
+            tail = flashfsFindStartOfFreeSpace(previousSector * sectorSize, (previousSector + 1) * sectorSize);
+            eraseSector = sector;
+            found = true;
+            break;
+        }
+        previousErased = erased;
+    }
+
+    if (!found && !lastErased) {
+        // Nothing erased
+        flashfsSeekAbs(0);
+        ringEraseHead = 0;
+        return;
+    }
+
+    flashfsSeekAbs(tail);
+    ringEraseHead = eraseSector * sectorSize;
+
+    // Count the erased sectors ahead, up to the configured distance
+    do {
+        ringEraseHead += sectorSize;
+        if (ringEraseHead >= flashfsSize) {
+            ringEraseHead = 0;
+        }
+    } while (flashfsRingErasedSpace() < ringEraseAheadSize && flashfsSectorIsErased(ringEraseHead / sectorSize));
+}
+
 /**
  * Returns true if the file pointer is at the end of the device.
  */
 bool flashfsIsEOF(void)
 {
-    return tailAddress >= flashfsSize;
+    // A ring is never full
+    return !ringEraseAheadSize && tailAddress >= flashfsSize;
 }
 
 void flashfsClose(void)
@@ -613,6 +937,8 @@ void flashfsClose(void)
  */
 void flashfsInit(void)
 {
+    flashfsReadAheadInvalidate();
+
     flashfsSize = 0;
 
     flashPartition = flashPartitionFindByType(FLASH_PARTITION_TYPE_FLASHFS);
@@ -624,7 +950,34 @@ void flashfsInit(void)
 
     flashfsSize = FLASH_PARTITION_SECTOR_COUNT(flashPartition) * flashGeometry->sectorSize;
 
+    // At least one sector has to hold data in ring mode
+    const uint32_t ringEraseAheadSectors = MIN(flashConfig()->ringEraseAheadSectors, FLASH_PARTITION_SECTOR_COUNT(flashPartition) - 1);
+    ringEraseAheadSize = ringEraseAheadSectors * flashGeometry->sectorSize;
+
+    if (ringEraseAheadSize) {
+        flashfsRingInit();
+        return;
+    }
+
     // Start the file pointer off at the beginning of free space so caller can start writing immediately
+#ifdef USE_FLASHFS_INDEX
+    const flashPartition_t *indexPartition = flashPartitionFindByType(FLASH_PARTITION_TYPE_FLASHFS_INDEX);
+    if (indexPartition && indexPartition->startSector == flashPartition->endSector + 1 && !flashfsIndexIsUsable()) {
+        // Logs written before the index was enabled run on into its sectors, keep them readable until the next erase
+        flashfsSize += FLASH_PARTITION_SECTOR_COUNT(indexPartition) * flashGeometry->sectorSize;
+    }
+
+    uint32_t usedSpace;
+    if (flashfsIndexInit(&usedSpace)) {
+        if (flashGeometry->flashType == FLASH_TYPE_NAND) {
+            // Pages are only programmed once, continue on the next one like flashfsClose() does
+            const uint32_t pageSize = flashGeometry->pageSize;
+            usedSpace = (usedSpace + pageSize - 1) & ~(pageSize - 1);
+        }
+        flashfsSeekAbs(usedSpace);
+        return;
+    }
+#endif
     flashfsSeekAbs(flashfsIdentifyStartOfFreeSpace());
 }
 
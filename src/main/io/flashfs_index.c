@@ -0,0 +1,582 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * A journal of blackbox log boundaries, kept in the FLASHFS_INDEX partition that follows the FLASHFS partition.
+ *
+ * Without it, the end of the written data is found with a binary search for erased blocks and individual logs
+ * are found by scanning the whole used space for log headers. With it, boot, MSC enumeration and MSP log
+ * listing only read one record per log.
+ *
+ * The partition is used as two sectors. Each sector starts with a header record carrying a generation number,
+ * the sector with the newest valid header is the active one. Records are appended to the first erased slot of
+ * the active sector: a BEGIN record when a log is opened and an END record when it is closed. When the active
+ * sector is running out of slots it is compacted at boot into the other sector, one LOG record per complete log.
+ *
+ * A slot is 16 bytes on NOR flash and a whole page on NAND flash, so that every slot is programmed exactly once
+ * between erases. Records with a bad checksum (eg. power lost while programming) are skipped.
+ *
+ * Data found past the last indexed log, eg. written by firmware without the index, is recorded as an UNINDEXED
+ * range which readers have to scan for log headers as before.
+ *
+ * BEGIN and END records are queued in RAM and programmed by flashfsIndexFlushAsync() while the flash is idle, so
+ * arming and disarming never wait for the flash. A record that is still queued at a power loss is recovered at boot
+ * like any other missing record. Formatting at boot and compaction write directly.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "platform.h"
+
+#ifdef USE_FLASHFS_INDEX
+
+#include "common/crc.h"
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "drivers/flash/flash.h"
+
+#include "io/flashfs.h"
+
+#include "io/flashfs_index.h"
+
+#define FLASHFS_INDEX_MAGIC 0xB10C
+
+// Blocks older firmware resumes writing at after a reboot, see flashfsIdentifyStartOfFreeSpace()
+#define FLASHFS_INDEX_LEGACY_BLOCK_SIZE 2048
+#define FLASHFS_INDEX_PROBE_SIZE 16
+
+// A BEGIN and an END record per log, with room for a log opened before the last one's records have been written
+#define FLASHFS_INDEX_QUEUE_SIZE 4
+
+typedef enum {
+    FLASHFS_INDEX_RECORD_HEADER = 1,
+    FLASHFS_INDEX_RECORD_BEGIN,
+    FLASHFS_INDEX_RECORD_END,
+    FLASHFS_INDEX_RECORD_LOG,
+    FLASHFS_INDEX_RECORD_UNINDEXED,
+} flashfsIndexRecordType_e;
+
+typedef struct flashfsIndexRecord_s {
+    uint16_t magic;
+    uint8_t type;
+    uint8_t crc;
+    uint32_t generation;        // of the sector for headers, unused otherwise
+    uint32_t start;
+    uint32_t end;
+} flashfsIndexRecord_t;
+
+STATIC_ASSERT(sizeof(flashfsIndexRecord_t) == FLASHFS_INDEX_PROBE_SIZE, flashfsIndexRecord_t_size);
+
+typedef enum {
+    FLASHFS_INDEX_SLOT_ERASED,
+    FLASHFS_INDEX_SLOT_VALID,
+    FLASHFS_INDEX_SLOT_INVALID,
+} flashfsIndexSlotState_e;
+
+typedef struct flashfsIndexQueued_s {
+    uint8_t sector;
+    uint16_t slot;
+    flashfsIndexRecord_t record;
+} flashfsIndexQueued_t;
+
+static struct {
+    bool available;
+    uint32_t address;           // of the first sector
+    uint32_t sectorSize;
+    uint32_t slotSize;
+    uint16_t slotCount;         // per sector, including the header
+    uint8_t activeSector;
+    uint32_t generation;
+    uint16_t writeSlot;         // first erased slot of the active sector
+    uint8_t queueCount;
+    flashfsIndexQueued_t queue[FLASHFS_INDEX_QUEUE_SIZE];
+} flashfsIndex;
+
+// Source of the page program of a queued record, which may still be running when the record leaves the queue
+static DMA_DATA_ZERO_INIT flashfsIndexRecord_t flashfsIndexProgramRecord;
+
+static uint8_t flashfsIndexRecordCrc(const flashfsIndexRecord_t *record)
+{
+    flashfsIndexRecord_t copy = *record;
+    copy.crc = 0;
+    return crc8_dvb_s2_update(0, &copy, sizeof(copy));
+}
+
+static bool flashfsIndexIsErased(const uint8_t *data, unsigned length)
+{
+    for (unsigned i = 0; i < length; i++) {
+        if (data[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t flashfsIndexSlotAddress(uint8_t sector, uint16_t slot)
+{
+    return flashfsIndex.address + sector * flashfsIndex.sectorSize + slot * flashfsIndex.slotSize;
+}
+
+static flashfsIndexSlotState_e flashfsIndexReadSlot(uint8_t sector, uint16_t slot, flashfsIndexRecord_t *record)
+{
+    for (unsigned i = 0; i < flashfsIndex.queueCount; i++) {
+        if (flashfsIndex.queue[i].sector == sector && flashfsIndex.queue[i].slot == slot) {
+            *record = flashfsIndex.queue[i].record;
+            return FLASHFS_INDEX_SLOT_VALID;
+        }
+    }
+
+    if (flashReadBytes(flashfsIndexSlotAddress(sector, slot), (uint8_t *)record, sizeof(*record)) < (int)sizeof(*record)) {
+        return FLASHFS_INDEX_SLOT_INVALID;
+    }
+
+    if (flashfsIndexIsErased((const uint8_t *)record, sizeof(*record))) {
+        return FLASHFS_INDEX_SLOT_ERASED;
+    }
+
+    if (record->magic != FLASHFS_INDEX_MAGIC || record->crc != flashfsIndexRecordCrc(record)) {
+        return FLASHFS_INDEX_SLOT_INVALID;
+    }
+
+    return FLASHFS_INDEX_SLOT_VALID;
+}
+
+static flashfsIndexRecord_t flashfsIndexMakeRecord(flashfsIndexRecordType_e type, uint32_t generation, uint32_t start, uint32_t end)
+{
+    flashfsIndexRecord_t record = {
+        .magic = FLASHFS_INDEX_MAGIC,
+        .type = type,
+        .crc = 0,
+        .generation = generation,
+        .start = start,
+        .end = end,
+    };
+    record.crc = flashfsIndexRecordCrc(&record);
+
+    return record;
+}
+
+static void flashfsIndexWriteSlot(uint8_t sector, uint16_t slot, flashfsIndexRecordType_e type, uint32_t generation, uint32_t start, uint32_t end)
+{
+    flashfsIndexProgramRecord = flashfsIndexMakeRecord(type, generation, start, end);
+
+    flashPageProgram(flashfsIndexSlotAddress(sector, slot), (const uint8_t *)&flashfsIndexProgramRecord, sizeof(flashfsIndexProgramRecord), NULL);
+    flashFlush();
+    flashWaitForReady();
+}
+
+static bool flashfsIndexQueueSlot(uint8_t sector, uint16_t slot, flashfsIndexRecordType_e type, uint32_t generation, uint32_t start, uint32_t end)
+{
+    if (flashfsIndex.queueCount >= FLASHFS_INDEX_QUEUE_SIZE) {
+        return false;
+    }
+
+    flashfsIndexQueued_t *queued = &flashfsIndex.queue[flashfsIndex.queueCount++];
+    queued->sector = sector;
+    queued->slot = slot;
+    queued->record = flashfsIndexMakeRecord(type, generation, start, end);
+
+    return true;
+}
+
+static void flashfsIndexEraseSector(uint8_t sector)
+{
+    flashEraseSector(flashfsIndexSlotAddress(sector, 0));
+    flashWaitForReady();
+}
+
+static bool flashfsIndexAppend(flashfsIndexRecordType_e type, uint32_t start, uint32_t end)
+{
+    if (!flashfsIndex.available) {
+        return false;
+    }
+
+    if (flashfsIndex.writeSlot >= flashfsIndex.slotCount) {
+        // Full until the next boot compacts it, data written meanwhile is picked up as unindexed
+        flashfsIndex.available = false;
+        return false;
+    }
+
+    if (!flashfsIndexQueueSlot(flashfsIndex.activeSector, flashfsIndex.writeSlot, type, 0, start, end)) {
+        flashfsIndex.available = false;
+        return false;
+    }
+    flashfsIndex.writeSlot++;
+
+    return true;
+}
+
+// Slots left free by compaction, so that compaction is needed every few flights at most
+static uint16_t flashfsIndexSpareSlots(void)
+{
+    return flashfsIndex.slotCount / 4;
+}
+
+/*
+ * Rewrite the complete logs of the active sector into the other sector, one record each. If they don't fit,
+ * the oldest ones are merged into a single unindexed range.
+ */
+static void flashfsIndexCompact(void)
+{
+    flashfsIndexIterator_t iterator;
+    flashfsIndexLog_t log;
+
+    int logCount = 0;
+    flashfsIndexIteratorInit(&iterator);
+    while (flashfsIndexIteratorNext(&iterator, &log)) {
+        logCount++;
+    }
+    const bool open = iterator.pending;
+
+    const int capacity = flashfsIndex.slotCount - 1 - flashfsIndexSpareSlots() - (open ? 1 : 0);
+    const int mergeCount = logCount > capacity ? logCount - capacity + 1 : 0;
+
+    const uint8_t sector = flashfsIndex.activeSector ^ 1;
+    const uint32_t generation = flashfsIndex.generation + 1;
+    uint16_t slot = 1;
+
+    flashfsIndexEraseSector(sector);
+
+    uint32_t mergeStart = 0;
+    int logIndex = 0;
+    flashfsIndexIteratorInit(&iterator);
+    while (flashfsIndexIteratorNext(&iterator, &log)) {
+        if (logIndex < mergeCount) {
+            if (logIndex == 0) {
+                mergeStart = log.start;
+            }
+            if (++logIndex == mergeCount) {
+                flashfsIndexWriteSlot(sector, slot++, FLASHFS_INDEX_RECORD_UNINDEXED, 0, mergeStart, log.end);
+            }
+            continue;
+        }
+        logIndex++;
+
+        const flashfsIndexRecordType_e type = log.indexed ? FLASHFS_INDEX_RECORD_LOG : FLASHFS_INDEX_RECORD_UNINDEXED;
+        flashfsIndexWriteSlot(sector, slot++, type, 0, log.start, log.end);
+    }
+    if (open) {
+        flashfsIndexWriteSlot(sector, slot++, FLASHFS_INDEX_RECORD_BEGIN, 0, iterator.pendingStart, 0);
+    }
+
+    // The header goes last so that an interrupted compaction leaves the old sector active
+    flashfsIndexWriteSlot(sector, 0, FLASHFS_INDEX_RECORD_HEADER, generation, 0, 0);
+
+    flashfsIndex.activeSector = sector;
+    flashfsIndex.generation = generation;
+    flashfsIndex.writeSlot = slot;
+}
+
+static bool flashfsIndexConfigure(void)
+{
+    const flashPartition_t *partition = flashPartitionFindByType(FLASH_PARTITION_TYPE_FLASHFS_INDEX);
+    const flashGeometry_t *geometry = flashGetGeometry();
+
+    if (!partition || FLASH_PARTITION_SECTOR_COUNT(partition) < FLASH_PARTITION_FLASHFS_INDEX_SECTORS) {
+        return false;
+    }
+
+    flashfsIndex.address = partition->startSector * geometry->sectorSize;
+    flashfsIndex.sectorSize = geometry->sectorSize;
+    flashfsIndex.slotSize = geometry->flashType == FLASH_TYPE_NAND ? geometry->pageSize : sizeof(flashfsIndexRecord_t);
+    flashfsIndex.slotCount = MIN(flashfsIndex.sectorSize / flashfsIndex.slotSize, (uint32_t)UINT16_MAX);
+
+    return true;
+}
+
+// True if there is written data at, or at the block older firmware would continue from after, the given offset
+static bool flashfsIndexDataFollows(uint32_t offset)
+{
+    const uint32_t probes[] = {
+        offset,
+        (offset + FLASHFS_INDEX_LEGACY_BLOCK_SIZE - 1) & ~(FLASHFS_INDEX_LEGACY_BLOCK_SIZE - 1),
+    };
+
+    for (unsigned i = 0; i < ARRAYLEN(probes); i++) {
+        uint8_t buffer[FLASHFS_INDEX_PROBE_SIZE];
+        if (probes[i] + sizeof(buffer) > flashfsGetSize()) {
+            continue;
+        }
+        if (flashReadBytes(probes[i], buffer, sizeof(buffer)) < (int)sizeof(buffer) || !flashfsIndexIsErased(buffer, sizeof(buffer))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Finds the active sector, returns false if neither sector has a header
+static bool flashfsIndexFindHeader(bool *blank)
+{
+    flashfsIndexRecord_t record;
+    bool found = false;
+
+    *blank = true;
+    for (uint8_t sector = 0; sector < FLASH_PARTITION_FLASHFS_INDEX_SECTORS; sector++) {
+        const flashfsIndexSlotState_e state = flashfsIndexReadSlot(sector, 0, &record);
+        if (state != FLASHFS_INDEX_SLOT_ERASED) {
+            *blank = false;
+        }
+        if (state == FLASHFS_INDEX_SLOT_VALID && record.type == FLASHFS_INDEX_RECORD_HEADER && (!found || record.generation > flashfsIndex.generation)) {
+            found = true;
+            flashfsIndex.activeSector = sector;
+            flashfsIndex.generation = record.generation;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * False if the FLASHFS_INDEX partition holds something other than an index, eg. logs written before the index was
+ * enabled that ran on into its sectors. flashfsInit() then leaves them part of the volume until the next full erase.
+ */
+bool flashfsIndexIsUsable(void)
+{
+    flashfsIndex.queueCount = 0;
+
+    if (!flashfsIndexConfigure()) {
+        return false;
+    }
+
+    bool blank;
+    return flashfsIndexFindHeader(&blank) || blank;
+}
+
+/**
+ * Call from flashfsInit(). On success the index is available and usedSpace is set to the end of the written data.
+ */
+bool flashfsIndexInit(uint32_t *usedSpace)
+{
+    flashfsIndex.available = false;
+    flashfsIndex.queueCount = 0;
+
+    if (!flashfsIndexConfigure()) {
+        return false;
+    }
+
+    flashfsIndexRecord_t record;
+    bool blank;
+
+    if (!flashfsIndexFindHeader(&blank)) {
+        if (!blank) {
+            // Overwritten by something else, unusable until the next full erase formats it
+            return false;
+        }
+        for (uint8_t sector = 0; sector < FLASH_PARTITION_FLASHFS_INDEX_SECTORS; sector++) {
+            flashfsIndexEraseSector(sector);
+        }
+        flashfsIndexFormat();
+    }
+
+    bool open = false;
+    uint32_t usedEnd = 0;
+
+    uint16_t slot;
+    for (slot = 1; slot < flashfsIndex.slotCount; slot++) {
+        const flashfsIndexSlotState_e state = flashfsIndexReadSlot(flashfsIndex.activeSector, slot, &record);
+        if (state == FLASHFS_INDEX_SLOT_ERASED) {
+            break;
+        }
+        if (state == FLASHFS_INDEX_SLOT_INVALID) {
+            continue;
+        }
+
+        switch (record.type) {
+        case FLASHFS_INDEX_RECORD_BEGIN:
+            open = true;
+            usedEnd = MAX(usedEnd, record.start);
+            break;
+        case FLASHFS_INDEX_RECORD_END:
+        case FLASHFS_INDEX_RECORD_LOG:
+        case FLASHFS_INDEX_RECORD_UNINDEXED:
+            open = false;
+            usedEnd = MAX(usedEnd, record.end);
+            break;
+        default:
+            break;
+        }
+    }
+
+    flashfsIndex.writeSlot = slot;
+    flashfsIndex.available = true;
+
+    if (flashfsIndex.slotCount - flashfsIndex.writeSlot < flashfsIndexSpareSlots() / 2) {
+        flashfsIndexCompact();
+    }
+
+    // A log left open by a power loss, or data written without the index, needs the free space search
+    uint32_t freeStart = usedEnd;
+    if (open || flashfsIndexDataFollows(usedEnd)) {
+        freeStart = MAX((uint32_t)flashfsIdentifyStartOfFreeSpace(), usedEnd);
+    }
+
+    if (open) {
+        flashfsIndexAppend(FLASHFS_INDEX_RECORD_END, 0, freeStart);
+    } else if (freeStart > usedEnd) {
+        flashfsIndexAppend(FLASHFS_INDEX_RECORD_UNINDEXED, usedEnd, freeStart);
+    }
+
+    *usedSpace = freeStart;
+
+    return flashfsIndex.available;
+}
+
+bool flashfsIndexIsAvailable(void)
+{
+    return flashfsIndex.available;
+}
+
+/**
+ * Start an empty index, call once the FLASHFS and FLASHFS_INDEX partitions have been erased, or as soon as the erase
+ * of the whole chip has been started. The header is queued like any other record.
+ */
+void flashfsIndexFormat(void)
+{
+    flashfsIndex.available = false;
+    flashfsIndex.queueCount = 0;
+
+    if (!flashfsIndexConfigure()) {
+        return;
+    }
+
+    flashfsIndex.activeSector = 0;
+    flashfsIndex.generation = 1;
+    flashfsIndex.writeSlot = 1;
+    flashfsIndex.available = flashfsIndexQueueSlot(0, 0, FLASHFS_INDEX_RECORD_HEADER, 1, 0, 0);
+}
+
+void flashfsIndexInvalidate(void)
+{
+    flashfsIndex.available = false;
+    flashfsIndex.queueCount = 0;
+}
+
+/**
+ * Program the oldest queued record if the flash is idle, call between writes of the log stream only. The records
+ * of a log go ahead of any data written after them.
+ *
+ * Returns true when no records are queued. After programming one it returns false, so the flash is busy again.
+ */
+bool flashfsIndexFlushAsync(void)
+{
+    if (flashfsIndex.queueCount == 0) {
+        return true;
+    }
+
+    if (!flashIsReady()) {
+        return false;
+    }
+
+    const flashfsIndexQueued_t *queued = &flashfsIndex.queue[0];
+    flashfsIndexProgramRecord = queued->record;
+    flashPageProgram(flashfsIndexSlotAddress(queued->sector, queued->slot), (const uint8_t *)&flashfsIndexProgramRecord, sizeof(flashfsIndexProgramRecord), NULL);
+    // Programs a partial NAND page
+    flashFlush();
+
+    flashfsIndex.queueCount--;
+    memmove(&flashfsIndex.queue[0], &flashfsIndex.queue[1], flashfsIndex.queueCount * sizeof(flashfsIndex.queue[0]));
+
+    return false;
+}
+
+void flashfsIndexLogBegin(uint32_t offset)
+{
+    // Keep room for the END record, a log without one would swallow the following unindexed data
+    if (flashfsIndex.available && flashfsIndex.slotCount - flashfsIndex.writeSlot < 2) {
+        flashfsIndex.available = false;
+    }
+
+    flashfsIndexAppend(FLASHFS_INDEX_RECORD_BEGIN, offset, 0);
+}
+
+void flashfsIndexLogEnd(uint32_t offset)
+{
+    flashfsIndexAppend(FLASHFS_INDEX_RECORD_END, 0, offset);
+}
+
+void flashfsIndexIteratorInit(flashfsIndexIterator_t *iterator)
+{
+    iterator->slot = 1;
+    iterator->pending = false;
+    iterator->pendingStart = 0;
+}
+
+/**
+ * Returns the complete logs in the order they were written. A log still open when iteration ends is left in
+ * iterator->pending.
+ */
+bool flashfsIndexIteratorNext(flashfsIndexIterator_t *iterator, flashfsIndexLog_t *log)
+{
+    flashfsIndexRecord_t record;
+
+    while (iterator->slot < flashfsIndex.writeSlot) {
+        if (flashfsIndexReadSlot(flashfsIndex.activeSector, iterator->slot++, &record) != FLASHFS_INDEX_SLOT_VALID) {
+            continue;
+        }
+
+        switch (record.type) {
+        case FLASHFS_INDEX_RECORD_BEGIN: {
+            // A log that was never closed ends where the next one starts
+            const bool closed = iterator->pending;
+            log->start = iterator->pendingStart;
+            log->end = record.start;
+            log->indexed = true;
+            iterator->pending = true;
+            iterator->pendingStart = record.start;
+            if (closed && log->end > log->start) {
+                return true;
+            }
+            break;
+        }
+        case FLASHFS_INDEX_RECORD_END:
+            if (iterator->pending) {
+                iterator->pending = false;
+                log->start = iterator->pendingStart;
+                log->end = record.end;
+                log->indexed = true;
+                if (log->end > log->start) {
+                    return true;
+                }
+            }
+            break;
+        case FLASHFS_INDEX_RECORD_LOG:
+        case FLASHFS_INDEX_RECORD_UNINDEXED:
+            iterator->pending = false;
+            log->start = record.start;
+            log->end = record.end;
+            log->indexed = record.type == FLASHFS_INDEX_RECORD_LOG;
+            if (log->end > log->start) {
+                return true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return false;
+}
+
+#endif // USE_FLASHFS_INDEX
@@ -0,0 +1,50 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct flashfsIndexLog_s {
+    uint32_t start;
+    uint32_t end;
+    bool indexed;       // false for data written without the index, which may hold several logs
+} flashfsIndexLog_t;
+
+typedef struct flashfsIndexIterator_s {
+    uint16_t slot;
+    bool pending;
+    uint32_t pendingStart;
+} flashfsIndexIterator_t;
+
+bool flashfsIndexIsUsable(void);
+bool flashfsIndexInit(uint32_t *usedSpace);
+bool flashfsIndexIsAvailable(void);
+void flashfsIndexFormat(void);
+void flashfsIndexInvalidate(void);
+bool flashfsIndexFlushAsync(void);
+
+void flashfsIndexLogBegin(uint32_t offset);
+void flashfsIndexLogEnd(uint32_t offset);
+
+void flashfsIndexIteratorInit(flashfsIndexIterator_t *iterator);
+bool flashfsIndexIteratorNext(flashfsIndexIterator_t *iterator, flashfsIndexLog_t *log);
@@ -49,7 +49,7 @@ void FAST_CODE run(void)
     while (true) {
         scheduler();
 #ifdef SIMULATOR_BUILD
-        delayMicroseconds_real(50); // max rate 20kHz
+        simulatorLoopIdle();
 #endif
     }
 }
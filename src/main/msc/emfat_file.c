@@ -37,6 +37,7 @@
 #include "drivers/usb_msc.h"
 
 #include "io/flashfs.h"
+#include "io/flashfs_index.h"
 
 #include "pg/flash.h"
 
@@ -307,22 +308,76 @@ static void emfat_add_log(emfat_entry_t *entry, int number, uint32_t offset, uin
     entry->cma_time[2] = entry->cma_time[0];
 }
 
-static int emfat_find_log(emfat_entry_t *entry, int maxCount, int flashfsUsedSpace)
+static const char logHeader[] = "H Product:Blackbox";
+
+// Find the "Log start datetime" entry, example encoding "H Log start datetime:2019-08-15T13:18:22.199+00:00"
+static void emfat_set_log_time(emfat_entry_t *entry, uint32_t offset, uint32_t end)
 {
     static uint8_t buffer[HDR_BUF_SIZE];
-    int lastOffset = 0;
-    int currOffset = 0;
-    int buffOffset;
-    int hdrOffset;
-    int fileNumber = 0;
-    int logCount = 0;
-    char *logHeader = "H Product:Blackbox";
-    int lenLogHeader = strlen(logHeader);
-    char *timeHeader = "H Log start datetime:";
-    int lenTimeHeader = strlen(timeHeader);
+    const char *timeHeader = "H Log start datetime:";
+    const int lenTimeHeader = strlen(timeHeader);
     int timeHeaderMatched = 0;
+    int buffOffset = 0;
+    uint32_t hdrOffset = offset;
+
+    // Set the default timestamp for this log entry in case the timestamp is not found
+    entry->cma_time[0] = cmaTime;
+
+    flashfsReadAbs(hdrOffset, buffer, HDR_BUF_SIZE);
+
+    // Search for the timestamp record
+    while (true) {
+        if (buffer[buffOffset++] == timeHeader[timeHeaderMatched]) {
+            // This matches the header we're looking for so far
+            if (++timeHeaderMatched == lenTimeHeader) {
+                // Complete match so read date/time into buffer
+                flashfsReadAbs(hdrOffset + buffOffset, buffer, HDR_BUF_SIZE);
+
+                // Extract the time values to create the CMA time
+                char *nextToken = (char *)buffer;
+                int year = strtoul(nextToken, &nextToken, 10);
+                int month = strtoul(++nextToken, &nextToken, 10);
+                int day = strtoul(++nextToken, &nextToken, 10);
+                int hour = strtoul(++nextToken, &nextToken, 10);
+                int min = strtoul(++nextToken, &nextToken, 10);
+                int sec = strtoul(++nextToken, NULL, 10);
+
+                // Set the file creation time
+                if (year) {
+                    entry->cma_time[0] = EMFAT_ENCODE_CMA_TIME(day, month, year, hour, min, sec);
+                }
 
-    for ( ; currOffset < flashfsUsedSpace ; currOffset += 2048) { // XXX 2048 = FREE_BLOCK_SIZE in io/flashfs.c
+                break;
+            }
+        } else {
+            timeHeaderMatched = 0;
+        }
+
+        if (buffOffset == HDR_BUF_SIZE) {
+            // Read the next portion of the header
+            hdrOffset += HDR_BUF_SIZE;
+
+            // Check for flash overflow
+            if (hdrOffset > end) {
+                break;
+            }
+
+            flashfsReadAbs(hdrOffset, buffer, HDR_BUF_SIZE);
+            buffOffset = 0;
+        }
+    }
+}
+
+// Split [start, end) into logs by looking for log headers at the start of each 2048 byte block
+static int emfat_find_log(emfat_entry_t *entry, int maxCount, int firstNumber, uint32_t start, uint32_t end)
+{
+    static uint8_t buffer[HDR_BUF_SIZE];
+    uint32_t lastOffset = start;
+    uint32_t currOffset = start;
+    int logCount = 0;
+    const int lenLogHeader = strlen(logHeader);
+
+    for ( ; currOffset < end ; currOffset = (currOffset + 2048) & ~2047) { // XXX 2048 = FREE_BLOCK_SIZE in io/flashfs.c
 
         mscSetActive();
         mscActivityLed();
@@ -336,62 +391,12 @@ static int emfat_find_log(emfat_entry_t *entry, int maxCount, int flashfsUsedSpa
         // The length of the previous record is now known
         if (lastOffset != currOffset) {
             // Record the previous entry
-            emfat_add_log(entry++, fileNumber++, lastOffset, currOffset - lastOffset);
-
-            logCount++;
+            emfat_add_log(entry++, firstNumber + logCount++, lastOffset, currOffset - lastOffset);
         }
 
-        // Find the "Log start datetime" entry, example encoding "H Log start datetime:2019-08-15T13:18:22.199+00:00"
-
-        buffOffset = lenLogHeader;
-        hdrOffset = currOffset;
-
-        // Set the default timestamp for this log entry in case the timestamp is not found
-        entry->cma_time[0] = cmaTime;
-
-        // Search for the timestamp record
-        while (true) {
-            if (buffer[buffOffset++] == timeHeader[timeHeaderMatched]) {
-                // This matches the header we're looking for so far
-                if (++timeHeaderMatched == lenTimeHeader) {
-                    // Complete match so read date/time into buffer
-                    flashfsReadAbs(hdrOffset + buffOffset, buffer, HDR_BUF_SIZE);
-
-                    // Extract the time values to create the CMA time
-                    char *nextToken = (char *)buffer;
-                    int year = strtoul(nextToken, &nextToken, 10);
-                    int month = strtoul(++nextToken, &nextToken, 10);
-                    int day = strtoul(++nextToken, &nextToken, 10);
-                    int hour = strtoul(++nextToken, &nextToken, 10);
-                    int min = strtoul(++nextToken, &nextToken, 10);
-                    int sec = strtoul(++nextToken, NULL, 10);
-
-                    // Set the file creation time
-                    if (year) {
-                        entry->cma_time[0] = EMFAT_ENCODE_CMA_TIME(day, month, year, hour, min, sec);
-                    }
-
-                    break;
-                }
-            } else {
-                timeHeaderMatched = 0;
-            }
-
-            if (buffOffset == HDR_BUF_SIZE) {
-                // Read the next portion of the header
-                hdrOffset += HDR_BUF_SIZE;
-
-                // Check for flash overflow
-                if (hdrOffset > flashfsUsedSpace) {
-                    break;
-                }
+        emfat_set_log_time(entry, currOffset, end);
 
-                flashfsReadAbs(hdrOffset, buffer, HDR_BUF_SIZE);
-                buffOffset = 0;
-            }
-        }
-
-        if (fileNumber == maxCount) {
+        if (logCount == maxCount) {
             break;
         }
 
@@ -399,13 +404,40 @@ static int emfat_find_log(emfat_entry_t *entry, int maxCount, int flashfsUsedSpa
     }
 
     // Now add the final entry
-    if (fileNumber != maxCount && lastOffset != currOffset) {
-        emfat_add_log(entry, fileNumber, lastOffset, currOffset - lastOffset);
+    if (logCount != maxCount && lastOffset < end) {
+        emfat_add_log(entry, firstNumber + logCount, lastOffset, end - lastOffset);
         ++logCount;
     }
 
     return logCount;
 }
+
+#ifdef USE_FLASHFS_INDEX
+// One index record per log, only ranges written without the index are scanned
+static int emfat_find_indexed_log(emfat_entry_t *entry, int maxCount)
+{
+    flashfsIndexIterator_t iterator;
+    flashfsIndexLog_t log;
+    int logCount = 0;
+
+    flashfsIndexIteratorInit(&iterator);
+    while (logCount < maxCount && flashfsIndexIteratorNext(&iterator, &log)) {
+        if (log.indexed) {
+            mscSetActive();
+            mscActivityLed();
+
+            emfat_set_log_time(entry, log.start, log.end);
+            emfat_add_log(entry++, logCount++, log.start, log.end - log.start);
+        } else {
+            const int count = emfat_find_log(entry, maxCount - logCount, logCount, log.start, log.end);
+            entry += count;
+            logCount += count;
+        }
+    }
+
+    return logCount;
+}
+#endif
 #endif  // USE_FLASHFS
 
 void emfat_init_files(void)
@@ -435,10 +467,17 @@ void emfat_init_files(void)
     flashfsInit();
     LED0_OFF;
 
-    flashfsUsedSpace = flashfsIdentifyStartOfFreeSpace();
+    // flashfsInit() leaves the file pointer at the start of free space
+    flashfsUsedSpace = flashfsGetOffset();
 
     // Detect and create entries for each individual log
-    const int logCount = emfat_find_log(&entries[PREDEFINED_ENTRY_COUNT], EMFAT_MAX_LOG_ENTRY, flashfsUsedSpace);
+#ifdef USE_FLASHFS_INDEX
+    const int logCount = flashfsIndexIsAvailable()
+        ? emfat_find_indexed_log(&entries[PREDEFINED_ENTRY_COUNT], EMFAT_MAX_LOG_ENTRY)
+        : emfat_find_log(&entries[PREDEFINED_ENTRY_COUNT], EMFAT_MAX_LOG_ENTRY, 0, 0, flashfsUsedSpace);
+#else
+    const int logCount = emfat_find_log(&entries[PREDEFINED_ENTRY_COUNT], EMFAT_MAX_LOG_ENTRY, 0, 0, flashfsUsedSpace);
+#endif
 
     entryIndex += logCount;
 
@@ -47,6 +47,7 @@
 
 #include "config/config.h"
 #include "config/config_eeprom.h"
+#include "config/config_snapshot.h"
 #include "config/feature.h"
 #include "config/simplified_tuning.h"
 
@@ -95,6 +96,7 @@
 #include "io/asyncfatfs/asyncfatfs.h"
 #include "io/beeper.h"
 #include "io/flashfs.h"
+#include "io/flashfs_index.h"
 #include "io/gimbal.h"
 #include "io/gps.h"
 #include "io/ledstrip.h"
@@ -183,10 +185,15 @@ typedef enum {
 } mspSDCardFlags_e;
 
 typedef enum {
-    MSP_FLASHFS_FLAG_READY       = 1,
-    MSP_FLASHFS_FLAG_SUPPORTED  = 2
+    MSP_FLASHFS_FLAG_READY            = 1,
+    MSP_FLASHFS_FLAG_SUPPORTED        = 2,
+    MSP_FLASHFS_FLAG_ADAPTIVE_HUFFMAN = 4  // MSP_DATAFLASH_READ accepts compression 2
 } mspFlashFsFlags_e;
 
+typedef enum {
+    MSP_FLASHFS_LOG_FLAG_UNINDEXED = 1    // written without the index, may hold several logs
+} mspFlashFsLogFlags_e;
+
 typedef enum {
     MSP_PASSTHROUGH_ESC_SIMONK = PROTOCOL_SIMONK,
     MSP_PASSTHROUGH_ESC_BLHELI = PROTOCOL_BLHELI,
@@ -355,6 +362,8 @@ static void mspRebootFn(serialPort_t *serialPort)
     UNUSED(serialPort);
 
     motorShutdown();
+    // don't lose a save that is still being written
+    finishEepromWrite();
 
     switch (rebootMode) {
     case MSP_REBOOT_FIRMWARE:
@@ -418,8 +427,9 @@ void writeReadEeprom(dispatchEntry_t* self)
         return;
     }
 
-    writeEEPROM();
-    readEEPROM();
+    // What readEEPROM() would load back once the save completes is already in memory
+    writeEEPROMInBackground(NULL);
+    applyConfig();
 
 #ifdef USE_VTX_TABLE
     if (vtxTableNeedsInit) {
@@ -495,6 +505,9 @@ static void serializeDataflashSummaryReply(sbuf_t *dst)
     if (flashfsIsSupported()) {
         uint8_t flags = MSP_FLASHFS_FLAG_SUPPORTED;
         flags |= (flashfsIsReady() ? MSP_FLASHFS_FLAG_READY : 0);
+#ifdef USE_HUFFMAN_ADAPTIVE
+        flags |= MSP_FLASHFS_FLAG_ADAPTIVE_HUFFMAN;
+#endif
 
         const flashPartition_t *flashPartition = flashPartitionFindByType(FLASH_PARTITION_TYPE_FLASHFS);
 
@@ -517,10 +530,16 @@ static void serializeDataflashSummaryReply(sbuf_t *dst)
 #ifdef USE_FLASHFS
 enum compressionType_e {
     NO_COMPRESSION,
-    HUFFMAN
+    HUFFMAN,
+    ADAPTIVE_HUFFMAN,   // see huffmanAdaptive_t, seeded from huffmanTable and reset for every reply
+    COMPRESSION_COUNT
 };
 
-static void serializeDataflashReadReply(sbuf_t *dst, uint32_t address, const uint16_t size, bool useLegacyFormat, bool allowCompression)
+#ifdef USE_HUFFMAN_ADAPTIVE
+static huffmanAdaptive_t dataflashHuffmanModel;
+#endif
+
+static void serializeDataflashReadReply(sbuf_t *dst, uint32_t address, const uint16_t size, bool useLegacyFormat, uint8_t compression)
 {
     STATIC_ASSERT(MSP_PORT_DATAFLASH_INFO_SIZE >= 16, MSP_PORT_DATAFLASH_INFO_SIZE_invalid);
 
@@ -539,10 +558,16 @@ static void serializeDataflashReadReply(sbuf_t *dst, uint32_t address, const uin
 
     // legacy format does not support compression
 #ifdef USE_HUFFMAN
-    const uint8_t compressionMethod = (!allowCompression || useLegacyFormat) ? NO_COMPRESSION : HUFFMAN;
+    uint8_t compressionMethod = (useLegacyFormat || compression >= COMPRESSION_COUNT) ? NO_COMPRESSION : compression;
+#ifndef USE_HUFFMAN_ADAPTIVE
+    if (compressionMethod == ADAPTIVE_HUFFMAN) {
+        // not advertised in MSP_DATAFLASH_SUMMARY
+        compressionMethod = NO_COMPRESSION;
+    }
+#endif
 #else
     const uint8_t compressionMethod = NO_COMPRESSION;
-    UNUSED(allowCompression);
+    UNUSED(compression);
 #endif
 
     if (compressionMethod == NO_COMPRESSION) {
@@ -584,13 +609,29 @@ static void serializeDataflashReadReply(sbuf_t *dst, uint32_t address, const uin
         };
         *state.outByte = 0;
 
+#ifdef USE_HUFFMAN_ADAPTIVE
+        if (compressionMethod == ADAPTIVE_HUFFMAN) {
+            huffmanAdaptiveInit(&dataflashHuffmanModel, huffmanTable);
+        }
+#endif
+
         uint16_t bytesReadTotal = 0;
-        // read until output buffer overflows or flash is exhausted
-        while (state.bytesWritten < state.outBufLen && address + bytesReadTotal < flashfsSize) {
+        // read until output buffer overflows or flash is exhausted.
+        // Well compressed data can take more flash than fits in the reply, up to the uncompressed count limit
+        while (state.bytesWritten < state.outBufLen && address + bytesReadTotal < flashfsSize
+            && bytesReadTotal <= UINT16_MAX - READ_BUFFER_SIZE) {
             const int bytesRead = flashfsReadAbs(address + bytesReadTotal, readBuffer,
                 MIN(sizeof(readBuffer), flashfsSize - address - bytesReadTotal));
 
-            const int status = huffmanEncodeBufStreaming(&state, readBuffer, bytesRead, huffmanTable);
+            int status;
+#ifdef USE_HUFFMAN_ADAPTIVE
+            if (compressionMethod == ADAPTIVE_HUFFMAN) {
+                status = huffmanAdaptiveEncodeBufStreaming(&state, &dataflashHuffmanModel, readBuffer, bytesRead);
+            } else
+#endif
+            {
+                status = huffmanEncodeBufStreaming(&state, readBuffer, bytesRead, huffmanTable);
+            }
             if (status == -1) {
                 // overflow
                 break;
@@ -2313,6 +2354,204 @@ static void writePidfs(pidProfile_t* pidProfile, sbuf_t *dst)
 }
 #endif // USE_SIMPLIFIED_TUNING
 
+// cmd (U16) and payload size (U8) ahead of each payload in a MSP2_MULTIPLE_MSP request
+#define MSP2_MULTIPLE_MSP_REQUEST_HEADER_SIZE 3
+// cmd (U16), result (I8) and reply size (U16) ahead of each reply
+#define MSP2_MULTIPLE_MSP_REPLY_HEADER_SIZE 5
+
+// The out buffer of every MSP port holds at least MSP_PORT_OUTBUF_SIZE_MIN, so no reply is larger
+static uint8_t multipleMspReplyBuf[MSP_PORT_OUTBUF_SIZE_MIN];
+
+static bool isMultipleMsp2RequestValid(sbuf_t *src)
+{
+    sbuf_t request = *src;
+
+    while (sbufBytesRemaining(&request) >= MSP2_MULTIPLE_MSP_REQUEST_HEADER_SIZE) {
+        sbufReadU16(&request);
+        const uint8_t payloadSize = sbufReadU8(&request);
+        if (payloadSize > sbufBytesRemaining(&request)) {
+            return false;
+        }
+        sbufAdvance(&request, payloadSize);
+    }
+
+    return sbufBytesRemaining(&request) == 0;
+}
+
+/*
+ * Runs the commands of a MSP2_MULTIPLE_MSP request in order, stopping at the first reply which doesn't fit, so the
+ * host can tell from the count of replies which commands to send again. Post processing (eg. a reboot) is not run for
+ * commands in a batch.
+ */
+static mspResult_e mspFcProcessMultipleMsp2(mspDescriptor_t srcDesc, sbuf_t *src, sbuf_t *dst)
+{
+    if (!isMultipleMsp2RequestValid(src)) {
+        return MSP_RESULT_ERROR;
+    }
+
+    while (sbufBytesRemaining(src)) {
+        const uint16_t cmd = sbufReadU16(src);
+        const uint8_t payloadSize = sbufReadU8(src);
+
+        mspPacket_t packetIn = {
+            .buf = { .ptr = sbufPtr(src), .end = sbufPtr(src) + payloadSize, },
+            .cmd = cmd,
+            .direction = MSP_DIRECTION_REQUEST,
+        };
+        sbufAdvance(src, payloadSize);
+
+        if (sbufBytesRemaining(dst) < MSP2_MULTIPLE_MSP_REPLY_HEADER_SIZE) {
+            break;
+        }
+        // Handlers don't check the space left, so each reply goes to a buffer which holds the largest of them.
+        // Those which size their reply to the space left see only what is left in dst.
+        const int spaceLeft = MIN(sbufBytesRemaining(dst) - MSP2_MULTIPLE_MSP_REPLY_HEADER_SIZE, (int)sizeof(multipleMspReplyBuf));
+        mspPacket_t packetOut;
+        sbufInit(&packetOut.buf, multipleMspReplyBuf, multipleMspReplyBuf + spaceLeft);
+
+        mspResult_e result;
+        if (cmd == MSP_MULTIPLE_MSP || cmd == MSP2_MULTIPLE_MSP || cmd == MSP2_MULTIPLE_MSP_SUBSCRIBE) {
+            // no batches within batches
+            result = MSP_RESULT_ERROR;
+        } else {
+            result = mspFcProcessCommand(srcDesc, &packetIn, &packetOut, NULL);
+        }
+
+        const int replySize = sbufPtr(&packetOut.buf) - multipleMspReplyBuf;
+        if (replySize > spaceLeft) {
+            break;
+        }
+
+        sbufWriteU16(dst, cmd);
+        sbufWriteU8(dst, (uint8_t)(int8_t)result);
+        sbufWriteU16(dst, replySize);
+        sbufWriteData(dst, multipleMspReplyBuf, replySize);
+    }
+
+    return MSP_RESULT_ACK;
+}
+
+/*
+ * Whether cmd is a getter, so that MSP2_MULTIPLE_MSP_SUBSCRIBE may push it at an interval. Getters of features which
+ * are not built in are listed too, they reply with an error.
+ */
+static bool mspFcIsReadOnlyCommand(int16_t cmdMSP)
+{
+    switch (cmdMSP) {
+    // mspCommonProcessOutCommand()
+    case MSP_API_VERSION:
+    case MSP_FC_VARIANT:
+    case MSP_FC_VERSION:
+    case MSP_BOARD_INFO:
+    case MSP_BUILD_INFO:
+    case MSP_ANALOG:
+    case MSP_DEBUG:
+    case MSP_UID:
+    case MSP_FEATURE_CONFIG:
+    case MSP_BEEPER_CONFIG:
+    case MSP_BATTERY_STATE:
+    case MSP_VOLTAGE_METERS:
+    case MSP_CURRENT_METERS:
+    case MSP_VOLTAGE_METER_CONFIG:
+    case MSP_CURRENT_METER_CONFIG:
+    case MSP_BATTERY_CONFIG:
+    case MSP_TRANSPONDER_CONFIG:
+    case MSP_OSD_CONFIG:
+    case MSP_OSD_CANVAS:
+    // mspProcessOutCommand()
+    case MSP_STATUS_EX:
+    case MSP_STATUS:
+    case MSP_RAW_IMU:
+    case MSP_NAME:
+    case MSP_SERVO:
+    case MSP_SERVO_CONFIGURATIONS:
+    case MSP_SERVO_MIX_RULES:
+    case MSP_MOTOR:
+    case MSP_MOTOR_TELEMETRY:
+    case MSP2_MOTOR_OUTPUT_REORDERING:
+    case MSP2_GET_VTX_DEVICE_STATUS:
+    case MSP2_GET_OSD_WARNINGS:
+    case MSP_RC:
+    case MSP_ATTITUDE:
+    case MSP_ALTITUDE:
+    case MSP_SONAR_ALTITUDE:
+    case MSP_BOARD_ALIGNMENT_CONFIG:
+    case MSP_ARMING_CONFIG:
+    case MSP_RC_TUNING:
+    case MSP_PID:
+    case MSP_PIDNAMES:
+    case MSP_PID_CONTROLLER:
+    case MSP_MODE_RANGES:
+    case MSP_MODE_RANGES_EXTRA:
+    case MSP_ADJUSTMENT_RANGES:
+    case MSP_MOTOR_CONFIG:
+    case MSP_COMPASS_CONFIG:
+    case MSP_ESC_SENSOR_DATA:
+    case MSP_GPS_CONFIG:
+    case MSP_RAW_GPS:
+    case MSP_COMP_GPS:
+    case MSP_GPSSVINFO:
+    case MSP_GPS_RESCUE:
+    case MSP_GPS_RESCUE_PIDS:
+    case MSP_ACC_TRIM:
+    case MSP_MIXER_CONFIG:
+    case MSP_RX_CONFIG:
+    case MSP_FAILSAFE_CONFIG:
+    case MSP_RXFAIL_CONFIG:
+    case MSP_RSSI_CONFIG:
+    case MSP_RX_MAP:
+    case MSP_CF_SERIAL_CONFIG:
+    case MSP2_COMMON_SERIAL_CONFIG:
+    case MSP_LED_COLORS:
+    case MSP_LED_STRIP_CONFIG:
+    case MSP_LED_STRIP_MODECOLOR:
+    case MSP_DATAFLASH_SUMMARY:
+    case MSP_BLACKBOX_CONFIG:
+    case MSP_SDCARD_SUMMARY:
+    case MSP_MOTOR_3D_CONFIG:
+    case MSP_RC_DEADBAND:
+    case MSP_SENSOR_ALIGNMENT:
+    case MSP_ADVANCED_CONFIG:
+    case MSP_FILTER_CONFIG:
+    case MSP_PID_ADVANCED:
+    case MSP_SENSOR_CONFIG:
+    case MSP2_SENSOR_CONFIG_ACTIVE:
+    case MSP_VTX_CONFIG:
+    case MSP_TX_INFO:
+    case MSP_RTC:
+    // mspFcProcessOutCommandWithArg()
+    case MSP_BOXNAMES:
+    case MSP_BOXIDS:
+    case MSP2_GET_CONFIG_SNAPSHOT:
+    case MSP2_GET_TEXT:
+    case MSP_VTXTABLE_BAND:
+    case MSP_VTXTABLE_POWERLEVEL:
+    case MSP_SIMPLIFIED_TUNING:
+    case MSP2_GET_TASK_HISTOGRAM:
+    case MSP2_GET_FLASHFS_LOGS:
+    case MSP2_GET_LED_STRIP_CONFIG_VALUES:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Setters, reboots and the like are refused, as a subscription would repeat them every interval
+static bool isMultipleMsp2RequestReadOnly(sbuf_t *src)
+{
+    sbuf_t request = *src;
+
+    while (sbufBytesRemaining(&request)) {
+        const uint16_t cmd = sbufReadU16(&request);
+        sbufAdvance(&request, sbufReadU8(&request));
+        if (!mspFcIsReadOnlyCommand(cmd)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static mspResult_e mspFcProcessOutCommandWithArg(mspDescriptor_t srcDesc, int16_t cmdMSP, sbuf_t *src, sbuf_t *dst, mspPostProcessFnPtr *mspPostProcessFn)
 {
 
@@ -2402,6 +2641,40 @@ static mspResult_e mspFcProcessOutCommandWithArg(mspDescriptor_t srcDesc, int16_
         }
         break;
 
+    case MSP2_MULTIPLE_MSP:
+        return mspFcProcessMultipleMsp2(srcDesc, src, dst);
+
+    case MSP2_MULTIPLE_MSP_SUBSCRIBE:
+        {
+            // interval in ms (0 cancels), then a MSP2_MULTIPLE_MSP request
+            if (sbufBytesRemaining(src) < 2) {
+                return MSP_RESULT_ERROR;
+            }
+            const uint16_t intervalMs = sbufReadU16(src);
+            if (!isMultipleMsp2RequestValid(src)
+                || !isMultipleMsp2RequestReadOnly(src)
+                || !mspSerialSubscribe(srcDesc, sbufPtr(src), sbufBytesRemaining(src), intervalMs)) {
+                return MSP_RESULT_ERROR;
+            }
+        }
+        break;
+
+    case MSP2_GET_CONFIG_SNAPSHOT:
+        {
+            // offset (U32) and the most to return (U16), replying with the offset, the snapshot size and its bytes
+            if (sbufBytesRemaining(src) < 6) {
+                return MSP_RESULT_ERROR;
+            }
+            const uint32_t offset = sbufReadU32(src);
+            const int maxLength = sbufReadU16(src);
+
+            sbufWriteU32(dst, offset);
+            sbufWriteU32(dst, configSnapshotSize());
+            const int length = configSnapshotRead(offset, sbufPtr(dst), MIN(maxLength, sbufBytesRemaining(dst)));
+            sbufAdvance(dst, length);
+        }
+        break;
+
 #ifdef USE_VTX_TABLE
     case MSP_VTXTABLE_BAND:
         {
@@ -2602,6 +2875,60 @@ static mspResult_e mspFcProcessOutCommandWithArg(mspDescriptor_t srcDesc, int16_
             }
         }
         break;
+#ifdef USE_TASK_HISTOGRAMS
+    case MSP2_GET_TASK_HISTOGRAM:
+        {
+            // task id, bucket count, then the execution time and start jitter buckets
+            const taskId_e taskId = sbufBytesRemaining(src) ? sbufReadU8(src) : TASK_COUNT;
+            taskHistogram_t histogram;
+            if (taskId >= TASK_COUNT || !getTaskHistogram(taskId, &histogram)) {
+                return MSP_RESULT_ERROR;
+            }
+
+            sbufWriteU8(dst, taskId);
+            sbufWriteU8(dst, TASK_HISTOGRAM_BUCKET_COUNT);
+            for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+                sbufWriteU32(dst, histogram.executionTimeUs[i]);
+            }
+            for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+                sbufWriteU32(dst, histogram.startJitterUs[i]);
+            }
+        }
+        break;
+#endif
+#ifdef USE_FLASHFS_INDEX
+    case MSP2_GET_FLASHFS_LOGS:
+        {
+            // available flag, first log index and log count, then start, size and flags of each log
+            const int logEntrySize = 2 * sizeof(uint32_t) + sizeof(uint8_t);
+            const uint16_t firstLog = sbufBytesRemaining(src) >= 2 ? sbufReadU16(src) : 0;
+            const bool available = flashfsIndexIsAvailable();
+
+            sbufWriteU8(dst, available ? 1 : 0);
+            sbufWriteU16(dst, firstLog);
+            uint8_t *logCountPtr = sbufPtr(dst);
+            sbufWriteU8(dst, 0);
+
+            if (available) {
+                flashfsIndexIterator_t iterator;
+                flashfsIndexLog_t log;
+                uint8_t logCount = 0;
+
+                flashfsIndexIteratorInit(&iterator);
+                for (int logIndex = 0; sbufBytesRemaining(dst) >= logEntrySize && flashfsIndexIteratorNext(&iterator, &log); logIndex++) {
+                    if (logIndex < firstLog) {
+                        continue;
+                    }
+                    sbufWriteU32(dst, log.start);
+                    sbufWriteU32(dst, log.end - log.start);
+                    sbufWriteU8(dst, log.indexed ? 0 : MSP_FLASHFS_LOG_FLAG_UNINDEXED);
+                    logCount++;
+                }
+                *logCountPtr = logCount;
+            }
+        }
+        break;
+#endif
 #ifdef USE_LED_STRIP
     case MSP2_GET_LED_STRIP_CONFIG_VALUES:
         sbufWriteU8(dst, ledStripConfig()->ledstrip_brightness);
@@ -2622,12 +2949,13 @@ static void mspFcDataFlashReadCommand(sbuf_t *dst, sbuf_t *src)
     const unsigned int dataSize = sbufBytesRemaining(src);
     const uint32_t readAddress = sbufReadU32(src);
     uint16_t readLength;
-    bool allowCompression = false;
+    uint8_t compression = NO_COMPRESSION;
     bool useLegacyFormat;
     if (dataSize >= sizeof(uint32_t) + sizeof(uint16_t)) {
         readLength = sbufReadU16(src);
         if (sbufBytesRemaining(src)) {
-            allowCompression = sbufReadU8(src);
+            // 0 none, 1 static huffman, 2 adaptive huffman (MSP_FLASHFS_FLAG_ADAPTIVE_HUFFMAN)
+            compression = sbufReadU8(src);
         }
         useLegacyFormat = false;
     } else {
@@ -2635,7 +2963,7 @@ static void mspFcDataFlashReadCommand(sbuf_t *dst, sbuf_t *src)
         useLegacyFormat = true;
     }
 
-    serializeDataflashReadReply(dst, readAddress, readLength, useLegacyFormat, allowCompression);
+    serializeDataflashReadReply(dst, readAddress, readLength, useLegacyFormat, compression);
 }
 #endif
 
@@ -3551,6 +3879,22 @@ static mspResult_e mspProcessInCommand(mspDescriptor_t srcDesc, int16_t cmdMSP,
         }
         break;
 
+#ifdef USE_TASK_HISTOGRAMS
+    case MSP2_RESET_TASK_HISTOGRAMS:
+        if (sbufBytesRemaining(src)) {
+            const taskId_e taskId = sbufReadU8(src);
+            if (taskId >= TASK_COUNT) {
+                return MSP_RESULT_ERROR;
+            }
+            schedulerResetTaskHistogram(taskId);
+        } else {
+            for (taskId_e taskId = 0; taskId < TASK_COUNT; taskId++) {
+                schedulerResetTaskHistogram(taskId);
+            }
+        }
+        break;
+#endif
+
 #ifdef USE_DSHOT
     case MSP2_SEND_DSHOT_COMMAND:
         {
@@ -4067,6 +4411,28 @@ static mspResult_e mspProcessInCommand(mspDescriptor_t srcDesc, int16_t cmdMSP,
         }
         break;
 
+    case MSP2_SET_CONFIG_SNAPSHOT:
+        {
+            // offset (U32) and snapshot size (U32), then the bytes at the offset, starting a restore at offset 0
+            if (ARMING_FLAG(ARMED) || dataSize < 8) {
+                return MSP_RESULT_ERROR;
+            }
+            const uint32_t offset = sbufReadU32(src);
+            const uint32_t size = sbufReadU32(src);
+
+            // the PGs are only changed once the last part has been checked
+            if ((offset == 0 && !configSnapshotRestoreBegin(size))
+                || !configSnapshotRestoreWrite(offset, sbufPtr(src), sbufBytesRemaining(src))) {
+                return MSP_RESULT_ERROR;
+            }
+
+            if (configSnapshotRestoreIsComplete()) {
+                schedulerIgnoreTaskStateTime();
+                writeReadEeprom(NULL);
+            }
+        }
+        break;
+
 #ifdef USE_LED_STRIP
     case MSP2_SET_LED_STRIP_CONFIG_VALUES:
         ledStripConfigMutable()->ledstrip_brightness = sbufReadU8(src);
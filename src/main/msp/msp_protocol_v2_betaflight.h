@@ -29,6 +29,13 @@
 #define MSP2_GET_LED_STRIP_CONFIG_VALUES    0x3008
 #define MSP2_SET_LED_STRIP_CONFIG_VALUES    0x3009
 #define MSP2_SENSOR_CONFIG_ACTIVE           0x300A
+#define MSP2_GET_TASK_HISTOGRAM             0x300B  // returns the execution time and start jitter histograms of a gyro, filter or PID task
+#define MSP2_RESET_TASK_HISTOGRAMS          0x300C  // clears the histograms of a task, or of all tasks without an argument
+#define MSP2_GET_FLASHFS_LOGS               0x300D  // returns the blackbox logs on the dataflash from its log index
+#define MSP2_MULTIPLE_MSP                   0x300E  // runs a list of commands with their payloads, returning their replies in one frame
+#define MSP2_MULTIPLE_MSP_SUBSCRIBE         0x300F  // pushes the MSP2_MULTIPLE_MSP reply for a list of read-only commands at a fixed interval
+#define MSP2_GET_CONFIG_SNAPSHOT            0x3010  // returns part of a binary snapshot of all parameter groups
+#define MSP2_SET_CONFIG_SNAPSHOT            0x3011  // restores a snapshot part by part, saving it once the last part is checked
 
 // MSP2_SET_TEXT and MSP2_GET_TEXT variable types
 #define MSP2TEXT_PILOT_NAME                      1
@@ -37,6 +37,7 @@
 #include "io/displayport_msp.h"
 
 #include "msp/msp.h"
+#include "msp/msp_protocol_v2_betaflight.h"
 
 #include "msp_serial.h"
 
@@ -304,6 +305,7 @@ static uint8_t mspSerialChecksumBuf(uint8_t checksum, const uint8_t *data, int l
 }
 
 #define JUMBO_FRAME_SIZE_LIMIT 255
+#define JUMBO_REPLY_DRAIN_TIMEOUT_MS 1000  // a 4kB reply takes about 360ms at 115200 baud
 static int mspSerialSendFrame(mspPort_t *msp, const uint8_t * hdr, int hdrLen, const uint8_t * data, int dataLen, const uint8_t * crc, int crcLen)
 {
     // We are allowed to send out the response if
@@ -413,10 +415,10 @@ static int mspSerialEncode(mspPort_t *msp, mspPacket_t *packet, mspVersion_e msp
     return mspSerialSendFrame(msp, hdrBuf, hdrLen, sbufPtr(&packet->buf), dataLen, crcBuf, crcLen);
 }
 
+static uint8_t mspSerialOutBuf[MSP_PORT_OUTBUF_SIZE];
+
 static mspPostProcessFnPtr mspSerialProcessReceivedCommand(mspPort_t *msp, mspProcessCommandFnPtr mspProcessCommandFn)
 {
-    static uint8_t mspSerialOutBuf[MSP_PORT_OUTBUF_SIZE];
-
     mspPacket_t reply = {
         .buf = { .ptr = mspSerialOutBuf, .end = ARRAYEND(mspSerialOutBuf), },
         .cmd = -1,
@@ -439,12 +441,46 @@ static mspPostProcessFnPtr mspSerialProcessReceivedCommand(mspPort_t *msp, mspPr
 
     if (status != MSP_RESULT_NO_REPLY) {
         sbufSwitchToReader(&reply.buf, outBufHead); // change streambuf direction
-        mspSerialEncode(msp, &reply, msp->mspVersion);
+        msp->jumboReplyPending = mspSerialEncode(msp, &reply, msp->mspVersion) > JUMBO_FRAME_SIZE_LIMIT;
+        msp->jumboReplySentAtMs = millis();
     }
 
     return mspPostProcessFn;
 }
 
+// Push the reply to the port's MSP2_MULTIPLE_MSP subscription when it is due, as though it had been requested
+static void mspSerialPushSubscription(mspPort_t *msp, mspProcessCommandFnPtr mspProcessCommandFn)
+{
+    const timeMs_t nowMs = millis();
+    if (nowMs - msp->subscriptionPushedAtMs < msp->subscriptionIntervalMs) {
+        return;
+    }
+    msp->subscriptionPushedAtMs = nowMs;
+
+    mspPacket_t reply = {
+        .buf = { .ptr = mspSerialOutBuf, .end = ARRAYEND(mspSerialOutBuf), },
+        .cmd = -1,
+        .flags = 0,
+        .result = 0,
+        .direction = MSP_DIRECTION_REPLY,
+    };
+    uint8_t *outBufHead = reply.buf.ptr;
+
+    mspPacket_t command = {
+        .buf = { .ptr = msp->subscription, .end = msp->subscription + msp->subscriptionSize, },
+        .cmd = MSP2_MULTIPLE_MSP,
+        .flags = 0,
+        .result = 0,
+        .direction = MSP_DIRECTION_REQUEST,
+    };
+
+    if (mspProcessCommandFn(msp->descriptor, &command, &reply, NULL) != MSP_RESULT_NO_REPLY) {
+        sbufSwitchToReader(&reply.buf, outBufHead);
+        // dropped rather than queued when the TX buffer is full, the next push has fresher data
+        mspSerialEncode(msp, &reply, msp->subscriptionVersion);
+    }
+}
+
 static void mspEvaluateNonMspData(mspPort_t * mspPort, uint8_t receivedChar)
 {
    if (receivedChar == serialConfig()->reboot_character) {
@@ -516,6 +552,22 @@ void mspSerialProcess(mspEvaluateNonMspData_e evaluateNonMspData, mspProcessComm
 
         mspPostProcessFnPtr mspPostProcessFn = NULL;
 
+        // A host may pipeline requests, eg. MSP_DATAFLASH_READ, without waiting for each reply.
+        // Leave them in the RX buffer until a jumbo reply has drained, as the next reply would
+        // not fit in the TX buffer and get dropped. A port that does not drain, eg. a UART whose
+        // host has stopped reading, only holds them up for JUMBO_REPLY_DRAIN_TIMEOUT_MS, then
+        // requests are processed again and replies that do not fit are dropped as before.
+        if (mspPort->jumboReplyPending) {
+            if (!isSerialTransmitBufferEmpty(mspPort->port) && millis() - mspPort->jumboReplySentAtMs < JUMBO_REPLY_DRAIN_TIMEOUT_MS) {
+                continue;
+            }
+            mspPort->jumboReplyPending = false;
+        }
+
+        if (mspPort->subscriptionIntervalMs) {
+            mspSerialPushSubscription(mspPort, mspProcessCommandFn);
+        }
+
         if (serialRxBytesWaiting(mspPort->port)) {
             // There are bytes incoming - abort pending request
             mspPort->lastActivityMs = millis();
@@ -601,6 +653,34 @@ int mspSerialPush(serialPortIdentifier_e port, uint8_t cmd, uint8_t *data, int d
 }
 
 
+/*
+ * Have the MSP2_MULTIPLE_MSP reply for request pushed to the serial port the descriptor belongs to every intervalMs,
+ * using the MSP version of the port's last command, in place of any earlier subscription. An interval of 0 cancels.
+ */
+bool mspSerialSubscribe(mspDescriptor_t descriptor, const uint8_t *request, int requestSize, uint16_t intervalMs)
+{
+    for (int portIndex = 0; portIndex < MAX_MSP_PORT_COUNT; portIndex++) {
+        mspPort_t * const mspPort = &mspPorts[portIndex];
+        if (!mspPort->port || mspPort->descriptor != descriptor) {
+            continue;
+        }
+
+        if (requestSize > (int)sizeof(mspPort->subscription)) {
+            return false;
+        }
+
+        memcpy(mspPort->subscription, request, requestSize);
+        mspPort->subscriptionSize = requestSize;
+        mspPort->subscriptionIntervalMs = requestSize ? intervalMs : 0;
+        mspPort->subscriptionVersion = mspPort->mspVersion;
+        mspPort->subscriptionPushedAtMs = millis();
+
+        return true;
+    }
+
+    return false;
+}
+
 uint32_t mspSerialTxBytesFree(void)
 {
     uint32_t ret = UINT32_MAX;
@@ -95,6 +95,9 @@ typedef struct __attribute__((packed)) {
 
 #define MSP_MAX_HEADER_SIZE     9
 
+// Room for a MSP2_MULTIPLE_MSP request pushed at an interval, see mspSerialSubscribe()
+#define MSP_PORT_SUBSCRIPTION_SIZE 64
+
 struct serialPort_s;
 typedef struct mspPort_s {
     struct serialPort_s *port; // null when port unused.
@@ -111,7 +114,14 @@ typedef struct mspPort_s {
     uint8_t checksum1;
     uint8_t checksum2;
     bool sharedWithTelemetry;
+    bool jumboReplyPending;     // a jumbo reply is still being transmitted, see mspSerialProcess()
+    timeMs_t jumboReplySentAtMs;
     mspDescriptor_t descriptor;
+    uint8_t subscription[MSP_PORT_SUBSCRIPTION_SIZE];
+    uint8_t subscriptionSize;
+    uint16_t subscriptionIntervalMs;    // 0 when there is no subscription
+    mspVersion_e subscriptionVersion;
+    timeMs_t subscriptionPushedAtMs;
 } mspPort_t;
 
 void mspSerialInit(void);
@@ -122,4 +132,5 @@ void mspSerialReleasePortIfAllocated(struct serialPort_s *serialPort);
 void mspSerialReleaseSharedTelemetryPorts(void);
 mspDescriptor_t getMspSerialPortDescriptor(const uint8_t portIdentifier);
 int mspSerialPush(serialPortIdentifier_e port, uint8_t cmd, uint8_t *data, int datalen, mspDirection_e direction, mspVersion_e mspVersion);
+bool mspSerialSubscribe(mspDescriptor_t descriptor, const uint8_t *request, int requestSize, uint16_t intervalMs);
 uint32_t mspSerialTxBytesFree(void);
@@ -31,6 +31,7 @@ typedef struct flashConfig_s {
     uint8_t spiDevice;
     uint8_t quadSpiDevice;
     uint8_t octoSpiDevice;
+    uint8_t ringEraseAheadSectors;  // sectors flashfs keeps erased ahead of the write position, overwriting the oldest logs, 0 to stop when full
 } flashConfig_t;
 
 PG_DECLARE(flashConfig_t, flashConfig);
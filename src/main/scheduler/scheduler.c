@@ -261,6 +261,27 @@ void getTaskInfo(taskId_e taskId, taskInfo_t * taskInfo)
 #endif
 }
 
+#if defined(USE_TASK_HISTOGRAMS)
+static taskHistogram_t taskHistograms[TASK_HISTOGRAM_TASK_COUNT];
+
+static taskHistogram_t *getTaskHistogramPtr(taskId_e taskId)
+{
+    const unsigned index = taskId - TASK_HISTOGRAM_FIRST_TASK;
+    return index < TASK_HISTOGRAM_TASK_COUNT ? &taskHistograms[index] : NULL;
+}
+
+// Returns false for tasks that keep no histogram
+bool getTaskHistogram(taskId_e taskId, taskHistogram_t *histogram)
+{
+    const taskHistogram_t *taskHistogram = getTaskHistogramPtr(taskId);
+    if (!taskHistogram) {
+        return false;
+    }
+    *histogram = *taskHistogram;
+    return true;
+}
+#endif
+
 void rescheduleTask(taskId_e taskId, timeDelta_t newPeriodUs)
 {
     task_t *task;
@@ -361,6 +382,22 @@ void schedulerResetCheckFunctionMaxExecutionTime(void)
     checkFuncMaxExecutionTimeUs = 0;
 }
 
+#if defined(USE_TASK_HISTOGRAMS)
+void schedulerResetTaskHistogram(taskId_e taskId)
+{
+    taskHistogram_t *taskHistogram = getTaskHistogramPtr(taskId == TASK_SELF ? (taskId_e)(currentTask - tasks) : taskId);
+    if (taskHistogram) {
+        memset(taskHistogram, 0, sizeof(*taskHistogram));
+    }
+}
+
+static unsigned taskHistogramBucket(timeUs_t timeUs)
+{
+    const unsigned bucket = timeUs ? llog2(timeUs) + 1 : 0;
+    return MIN(bucket, (unsigned)TASK_HISTOGRAM_BUCKET_COUNT - 1);
+}
+#endif
+
 void schedulerInit(void)
 {
     queueClear();
@@ -388,6 +425,9 @@ void schedulerInit(void)
 
     for (taskId_e taskId = 0; taskId < TASK_COUNT; taskId++) {
         schedulerResetTaskStatistics(taskId);
+#if defined(USE_TASK_HISTOGRAMS)
+        schedulerResetTaskHistogram(taskId);
+#endif
     }
 }
 
@@ -413,6 +453,9 @@ FAST_CODE timeUs_t schedulerExecuteTask(task_t *selectedTask, timeUs_t currentTi
         ignoreCurrentTaskExecTime = false;
         taskNextStateTime = -1;
         float period = currentTimeUs - selectedTask->lastExecutedAtUs;
+#if defined(USE_TASK_HISTOGRAMS)
+        const bool hasRunBefore = selectedTask->lastExecutedAtUs != 0;
+#endif
         selectedTask->lastExecutedAtUs = currentTimeUs;
         selectedTask->lastDesiredAt += selectedTask->attribute->desiredPeriodUs;
         selectedTask->dynamicPriority = 0;
@@ -449,6 +492,19 @@ FAST_CODE timeUs_t schedulerExecuteTask(task_t *selectedTask, timeUs_t currentTi
             selectedTask->maxExecutionTimeUs = MAX(selectedTask->maxExecutionTimeUs, taskExecutionTimeUs);
         }
 
+#if defined(USE_TASK_HISTOGRAMS)
+        taskHistogram_t *taskHistogram = getTaskHistogramPtr(selectedTask - tasks);
+        if (taskHistogram) {
+            if (!ignoreCurrentTaskExecTime) {
+                taskHistogram->executionTimeUs[taskHistogramBucket(taskExecutionTimeUs)]++;
+            }
+            if (!ignoreCurrentTaskExecRate && hasRunBefore) {
+                const timeDelta_t jitterUs = lrintf(period) - selectedTask->attribute->desiredPeriodUs;
+                taskHistogram->startJitterUs[taskHistogramBucket(ABS(jitterUs))]++;
+            }
+        }
+#endif
+
         selectedTask->totalExecutionTimeUs += taskExecutionTimeUs;   // time consumed by scheduler + task
         selectedTask->movingAverageCycleTimeUs += 0.05f * (period - selectedTask->movingAverageCycleTimeUs);
 #if defined(USE_LATE_TASK_STATISTICS)
@@ -843,3 +899,18 @@ float schedulerGetCycleTimeMultiplier(void)
 {
     return (float)clockMicrosToCycles(getTask(TASK_GYRO)->attribute->desiredPeriodUs) / desiredPeriodCycles;
 }
+
+// Cycles until the next gyro task boundary as scheduler() will compute it, or zero if it is already due
+int32_t schedulerGetGyroRemainingCycles(void)
+{
+    uint32_t nextTargetCycles = lastTargetCycles + desiredPeriodCycles;
+    int32_t remainingCycles = cmpTimeCycles(nextTargetCycles, getCycleCounter());
+
+    if (remainingCycles < -desiredPeriodCycles) {
+        // Match the recovery from a skipped gyro cycle in scheduler()
+        nextTargetCycles += desiredPeriodCycles * (1 + (remainingCycles / -desiredPeriodCycles));
+        remainingCycles = cmpTimeCycles(nextTargetCycles, getCycleCounter());
+    }
+
+    return MAX(remainingCycles, 0);
+}
@@ -95,6 +95,16 @@ typedef struct {
 #endif
 } taskInfo_t;
 
+#if defined(USE_TASK_HISTOGRAMS)
+// Bucket 0 counts 0us, bucket n counts [2^(n-1), 2^n)us and the last bucket everything from 1024us up
+#define TASK_HISTOGRAM_BUCKET_COUNT 12
+
+typedef struct {
+    uint32_t executionTimeUs[TASK_HISTOGRAM_BUCKET_COUNT];
+    uint32_t startJitterUs[TASK_HISTOGRAM_BUCKET_COUNT];    // difference between actual and desired period
+} taskHistogram_t;
+#endif
+
 typedef enum {
     /* Actual tasks */
     TASK_SYSTEM = 0,
@@ -110,6 +120,7 @@ typedef enum {
     TASK_BATTERY_VOLTAGE,
     TASK_BATTERY_CURRENT,
     TASK_BATTERY_ALERTS,
+    TASK_EEPROM_WRITE,
 #ifdef USE_BEEPER
     TASK_BEEPER,
 #endif
@@ -191,6 +202,12 @@ typedef enum {
     TASK_SELF
 } taskId_e;
 
+#if defined(USE_TASK_HISTOGRAMS)
+// Only the tasks of the realtime loop keep histograms, so that they fit in the RAM of the smallest targets
+#define TASK_HISTOGRAM_FIRST_TASK TASK_GYRO
+#define TASK_HISTOGRAM_TASK_COUNT (TASK_PID - TASK_GYRO + 1)
+#endif
+
 typedef struct {
     // Configuration
     const char * taskName;
@@ -240,6 +257,10 @@ bool schedulerGetIgnoreTaskExecTime();
 void schedulerResetTaskStatistics(taskId_e taskId);
 void schedulerResetTaskMaxExecutionTime(taskId_e taskId);
 void schedulerResetCheckFunctionMaxExecutionTime(void);
+#if defined(USE_TASK_HISTOGRAMS)
+bool getTaskHistogram(taskId_e taskId, taskHistogram_t *histogram);
+void schedulerResetTaskHistogram(taskId_e taskId);
+#endif
 void schedulerSetNextStateTime(timeDelta_t nextStateTime);
 timeDelta_t schedulerGetNextStateTime(void);
 void schedulerInit(void);
@@ -250,3 +271,4 @@ uint32_t getCpuPercentageLate(void);
 void schedulerEnableGyro(void);
 uint16_t getAverageSystemLoadPercent(void);
 float schedulerGetCycleTimeMultiplier(void);
+int32_t schedulerGetGyroRemainingCycles(void);
@@ -50,6 +50,7 @@
 #endif
 
 #define GYRO_IMU_DOWNSAMPLE_CUTOFF_HZ 200
+#define GYRO_BIQUAD_SECTION_COUNT_MAX 3  // notch 1, notch 2 and lowpass 1
 
 typedef union gyroLowpassFilter_u {
     pt1Filter_t pt1FilterState;
@@ -100,17 +101,15 @@ typedef struct gyro_s {
     // lowpass gyro soft filter
     filterApplyFnPtr lowpassFilterApplyFn;
     gyroLowpassFilter_t lowpassFilter[XYZ_AXIS_COUNT];
+    bool lowpassFilterEnabled;         // if false then lowpass 1 is off or a static biquad in the biquad cascade
 
     // lowpass2 gyro soft filter
     filterApplyFnPtr lowpass2FilterApplyFn;
     gyroLowpassFilter_t lowpass2Filter[XYZ_AXIS_COUNT];
 
-    // notch filters
-    filterApplyFnPtr notchFilter1ApplyFn;
-    biquadFilter_t notchFilter1[XYZ_AXIS_COUNT];
-
-    filterApplyFnPtr notchFilter2ApplyFn;
-    biquadFilter_t notchFilter2[XYZ_AXIS_COUNT];
+    // notch filters and a static biquad lowpass 1, applied as one biquad cascade per axis
+    biquadFilter_t biquadSections[XYZ_AXIS_COUNT][GYRO_BIQUAD_SECTION_COUNT_MAX];
+    biquadCascade_t biquadCascade[XYZ_AXIS_COUNT];
 
     uint16_t accSampleRateHz;
     uint8_t gyroToUse;
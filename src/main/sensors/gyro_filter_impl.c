@@ -22,6 +22,8 @@
 
 static FAST_CODE void GYRO_FILTER_FUNCTION_NAME(void)
 {
+    float gyroADCf[XYZ_AXIS_COUNT];
+
     for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
         // DEBUG_GYRO_RAW records the raw value read from the sensor (not zero offset, not scaled)
         GYRO_FILTER_DEBUG_SET(DEBUG_GYRO_RAW, axis, gyro.rawSensorDev->gyroADCRaw[axis]);
@@ -34,58 +36,65 @@ static FAST_CODE void GYRO_FILTER_FUNCTION_NAME(void)
         GYRO_FILTER_AXIS_DEBUG_SET(axis, DEBUG_GYRO_SAMPLE, 0, lrintf(gyro.gyroADC[axis]));
 
         // downsample the individual gyro samples
-        float gyroADCf = 0;
+        gyroADCf[axis] = 0;
         if (gyro.downsampleFilterEnabled) {
             // using gyro lowpass 2 filter for downsampling
-            gyroADCf = gyro.sampleSum[axis];
+            gyroADCf[axis] = gyro.sampleSum[axis];
         } else {
             // using simple average for downsampling
             if (gyro.sampleCount) {
-                gyroADCf = gyro.sampleSum[axis] / gyro.sampleCount;
+                gyroADCf[axis] = gyro.sampleSum[axis] / gyro.sampleCount;
             }
             gyro.sampleSum[axis] = 0;
         }
 
         // DEBUG_GYRO_SAMPLE(1) Record the post-downsample value for the selected debug axis
-        GYRO_FILTER_AXIS_DEBUG_SET(axis, DEBUG_GYRO_SAMPLE, 1, lrintf(gyroADCf));
+        GYRO_FILTER_AXIS_DEBUG_SET(axis, DEBUG_GYRO_SAMPLE, 1, lrintf(gyroADCf[axis]));
+    }
 
 #ifdef USE_RPM_FILTER
-        gyroADCf = rpmFilterApply(axis, gyroADCf);
+    // all axes at once, they share the notch coefficients
+    rpmFilterApply(gyroADCf);
 #endif
 
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        float gyroADCfAxis = gyroADCf[axis];
+
         // DEBUG_GYRO_SAMPLE(2) Record the post-RPM Filter value for the selected debug axis
-        GYRO_FILTER_AXIS_DEBUG_SET(axis, DEBUG_GYRO_SAMPLE, 2, lrintf(gyroADCf));
+        GYRO_FILTER_AXIS_DEBUG_SET(axis, DEBUG_GYRO_SAMPLE, 2, lrintf(gyroADCfAxis));
 
         // apply static notch filters and software lowpass filters
-        gyroADCf = gyro.notchFilter1ApplyFn((filter_t *)&gyro.notchFilter1[axis], gyroADCf);
-        gyroADCf = gyro.notchFilter2ApplyFn((filter_t *)&gyro.notchFilter2[axis], gyroADCf);
-        gyroADCf = gyro.lowpassFilterApplyFn((filter_t *)&gyro.lowpassFilter[axis], gyroADCf);
+        // a static biquad lowpass is part of the cascade, any other lowpass is applied after it
+        gyroADCfAxis = biquadCascadeApply(&gyro.biquadCascade[axis], gyroADCfAxis);
+        if (gyro.lowpassFilterEnabled) {
+            gyroADCfAxis = gyro.lowpassFilterApplyFn((filter_t *)&gyro.lowpassFilter[axis], gyroADCfAxis);
+        }
 
         // DEBUG_GYRO_SAMPLE(3) Record the post-static notch and lowpass filter value for the selected debug axis
-        GYRO_FILTER_AXIS_DEBUG_SET(axis, DEBUG_GYRO_SAMPLE, 3, lrintf(gyroADCf));
+        GYRO_FILTER_AXIS_DEBUG_SET(axis, DEBUG_GYRO_SAMPLE, 3, lrintf(gyroADCfAxis));
 
 #ifdef USE_DYN_NOTCH_FILTER
         if (isDynNotchActive()) {
             if (axis == gyro.gyroDebugAxis) {
-                GYRO_FILTER_DEBUG_SET(DEBUG_FFT, 0, lrintf(gyroADCf));
-                GYRO_FILTER_DEBUG_SET(DEBUG_FFT_FREQ, 0, lrintf(gyroADCf));
-                GYRO_FILTER_DEBUG_SET(DEBUG_DYN_LPF, 0, lrintf(gyroADCf));
+                GYRO_FILTER_DEBUG_SET(DEBUG_FFT, 0, lrintf(gyroADCfAxis));
+                GYRO_FILTER_DEBUG_SET(DEBUG_FFT_FREQ, 0, lrintf(gyroADCfAxis));
+                GYRO_FILTER_DEBUG_SET(DEBUG_DYN_LPF, 0, lrintf(gyroADCfAxis));
             }
 
-            dynNotchPush(axis, gyroADCf);
-            gyroADCf = dynNotchFilter(axis, gyroADCf);
+            dynNotchPush(axis, gyroADCfAxis);
+            gyroADCfAxis = dynNotchFilter(axis, gyroADCfAxis);
 
             if (axis == gyro.gyroDebugAxis) {
-                GYRO_FILTER_DEBUG_SET(DEBUG_FFT, 1, lrintf(gyroADCf));
-                GYRO_FILTER_DEBUG_SET(DEBUG_DYN_LPF, 3, lrintf(gyroADCf));
+                GYRO_FILTER_DEBUG_SET(DEBUG_FFT, 1, lrintf(gyroADCfAxis));
+                GYRO_FILTER_DEBUG_SET(DEBUG_DYN_LPF, 3, lrintf(gyroADCfAxis));
             }
         }
 #endif
 
         // DEBUG_GYRO_FILTERED records the scaled, filtered, after all software filtering has been applied.
-        GYRO_FILTER_DEBUG_SET(DEBUG_GYRO_FILTERED, axis, lrintf(gyroADCf));
+        GYRO_FILTER_DEBUG_SET(DEBUG_GYRO_FILTERED, axis, lrintf(gyroADCfAxis));
 
-        gyro.gyroADCf[axis] = gyroADCf;
+        gyro.gyroADCf[axis] = gyroADCfAxis;
     }
     gyro.sampleCount = 0;
 }
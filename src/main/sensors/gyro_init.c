@@ -110,34 +110,27 @@ static uint16_t calculateNyquistAdjustedNotchHz(uint16_t notchHz, uint16_t notch
     return notchHz;
 }
 
-static void gyroInitFilterNotch1(uint16_t notchHz, uint16_t notchCutoffHz)
+static void gyroInitFilterNotch(uint16_t notchHz, uint16_t notchCutoffHz)
 {
-    gyro.notchFilter1ApplyFn = nullFilterApply;
-
     notchHz = calculateNyquistAdjustedNotchHz(notchHz, notchCutoffHz);
 
     if (notchHz != 0 && notchCutoffHz != 0) {
-        gyro.notchFilter1ApplyFn = (filterApplyFnPtr)biquadFilterApply;
+        const int section = gyro.biquadCascade[0].count;
         const float notchQ = filterGetNotchQ(notchHz, notchCutoffHz);
         for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-            biquadFilterInit(&gyro.notchFilter1[axis], notchHz, gyro.targetLooptime, notchQ, FILTER_NOTCH, 1.0f);
+            biquadFilterInit(&gyro.biquadSections[axis][section], notchHz, gyro.targetLooptime, notchQ, FILTER_NOTCH, 1.0f);
+            gyro.biquadCascade[axis].count++;
         }
     }
 }
 
-static void gyroInitFilterNotch2(uint16_t notchHz, uint16_t notchCutoffHz)
+static bool gyroLowpass1IsDynamic(void)
 {
-    gyro.notchFilter2ApplyFn = nullFilterApply;
-
-    notchHz = calculateNyquistAdjustedNotchHz(notchHz, notchCutoffHz);
-
-    if (notchHz != 0 && notchCutoffHz != 0) {
-        gyro.notchFilter2ApplyFn = (filterApplyFnPtr)biquadFilterApply;
-        const float notchQ = filterGetNotchQ(notchHz, notchCutoffHz);
-        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-            biquadFilterInit(&gyro.notchFilter2[axis], notchHz, gyro.targetLooptime, notchQ, FILTER_NOTCH, 1.0f);
-        }
-    }
+#ifdef USE_DYN_LPF
+    return gyroConfig()->gyro_lpf1_dyn_min_hz > 0;
+#else
+    return false;
+#endif
 }
 
 static bool gyroInitLowpassFilterLpf(int slot, int type, uint16_t lpfHz, uint32_t looptime)
@@ -185,13 +178,19 @@ static bool gyroInitLowpassFilterLpf(int slot, int type, uint16_t lpfHz, uint32_
             break;
         case FILTER_BIQUAD:
             if (lpfHz <= gyroFrequencyNyquist) {
-#ifdef USE_DYN_LPF
-                *lowpassFilterApplyFn = (filterApplyFnPtr) biquadFilterApplyDF1;
-#else
-                *lowpassFilterApplyFn = (filterApplyFnPtr) biquadFilterApply;
-#endif
-                for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                    biquadFilterInitLPF(&lowpassFilter[axis].biquadFilterState, lpfHz, looptime);
+                if (slot == FILTER_LPF1 && !gyroLowpass1IsDynamic()) {
+                    // appended to the biquad cascade after the notches
+                    const int section = gyro.biquadCascade[0].count;
+                    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                        biquadFilterInitLPF(&gyro.biquadSections[axis][section], lpfHz, looptime);
+                        gyro.biquadCascade[axis].count++;
+                    }
+                } else {
+                    // a dynamic lowpass changes its coefficients in flight, which direct form 1 copes with
+                    *lowpassFilterApplyFn = slot == FILTER_LPF1 ? (filterApplyFnPtr) biquadFilterApplyDF1 : (filterApplyFnPtr) biquadFilterApply;
+                    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                        biquadFilterInitLPF(&lowpassFilter[axis].biquadFilterState, lpfHz, looptime);
+                    }
                 }
                 ret = true;
             }
@@ -255,12 +254,21 @@ void gyroInitFilters(void)
     }
 #endif
 
+    // the notches and a static biquad lowpass 1 are built up as one biquad cascade per axis
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        biquadCascadeInit(&gyro.biquadCascade[axis], gyro.biquadSections[axis], 0, BIQUAD_FORM_DF2T);
+    }
+
+    gyroInitFilterNotch(gyroConfig()->gyro_soft_notch_hz_1, gyroConfig()->gyro_soft_notch_cutoff_1);
+    gyroInitFilterNotch(gyroConfig()->gyro_soft_notch_hz_2, gyroConfig()->gyro_soft_notch_cutoff_2);
+
     gyroInitLowpassFilterLpf(
       FILTER_LPF1,
       gyroConfig()->gyro_lpf1_type,
       gyro_lpf1_init_hz,
       gyro.targetLooptime
     );
+    gyro.lowpassFilterEnabled = gyro.lowpassFilterApplyFn != nullFilterApply;
 
     gyro.downsampleFilterEnabled = gyroInitLowpassFilterLpf(
       FILTER_LPF2,
@@ -269,8 +277,6 @@ void gyroInitFilters(void)
       gyro.sampleLooptime
     );
 
-    gyroInitFilterNotch1(gyroConfig()->gyro_soft_notch_hz_1, gyroConfig()->gyro_soft_notch_cutoff_1);
-    gyroInitFilterNotch2(gyroConfig()->gyro_soft_notch_hz_2, gyroConfig()->gyro_soft_notch_cutoff_2);
 #ifdef USE_DYN_LPF
     dynLpfFilterInit();
 #endif
@@ -0,0 +1,390 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A rigid body quad X model, so SITL can fly closed loop without an external simulator.
+ *
+ * The motors follow the throttle with a first order lag, thrust and the props' drag torque go with the square of the
+ * motor speed, and the frame has quadratic drag and a little rate damping. The virtual gyro and accelerometer see the
+ * body rates and specific force plus white noise and a vibration at each motor's rotation frequency, growing with
+ * its speed, for the filters to work on. It sits on flat ground at z = 0 until the thrust lifts it.
+ *
+ * The body axes are forward, left, up and the earth axes north, west, up, which are those of the FC's gyro, acc
+ * and attitude, so the motors' geometry below is all that ties the model to the mixer.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#include <errno.h>
+
+#include "platform.h"
+
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "drivers/accgyro/accgyro_virtual.h"
+#include "drivers/barometer/barometer_virtual.h"
+
+#include "flight/imu.h"
+
+#include "target/SITL/physics.h"
+
+#define PHYSICS_MAX_STEP_US     125         // integration step, at most
+#define PHYSICS_MAX_UPDATE_US   100000      // a longer gap, eg. a stalled loop, is not caught up
+
+#define GRAVITY                 9.80665
+#define SEA_LEVEL_PRESSURE      101325.0    // Pa
+
+#define RAD2DEG                 (180.0 / M_PI)
+#define RPM_TO_RADS             (M_PI / 30.0)
+#define ACC_SCALE               (256 / GRAVITY)
+#define GYRO_SCALE              (16.4)
+
+typedef struct physicsModel_s {
+    double mass;                // kg
+    double armOffset;           // m, forward and sideways from the centre of mass to each motor
+    double inertia[3];          // kg m^2, roll, pitch, yaw
+    double maxRpm;              // at full throttle
+    double maxThrust;           // N per motor, at full throttle
+    double torquePerThrust;     // m, the prop's yaw reaction torque per N of thrust
+    double motorTimeConstant;   // s
+    double rotorInertia;        // kg m^2 of each prop and motor bell, speeding it up turns the frame the other way
+    double drag;                // N / (m/s)^2
+    double rateDamping;         // N m / (rad/s)
+    double gyroNoise;           // rad/s rms
+    double gyroVibration;       // rad/s peak per motor, at full speed
+    double accNoise;            // m/s^2 rms
+    double accVibration;        // m/s^2 peak per motor, at full speed
+    double baroNoise;           // Pa rms
+} physicsModel_t;
+
+// A 5" freestyle quad on 4S
+static const physicsModel_t model = {
+    .mass = 0.65,
+    .armOffset = 0.08,
+    .inertia = { 2.2e-3, 2.4e-3, 4.2e-3 },
+    .maxRpm = 30000,
+    .maxThrust = 9.0,
+    .torquePerThrust = 0.016,
+    .motorTimeConstant = 0.025,
+    .rotorInertia = 5e-6,
+    .drag = 0.03,
+    .rateDamping = 2e-4,
+    .gyroNoise = 0.005,
+    .gyroVibration = 0.25,
+    .accNoise = 0.1,
+    .accVibration = 5.0,
+    .baroNoise = 2.0,
+};
+
+// Where each motor is, in units of armOffset, and the direction of its yaw reaction torque, in mixer order.
+// These are the default props in: the rear right and front left props turn clockwise seen from above.
+static const struct {
+    int8_t forward;
+    int8_t left;
+    int8_t yaw;
+} motorLayout[PHYSICS_MOTOR_COUNT] = {
+    { -1, -1,  1 },     // REAR_R
+    {  1, -1, -1 },     // FRONT_R
+    { -1,  1, -1 },     // REAR_L
+    {  1,  1,  1 },     // FRONT_L
+};
+
+static struct {
+    bool started;
+    uint64_t timeUs;
+    double position[3];     // m, earth axes
+    double velocity[3];     // m/s, earth axes
+    double q[4];            // w, x, y, z from the body to the earth axes
+    double rate[3];         // rad/s, body axes
+    double acc[3];          // m/s^2, specific force on the body axes
+    double motorSpeed[PHYSICS_MOTOR_COUNT];     // rad/s
+    double motorPhase[PHYSICS_MOTOR_COUNT];     // rad
+    double motorOutput[PHYSICS_MOTOR_COUNT];
+} state = {
+    .q = { 1, 0, 0, 0 },
+};
+
+static double noiseScale = 1.0;
+static uint32_t noiseSeed = 0x12345678;     // fixed, so runs can be compared
+static FILE *logFile;
+
+bool physicsSetNoise(const char *arg)
+{
+    char *end;
+    errno = 0;
+    const double scale = strtod(arg, &end);
+    if (errno || end == arg || *end || !(scale >= 0)) {
+        return false;
+    }
+    noiseScale = scale;
+    return true;
+}
+
+bool physicsSetLog(const char *fileName)
+{
+    logFile = fopen(fileName, "w");
+    if (!logFile) {
+        fprintf(stderr, "[physics] can't write '%s': %s\n", fileName, strerror(errno));
+        return false;
+    }
+    fprintf(logFile, "time_us,motor0,motor1,motor2,motor3,rpm0,rpm1,rpm2,rpm3,"
+                     "roll_rate,pitch_rate,yaw_rate,gyro_x,gyro_y,gyro_z,roll,pitch,heading,altitude\n");
+    return true;
+}
+
+// Roughly normal, mean 0 and rms 1, from the sum of four uniform samples
+static double noise(void)
+{
+    double sum = 0;
+    for (int i = 0; i < 4; i++) {
+        noiseSeed ^= noiseSeed << 13;
+        noiseSeed ^= noiseSeed >> 17;
+        noiseSeed ^= noiseSeed << 5;
+        sum += noiseSeed / 4294967296.0 - 0.5;
+    }
+    return sum * sqrt(3.0);
+}
+
+static void bodyToEarth(const double *q, const double *body, double *earth)
+{
+    const double w = q[0], x = q[1], y = q[2], z = q[3];
+
+    earth[0] = (1 - 2 * (y * y + z * z)) * body[0] + 2 * (x * y - w * z) * body[1] + 2 * (x * z + w * y) * body[2];
+    earth[1] = 2 * (x * y + w * z) * body[0] + (1 - 2 * (x * x + z * z)) * body[1] + 2 * (y * z - w * x) * body[2];
+    earth[2] = 2 * (x * z - w * y) * body[0] + 2 * (y * z + w * x) * body[1] + (1 - 2 * (x * x + y * y)) * body[2];
+}
+
+static void earthToBody(const double *q, const double *earth, double *body)
+{
+    const double conjugate[4] = { q[0], -q[1], -q[2], -q[3] };
+
+    bodyToEarth(conjugate, earth, body);
+}
+
+static void physicsStep(double dt)
+{
+    const double maxSpeed = model.maxRpm * RPM_TO_RADS;
+    const double thrustPerSpeedSquared = model.maxThrust / (maxSpeed * maxSpeed);
+
+    double thrust = 0;
+    double torque[3] = { 0, 0, 0 };
+
+    for (int i = 0; i < PHYSICS_MOTOR_COUNT; i++) {
+        const double targetSpeed = fmin(fmax(state.motorOutput[i], 0), 1) * maxSpeed;
+        const double motorAccel = (targetSpeed - state.motorSpeed[i]) / model.motorTimeConstant;
+        state.motorSpeed[i] += motorAccel * dt;
+        state.motorPhase[i] = fmod(state.motorPhase[i] + state.motorSpeed[i] * dt, 2 * M_PI);
+
+        const double motorThrust = thrustPerSpeedSquared * state.motorSpeed[i] * state.motorSpeed[i];
+        thrust += motorThrust;
+        torque[0] += motorLayout[i].left * model.armOffset * motorThrust;
+        torque[1] -= motorLayout[i].forward * model.armOffset * motorThrust;
+        torque[2] += motorLayout[i].yaw * (model.torquePerThrust * motorThrust + model.rotorInertia * motorAccel);
+    }
+
+    // Euler's equations, with the body axes the principal axes
+    const double *inertia = model.inertia;
+    double *rate = state.rate;
+    const double rateDot[3] = {
+        (torque[0] - (inertia[2] - inertia[1]) * rate[1] * rate[2] - model.rateDamping * rate[0]) / inertia[0],
+        (torque[1] - (inertia[0] - inertia[2]) * rate[2] * rate[0] - model.rateDamping * rate[1]) / inertia[1],
+        (torque[2] - (inertia[1] - inertia[0]) * rate[0] * rate[1] - model.rateDamping * rate[2]) / inertia[2],
+    };
+    for (int axis = 0; axis < 3; axis++) {
+        rate[axis] += rateDot[axis] * dt;
+    }
+
+    double *q = state.q;
+    const double qDot[4] = {
+        0.5 * (-q[1] * rate[0] - q[2] * rate[1] - q[3] * rate[2]),
+        0.5 * ( q[0] * rate[0] + q[2] * rate[2] - q[3] * rate[1]),
+        0.5 * ( q[0] * rate[1] - q[1] * rate[2] + q[3] * rate[0]),
+        0.5 * ( q[0] * rate[2] + q[1] * rate[1] - q[2] * rate[0]),
+    };
+    double norm = 0;
+    for (int i = 0; i < 4; i++) {
+        q[i] += qDot[i] * dt;
+        norm += q[i] * q[i];
+    }
+    norm = sqrt(norm);
+    for (int i = 0; i < 4; i++) {
+        q[i] /= norm;
+    }
+
+    const double bodyThrust[3] = { 0, 0, thrust };
+    double force[3];
+    bodyToEarth(q, bodyThrust, force);
+
+    double *velocity = state.velocity;
+    const double speed = sqrt(velocity[0] * velocity[0] + velocity[1] * velocity[1] + velocity[2] * velocity[2]);
+    double accel[3];
+    for (int axis = 0; axis < 3; axis++) {
+        accel[axis] = (force[axis] - model.drag * speed * velocity[axis]) / model.mass;
+    }
+    accel[2] -= GRAVITY;
+
+    for (int axis = 0; axis < 3; axis++) {
+        velocity[axis] += accel[axis] * dt;
+        state.position[axis] += velocity[axis] * dt;
+    }
+
+    // The ground stops it dead, which also holds it still before take off
+    if (state.position[2] <= 0 && velocity[2] <= 0) {
+        state.position[2] = 0;
+        memset(velocity, 0, sizeof(state.velocity));
+        memset(rate, 0, sizeof(state.rate));
+        memset(accel, 0, sizeof(accel));
+    }
+
+    // what an accelerometer measures
+    accel[2] += GRAVITY;
+    earthToBody(q, accel, state.acc);
+}
+
+// In degrees, as the FC shows them: roll right, pitch nose down and heading clockwise from north are positive
+static void physicsAttitude(double *roll, double *pitch, double *heading)
+{
+    const double *q = state.q;
+
+    *roll = atan2(2 * (q[0] * q[1] + q[2] * q[3]), 1 - 2 * (q[1] * q[1] + q[2] * q[2])) * RAD2DEG;
+    *pitch = asin(fmin(fmax(2 * (q[0] * q[2] - q[1] * q[3]), -1), 1)) * RAD2DEG;
+    *heading = -atan2(2 * (q[0] * q[3] + q[1] * q[2]), 1 - 2 * (q[2] * q[2] + q[3] * q[3])) * RAD2DEG;
+    if (*heading < 0) {
+        *heading += 360;
+    }
+}
+
+static int16_t sensorValue(double value)
+{
+    return constrain(lrint(value), -32767, 32767);
+}
+
+static void physicsSetSensors(double *gyro)
+{
+    const double maxSpeed = model.maxRpm * RPM_TO_RADS;
+
+    double acc[3];
+    for (int axis = 0; axis < 3; axis++) {
+        gyro[axis] = state.rate[axis] + model.gyroNoise * noiseScale * noise();
+        acc[axis] = state.acc[axis] + model.accNoise * noiseScale * noise();
+    }
+
+    // each prop's imbalance shakes the frame sideways, turning at the prop's speed
+    for (int i = 0; i < PHYSICS_MOTOR_COUNT; i++) {
+        const double relativeSpeed = state.motorSpeed[i] / maxSpeed;
+        const double amplitude = relativeSpeed * relativeSpeed * noiseScale;
+        const double sine = sin(state.motorPhase[i]);
+        const double cosine = cos(state.motorPhase[i]);
+
+        gyro[0] += model.gyroVibration * amplitude * sine;
+        gyro[1] += model.gyroVibration * amplitude * cosine;
+        gyro[2] += 0.2 * model.gyroVibration * amplitude * sine;
+        acc[0] += model.accVibration * amplitude * cosine;
+        acc[1] += model.accVibration * amplitude * sine;
+        acc[2] += 0.5 * model.accVibration * amplitude * sine;
+    }
+
+    if (virtualGyroDev) {
+        virtualGyroSet(virtualGyroDev, sensorValue(gyro[0] * RAD2DEG * GYRO_SCALE),
+            sensorValue(gyro[1] * RAD2DEG * GYRO_SCALE), sensorValue(gyro[2] * RAD2DEG * GYRO_SCALE));
+    }
+    if (virtualAccDev) {
+        virtualAccSet(virtualAccDev, sensorValue(acc[0] * ACC_SCALE), sensorValue(acc[1] * ACC_SCALE),
+            sensorValue(acc[2] * ACC_SCALE));
+    }
+
+    // standard atmosphere, temperature in 0.01 C = 25 deg
+    const double pressure = SEA_LEVEL_PRESSURE * pow(1 - 2.25577e-5 * state.position[2], 5.25588);
+    virtualBaroSet(lrint(pressure + model.baroNoise * noiseScale * noise()), 2500);
+
+#if !defined(USE_IMU_CALC)
+#if defined(SET_IMU_FROM_EULER)
+    double roll, pitch, heading;
+    physicsAttitude(&roll, &pitch, &heading);
+    imuSetAttitudeRPY(roll, pitch, heading);
+#else
+    // the IMU takes the quaternion as a simulator sends it, on forward, right, down axes, see imuComputeRotationMatrix()
+    imuSetAttitudeQuat(state.q[0], state.q[1], -state.q[2], -state.q[3]);
+#endif
+#endif
+}
+
+static void physicsLog(const double *gyro)
+{
+    double roll, pitch, heading;
+    physicsAttitude(&roll, &pitch, &heading);
+
+    fprintf(logFile, "%llu", (unsigned long long)state.timeUs);
+    for (int i = 0; i < PHYSICS_MOTOR_COUNT; i++) {
+        fprintf(logFile, ",%.4f", state.motorOutput[i]);
+    }
+    for (int i = 0; i < PHYSICS_MOTOR_COUNT; i++) {
+        fprintf(logFile, ",%.0f", state.motorSpeed[i] / RPM_TO_RADS);
+    }
+    fprintf(logFile, ",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.4f\n",
+        state.rate[0] * RAD2DEG, state.rate[1] * RAD2DEG, state.rate[2] * RAD2DEG,
+        gyro[0] * RAD2DEG, gyro[1] * RAD2DEG, gyro[2] * RAD2DEG,
+        roll, pitch, heading, state.position[2]);
+}
+
+void physicsInit(void)
+{
+    printf("[physics] %.2fkg quad X, %.1fN and %.0frpm per motor at full throttle, noise x%.2f\n",
+           model.mass, model.maxThrust, model.maxRpm, noiseScale);
+}
+
+void physicsUpdate(const double *motorOutput, uint64_t timeUs)
+{
+    if (!state.started) {
+        state.started = true;
+        state.timeUs = timeUs;
+        earthToBody(state.q, (const double[3]){ 0, 0, GRAVITY }, state.acc);
+    }
+
+    // the outputs written by the last update have been driving the motors until now
+    uint64_t elapsedUs = timeUs > state.timeUs ? MIN(timeUs - state.timeUs, (uint64_t)PHYSICS_MAX_UPDATE_US) : 0;
+    while (elapsedUs) {
+        const uint64_t stepUs = MIN(elapsedUs, (uint64_t)PHYSICS_MAX_STEP_US);
+        physicsStep(stepUs * 1e-6);
+        elapsedUs -= stepUs;
+    }
+    state.timeUs = timeUs;
+    if (motorOutput) {
+        memcpy(state.motorOutput, motorOutput, sizeof(state.motorOutput));
+    }
+
+    double gyro[3];
+    physicsSetSensors(gyro);
+
+    if (logFile) {
+        physicsLog(gyro);
+    }
+}
+
+uint64_t physicsLastUpdateUs(void)
+{
+    return state.timeUs;
+}
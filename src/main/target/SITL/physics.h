@@ -0,0 +1,35 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PHYSICS_MOTOR_COUNT 4
+
+bool physicsSetNoise(const char *arg);
+bool physicsSetLog(const char *fileName);
+
+void physicsInit(void);
+// Advance the model to timeUs and set the virtual sensors, then set the motors to 0.0-1.0 of full throttle, in mixer
+// order, or leave them as they are if motorOutput is NULL
+void physicsUpdate(const double *motorOutput, uint64_t timeUs);
+uint64_t physicsLastUpdateUs(void);
@@ -0,0 +1,284 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The SITL I/O thread: one epoll loop that services the simulator's UDP sockets and the TCP serial ports, sleeping
+ * until one of them, or the FC loop, needs it.
+ *
+ * Sources are registered with a callback which runs on the reactor thread. The FC loop asks for a source to be
+ * serviced with reactorKick(), eg. after writing to a serial port, and data goes the other way through a
+ * reactorQueue_t and a reactorSignal_t the FC loop waits on, so neither side takes a lock on the data path.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "platform.h"
+
+#include "target/SITL/reactor.h"
+
+#define REACTOR_MAX_EVENTS  16
+
+static int epollFd = -1;
+static pthread_t reactorThread;
+static bool reactorRunning;
+
+// Kicks from the FC loop raise this, then the reactor calls every kicked source
+static reactorSignal_t kickSignal;
+static reactorSource_t kickSource;
+static bool kicksPending;      // FC loop only
+
+// Slots are claimed by whichever thread adds a source and only freed by the reactor thread
+static reactorSource_t *sources[REACTOR_MAX_SOURCES];
+
+bool reactorSignalInit(reactorSignal_t *signal)
+{
+    signal->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    signal->raised = false;
+
+    return signal->fd >= 0;
+}
+
+void reactorSignalRaise(reactorSignal_t *signal)
+{
+    if (!__atomic_exchange_n(&signal->raised, true, __ATOMIC_SEQ_CST)) {
+        const uint64_t one = 1;
+        if (write(signal->fd, &one, sizeof(one)) < 0) {
+            fprintf(stderr, "[reactor] signal write failed: %s\n", strerror(errno));
+        }
+    }
+}
+
+// Call before consuming what the signal was raised for, anything published after it raises the signal again
+void reactorSignalClear(reactorSignal_t *signal)
+{
+    // the eventfd is only written when raised is set, so this saves a syscall per main loop pass
+    if (!__atomic_load_n(&signal->raised, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+
+    uint64_t count;
+    if (read(signal->fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        fprintf(stderr, "[reactor] signal read failed: %s\n", strerror(errno));
+    }
+    __atomic_store_n(&signal->raised, false, __ATOMIC_SEQ_CST);
+}
+
+// Wait up to timeoutUs, or forever if it is negative, for the signal to be raised, returning true if it was
+bool reactorSignalWait(reactorSignal_t *signal, int timeoutUs)
+{
+    struct pollfd pfd = { .fd = signal->fd, .events = POLLIN };
+    const struct timespec timeout = { .tv_sec = timeoutUs / 1000000, .tv_nsec = (timeoutUs % 1000000) * 1000L };
+
+    int ret;
+    while ((ret = ppoll(&pfd, 1, timeoutUs < 0 ? NULL : &timeout, NULL)) < 0 && errno == EINTR);
+
+    return ret > 0;
+}
+
+bool reactorQueuePush(reactorQueue_t *queue, const void *item)
+{
+    const uint32_t head = queue->head;
+    if (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == queue->count) {
+        return false;
+    }
+
+    memcpy(queue->items + (head & (queue->count - 1)) * queue->itemSize, item, queue->itemSize);
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool reactorQueuePop(reactorQueue_t *queue, void *item)
+{
+    const uint32_t tail = queue->tail;
+    if (__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == tail) {
+        return false;
+    }
+
+    memcpy(item, queue->items + (tail & (queue->count - 1)) * queue->itemSize, queue->itemSize);
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool reactorQueueIsEmpty(const reactorQueue_t *queue)
+{
+    return __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+}
+
+bool reactorAdd(reactorSource_t *source, int fd, uint32_t events, reactorCallbackFn *callback, void *context)
+{
+    source->fd = fd;
+    source->events = events;
+    source->callback = callback;
+    source->context = context;
+    source->kicked = false;
+
+    unsigned slot;
+    for (slot = 0; slot < REACTOR_MAX_SOURCES; slot++) {
+        reactorSource_t *empty = NULL;
+        if (__atomic_compare_exchange_n(&sources[slot], &empty, source, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (slot == REACTOR_MAX_SOURCES) {
+        fprintf(stderr, "[reactor] too many sources\n");
+        return false;
+    }
+
+    struct epoll_event event = { .events = events, .data.ptr = source };
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        fprintf(stderr, "[reactor] add fd %d failed: %s\n", fd, strerror(errno));
+        __atomic_store_n(&sources[slot], NULL, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    return true;
+}
+
+bool reactorSetEvents(reactorSource_t *source, uint32_t events)
+{
+    if (source->events == events) {
+        return true;
+    }
+
+    struct epoll_event event = { .events = events, .data.ptr = source };
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, source->fd, &event) < 0) {
+        fprintf(stderr, "[reactor] modify fd %d failed: %s\n", source->fd, strerror(errno));
+        return false;
+    }
+    source->events = events;
+
+    return true;
+}
+
+// Called on the reactor thread, the caller closes the fd
+void reactorRemove(reactorSource_t *source)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, source->fd, NULL);
+    source->fd = -1;
+
+    for (unsigned slot = 0; slot < REACTOR_MAX_SOURCES; slot++) {
+        if (__atomic_load_n(&sources[slot], __ATOMIC_ACQUIRE) == source) {
+            __atomic_store_n(&sources[slot], NULL, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/*
+ * Have the reactor call the source's callback with REACTOR_KICK after the next reactorFlush(). The FC loop flushes
+ * when it goes idle, so that the reactor doesn't preempt a task on a single core and inflate its execution time.
+ */
+void reactorKick(reactorSource_t *source)
+{
+    __atomic_store_n(&source->kicked, true, __ATOMIC_SEQ_CST);
+    kicksPending = true;
+}
+
+void reactorFlush(void)
+{
+    if (kicksPending) {
+        kicksPending = false;
+        reactorSignalRaise(&kickSignal);
+    }
+}
+
+static void reactorOnKick(void *context, uint32_t events)
+{
+    UNUSED(context);
+    UNUSED(events);
+
+    reactorSignalClear(&kickSignal);
+
+    for (unsigned slot = 0; slot < REACTOR_MAX_SOURCES; slot++) {
+        reactorSource_t *source = __atomic_load_n(&sources[slot], __ATOMIC_ACQUIRE);
+        if (source && __atomic_exchange_n(&source->kicked, false, __ATOMIC_SEQ_CST)) {
+            source->callback(source->context, REACTOR_KICK);
+        }
+    }
+}
+
+static void *reactorLoop(void *data)
+{
+    UNUSED(data);
+
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (__atomic_load_n(&reactorRunning, __ATOMIC_ACQUIRE)) {
+        const int count = epoll_wait(epollFd, events, REACTOR_MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR) {
+            fprintf(stderr, "[reactor] epoll_wait failed: %s\n", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            reactorSource_t *source = events[i].data.ptr;
+            // an earlier callback may have removed it
+            if (source->fd >= 0) {
+                source->callback(source->context, events[i].events);
+            }
+        }
+    }
+
+    printf("[reactor] end\n");
+    return NULL;
+}
+
+bool reactorInit(void)
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0 || !reactorSignalInit(&kickSignal)) {
+        return false;
+    }
+
+    return reactorAdd(&kickSource, kickSignal.fd, EPOLLIN, reactorOnKick, NULL);
+}
+
+bool reactorStart(void)
+{
+    __atomic_store_n(&reactorRunning, true, __ATOMIC_RELEASE);
+
+    return pthread_create(&reactorThread, NULL, reactorLoop, NULL) == 0;
+}
+
+void reactorStop(void)
+{
+    __atomic_store_n(&reactorRunning, false, __ATOMIC_RELEASE);
+
+    // not reactorSignalRaise(), the reactor may be between reading the eventfd and clearing raised for a kick
+    const uint64_t one = 1;
+    if (write(kickSignal.fd, &one, sizeof(one)) < 0) {
+        fprintf(stderr, "[reactor] signal write failed: %s\n", strerror(errno));
+    }
+
+    pthread_join(reactorThread, NULL);
+}
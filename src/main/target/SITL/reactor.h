@@ -0,0 +1,79 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <sys/epoll.h>
+
+#include "common/utils.h"
+
+// Passed to a source's callback when it was kicked by reactorKick(), never set by epoll
+#define REACTOR_KICK            (1u << 24)
+
+#define REACTOR_MAX_SOURCES     32
+
+typedef void reactorCallbackFn(void *context, uint32_t events);
+
+typedef struct reactorSource_s {
+    int fd;
+    uint32_t events;
+    reactorCallbackFn *callback;
+    void *context;
+    bool kicked;
+} reactorSource_t;
+
+// An eventfd that coalesces raises until it is cleared, so a busy producer costs one syscall per wakeup
+typedef struct reactorSignal_s {
+    int fd;
+    bool raised;
+} reactorSignal_t;
+
+// A single producer, single consumer queue of fixed size items, count a power of 2
+typedef struct reactorQueue_s {
+    uint8_t *items;
+    uint32_t itemSize;
+    uint32_t count;
+    uint32_t head;      // written by the producer only
+    uint32_t tail;      // written by the consumer only
+} reactorQueue_t;
+
+#define REACTOR_QUEUE_INIT(buffer) { .items = (uint8_t *)(buffer), .itemSize = sizeof((buffer)[0]), .count = ARRAYLEN(buffer) }
+
+bool reactorInit(void);
+bool reactorStart(void);
+void reactorStop(void);
+
+bool reactorAdd(reactorSource_t *source, int fd, uint32_t events, reactorCallbackFn *callback, void *context);
+bool reactorSetEvents(reactorSource_t *source, uint32_t events);
+void reactorRemove(reactorSource_t *source);
+void reactorKick(reactorSource_t *source);
+void reactorFlush(void);
+
+bool reactorSignalInit(reactorSignal_t *signal);
+void reactorSignalRaise(reactorSignal_t *signal);
+void reactorSignalClear(reactorSignal_t *signal);
+bool reactorSignalWait(reactorSignal_t *signal, int timeoutUs);
+
+bool reactorQueuePush(reactorQueue_t *queue, const void *item);
+bool reactorQueuePop(reactorQueue_t *queue, void *item);
+bool reactorQueueIsEmpty(const reactorQueue_t *queue);
@@ -0,0 +1,158 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "platform.h"
+
+#include "common/utils.h"
+
+#include "target/SITL/shmlink.h"
+
+STATIC_ASSERT(sizeof(shmLinkRing_t) == 128, shm_link_ring_not_two_cache_lines);
+STATIC_ASSERT(offsetof(shmLinkRegion_t, fdm) == 64, shm_link_header_not_one_cache_line);
+STATIC_ASSERT((SHM_LINK_SLOTS & (SHM_LINK_SLOTS - 1)) == 0, shm_link_slots_not_power_of_2);
+
+static shmLinkRegion_t *region;
+
+static void shmLinkPush(shmLinkRing_t *ring, void *items, size_t itemSize, const void *item)
+{
+    const uint32_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == SHM_LINK_SLOTS) {
+        return;
+    }
+
+    memcpy((uint8_t *)items + (head & (SHM_LINK_SLOTS - 1)) * itemSize, item, itemSize);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+
+    // head is stored before sleeping is read, and the consumer does the opposite, so one of them sees the other
+    if (__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, &ring->head, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+static bool shmLinkPop(shmLinkRing_t *ring, const void *items, size_t itemSize, void *item)
+{
+    const uint32_t tail = ring->tail;
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+        return false;
+    }
+
+    memcpy(item, (const uint8_t *)items + (tail & (SHM_LINK_SLOTS - 1)) * itemSize, itemSize);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static bool shmLinkWait(shmLinkRing_t *ring, int timeoutUs)
+{
+    const struct timespec timeout = { .tv_sec = timeoutUs / 1000000, .tv_nsec = (timeoutUs % 1000000) * 1000L };
+
+    __atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+    const uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    if (head == ring->tail) {
+        // returns at once if head has moved on since it was read, and on a signal, which the caller treats as a timeout
+        syscall(SYS_futex, &ring->head, FUTEX_WAIT, head, timeoutUs < 0 ? NULL : &timeout, NULL, 0);
+    }
+    __atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail;
+}
+
+bool shmLinkInit(const char *name)
+{
+    const int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "[SITL] shared memory '%s': %s\n", name, strerror(errno));
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(*region)) < 0) {
+        fprintf(stderr, "[SITL] shared memory '%s': %s\n", name, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    region = mmap(NULL, sizeof(*region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        fprintf(stderr, "[SITL] shared memory '%s': %s\n", name, strerror(errno));
+        region = NULL;
+        return false;
+    }
+
+    if (__atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) == SHM_LINK_MAGIC
+        && region->version == SHM_LINK_VERSION
+        && region->slots == SHM_LINK_SLOTS
+        && region->fdmPacketSize == sizeof(fdm_packet)
+        && region->servoPacketSize == sizeof(servo_packet)
+        && region->servoRawPacketSize == sizeof(servo_packet_raw)) {
+        // A restarted SITL, the simulator may still have it mapped so only the indices this side owns move:
+        // the state packets sent to the previous run are dropped
+        __atomic_store_n(&region->fdm.tail, __atomic_load_n(&region->fdm.head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+        region->fdm.sleeping = 0;
+        return true;
+    }
+
+    __atomic_store_n(&region->magic, 0, __ATOMIC_RELEASE);
+    memset((uint8_t *)region + sizeof(region->magic), 0, sizeof(*region) - sizeof(region->magic));
+    region->version = SHM_LINK_VERSION;
+    region->slots = SHM_LINK_SLOTS;
+    region->fdmPacketSize = sizeof(fdm_packet);
+    region->servoPacketSize = sizeof(servo_packet);
+    region->servoRawPacketSize = sizeof(servo_packet_raw);
+    __atomic_store_n(&region->magic, SHM_LINK_MAGIC, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool shmLinkReceiveState(fdm_packet *pkt)
+{
+    return shmLinkPop(&region->fdm, region->fdmItems, sizeof(region->fdmItems[0]), pkt);
+}
+
+bool shmLinkWaitState(int timeoutUs)
+{
+    return shmLinkWait(&region->fdm, timeoutUs);
+}
+
+void shmLinkSendServo(const servo_packet *pkt)
+{
+    shmLinkPush(&region->servo, region->servoItems, sizeof(region->servoItems[0]), pkt);
+}
+
+void shmLinkSendServoRaw(const servo_packet_raw *pkt)
+{
+    shmLinkPush(&region->servoRaw, region->servoRawItems, sizeof(region->servoRawItems[0]), pkt);
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The simulator link through POSIX shared memory, an alternative to the UDP ports for the state and motor packets.
+ *
+ * The region holds one single producer, single consumer ring per packet type. A side pushes by copying the packet
+ * into items[head % SHM_LINK_SLOTS] and then storing head + 1, and pops by copying items[tail % SHM_LINK_SLOTS] out
+ * and then storing tail + 1, the ring being empty when head == tail and full when head - tail == SHM_LINK_SLOTS.
+ * A consumer with nothing to do sets sleeping, checks head again and sleeps on head as a (shared, not private)
+ * futex, and a producer only wakes it when sleeping is set, so a busy link makes no system calls at all.
+ *
+ * SITL creates the region and sets magic last. A simulator opens it with shm_open(), waits for the magic and checks
+ * the version and the packet sizes, which are those of target.h.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SHM_LINK_MAGIC      0x4c485342  // "BSHL"
+#define SHM_LINK_VERSION    1
+#define SHM_LINK_SLOTS      8           // per ring, a power of 2
+
+// The indices are on separate cache lines, so the two sides do not take one from each other on every packet
+typedef struct shmLinkRing_s {
+    uint32_t head;              // packets pushed, written by the producer
+    uint32_t sleeping;          // set by the consumer while it waits on head
+    uint8_t reserved0[56];
+    uint32_t tail;              // packets popped, written by the consumer
+    uint8_t reserved1[60];
+} shmLinkRing_t;
+
+typedef struct shmLinkRegion_s {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t fdmPacketSize;
+    uint32_t servoPacketSize;
+    uint32_t servoRawPacketSize;
+    uint8_t reserved[40];
+
+    shmLinkRing_t fdm;          // simulator to SITL
+    shmLinkRing_t servo;        // SITL to simulator, the Gazebo motor packet
+    shmLinkRing_t servoRaw;     // SITL to simulator, the RealFlight raw PWM packet
+
+    fdm_packet fdmItems[SHM_LINK_SLOTS];
+    servo_packet servoItems[SHM_LINK_SLOTS];
+    servo_packet_raw servoRawItems[SHM_LINK_SLOTS];
+} shmLinkRegion_t;
+
+// Create the region, or take over the one a previous run left behind
+bool shmLinkInit(const char *name);
+
+bool shmLinkReceiveState(fdm_packet *pkt);
+// Wait up to timeoutUs, or forever if it is negative, for a state packet, returning true if there is one
+bool shmLinkWaitState(int timeoutUs);
+
+// A simulator that does not read them loses the packets once its ring is full, as it would over UDP
+void shmLinkSendServo(const servo_packet *pkt);
+void shmLinkSendServoRaw(const servo_packet_raw *pkt);
@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include <errno.h>
+#include <getopt.h>
 #include <time.h>
 
 #include "common/maths.h"
@@ -44,6 +45,8 @@
 
 #include "drivers/accgyro/accgyro_virtual.h"
 #include "drivers/barometer/barometer_virtual.h"
+#include "drivers/flash/flash_virtual.h"
+#include "drivers/sdcard_virtual.h"
 #include "flight/imu.h"
 
 #include "config/feature.h"
@@ -55,12 +58,13 @@
 
 #include "rx/rx.h"
 
-#include "dyad.h"
+#include "target/SITL/physics.h"
+#include "target/SITL/reactor.h"
+#include "target/SITL/shmlink.h"
 #include "target/SITL/udplink.h"
 
 uint32_t SystemCoreClock;
 
-static fdm_packet fdmPkt;
 static rc_packet rcPkt;
 static servo_packet pwmPkt;
 static servo_packet_raw pwmRawPkt;
@@ -70,27 +74,204 @@ static bool fdm_received = false;
 
 static struct timespec start_time;
 static double simRate = 1.0;
-static pthread_t tcpWorker, udpWorker, udpWorkerRC;
-static bool workerRunning = true;
 static udpLink_t stateLink, pwmLink, pwmRawLink, rcLink;
-static pthread_mutex_t updateLock;
-static pthread_mutex_t mainLoopLock;
+static bool stateUpdated = true;    // since the last PWM output was sent
+#if defined(SIMULATOR_GYROPID_SYNC)
+static bool mainLoopReleased = true;
+#endif
+
+// The reactor thread receives the simulator's packets and queues them for the main loop
+typedef struct {
+    fdm_packet pkt;
+    struct timespec received;
+} fdmQueueItem_t;
+
+static fdmQueueItem_t fdmQueueItems[8];
+static reactorQueue_t fdmQueue = REACTOR_QUEUE_INIT(fdmQueueItems);
+static reactorSignal_t fdmSignal;       // raised for each packet queued
+static rc_packet rcQueueItems[8];
+static reactorQueue_t rcQueue = REACTOR_QUEUE_INIT(rcQueueItems);
+static reactorSource_t stateSource, rcSource;
 static char simulator_ip[32] = "127.0.0.1";
+static const char *shmName = NULL;      // the simulator link is in this shared memory region instead of on UDP
+
+#define UDP_BASE_PORT   9000
+#define INSTANCE_PORT_STRIDE 10     // ports each instance moves all the others up by
+
+static unsigned udpBasePort = UDP_BASE_PORT;
+
+#define PORT_PWM_RAW    (udpBasePort + 1)   // Out
+#define PORT_PWM        (udpBasePort + 2)   // Out
+#define PORT_STATE      (udpBasePort + 3)   // In
+#define PORT_RC         (udpBasePort + 4)   // In
+
+static const char *eepromFileName = EEPROM_FILENAME;
+
+// Lockstep: virtual time only advances as far as the simulator's FDM timestamps allow
+#define LOCKSTEP_BACKGROUND_PASSES  4   // scheduler() calls per gyro cycle that may run a non-realtime task
+
+static bool lockstep = false;
+static uint64_t lockstepNowNs = 0;          // virtual time seen by micros64()/millis64()
+static uint64_t lockstepHorizonNs = 0;      // virtual time covered by the FDM packets received so far
+static bool lockstepStarted = false;
+static bool lockstepReplyPending = false;
+
+static bool physics = false;                // the built-in model stands in for the simulator
+
+#define PHYSICS_IDLE_UPDATE_US      1000    // sensor update interval while the motors are not being written
+
+enum {
+    OPTION_FLASH = 256,
+    OPTION_FLASH_MODEL,
+    OPTION_SDCARD,
+    OPTION_SDCARD_MODEL,
+    OPTION_INSTANCE,
+    OPTION_TCP_PORT_BASE,
+    OPTION_UDP_PORT_BASE,
+    OPTION_EEPROM,
+    OPTION_PHYSICS,
+    OPTION_PHYSICS_NOISE,
+    OPTION_PHYSICS_LOG,
+    OPTION_SHM,
+};
 
-#define PORT_PWM_RAW    9001    // Out
-#define PORT_PWM        9002    // Out
-#define PORT_STATE      9003    // In
-#define PORT_RC         9004    // In
+static void printStorageStats(void)
+{
+    virtualFlashPrintStats();
+    virtualSdcardPrintStats();
+}
+
+static bool parseUnsigned(const char *arg, unsigned max, unsigned *value)
+{
+    char *end;
+    errno = 0;
+    const unsigned long parsed = strtoul(arg, &end, 10);
+    if (errno || end == arg || *end || parsed > max) {
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
 
 int targetParseArgs(int argc, char * argv[])
 {
-    //The first argument should be target IP.
-    if (argc > 1) {
-        strcpy(simulator_ip, argv[1]);
+    static const struct option longOptions[] = {
+        { "lockstep", no_argument, NULL, 'l' },
+        { "flash", required_argument, NULL, OPTION_FLASH },
+        { "flash-model", required_argument, NULL, OPTION_FLASH_MODEL },
+        { "sdcard", required_argument, NULL, OPTION_SDCARD },
+        { "sdcard-model", required_argument, NULL, OPTION_SDCARD_MODEL },
+        { "instance", required_argument, NULL, OPTION_INSTANCE },
+        { "tcp-port-base", required_argument, NULL, OPTION_TCP_PORT_BASE },
+        { "udp-port-base", required_argument, NULL, OPTION_UDP_PORT_BASE },
+        { "eeprom", required_argument, NULL, OPTION_EEPROM },
+        { "physics", no_argument, NULL, OPTION_PHYSICS },
+        { "physics-noise", required_argument, NULL, OPTION_PHYSICS_NOISE },
+        { "physics-log", required_argument, NULL, OPTION_PHYSICS_LOG },
+        { "shm", required_argument, NULL, OPTION_SHM },
+        { NULL, 0, NULL, 0 }
+    };
+
+    unsigned instance = 0;
+    unsigned tcpBasePort = TCP_BASE_PORT;
+    bool eepromGiven = false;
+    static char instanceEepromFileName[32];
+
+    int opt;
+    bool valid = true;
+    while (valid && (opt = getopt_long(argc, argv, "l", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'l':
+            lockstep = true;
+            break;
+        case OPTION_FLASH:
+            valid = virtualFlashSetImage(optarg);
+            break;
+        case OPTION_FLASH_MODEL:
+            valid = virtualFlashSetModel(optarg);
+            break;
+        case OPTION_SDCARD:
+            valid = virtualSdcardSetImage(optarg);
+            break;
+        case OPTION_SDCARD_MODEL:
+            valid = virtualSdcardSetModel(optarg);
+            break;
+        case OPTION_INSTANCE:
+            valid = parseUnsigned(optarg, 1000, &instance);
+            break;
+        case OPTION_TCP_PORT_BASE:
+            valid = parseUnsigned(optarg, UINT16_MAX, &tcpBasePort);
+            break;
+        case OPTION_UDP_PORT_BASE:
+            valid = parseUnsigned(optarg, UINT16_MAX, &udpBasePort);
+            break;
+        case OPTION_EEPROM:
+            eepromFileName = optarg;
+            eepromGiven = true;
+            valid = *optarg;
+            break;
+        case OPTION_PHYSICS:
+            physics = true;
+            break;
+        case OPTION_PHYSICS_NOISE:
+            valid = physicsSetNoise(optarg);
+            break;
+        case OPTION_PHYSICS_LOG:
+            valid = physicsSetLog(optarg);
+            break;
+        case OPTION_SHM:
+            shmName = optarg;
+            valid = *optarg;
+            break;
+        default:
+            valid = false;
+            break;
+        }
+    }
+
+    // Each instance has its own ports, INSTANCE_PORT_STRIDE above the previous one's, and its own EEPROM file
+    if (valid && instance) {
+        tcpBasePort += instance * INSTANCE_PORT_STRIDE;
+        udpBasePort += instance * INSTANCE_PORT_STRIDE;
+        if (!eepromGiven) {
+            snprintf(instanceEepromFileName, sizeof(instanceEepromFileName), "eeprom%u.bin", instance);
+            eepromFileName = instanceEepromFileName;
+        }
+    }
+    valid = valid && udpBasePort + 4 <= UINT16_MAX && tcpSetBasePort(tcpBasePort) && !(physics && shmName);
+
+    if (!valid) {
+        printf("Usage: %s [--lockstep] [--flash image] [--flash-model w25q128|m25p16|ideal|<timing>]\n"
+               "       [--sdcard image] [--sdcard-model spi|sdio|ideal|<timing>]\n"
+               "       [--instance n] [--tcp-port-base port] [--udp-port-base port] [--eeprom file]\n"
+               "       [--physics] [--physics-noise scale] [--physics-log file] [--shm name] [simulator IP]\n", argv[0]);
+        exit(1);
+    }
+
+    atexit(printStorageStats);
+
+    // The first remaining argument should be target IP.
+    if (optind < argc) {
+        strncpy(simulator_ip, argv[optind], sizeof(simulator_ip) - 1);
     }
 
-    printf("[SITL] The SITL will output to IP %s:%d (Gazebo) and %s:%d (RealFlightBridge)\n",
-           simulator_ip, PORT_PWM, simulator_ip, PORT_PWM_RAW);
+    if (physics) {
+        printf("[SITL] Flying the built-in quad model, RC input on port %d\n", PORT_RC);
+    } else if (shmName) {
+        printf("[SITL] The SITL will exchange state and motor packets with the simulator in shared memory '%s'\n", shmName);
+    } else {
+        printf("[SITL] The SITL will output to IP %s:%d (Gazebo) and %s:%d (RealFlightBridge)\n",
+               simulator_ip, PORT_PWM, simulator_ip, PORT_PWM_RAW);
+    }
+    printf("[SITL] UARTs on TCP ports %u-%u, config in '%s'\n",
+           tcpGetBasePort() + 1, tcpGetBasePort() + SERIAL_PORT_COUNT, eepromFileName);
+    if (lockstep && physics) {
+        printf("[SITL] Lockstep mode, time runs as fast as the model can be stepped\n");
+    } else if (lockstep && shmName) {
+        printf("[SITL] Lockstep mode, time advances with each state packet in shared memory\n");
+    } else if (lockstep) {
+        printf("[SITL] Lockstep mode, time advances with each state packet on port %d\n", PORT_STATE);
+    }
     return 0;
 }
 
@@ -98,7 +279,14 @@ int timeval_sub(struct timespec *result, struct timespec *x, struct timespec *y)
 
 int lockMainPID(void)
 {
-    return pthread_mutex_trylock(&mainLoopLock);
+#if defined(SIMULATOR_GYROPID_SYNC)
+    // succeeds, returning 0, once for each state packet
+    if (mainLoopReleased) {
+        mainLoopReleased = false;
+        return 0;
+    }
+#endif
+    return EBUSY;
 }
 
 #define RAD2DEG (180.0 / M_PI)
@@ -107,20 +295,38 @@ int lockMainPID(void)
 
 void sendMotorUpdate(void)
 {
-    udpSend(&pwmLink, &pwmPkt, sizeof(servo_packet));
+    if (shmName) {
+        shmLinkSendServo(&pwmPkt);
+    } else {
+        udpSend(&pwmLink, &pwmPkt, sizeof(servo_packet));
+    }
+}
+
+static void sendMotorUpdates(void)
+{
+    sendMotorUpdate();
+    if (shmName) {
+        shmLinkSendServoRaw(&pwmRawPkt);
+    } else {
+        udpSend(&pwmRawLink, &pwmRawPkt, sizeof(servo_packet_raw));
+    }
 }
 
-void updateState(const fdm_packet* pkt)
+// Called from the main loop, with the time the packet was received
+static void updateState(const fdm_packet* pkt, struct timespec *now_ts)
 {
     static double last_timestamp = 0; // in seconds
     static uint64_t last_realtime = 0; // in uS
     static struct timespec last_ts; // last packet
 
-    struct timespec now_ts;
-    clock_gettime(CLOCK_MONOTONIC, &now_ts);
+    if (lockstep && !lockstepStarted) {
+        // the first packet sets the time base, reply without running any cycles
+        last_timestamp = pkt->timestamp;
+        lockstepStarted = true;
+    }
 
     const uint64_t realtime_now = micros64_real();
-    if (realtime_now > last_realtime + 500*1e3) { // 500ms timeout
+    if (!lockstep && realtime_now > last_realtime + 500*1e3) { // 500ms timeout
         last_timestamp = pkt->timestamp;
         last_realtime = realtime_now;
         sendMotorUpdate();
@@ -184,10 +390,16 @@ void updateState(const fdm_packet* pkt)
 #endif
 
 
+    if (lockstep) {
+        lockstepHorizonNs += deltaSim * 1e9;
+        last_timestamp = pkt->timestamp;
+        return;
+    }
+
     if (deltaSim < 0.02 && deltaSim > 0) { // simulator should run faster than 50Hz
 //        simRate = simRate * 0.5 + (1e6 * deltaSim / (realtime_now - last_realtime)) * 0.5;
         struct timespec out_ts;
-        timeval_sub(&out_ts, &now_ts, &last_ts);
+        timeval_sub(&out_ts, now_ts, &last_ts);
         simRate = deltaSim / (out_ts.tv_sec + 1e-9*out_ts.tv_nsec);
     }
 //    printf("simRate = %lf, millis64 = %lu, millis64_real = %lu, deltaSim = %lf\n", simRate, millis64(), millis64_real(), deltaSim*1e6);
@@ -195,34 +407,143 @@ void updateState(const fdm_packet* pkt)
     last_timestamp = pkt->timestamp;
     last_realtime = micros64_real();
 
-    last_ts.tv_sec = now_ts.tv_sec;
-    last_ts.tv_nsec = now_ts.tv_nsec;
+    last_ts.tv_sec = now_ts->tv_sec;
+    last_ts.tv_nsec = now_ts->tv_nsec;
 
-    pthread_mutex_unlock(&updateLock); // can send PWM output now
+    stateUpdated = true; // can send PWM output now
 
 #if defined(SIMULATOR_GYROPID_SYNC)
-    pthread_mutex_unlock(&mainLoopLock); // can run main loop
+    mainLoopReleased = true; // can run main loop
 #endif
 }
 
-static void* udpThread(void* data)
+// Reactor thread: queue the state packets for the main loop
+static void onStatePacket(void *context, uint32_t events)
+{
+    UNUSED(context);
+    UNUSED(events);
+
+    fdmQueueItem_t item;
+    int n;
+
+    while ((n = udpRecv(&stateLink, &item.pkt, sizeof(item.pkt), 0)) >= 0) {
+        if (n != sizeof(fdm_packet)) {
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &item.received);
+
+        if (!fdm_received) {
+            printf("[SITL] new fdm %d t:%f from %s:%d\n", n, item.pkt.timestamp, inet_ntoa(stateLink.recv.sin_addr), stateLink.recv.sin_port);
+            fdm_received = true;
+        }
+        if (!reactorQueuePush(&fdmQueue, &item)) {
+            // in lockstep the simulator has to wait for the reply to each one
+            printf("[SITL] state packet dropped, the main loop is behind\n");
+        }
+        reactorSignalRaise(&fdmSignal);
+    }
+}
+
+// Main loop: the shared memory link skips the reactor, the packets are taken straight from the simulator's ring
+static bool popStatePacket(fdmQueueItem_t *item)
+{
+    if (!shmName) {
+        return reactorQueuePop(&fdmQueue, item);
+    }
+
+    if (!shmLinkReceiveState(&item->pkt)) {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &item->received);
+
+    if (!fdm_received) {
+        printf("[SITL] new fdm t:%f from shared memory '%s'\n", item->pkt.timestamp, shmName);
+        fdm_received = true;
+    }
+
+    return true;
+}
+
+static void waitStatePacket(int timeoutUs)
+{
+    if (shmName) {
+        shmLinkWaitState(timeoutUs);
+    } else {
+        reactorSignalWait(&fdmSignal, timeoutUs);
+    }
+}
+
+static void processStatePackets(void)
+{
+    fdmQueueItem_t item;
+
+    reactorSignalClear(&fdmSignal);
+    while (popStatePacket(&item)) {
+        updateState(&item.pkt, &item.received);
+    }
+}
+
+// Called from the main loop after each scheduler() pass
+static void lockstepAdvance(void)
 {
-    UNUSED(data);
-    int n = 0;
+    static unsigned passes = 0;
+
+    const int32_t remainingUs = clockCyclesToMicros(schedulerGetGyroRemainingCycles());
+
+    // Give the non-realtime tasks a few passes at this instant, unless the gyro is nearly due, in which
+    // case scheduler() would poll a clock that cannot move
+    if (remainingUs > SCHED_START_LOOP_MAX_US && ++passes < LOCKSTEP_BACKGROUND_PASSES) {
+        return;
+    }
+    passes = 0;
+
+    const uint64_t nextNs = lockstepNowNs + (uint64_t)remainingUs * 1000;
+
+    while (nextNs > lockstepHorizonNs) {
+        // The cycles for the last packet are done, answer it and wait for the next
+        if (lockstepReplyPending) {
+            sendMotorUpdates();
+            lockstepReplyPending = false;
+        }
+
+        fdmQueueItem_t item;
+        while (!popStatePacket(&item)) {
+            waitStatePacket(-1);
+            reactorSignalClear(&fdmSignal);
+        }
 
-    while (workerRunning) {
-        n = udpRecv(&stateLink, &fdmPkt, sizeof(fdm_packet), 100);
-        if (n == sizeof(fdm_packet)) {
-            if (!fdm_received) {
-                printf("[SITL] new fdm %d t:%f from %s:%d\n", n, fdmPkt.timestamp, inet_ntoa(stateLink.recv.sin_addr), stateLink.recv.sin_port);
-                fdm_received = true;
-            }
-            updateState(&fdmPkt);
+        if (!lockstepStarted) {
+            lockstepHorizonNs = lockstepNowNs;
         }
+        updateState(&item.pkt, &item.received);
+        lockstepReplyPending = true;
+    }
+
+    lockstepNowNs = nextNs;
+}
+
+static void processRcPackets(void);
+
+void simulatorLoopIdle(void)
+{
+    // the serial ports written to by the tasks are sent now, rather than the reactor preempting them
+    reactorFlush();
+
+    if (lockstep) {
+        lockstepAdvance();
+    } else {
+        // max rate 20kHz, but a state packet is applied as soon as it arrives
+        waitStatePacket(50);
+        processStatePackets();
+    }
+
+    // The model is stepped by the motor updates, this keeps the sensors going without them, eg. before the motors
+    // are enabled, or when the loop is late
+    if (physics && micros64() >= physicsLastUpdateUs() + PHYSICS_IDLE_UPDATE_US) {
+        physicsUpdate(NULL, micros64());
     }
 
-    printf("udpThread end!!\n");
-    return NULL;
+    processRcPackets();
 }
 
 static float readRCSITL(const rxRuntimeState_t *rxRuntimeState, uint8_t channel)
@@ -237,48 +558,38 @@ static uint8_t rxRCFrameStatus(rxRuntimeState_t *rxRuntimeState)
     return RX_FRAME_COMPLETE;
 }
 
-static void *udpRCThread(void *data)
+// Reactor thread: queue the RC packets for the main loop
+static void onRcPacket(void *context, uint32_t events)
 {
-    UNUSED(data);
-    int n = 0;
+    UNUSED(context);
+    UNUSED(events);
+
+    rc_packet pkt;
+    int n;
 
-    while (workerRunning) {
-        n = udpRecv(&rcLink, &rcPkt, sizeof(rc_packet), 100);
+    while ((n = udpRecv(&rcLink, &pkt, sizeof(pkt), 0)) >= 0) {
         if (n == sizeof(rc_packet)) {
-            if (!rc_received) {
-                printf("[SITL] new rc %d: t:%f AETR: %d %d %d %d AUX1-4: %d %d %d %d\n", n, rcPkt.timestamp,
-                    rcPkt.channels[0], rcPkt.channels[1],rcPkt.channels[2],rcPkt.channels[3],
-                    rcPkt.channels[4], rcPkt.channels[5],rcPkt.channels[6],rcPkt.channels[7]);
-
-                rxRuntimeState.channelCount = SIMULATOR_MAX_RC_CHANNELS;
-                rxRuntimeState.rcReadRawFn = readRCSITL;
-                rxRuntimeState.rcFrameStatusFn = rxRCFrameStatus;
-
-                rxRuntimeState.rxProvider = RX_PROVIDER_UDP;
-                rc_received = true;
-            }
+            reactorQueuePush(&rcQueue, &pkt);
         }
     }
-
-    printf("udpRCThread end!!\n");
-    return NULL;
 }
 
-static void* tcpThread(void* data)
+static void processRcPackets(void)
 {
-    UNUSED(data);
-
-    dyad_init();
-    dyad_setTickInterval(0.2f);
-    dyad_setUpdateTimeout(0.01f);
-
-    while (workerRunning) {
-        dyad_update();
+    while (reactorQueuePop(&rcQueue, &rcPkt)) {
+        if (!rc_received) {
+            printf("[SITL] new rc %d: t:%f AETR: %d %d %d %d AUX1-4: %d %d %d %d\n", (int)sizeof(rcPkt), rcPkt.timestamp,
+                rcPkt.channels[0], rcPkt.channels[1],rcPkt.channels[2],rcPkt.channels[3],
+                rcPkt.channels[4], rcPkt.channels[5],rcPkt.channels[6],rcPkt.channels[7]);
+
+            rxRuntimeState.channelCount = SIMULATOR_MAX_RC_CHANNELS;
+            rxRuntimeState.rcReadRawFn = readRCSITL;
+            rxRuntimeState.rcFrameStatusFn = rxRCFrameStatus;
+
+            rxRuntimeState.rxProvider = RX_PROVIDER_UDP;
+            rc_received = true;
+        }
     }
-
-    dyad_shutdown();
-    printf("tcpThread end!!\n");
-    return NULL;
 }
 
 // system
@@ -291,43 +602,40 @@ void systemInit(void)
 
     SystemCoreClock = 500 * 1e6; // virtual 500MHz
 
-    if (pthread_mutex_init(&updateLock, NULL) != 0) {
-        printf("Create updateLock error!\n");
-        exit(1);
-    }
-
-    if (pthread_mutex_init(&mainLoopLock, NULL) != 0) {
-        printf("Create mainLoopLock error!\n");
-        exit(1);
-    }
-
-    ret = pthread_create(&tcpWorker, NULL, tcpThread, NULL);
-    if (ret != 0) {
-        printf("Create tcpWorker error!\n");
+    if (!reactorInit() || !reactorSignalInit(&fdmSignal)) {
+        printf("Create reactor error!\n");
         exit(1);
     }
 
-    ret = udpInit(&pwmLink, simulator_ip, PORT_PWM, false);
-    printf("[SITL] init PwmOut UDP link to gazebo %s:%d...%d\n", simulator_ip, PORT_PWM, ret);
+    if (physics) {
+        physicsInit();
+        // nothing to wait for in lockstep, the model is stepped with each motor update
+        lockstepStarted = true;
+        lockstepHorizonNs = UINT64_MAX;
+    } else if (shmName) {
+        if (!shmLinkInit(shmName)) {
+            exit(1);
+        }
+        printf("[SITL] shared memory link to the simulator in '%s'\n", shmName);
+    } else {
+        ret = udpInit(&pwmLink, simulator_ip, PORT_PWM, false);
+        printf("[SITL] init PwmOut UDP link to gazebo %s:%d...%d\n", simulator_ip, PORT_PWM, ret);
 
-    ret = udpInit(&pwmRawLink, simulator_ip, PORT_PWM_RAW, false);
-    printf("[SITL] init PwmOut UDP link to RF9 %s:%d...%d\n", simulator_ip, PORT_PWM_RAW, ret);
+        ret = udpInit(&pwmRawLink, simulator_ip, PORT_PWM_RAW, false);
+        printf("[SITL] init PwmOut UDP link to RF9 %s:%d...%d\n", simulator_ip, PORT_PWM_RAW, ret);
 
-    ret = udpInit(&stateLink, NULL, PORT_STATE, true);
-    printf("[SITL] start UDP server @%d...%d\n", PORT_STATE, ret);
+        ret = udpInit(&stateLink, NULL, PORT_STATE, true);
+        printf("[SITL] start UDP server @%d...%d\n", PORT_STATE, ret);
+    }
 
     ret = udpInit(&rcLink, NULL, PORT_RC, true);
     printf("[SITL] start UDP server for RC input @%d...%d\n", PORT_RC, ret);
 
-    ret = pthread_create(&udpWorker, NULL, udpThread, NULL);
-    if (ret != 0) {
-        printf("Create udpWorker error!\n");
-        exit(1);
-    }
-
-    ret = pthread_create(&udpWorkerRC, NULL, udpRCThread, NULL);
-    if (ret != 0) {
-        printf("Create udpRCThread error!\n");
+    // the TCP serial ports are added as they are opened
+    if ((!physics && !shmName && !reactorAdd(&stateSource, stateLink.fd, EPOLLIN, onStatePacket, NULL))
+        || !reactorAdd(&rcSource, rcLink.fd, EPOLLIN, onRcPacket, NULL)
+        || !reactorStart()) {
+        printf("Create reactor error!\n");
         exit(1);
     }
 }
@@ -335,9 +643,7 @@ void systemInit(void)
 void systemReset(void)
 {
     printf("[system]Reset!\n");
-    workerRunning = false;
-    pthread_join(tcpWorker, NULL);
-    pthread_join(udpWorker, NULL);
+    reactorStop();
     exit(0);
 }
 void systemResetToBootloader(bootloaderRequestType_e requestType)
@@ -345,9 +651,7 @@ void systemResetToBootloader(bootloaderRequestType_e requestType)
     UNUSED(requestType);
 
     printf("[system]ResetToBootloader!\n");
-    workerRunning = false;
-    pthread_join(tcpWorker, NULL);
-    pthread_join(udpWorker, NULL);
+    reactorStop();
     exit(0);
 }
 
@@ -393,6 +697,10 @@ uint64_t millis64_real(void)
 
 uint64_t micros64(void)
 {
+    if (lockstep) {
+        return lockstepNowNs / 1000;
+    }
+
     static uint64_t last = 0;
     static uint64_t out = 0;
     uint64_t now = nanos64_real();
@@ -406,6 +714,10 @@ uint64_t micros64(void)
 
 uint64_t millis64(void)
 {
+    if (lockstep) {
+        return lockstepNowNs / 1000000;
+    }
+
     static uint64_t last = 0;
     static uint64_t out = 0;
     uint64_t now = nanos64_real();
@@ -461,6 +773,11 @@ void microsleep(uint32_t usec)
 
 void delayMicroseconds(uint32_t us)
 {
+    if (lockstep) {
+        lockstepNowNs += (uint64_t)us * 1000;
+        return;
+    }
+
     microsleep(us / simRate);
 }
 
@@ -471,6 +788,11 @@ void delayMicroseconds_real(uint32_t us)
 
 void delay(uint32_t ms)
 {
+    if (lockstep) {
+        lockstepNowNs += (uint64_t)ms * 1000000;
+        return;
+    }
+
     uint64_t start = millis64();
 
     while ((millis64() - start) < ms) {
@@ -551,7 +873,8 @@ static bool pwmEnableMotors(void)
 
 static void pwmWriteMotor(uint8_t index, float value)
 {
-    if (pthread_mutex_trylock(&updateLock) != 0) return;
+    // in lockstep the outputs are sent once per state packet by lockstepAdvance()
+    if (!lockstep && !stateUpdated) return;
 
     if (index < MAX_SUPPORTED_MOTORS) {
         motorsPwm[index] = value - idlePulse;
@@ -560,8 +883,6 @@ static void pwmWriteMotor(uint8_t index, float value)
     if (index < pwmRawPkt.motorCount) {
         pwmRawPkt.pwm_output_raw[index] = value;
     }
-
-    pthread_mutex_unlock(&updateLock); // can send PWM output now
 }
 
 static void pwmWriteMotorInt(uint8_t index, uint16_t value)
@@ -589,16 +910,25 @@ static void pwmCompleteMotorUpdate(void)
         outScale = 500.0;
     }
 
+    if (physics) {
+        double motorOutput[PHYSICS_MOTOR_COUNT];
+        for (int i = 0; i < PHYSICS_MOTOR_COUNT; i++) {
+            motorOutput[i] = motorsPwm[i] / outScale;
+        }
+        physicsUpdate(motorOutput, micros64());
+        return;
+    }
+
     pwmPkt.motor_speed[3] = motorsPwm[0] / outScale;
     pwmPkt.motor_speed[0] = motorsPwm[1] / outScale;
     pwmPkt.motor_speed[1] = motorsPwm[2] / outScale;
     pwmPkt.motor_speed[2] = motorsPwm[3] / outScale;
 
     // get one "fdm_packet" can only send one "servo_packet"!!
-    if (pthread_mutex_trylock(&updateLock) != 0) return;
-    udpSend(&pwmLink, &pwmPkt, sizeof(servo_packet));
+    if (lockstep || !stateUpdated) return;
+    stateUpdated = false;
 //    printf("[pwm]%u:%u,%u,%u,%u\n", idlePulse, motorsPwm[0], motorsPwm[1], motorsPwm[2], motorsPwm[3]);
-    udpSend(&pwmRawLink, &pwmRawPkt, sizeof(servo_packet_raw));
+    sendMotorUpdates();
 }
 
 void pwmWriteServo(uint8_t index, float value)
@@ -632,6 +962,9 @@ motorDevice_t *motorPwmDevInit(const motorDevConfig_t *motorConfig, uint16_t _id
     UNUSED(useUnsyncedPwm);
 
     printf("Initialized motor count %d\n", motorCount);
+    if (physics && motorCount != PHYSICS_MOTOR_COUNT) {
+        printf("[physics] the model is a quad, only the first %d motors drive it\n", PHYSICS_MOTOR_COUNT);
+    }
     pwmRawPkt.motorCount = motorCount;
 
     idlePulse = _idlePulse;
@@ -668,7 +1001,7 @@ void FLASH_Unlock(void)
     }
 
     // open or create
-    eepromFd = fopen(EEPROM_FILENAME,"r+");
+    eepromFd = fopen(eepromFileName,"r+");
     if (eepromFd != NULL) {
         // obtain file size:
         fseek(eepromFd , 0 , SEEK_END);
@@ -677,15 +1010,15 @@ void FLASH_Unlock(void)
 
         size_t n = fread(eepromData, 1, sizeof(eepromData), eepromFd);
         if (n == lSize) {
-            printf("[FLASH_Unlock] loaded '%s', size = %ld / %ld\n", EEPROM_FILENAME, lSize, sizeof(eepromData));
+            printf("[FLASH_Unlock] loaded '%s', size = %ld / %ld\n", eepromFileName, lSize, sizeof(eepromData));
         } else {
-            fprintf(stderr, "[FLASH_Unlock] failed to load '%s'\n", EEPROM_FILENAME);
+            fprintf(stderr, "[FLASH_Unlock] failed to load '%s'\n", eepromFileName);
             return;
         }
     } else {
-        printf("[FLASH_Unlock] created '%s', size = %ld\n", EEPROM_FILENAME, sizeof(eepromData));
-        if ((eepromFd = fopen(EEPROM_FILENAME, "w+")) == NULL) {
-            fprintf(stderr, "[FLASH_Unlock] failed to create '%s'\n", EEPROM_FILENAME);
+        printf("[FLASH_Unlock] created '%s', size = %ld\n", eepromFileName, sizeof(eepromData));
+        if ((eepromFd = fopen(eepromFileName, "w+")) == NULL) {
+            fprintf(stderr, "[FLASH_Unlock] failed to create '%s'\n", eepromFileName);
             return;
         }
         if (fwrite(eepromData, sizeof(eepromData), 1, eepromFd) != 1) {
@@ -702,7 +1035,7 @@ void FLASH_Lock(void)
         fwrite(eepromData, 1, sizeof(eepromData), eepromFd);
         fclose(eepromFd);
         eepromFd = NULL;
-        printf("[FLASH_Lock] saved '%s'\n", EEPROM_FILENAME);
+        printf("[FLASH_Lock] saved '%s'\n", eepromFileName);
     } else {
         fprintf(stderr, "[FLASH_Lock] eeprom is not unlocked\n");
     }
@@ -710,8 +1043,10 @@ void FLASH_Lock(void)
 
 FLASH_Status FLASH_ErasePage(uintptr_t Page_Address)
 {
-    UNUSED(Page_Address);
-//    printf("[FLASH_ErasePage]%x\n", Page_Address);
+    // Erased flash reads as 0xFF, which is how the end of the config journal is found
+    if ((Page_Address >= (uintptr_t)eepromData) && (Page_Address < (uintptr_t)ARRAYEND(eepromData))) {
+        memset((void *)Page_Address, 0xFF, MIN((uintptr_t)FLASH_PAGE_SIZE, (uintptr_t)ARRAYEND(eepromData) - Page_Address));
+    }
     return FLASH_COMPLETE;
 }
 
@@ -733,6 +1068,12 @@ void IOConfigGPIO(IO_t io, ioConfig_t cfg)
     printf("IOConfigGPIO\n");
 }
 
+bool IORead(IO_t io)
+{
+    UNUSED(io);
+    return false;
+}
+
 void spektrumBind(rxConfig_t *rxConfig)
 {
     UNUSED(rxConfig);
@@ -103,6 +103,18 @@
 #define USE_PWM_OUTPUT
 #endif
 
+#define USE_TASK_HISTOGRAMS
+
+// Blackbox storage emulated in image files, see --flash and --sdcard
+#define USE_BLACKBOX
+#define USE_FLASH_CHIP
+#define USE_FLASH_VIRTUAL
+#define USE_FLASHFS
+#define USE_FLASHFS_INDEX
+#define USE_FLASH_TOOLS
+#define USE_SDCARD
+#define USE_SDCARD_VIRTUAL
+
 #undef USE_STACK_CHECK // I think SITL don't need this
 #undef USE_DASHBOARD
 #undef USE_TELEMETRY_LTM
@@ -285,5 +297,6 @@ uint64_t micros64(void);
 uint64_t millis64(void);
 
 int lockMainPID(void);
+void simulatorLoopIdle(void);
 
 int targetParseArgs(int argc, char * argv[]);
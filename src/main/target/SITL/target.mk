@@ -6,4 +6,6 @@ TARGET_SRC = \
             drivers/accgyro/accgyro_virtual.c \
             drivers/barometer/barometer_virtual.c \
             drivers/compass/compass_virtual.c \
+            drivers/flash/flash_virtual.c \
+            drivers/sdcard_virtual.c \
             drivers/serial_tcp.c
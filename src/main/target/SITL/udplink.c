@@ -60,7 +60,8 @@ int udpRecv(udpLink_t* link, void* data, size_t size, uint32_t timeout_ms)
     tv.tv_sec = timeout_ms / 1000;
     tv.tv_usec = (timeout_ms % 1000) * 1000UL;
 
-    if (select(link->fd+1, &fds, NULL, NULL, &tv) != 1) {
+    // the socket is non-blocking, so without a timeout there is no need to wait
+    if (timeout_ms && select(link->fd+1, &fds, NULL, NULL, &tv) != 1) {
         return -1;
     }
 
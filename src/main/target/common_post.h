@@ -368,6 +368,10 @@
 #undef USE_FLASHFS
 #endif
 
+#if !defined(USE_FLASHFS)
+#undef USE_FLASHFS_INDEX
+#endif
+
 #if (!defined(USE_SDCARD) && !defined(USE_FLASHFS)) || !defined(USE_BLACKBOX)
 #undef USE_USB_MSC
 #endif
@@ -639,3 +643,7 @@ extern uint8_t __config_end;
 #define USE_PIN_PULL_UP_DOWN
 #endif
 #endif // USE_PINIO
+
+#if defined(USE_LATE_TASK_STATISTICS) && !defined(USE_TASK_HISTOGRAMS)
+#define USE_TASK_HISTOGRAMS
+#endif
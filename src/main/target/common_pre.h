@@ -297,6 +297,14 @@
 
 #define USE_HUFFMAN
 
+#if TARGET_FLASH_SIZE >= 1024
+#define USE_CRC_SLICE_BY_4  // extra 2.25kB of CRC tables for faster checksums over long buffers
+#define USE_HUFFMAN_ADAPTIVE  // extra 2.3kB of RAM for the adaptive Huffman model of MSP_DATAFLASH_READ
+#define USE_FLASHFS_READ_AHEAD  // extra 2kB of DMA RAM for reading ahead of flash log downloads
+#define USE_EEPROM_BACKGROUND_WRITE  // extra 1kB of RAM to hold a save while it is programmed in the background
+#define USE_CLI_SETTING_NAME_INDEX  // extra 1.4kB of RAM for a sorted index of the CLI setting names
+#endif
+
 #define PID_PROFILE_COUNT 4
 #define CONTROL_RATE_PROFILE_COUNT  4
 
@@ -0,0 +1,160 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Minimal timing helpers shared by the host benchmarks in this directory.
+//
+// A benchStage_t collects one duration per call of the code under test and
+// reports mean, p99 and worst-case. The clock overhead is measured once and
+// subtracted so that short stages are not dominated by clock_gettime().
+
+#pragma once
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+static inline uint64_t benchNowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t benchClockOverheadNs(void)
+{
+    static uint64_t overheadNs = UINT64_MAX;
+    if (overheadNs == UINT64_MAX) {
+        std::vector<uint64_t> samples(10000);
+        for (auto &sample : samples) {
+            const uint64_t startNs = benchNowNs();
+            sample = benchNowNs() - startNs;
+        }
+        std::sort(samples.begin(), samples.end());
+        overheadNs = samples[samples.size() / 2];
+    }
+    return overheadNs;
+}
+
+// Parse a count option, eg. -n, which must be a whole positive number
+static inline bool benchParseCount(const char *arg, int *count)
+{
+    // strtoul() skips spaces and takes a sign, so the first character must already be a digit
+    if (!isdigit((unsigned char)arg[0])) {
+        return false;
+    }
+
+    char *end;
+    errno = 0;
+    const unsigned long value = strtoul(arg, &end, 10);
+    if (errno || *end || value == 0 || value > INT_MAX) {
+        return false;
+    }
+
+    *count = (int)value;
+    return true;
+}
+
+typedef struct benchStage_s {
+    const char *name;
+    std::vector<uint64_t> samplesNs;
+    uint64_t startNs;
+
+    explicit benchStage_s(const char *stageName) : name(stageName), startNs(0) {}
+
+    void reserve(size_t count) { samplesNs.reserve(count); }
+    void clear(void) { samplesNs.clear(); }
+
+    void begin(void) { startNs = benchNowNs(); }
+
+    void end(void)
+    {
+        const uint64_t elapsedNs = benchNowNs() - startNs;
+        const uint64_t overheadNs = benchClockOverheadNs();
+        samplesNs.push_back(elapsedNs > overheadNs ? elapsedNs - overheadNs : 0);
+    }
+
+    template <typename F>
+    void time(F fn)
+    {
+        begin();
+        fn();
+        end();
+    }
+} benchStage_t;
+
+typedef struct benchSummary_s {
+    size_t count;
+    double meanNs;
+    uint64_t p50Ns;
+    uint64_t p99Ns;
+    uint64_t maxNs;
+} benchSummary_t;
+
+static inline benchSummary_t benchSummarise(const benchStage_t &stage)
+{
+    benchSummary_t summary = { 0, 0.0, 0, 0, 0 };
+    if (stage.samplesNs.empty()) {
+        return summary;
+    }
+
+    std::vector<uint64_t> sorted(stage.samplesNs);
+    std::sort(sorted.begin(), sorted.end());
+
+    uint64_t totalNs = 0;
+    for (const uint64_t sample : sorted) {
+        totalNs += sample;
+    }
+
+    summary.count = sorted.size();
+    summary.meanNs = (double)totalNs / sorted.size();
+    summary.p50Ns = sorted[sorted.size() / 2];
+    summary.p99Ns = sorted[(sorted.size() * 99) / 100];
+    summary.maxNs = sorted.back();
+    return summary;
+}
+
+static inline void benchPrintHeader(const char *title)
+{
+    printf("\n%s\n", title);
+    printf("%-28s %10s %10s %10s %10s %10s\n", "stage", "samples", "ns/iter", "p50 ns", "p99 ns", "max ns");
+}
+
+static inline void benchPrintStage(const benchStage_t &stage)
+{
+    const benchSummary_t summary = benchSummarise(stage);
+    printf("%-28s %10zu %10.1f %10llu %10llu %10llu\n", stage.name, summary.count, summary.meanNs,
+        (unsigned long long)summary.p50Ns, (unsigned long long)summary.p99Ns, (unsigned long long)summary.maxNs);
+}
+
+// Speedups compare medians, as a few samples hit by preemption can outweigh the rest of a mean
+static inline void benchPrintSpeedup(const char *label, uint64_t referenceNs, uint64_t ns)
+{
+    if (ns > 0) {
+        printf("%-28s %10.1fx\n", label, (double)referenceNs / ns);
+    }
+}
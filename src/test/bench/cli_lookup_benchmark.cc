@@ -0,0 +1,149 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host benchmark of the CLI setting name lookup in cli/settings.c.
+//
+// Restoring a "dump all" runs one "set <name> = <value>" per setting, each of
+// which looks the name up in valueTable. This times that sequence of lookups
+// with the linear search cliGetSettingIndex() used to do and with the sorted
+// name index, after checking that both find the same entries.
+//
+// usage: cli_lookup_benchmark [-n samples]
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "build/debug.h"
+
+    #include "common/utils.h"
+
+    #include "cli/settings.h"
+
+    #include "sensors/current.h"
+    #include "sensors/voltage.h"
+}
+
+#include "benchmark.h"
+
+#define DEFAULT_SAMPLE_COUNT 200
+
+// As cliGetSettingIndex() was before the name index
+static uint16_t findByNameLinear(const char *name, size_t length)
+{
+    for (unsigned i = 0; i < valueTableEntryCount; i++) {
+        const char *settingName = valueTable[i].name;
+        if (strncasecmp(name, settingName, length) == 0 && length == strlen(settingName)) {
+            return i;
+        }
+    }
+    return valueTableEntryCount;
+}
+
+static volatile uint32_t sink;
+
+int main(int argc, char *argv[])
+{
+    int sampleCount = DEFAULT_SAMPLE_COUNT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            if (!benchParseCount(optarg, &sampleCount)) {
+                fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // the lines of a full dump, the name is followed by the rest of the line as in cliSet()
+    std::vector<std::string> lines;
+    for (unsigned i = 0; i < valueTableEntryCount; i++) {
+        lines.push_back(std::string(valueTable[i].name) + " = 0");
+    }
+
+    printf("clock overhead %lluns (subtracted), %u settings per dump\n",
+        (unsigned long long)benchClockOverheadNs(), (unsigned)valueTableEntryCount);
+
+    benchPrintHeader("Setting lookups for a full dump restore");
+
+    // the index is sorted on the first lookup, time that once on its own
+    benchStage_t buildStage("index build (first lookup)");
+    buildStage.time([&] { sink = valueTableFindByName(lines[0].c_str(), strlen(valueTable[0].name)); });
+
+    for (unsigned i = 0; i < valueTableEntryCount; i++) {
+        const size_t length = strlen(valueTable[i].name);
+        const uint16_t expected = findByNameLinear(lines[i].c_str(), length);
+        const uint16_t actual = valueTableFindByName(lines[i].c_str(), length);
+        if (actual != expected) {
+            printf("MISMATCH %s: %u != %u\n", valueTable[i].name, actual, expected);
+            return 1;
+        }
+    }
+
+    benchStage_t linearStage("linear search");
+    benchStage_t indexedStage("sorted name index");
+    linearStage.reserve(sampleCount);
+    indexedStage.reserve(sampleCount);
+
+    for (int sample = 0; sample < sampleCount; sample++) {
+        linearStage.time([&] {
+            for (unsigned i = 0; i < valueTableEntryCount; i++) {
+                sink = findByNameLinear(lines[i].c_str(), strlen(valueTable[i].name));
+            }
+        });
+        indexedStage.time([&] {
+            for (unsigned i = 0; i < valueTableEntryCount; i++) {
+                sink = valueTableFindByName(lines[i].c_str(), strlen(valueTable[i].name));
+            }
+        });
+    }
+
+    benchPrintStage(buildStage);
+    benchPrintStage(linearStage);
+    benchPrintStage(indexedStage);
+
+    benchPrintSpeedup("  speedup", benchSummarise(linearStage).p50Ns, benchSummarise(indexedStage).p50Ns);
+
+    return 0;
+}
+
+// STUBS
+extern "C" {
+    const char * const debugModeNames[DEBUG_COUNT] = { 0 };
+    const char * const currentMeterSourceNames[CURRENT_METER_COUNT] = { 0 };
+    const char * const voltageMeterSourceNames[VOLTAGE_METER_COUNT] = { 0 };
+}
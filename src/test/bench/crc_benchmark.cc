@@ -0,0 +1,207 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host benchmark of common/crc.c against the bitwise routines it replaced.
+//
+// For each buffer length the bitwise reference, the table driven per-byte
+// functions and the slice-by-4 buffer functions are first checked to give
+// identical results, then timed. Lengths cover a CRSF RC frame up to a
+// dataflash read chunk.
+//
+// usage: crc_benchmark [-n samples]
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+extern "C" {
+    #include "common/crc.h"
+    #include "common/utils.h"
+}
+
+#include "benchmark.h"
+
+#define DEFAULT_SAMPLE_COUNT 2000
+#define CALLS_PER_SAMPLE 64
+
+// The bitwise implementations as they were before the tables were introduced
+static uint16_t crc16CcittBitwise(uint16_t crc, unsigned char a)
+{
+    crc ^= (uint16_t)a << 8;
+    for (int ii = 0; ii < 8; ++ii) {
+        if (crc & 0x8000) {
+            crc = (crc << 1) ^ 0x1021;
+        } else {
+            crc = crc << 1;
+        }
+    }
+    return crc;
+}
+
+static uint16_t crc16CcittBitwiseUpdate(uint16_t crc, const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        crc = crc16CcittBitwise(crc, data[i]);
+    }
+    return crc;
+}
+
+static uint8_t crc8DvbS2BitwiseUpdate(uint8_t crc, const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        crc = crc8_calc(crc, data[i], 0xD5);
+    }
+    return crc;
+}
+
+static uint16_t crc16CcittPerByte(uint16_t crc, const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        crc = crc16_ccitt(crc, data[i]);
+    }
+    return crc;
+}
+
+static uint8_t crc8DvbS2PerByte(uint8_t crc, const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        crc = crc8_dvb_s2(crc, data[i]);
+    }
+    return crc;
+}
+
+typedef uint32_t (*crcFn_t)(const uint8_t *data, uint32_t length);
+
+typedef struct crcImplementation_s {
+    const char *name;
+    crcFn_t fn;
+} crcImplementation_t;
+
+static const crcImplementation_t crc16Implementations[] = {
+    { "bitwise", [](const uint8_t *d, uint32_t l) -> uint32_t { return crc16CcittBitwiseUpdate(0, d, l); } },
+    { "table, per byte", [](const uint8_t *d, uint32_t l) -> uint32_t { return crc16CcittPerByte(0, d, l); } },
+    { "crc16_ccitt_update", [](const uint8_t *d, uint32_t l) -> uint32_t { return crc16_ccitt_update(0, d, l); } },
+};
+
+static const crcImplementation_t crc8Implementations[] = {
+    { "bitwise", [](const uint8_t *d, uint32_t l) -> uint32_t { return crc8DvbS2BitwiseUpdate(0, d, l); } },
+    { "table, per byte", [](const uint8_t *d, uint32_t l) -> uint32_t { return crc8DvbS2PerByte(0, d, l); } },
+    { "crc8_dvb_s2_update", [](const uint8_t *d, uint32_t l) -> uint32_t { return crc8_dvb_s2_update(0, d, l); } },
+};
+
+static volatile uint32_t sink;
+
+static bool runFamily(const char *title, const crcImplementation_t *impls, int implCount,
+    const std::vector<uint8_t> &data, int sampleCount)
+{
+    static const uint32_t lengths[] = { 8, 26, 64, 256, 4096 };
+
+    benchPrintHeader(title);
+
+    for (const uint32_t length : lengths) {
+        // bit-exactness over every start offset so that unaligned slices are covered
+        for (uint32_t offset = 0; offset < 4; offset++) {
+            const uint32_t expected = impls[0].fn(&data[offset], length);
+            for (int i = 1; i < implCount; i++) {
+                const uint32_t actual = impls[i].fn(&data[offset], length);
+                if (actual != expected) {
+                    printf("MISMATCH %s length %u offset %u: 0x%x != 0x%x\n",
+                        impls[i].name, length, offset, actual, expected);
+                    return false;
+                }
+            }
+        }
+
+        uint64_t referenceNs = 0;
+        for (int i = 0; i < implCount; i++) {
+            char name[64];
+            snprintf(name, sizeof(name), "%s %u", impls[i].name, length);
+            benchStage_t stage(name);
+            stage.reserve(sampleCount);
+
+            for (int sample = 0; sample < sampleCount; sample++) {
+                const uint8_t *buffer = &data[(sample * 7) % (data.size() - length)];
+                stage.time([&] {
+                    for (int call = 0; call < CALLS_PER_SAMPLE; call++) {
+                        sink = impls[i].fn(buffer, length);
+                    }
+                });
+            }
+
+            // of all the calls in a sample, as a median of one call would be rounded to a few ns
+            const uint64_t p50Ns = benchSummarise(stage).p50Ns;
+
+            for (auto &sampleNs : stage.samplesNs) {
+                sampleNs /= CALLS_PER_SAMPLE;
+            }
+            benchPrintStage(stage);
+
+            if (i == 0) {
+                referenceNs = p50Ns;
+            } else {
+                benchPrintSpeedup("  speedup", referenceNs, p50Ns);
+            }
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int sampleCount = DEFAULT_SAMPLE_COUNT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            if (!benchParseCount(optarg, &sampleCount)) {
+                fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> data(8192);
+    uint32_t seed = 0x12345678;
+    for (auto &byte : data) {
+        seed = seed * 1664525 + 1013904223;
+        byte = seed >> 24;
+    }
+
+    printf("clock overhead %lluns (subtracted), %d calls per sample\n",
+        (unsigned long long)benchClockOverheadNs(), CALLS_PER_SAMPLE);
+
+    const bool exact = runFamily("CRC16 CCITT (SRXL2, SUMD, XBUS, config EEPROM)", crc16Implementations,
+            ARRAYLEN(crc16Implementations), data, sampleCount)
+        && runFamily("CRC8 DVB-S2 (CRSF, ELRS, MSPv2)", crc8Implementations,
+            ARRAYLEN(crc8Implementations), data, sampleCount);
+
+    return exact ? 0 : 1;
+}
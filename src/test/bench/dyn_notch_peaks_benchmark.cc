@@ -0,0 +1,289 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host benchmark of the dynamic notch peak search in common/sdft.c.
+//
+// Gyro noise made of a few sweeping motor tones on top of broadband noise is
+// pushed through an SDFT at the default 8kHz / 600Hz dyn notch setup. After
+// every push, sdftWinSqPeaks() is compared against the window, noise sum,
+// insertion sort and bubble sort that STEP_WINDOW and STEP_DETECT_PEAKS used
+// before, first for identical peaks and noise sum and then for time per axis.
+//
+// dynNotchProcess() runs one step per PID loop, so the two halves of the fused
+// pass (sdftWinSqPeaksLow() and sdftWinSqPeaksHigh()), the frequency
+// calculation and the filter updates are timed too. The largest step is what a
+// PID loop has to make room for, before (window, peaks, frequencies, filters)
+// and now (lower half, upper half, frequencies, filters).
+//
+// usage: dyn_notch_peaks_benchmark [-n samples]
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <initializer_list>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/filter.h"
+    #include "common/maths.h"
+    #include "common/sdft.h"
+}
+
+#include "benchmark.h"
+
+#define DEFAULT_SAMPLE_COUNT 20000    // 15 seconds of downsampled gyro data
+#define SDFT_SAMPLE_RATE_HZ  1333.3f  // 8kHz PID loop, 600Hz dyn_notch_max_hz
+#define START_BIN            5        // dyn_notch_min_hz 100
+#define END_BIN              32       // dyn_notch_max_hz 600
+#define PEAK_COUNT_MAX       7        // DYN_NOTCH_COUNT_MAX
+
+#define LOOPTIME_US          125
+#define NOTCH_Q              3.0f     // dyn_notch_q 300
+
+static const int peakCounts[] = { 3, 7 };
+
+// The two steps dynNotchProcess() used before: STEP_WINDOW
+static float referenceWindow(const sdft_t *sdft, float *data)
+{
+    sdftWinSq(sdft, data);
+
+    float noise = 0.0f;
+    for (int bin = sdft->startBin; bin <= sdft->endBin; bin++) {
+        noise += data[bin];
+    }
+    return noise;
+}
+
+// and STEP_DETECT_PEAKS, one PID loop later
+static void referenceDetectPeaks(const sdft_t *sdft, const float *data, sdftPeak_t *peaks, const int peakCount)
+{
+    for (int p = 0; p < peakCount; p++) {
+        peaks[p].bin = 0;
+        peaks[p].value = 0.0f;
+    }
+
+    for (int bin = (sdft->startBin + 1); bin < sdft->endBin; bin++) {
+        if ((data[bin] > data[bin - 1]) && (data[bin] > data[bin + 1])) {
+            for (int p = 0; p < peakCount; p++) {
+                if (data[bin] > peaks[p].value) {
+                    for (int k = peakCount - 1; k > p; k--) {
+                        peaks[k] = peaks[k - 1];
+                    }
+                    peaks[p].bin = bin;
+                    peaks[p].value = data[bin];
+                    break;
+                }
+            }
+            bin++;
+        }
+    }
+
+    for (int p = peakCount - 1; p > 0; p--) {
+        for (int k = 0; k < p; k++) {
+            if (peaks[k].bin > peaks[k + 1].bin && peaks[k + 1].bin != 0) {
+                sdftPeak_t temp = peaks[k];
+                peaks[k] = peaks[k + 1];
+                peaks[k + 1] = temp;
+            }
+        }
+    }
+}
+
+// STEP_CALC_FREQUENCIES, without the OSD and debug output
+static float calcFrequencies(const float *data, const sdftPeak_t *peaks, const int peakCount, float noiseThreshold, float *centerFreq)
+{
+    int count = 0;
+    for (int p = 0; p < peakCount; p++) {
+        if (peaks[p].bin != 0) {
+            noiseThreshold -= 0.75f * data[peaks[p].bin - 1];
+            noiseThreshold -= data[peaks[p].bin];
+            noiseThreshold -= 0.75f * data[peaks[p].bin + 1];
+            count++;
+        }
+    }
+    noiseThreshold /= END_BIN - START_BIN - count + 1;
+    noiseThreshold *= 2.0f;
+
+    const float resolutionHz = SDFT_SAMPLE_RATE_HZ / SDFT_SAMPLE_SIZE;
+    for (int p = 0; p < peakCount; p++) {
+        if (peaks[p].bin != 0 && peaks[p].value > noiseThreshold) {
+            float meanBin = peaks[p].bin;
+            const float y0 = data[peaks[p].bin - 1];
+            const float y1 = data[peaks[p].bin];
+            const float y2 = data[peaks[p].bin + 1];
+            const float denom = 2.0f * (y0 - 2 * y1 + y2);
+            if (denom != 0.0f) {
+                meanBin += (y0 - y2) / denom;
+            }
+            const float hz = constrainf(meanBin * resolutionHz, 100.0f, 600.0f);
+            const float cutoffMult = constrainf(peaks[p].value / noiseThreshold, 1.0f, 10.0f);
+            const float gain = pt1FilterGain(4.0f * cutoffMult, LOOPTIME_US * 1e-6f * 12);
+            centerFreq[p] += gain * (hz - centerFreq[p]);
+        }
+    }
+
+    return noiseThreshold;
+}
+
+// STEP_UPDATE_FILTERS
+static void updateFilters(biquadFilter_t *notch, const float *centerFreq, const sdftPeak_t *peaks, float noiseThreshold, const int peakCount)
+{
+    for (int p = 0; p < peakCount; p++) {
+        if (peaks[p].bin != 0 && peaks[p].value > noiseThreshold) {
+            biquadFilterUpdate(&notch[p], centerFreq[p], LOOPTIME_US, NOTCH_Q, FILTER_NOTCH, 1.0f);
+        }
+    }
+}
+
+static uint64_t largestP99Ns(std::initializer_list<const benchStage_t *> stages)
+{
+    uint64_t p99Ns = 0;
+    for (const benchStage_t *stage : stages) {
+        p99Ns = MAX(p99Ns, benchSummarise(*stage).p99Ns);
+    }
+    return p99Ns;
+}
+
+static volatile float sink;
+
+int main(int argc, char *argv[])
+{
+    int sampleCount = DEFAULT_SAMPLE_COUNT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            if (!benchParseCount(optarg, &sampleCount)) {
+                fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("clock overhead %lluns (subtracted)\n", (unsigned long long)benchClockOverheadNs());
+
+    int result = 0;
+    for (unsigned run = 0; run < ARRAYLEN(peakCounts); run++) {
+        const int peakCount = peakCounts[run];
+        sdft_t sdft;
+        sdftInit(&sdft, START_BIN, END_BIN, 1);
+
+        benchStage_t stageWindow("STEP_WINDOW");
+        benchStage_t stageDetect("STEP_DETECT_PEAKS");
+        benchStage_t stageFused("sdftWinSqPeaks");
+        benchStage_t stageLow("STEP_DETECT_PEAKS_LOW");
+        benchStage_t stageHigh("STEP_DETECT_PEAKS_HIGH");
+        benchStage_t stageCalc("STEP_CALC_FREQUENCIES");
+        benchStage_t stageUpdate("STEP_UPDATE_FILTERS");
+        stageWindow.reserve(sampleCount);
+        stageDetect.reserve(sampleCount);
+        stageFused.reserve(sampleCount);
+        stageLow.reserve(sampleCount);
+        stageHigh.reserve(sampleCount);
+        stageCalc.reserve(sampleCount);
+        stageUpdate.reserve(sampleCount);
+
+        biquadFilter_t notch[PEAK_COUNT_MAX];
+        float centerFreq[PEAK_COUNT_MAX];
+        for (int p = 0; p < PEAK_COUNT_MAX; p++) {
+            centerFreq[p] = 300.0f;
+            biquadFilterInit(&notch[p], centerFreq[p], LOOPTIME_US, NOTCH_Q, FILTER_NOTCH, 1.0f);
+        }
+
+        uint32_t seed = 12345;
+        int mismatches = 0;
+        for (int sample = 0; sample < sampleCount; sample++) {
+            const float t = sample / SDFT_SAMPLE_RATE_HZ;
+            float value = 0.0f;
+            for (int tone = 0; tone < 4; tone++) {
+                // motor tones sweep slowly through the dyn notch range at different strengths
+                const float hz = 250.0f + 60.0f * tone + 80.0f * sin_approx(0.3f * t + tone);
+                value += (40.0f - 8.0f * tone) * sin_approx(fmodf(2.0f * M_PIf * hz * t, 2.0f * M_PIf) - M_PIf);
+            }
+            seed = seed * 1664525u + 1013904223u;
+            value += ((int32_t)(seed >> 8) % 2000) * 0.01f;
+            sdftPush(&sdft, value);
+
+            float referenceData[SDFT_BIN_COUNT];
+            float fusedData[SDFT_BIN_COUNT];
+            float splitData[SDFT_BIN_COUNT];
+            sdftPeak_t referencePeaks[PEAK_COUNT_MAX];
+            sdftPeak_t fusedPeaks[PEAK_COUNT_MAX];
+            sdftPeak_t splitPeaks[PEAK_COUNT_MAX];
+            float referenceNoise = 0.0f;
+            float fusedNoise = 0.0f;
+            float splitNoise = 0.0f;
+
+            stageWindow.time([&] { referenceNoise = referenceWindow(&sdft, referenceData); });
+            stageDetect.time([&] { referenceDetectPeaks(&sdft, referenceData, referencePeaks, peakCount); });
+            stageFused.time([&] { fusedNoise = sdftWinSqPeaks(&sdft, fusedData, fusedPeaks, peakCount); });
+            stageLow.time([&] { splitNoise = sdftWinSqPeaksLow(&sdft, splitData, splitPeaks, peakCount); });
+            stageHigh.time([&] { splitNoise = sdftWinSqPeaksHigh(&sdft, splitData, splitPeaks, peakCount, splitNoise); });
+
+            float noiseThreshold = 0.0f;
+            stageCalc.time([&] { noiseThreshold = calcFrequencies(splitData, splitPeaks, peakCount, splitNoise, centerFreq); });
+            stageUpdate.time([&] { updateFilters(notch, centerFreq, splitPeaks, noiseThreshold, peakCount); });
+
+            bool match = referenceNoise == fusedNoise && referenceNoise == splitNoise;
+            for (int p = 0; p < peakCount; p++) {
+                match = match && referencePeaks[p].bin == fusedPeaks[p].bin && referencePeaks[p].value == fusedPeaks[p].value;
+                match = match && referencePeaks[p].bin == splitPeaks[p].bin && referencePeaks[p].value == splitPeaks[p].value;
+            }
+            mismatches += match ? 0 : 1;
+            sink = fusedNoise;
+        }
+
+        char title[128];
+        snprintf(title, sizeof(title), "%d peaks, bins %d-%d, %d mismatches", peakCount, START_BIN, END_BIN, mismatches);
+        benchPrintHeader(title);
+        benchPrintStage(stageWindow);
+        benchPrintStage(stageDetect);
+        benchPrintStage(stageFused);
+        benchPrintStage(stageLow);
+        benchPrintStage(stageHigh);
+        benchPrintStage(stageCalc);
+        benchPrintStage(stageUpdate);
+
+        // the reference walks the spectrum twice for what sdftWinSqPeaks() does in one pass
+        benchPrintSpeedup("  speedup", benchSummarise(stageWindow).p50Ns + benchSummarise(stageDetect).p50Ns,
+            benchSummarise(stageFused).p50Ns);
+
+        printf("%-28s %10llu ns before, %llu ns now\n", "  largest step p99",
+            (unsigned long long)largestP99Ns({ &stageWindow, &stageDetect, &stageCalc, &stageUpdate }),
+            (unsigned long long)largestP99Ns({ &stageLow, &stageHigh, &stageCalc, &stageUpdate }));
+
+        if (mismatches) {
+            result = 1;
+        }
+    }
+
+    return result;
+}
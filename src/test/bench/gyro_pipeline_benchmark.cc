@@ -0,0 +1,446 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host benchmark of the gyro -> filter -> PID -> mixer hot path.
+//
+// The real sensors/gyro.c, flight/rpm_filter.c, flight/dyn_notch_filter.c,
+// flight/pid.c and flight/mixer.c are driven through the virtual gyro with
+// either a synthetic gyro stream or one recorded to a CSV file, at 8kHz and
+// 4kHz PID loop rates, and the cost of every stage is reported.
+//
+// usage: gyro_pipeline_benchmark [-f gyro.csv] [-n samples]
+//
+// A recorded stream has one sample per line: gyroX,gyroY,gyroZ[,motorHz...]
+// with the gyro in raw sensor counts as logged in gyroADC[] and, optionally,
+// one eRPM derived frequency per motor. Lines that do not parse are skipped
+// so a header line is allowed.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "build/debug.h"
+
+    #include "common/axis.h"
+    #include "common/maths.h"
+    #include "common/filter.h"
+
+    #include "config/config.h"
+
+    #include "drivers/accgyro/accgyro_virtual.h"
+    #include "drivers/dshot.h"
+    #include "drivers/dshot_command.h"
+    #include "drivers/motor.h"
+    #include "drivers/sensor.h"
+
+    #include "fc/controlrate_profile.h"
+    #include "fc/core.h"
+    #include "fc/rc.h"
+    #include "fc/rc_controls.h"
+    #include "fc/runtime_config.h"
+
+    #include "flight/dyn_notch_filter.h"
+    #include "flight/failsafe.h"
+    #include "flight/imu.h"
+    #include "flight/mixer.h"
+    #include "flight/mixer_tricopter.h"
+    #include "flight/pid.h"
+    #include "flight/pid_init.h"
+    #include "flight/position.h"
+    #include "flight/rpm_filter.h"
+
+    #include "io/beeper.h"
+    #include "io/gps.h"
+
+    #include "pg/motor.h"
+    #include "pg/pg.h"
+    #include "pg/pg_ids.h"
+    #include "pg/rpm_filter.h"
+    #include "pg/rx.h"
+
+    #include "rx/rx.h"
+
+    #include "scheduler/scheduler.h"
+
+    #include "sensors/acceleration.h"
+    #include "sensors/battery.h"
+    #include "sensors/gyro.h"
+    #include "sensors/gyro_init.h"
+    #include "sensors/sensors.h"
+
+    extern gyroDev_t * const gyroDevPtr;
+}
+
+#include "benchmark.h"
+
+#define DEFAULT_SAMPLE_COUNT 80000    // 10 seconds of gyro data at 8kHz
+#define MOTOR_COUNT 4
+
+typedef struct gyroSample_s {
+    int16_t gyroADC[XYZ_AXIS_COUNT];
+    float motorHz[MAX_SUPPORTED_MOTORS];
+} gyroSample_t;
+
+typedef std::vector<gyroSample_t> gyroStream_t;
+
+static float benchMotorHz[MAX_SUPPORTED_MOTORS];
+static float benchSetpointRate[XYZ_AXIS_COUNT];
+
+// deterministic noise source so that runs are comparable
+static uint32_t noiseState = 0x12345678;
+
+static float whiteNoise(void)
+{
+    noiseState = noiseState * 1664525 + 1013904223;
+    return ((noiseState >> 8) / (float)(1 << 24)) * 2.0f - 1.0f;
+}
+
+// Throttle ramp with motor noise and its harmonics on top of slow stick input.
+// Amplitudes are in raw gyro counts and roughly match a 5" quad on a 2000dps gyro.
+static gyroStream_t generateSyntheticStream(int sampleCount, int sampleRateHz)
+{
+    gyroStream_t stream(sampleCount);
+    float phase[MAX_SUPPORTED_MOTORS] = { 0 };
+
+    for (int i = 0; i < sampleCount; i++) {
+        const float t = (float)i / sampleRateHz;
+        const float throttle = 0.5f + 0.4f * sinf(2.0f * M_PIf * 0.2f * t);
+        gyroSample_t &sample = stream[i];
+
+        for (int motor = 0; motor < MAX_SUPPORTED_MOTORS; motor++) {
+            sample.motorHz[motor] = (motor < MOTOR_COUNT) ? 80.0f + 300.0f * throttle + 5.0f * motor : 0.0f;
+            phase[motor] += 2.0f * M_PIf * sample.motorHz[motor] / sampleRateHz;
+        }
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            float value = 120.0f * sinf(2.0f * M_PIf * 1.5f * t + axis);
+            for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+                value += 20.0f * sinf(phase[motor] + axis);
+                value += 8.0f * sinf(2.0f * phase[motor]);
+                value += 4.0f * sinf(3.0f * phase[motor]);
+            }
+            value += 10.0f * whiteNoise();
+            sample.gyroADC[axis] = constrain(lrintf(value), INT16_MIN, INT16_MAX);
+        }
+    }
+
+    return stream;
+}
+
+static bool loadRecordedStream(const char *filename, gyroStream_t *stream)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror(filename);
+        return false;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        gyroSample_t sample;
+        memset(&sample, 0, sizeof(sample));
+
+        char *cursor = line;
+        int fields = 0;
+        while (fields < XYZ_AXIS_COUNT + MAX_SUPPORTED_MOTORS) {
+            char *end;
+            const float value = strtof(cursor, &end);
+            if (end == cursor) {
+                break;
+            }
+            if (fields < XYZ_AXIS_COUNT) {
+                sample.gyroADC[fields] = constrain(lrintf(value), INT16_MIN, INT16_MAX);
+            } else {
+                sample.motorHz[fields - XYZ_AXIS_COUNT] = value;
+            }
+            fields++;
+            cursor = end;
+            while (*cursor == ',' || *cursor == ' ' || *cursor == '\t') {
+                cursor++;
+            }
+        }
+
+        if (fields >= XYZ_AXIS_COUNT) {
+            stream->push_back(sample);
+        }
+    }
+
+    fclose(file);
+    return !stream->empty();
+}
+
+static void benchConfigure(uint8_t pidDenom)
+{
+    pgResetAll();
+    currentPidProfile = pidProfilesMutable(0);
+    loadControlRateProfile();
+
+    motorConfigMutable()->dev.useDshotTelemetry = true;
+    rpmFilterConfigMutable()->rpm_filter_harmonics = 3;
+    pidConfigMutable()->pid_process_denom = pidDenom;
+    mixerConfigMutable()->mixerMode = MIXER_QUADX;
+
+    useDshotTelemetry = true;
+
+    gyroInit();
+    gyroSetTargetLooptime(pidDenom);
+    gyroInitFilters();
+
+    mixerInit((mixerMode_e)mixerConfig()->mixerMode);
+    pidInit(currentPidProfile);
+    mixerInitProfile();
+
+    ENABLE_ARMING_FLAG(ARMED);
+}
+
+static void feedSample(const gyroSample_t &sample)
+{
+    memcpy(benchMotorHz, sample.motorHz, sizeof(benchMotorHz));
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        benchSetpointRate[axis] = sample.gyroADC[axis] * 0.9f;
+    }
+    virtualGyroSet(gyroDevPtr, sample.gyroADC[X], sample.gyroADC[Y], sample.gyroADC[Z]);
+}
+
+// One pass per table section, each starting from a freshly initialised
+// pipeline, so that the per-stage timers do not inflate the loop total.
+static void runPipeline(const gyroStream_t &stream, uint8_t pidDenom)
+{
+    const size_t pidLoops = stream.size() / pidDenom;
+
+    benchStage_t stageLoop("gyro + PID loop");
+    benchStage_t stageGyroUpdate("gyroUpdate");
+    benchStage_t stageGyroFiltering("gyroFiltering");
+    benchStage_t stagePidController("pidController");
+    benchStage_t stageMixTable("mixTable");
+    benchStage_t stageRpmFilterUpdate("rpmFilterUpdate");
+    benchStage_t stageRpmFilterApply("rpmFilterApply");
+    benchStage_t stageDynNotchFilter("dynNotchPush/Filter");
+    benchStage_t stageDynNotchUpdate("dynNotchUpdate");
+
+    stageLoop.reserve(pidLoops);
+    stageGyroUpdate.reserve(stream.size());
+    stageGyroFiltering.reserve(pidLoops);
+    stagePidController.reserve(pidLoops);
+    stageMixTable.reserve(pidLoops);
+    stageRpmFilterUpdate.reserve(pidLoops);
+    stageRpmFilterApply.reserve(pidLoops);
+    stageDynNotchFilter.reserve(pidLoops);
+    stageDynNotchUpdate.reserve(pidLoops);
+
+    // whole loop including all gyro samples of one PID cycle, as scheduled by taskGyroSample(), taskFiltering() and taskMainPidLoop()
+    benchConfigure(pidDenom);
+    timeUs_t currentTimeUs = 0;
+    for (size_t i = 0; i < stream.size(); i++) {
+        currentTimeUs += gyro.sampleLooptime;
+        feedSample(stream[i]);
+
+        if (i % pidDenom == 0) {
+            stageLoop.begin();
+        }
+        gyroUpdate();
+        if ((i + 1) % pidDenom == 0) {
+            gyroFiltering(currentTimeUs);
+            pidController(currentPidProfile, currentTimeUs);
+            mixTable(currentTimeUs);
+            stageLoop.end();
+        }
+    }
+
+    // the same loop split into stages
+    benchConfigure(pidDenom);
+    currentTimeUs = 0;
+    for (size_t i = 0; i < stream.size(); i++) {
+        currentTimeUs += gyro.sampleLooptime;
+        feedSample(stream[i]);
+
+        stageGyroUpdate.time([] { gyroUpdate(); });
+        if ((i + 1) % pidDenom == 0) {
+            stageGyroFiltering.time([&] { gyroFiltering(currentTimeUs); });
+            stagePidController.time([&] { pidController(currentPidProfile, currentTimeUs); });
+            stageMixTable.time([&] { mixTable(currentTimeUs); });
+        }
+    }
+
+    // RPM and dynamic notch filters on their own, called the way gyroFiltering() and pidController() call them
+    benchConfigure(pidDenom);
+    float sink = 0.0f;
+    for (size_t i = pidDenom - 1; i < stream.size(); i += pidDenom) {
+        const gyroSample_t &sample = stream[i];
+        memcpy(benchMotorHz, sample.motorHz, sizeof(benchMotorHz));
+
+        float gyroADCf[XYZ_AXIS_COUNT];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyroADCf[axis] = sample.gyroADC[axis] * gyro.scale;
+        }
+
+        stageRpmFilterUpdate.time([] { rpmFilterUpdate(); });
+        stageRpmFilterApply.time([&] { rpmFilterApply(gyroADCf); });
+        stageDynNotchFilter.time([&] {
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                dynNotchPush(axis, gyroADCf[axis]);
+                gyroADCf[axis] = dynNotchFilter(axis, gyroADCf[axis]);
+            }
+        });
+        stageDynNotchUpdate.time([] { dynNotchUpdate(); });
+
+        sink += gyroADCf[X] + gyroADCf[Y] + gyroADCf[Z];
+    }
+
+    char title[128];
+    snprintf(title, sizeof(title), "gyro %dHz, PID loop %dHz, %d motors, %d RPM harmonics, %d dynamic notches",
+        gyro.sampleRateHz, (int)lrintf(1e6f / gyro.targetLooptime), getMotorCount(),
+        rpmFilterConfig()->rpm_filter_harmonics, dynNotchConfig()->dyn_notch_count);
+    benchPrintHeader(title);
+    benchPrintStage(stageLoop);
+    benchPrintStage(stageGyroUpdate);
+    benchPrintStage(stageGyroFiltering);
+    benchPrintStage(stagePidController);
+    benchPrintStage(stageMixTable);
+    benchPrintStage(stageRpmFilterUpdate);
+    benchPrintStage(stageRpmFilterApply);
+    benchPrintStage(stageDynNotchFilter);
+    benchPrintStage(stageDynNotchUpdate);
+
+    // keep the isolated filter outputs alive
+    if (sink == 12345.0f) {
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filename = NULL;
+    int sampleCount = DEFAULT_SAMPLE_COUNT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:n:")) != -1) {
+        switch (opt) {
+        case 'f':
+            filename = optarg;
+            break;
+        case 'n':
+            if (!benchParseCount(optarg, &sampleCount)) {
+                fprintf(stderr, "usage: %s [-f gyro.csv] [-n samples]\n", argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-f gyro.csv] [-n samples]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    gyroStream_t stream;
+    if (filename) {
+        if (!loadRecordedStream(filename, &stream)) {
+            fprintf(stderr, "%s: no gyro samples found\n", filename);
+            return 1;
+        }
+    } else {
+        // the virtual gyro always runs at 8kHz, 4kHz is reached with pid_process_denom = 2
+        stream = generateSyntheticStream(sampleCount, 8000);
+    }
+
+    printf("clock overhead %lluns (subtracted)\n", (unsigned long long)benchClockOverheadNs());
+
+    runPipeline(stream, 1);
+    runPipeline(stream, 2);
+
+    return 0;
+}
+
+// STUBS
+
+extern "C" {
+
+uint8_t debugMode;
+int16_t debug[DEBUG16_VALUE_COUNT];
+
+acc_t acc;
+attitudeEulerAngles_t attitude;
+rxRuntimeState_t rxRuntimeState;
+gpsSolutionData_t gpsSol;
+float rcCommand[4];
+float rcData[MAX_SUPPORTED_RC_CHANNEL_COUNT];
+uint8_t detectedSensors[SENSOR_INDEX_COUNT];
+bool useDshotTelemetry;
+pidProfile_t *currentPidProfile;
+
+PG_REGISTER(accelerometerConfig_t, accelerometerConfig, PG_ACCELEROMETER_CONFIG, 0);
+PG_REGISTER(systemConfig_t, systemConfig, PG_SYSTEM_CONFIG, 2);
+PG_REGISTER(positionConfig_t, positionConfig, PG_POSITION, 0);
+PG_REGISTER(flight3DConfig_t, flight3DConfig, PG_MOTOR_3D_CONFIG, 0);
+
+float getMotorFrequencyHz(uint8_t motorIndex) { return benchMotorHz[motorIndex]; }
+float getMinMotorFrequencyHz(void) { return benchMotorHz[0]; }
+float getDigitalIdleOffset(const motorConfig_t *motorConfig) { return motorConfig->digitalIdleOffsetValue * 0.0001f; }
+bool isMotorProtocolDshot(void) { return true; }
+void dshotSetPidLoopTime(uint32_t) { }
+void motorInitEndpoints(const motorConfig_t *, float outputLimit, float *outputLow, float *outputHigh, float *disarm, float *deadbandMotor3DHigh, float *deadbandMotor3DLow)
+{
+    *outputLow = DSHOT_MIN_THROTTLE;
+    *outputHigh = DSHOT_MIN_THROTTLE + outputLimit * (DSHOT_MAX_THROTTLE - DSHOT_MIN_THROTTLE);
+    *disarm = DSHOT_CMD_MOTOR_STOP;
+    *deadbandMotor3DHigh = DSHOT_3D_FORWARD_MIN_THROTTLE;
+    *deadbandMotor3DLow = DSHOT_3D_FORWARD_MIN_THROTTLE - 1;
+}
+void motorWriteAll(float *) { }
+void mixerTricopterInit(void) { }
+float mixerTricopterMotorCorrection(int) { return 0.0f; }
+bool isMotorsReversed(void) { return false; }
+bool isFlipOverAfterCrashActive(void) { return false; }
+bool failsafeIsActive(void) { return false; }
+uint8_t calculateThrottlePercentAbs(void) { return 50; }
+float getSetpointRate(int axis) { return benchSetpointRate[axis]; }
+float getRawSetpoint(int axis) { return benchSetpointRate[axis]; }
+float getFeedforward(int axis) { UNUSED(axis); return 0.0f; }
+float getRcDeflection(int axis) { UNUSED(axis); return 0.0f; }
+float getRcDeflectionRaw(int axis) { UNUSED(axis); return 0.0f; }
+float getRcDeflectionAbs(int axis) { UNUSED(axis); return 0.0f; }
+float getMaxRcDeflectionAbs(void) { return 0.0f; }
+float getMaxRcRate(int axis) { UNUSED(axis); return 670.0f; }
+bool isAirmodeActivated(void) { return true; }
+bool isLaunchControlActive(void) { return false; }
+bool isAltitudeLow(void) { return false; }
+bool isFixedWingLaunchControlActive(void) { return false; }
+void initRcProcessing(void) { }
+void disarm(flightLogDisarmReason_e) { }
+void systemBeep(bool) { }
+void beeper(beeperMode_e) { }
+void beeperConfirmationBeeps(uint8_t) { }
+void schedulerResetTaskStatistics(taskId_e) { }
+void writeEEPROM(void) { }
+uint32_t micros(void) { return 0; }
+void delay(uint32_t) { }
+void parseRcChannels(const char *, rxConfig_t *) { }
+timeDelta_t getGyroUpdateRate(void) { return gyro.targetLooptime; }
+
+}
@@ -0,0 +1,243 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host benchmark of the RPM notch bank in flight/rpm_filter.c.
+//
+// An octocopter with 3 harmonics (24 notches per axis) is filtered at 8kHz
+// with motor frequencies sweeping through the flight range. The notch bank is
+// compared against the per-axis array of biquadFilter_t it replaced, first for
+// equal output and then for time per loop.
+//
+// usage: rpm_filter_benchmark [-n samples]
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "build/debug.h"
+
+    #include "common/axis.h"
+    #include "common/filter.h"
+    #include "common/maths.h"
+
+    #include "drivers/dshot.h"
+
+    #include "flight/mixer.h"
+    #include "flight/rpm_filter.h"
+
+    #include "pg/rpm_filter.h"
+}
+
+#include "benchmark.h"
+
+#define DEFAULT_SAMPLE_COUNT 80000    // 10 seconds of gyro data at 8kHz
+#define LOOPTIME_US 125
+#define MOTOR_COUNT 8
+#define HARMONIC_COUNT 3
+
+static float benchMotorHz[MAX_SUPPORTED_MOTORS];
+
+// The array of structs notch bank rpmFilterUpdate() and rpmFilterApply() used before,
+// with the same notch update schedule
+static struct {
+    float weights[RPM_FILTER_HARMONICS_MAX];
+    float minHz;
+    float maxHz;
+    float fadeRangeHz;
+    float q;
+    int notchUpdatesPerIteration;
+    int motorIndex;
+    int harmonicIndex;
+    biquadFilter_t notch[XYZ_AXIS_COUNT][MAX_SUPPORTED_MOTORS][RPM_FILTER_HARMONICS_MAX];
+} reference;
+
+static void referenceInit(const rpmFilterConfig_t *config)
+{
+    reference.minHz = config->rpm_filter_min_hz;
+    reference.maxHz = 0.48f * 1e6f / LOOPTIME_US;
+    reference.fadeRangeHz = config->rpm_filter_fade_range_hz;
+    reference.q = config->rpm_filter_q / 100.0f;
+    for (int n = 0; n < RPM_FILTER_HARMONICS_MAX; n++) {
+        reference.weights[n] = constrainf(config->rpm_filter_weights[n] / 100.0f, 0.0f, 1.0f);
+    }
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+            for (int i = 0; i < HARMONIC_COUNT; i++) {
+                biquadFilterInit(&reference.notch[axis][motor][i], reference.minHz * i, LOOPTIME_US, reference.q, FILTER_NOTCH, 0.0f);
+            }
+        }
+    }
+    const float loopIterationsPerUpdate = 0.001f / (LOOPTIME_US * 1e-6f);
+    reference.notchUpdatesPerIteration = ceilf(MOTOR_COUNT * HARMONIC_COUNT / loopIterationsPerUpdate);
+}
+
+static void referenceUpdate(void)
+{
+    for (int i = 0; i < reference.notchUpdatesPerIteration; i++) {
+        const int h = reference.harmonicIndex;
+        const int m = reference.motorIndex;
+        if (reference.weights[h] > 0.0f) {
+            biquadFilter_t *roll = &reference.notch[0][m][h];
+            const float frequencyHz = constrainf((h + 1) * benchMotorHz[m], reference.minHz, reference.maxHz);
+            const float marginHz = frequencyHz - reference.minHz;
+            float weight = 1.0f;
+            if (marginHz < reference.fadeRangeHz) {
+                weight *= marginHz / reference.fadeRangeHz;
+            }
+            weight *= reference.weights[h];
+            biquadFilterUpdate(roll, frequencyHz, LOOPTIME_US, reference.q, FILTER_NOTCH, weight);
+            for (int axis = 1; axis < XYZ_AXIS_COUNT; axis++) {
+                biquadFilter_t *dest = &reference.notch[axis][m][h];
+                dest->b0 = roll->b0;
+                dest->b1 = roll->b1;
+                dest->b2 = roll->b2;
+                dest->a1 = roll->a1;
+                dest->a2 = roll->a2;
+                dest->weight = roll->weight;
+            }
+        }
+        reference.harmonicIndex = (h + 1) % HARMONIC_COUNT;
+        if (reference.harmonicIndex == 0) {
+            reference.motorIndex = (m + 1) % MOTOR_COUNT;
+        }
+    }
+}
+
+static float referenceApply(int axis, float value)
+{
+    for (int i = 0; i < HARMONIC_COUNT; i++) {
+        if (reference.weights[i] <= 0.0f) {
+            continue;
+        }
+        for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+            value = biquadFilterApplyDF1Weighted(&reference.notch[axis][motor][i], value);
+        }
+    }
+    return value;
+}
+
+static volatile float sink;
+
+int main(int argc, char *argv[])
+{
+    int sampleCount = DEFAULT_SAMPLE_COUNT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            if (!benchParseCount(optarg, &sampleCount)) {
+                fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    rpmFilterConfig_t config = {};
+    config.rpm_filter_harmonics = HARMONIC_COUNT;
+    config.rpm_filter_weights[0] = 100;
+    config.rpm_filter_weights[1] = 100;
+    config.rpm_filter_weights[2] = 80;
+    config.rpm_filter_min_hz = 100;
+    config.rpm_filter_fade_range_hz = 50;
+    config.rpm_filter_q = 500;
+
+    useDshotTelemetry = true;
+    rpmFilterInit(&config, LOOPTIME_US);
+    referenceInit(&config);
+
+    benchStage_t stageReferenceUpdate("biquadFilter_t update");
+    benchStage_t stageReferenceApply("biquadFilter_t apply XYZ");
+    benchStage_t stageUpdate("rpmFilterUpdate");
+    benchStage_t stageApply("rpmFilterApply");
+    stageReferenceUpdate.reserve(sampleCount);
+    stageReferenceApply.reserve(sampleCount);
+    stageUpdate.reserve(sampleCount);
+    stageApply.reserve(sampleCount);
+
+    float maxError = 0.0f;
+    for (int sample = 0; sample < sampleCount; sample++) {
+        const float t = sample * LOOPTIME_US * 1e-6f;
+        for (int motor = 0; motor < MOTOR_COUNT; motor++) {
+            // each motor sweeps between 80Hz and 480Hz, so the lowest notches fade in and out
+            benchMotorHz[motor] = 280.0f + 200.0f * sin_approx(0.5f * t + motor * 0.7f);
+        }
+
+        float gyroADCf[XYZ_AXIS_COUNT];
+        float expected[XYZ_AXIS_COUNT];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyroADCf[axis] = 50.0f * sin_approx(fmodf(2.0f * M_PIf * benchMotorHz[axis] * t, 2.0f * M_PIf) - M_PIf) + 10.0f * axis;
+            expected[axis] = gyroADCf[axis];
+        }
+
+        stageReferenceUpdate.time([] { referenceUpdate(); });
+        stageReferenceApply.time([&] {
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                expected[axis] = referenceApply(axis, expected[axis]);
+            }
+        });
+        stageUpdate.time([] { rpmFilterUpdate(); });
+        stageApply.time([&] { rpmFilterApply(gyroADCf); });
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            maxError = fmaxf(maxError, fabsf(gyroADCf[axis] - expected[axis]));
+            sink = gyroADCf[axis];
+        }
+    }
+
+    printf("clock overhead %lluns (subtracted), max difference to biquadFilter_t bank %g\n",
+        (unsigned long long)benchClockOverheadNs(), maxError);
+
+    char title[128];
+    snprintf(title, sizeof(title), "%d motors, %d RPM harmonics, %d notches per axis, gyro %dHz",
+        MOTOR_COUNT, HARMONIC_COUNT, MOTOR_COUNT * HARMONIC_COUNT, 1000000 / LOOPTIME_US);
+    benchPrintHeader(title);
+    benchPrintStage(stageReferenceUpdate);
+    benchPrintStage(stageUpdate);
+    benchPrintStage(stageReferenceApply);
+    benchPrintStage(stageApply);
+
+    benchPrintSpeedup("  apply speedup", benchSummarise(stageReferenceApply).p50Ns, benchSummarise(stageApply).p50Ns);
+
+    return maxError < 1e-3f ? 0 : 1;
+}
+
+// STUBS
+extern "C" {
+
+uint8_t debugMode;
+int16_t debug[DEBUG16_VALUE_COUNT];
+bool useDshotTelemetry;
+
+uint8_t getMotorCount(void) { return MOTOR_COUNT; }
+float getMotorFrequencyHz(uint8_t motorIndex) { return benchMotorHz[motorIndex]; }
+
+}
@@ -0,0 +1,654 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+
+#include "blackbox/blackbox.h"
+#include "blackbox/blackbox_fielddefs.h"
+
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "blackbox_decode.h"
+
+#define LOG_START_MARKER "H Product:Blackbox flight data recorder by Nicholas Sherlock\n"
+#define LOG_END_MESSAGE  "End of log"
+
+#define TAG8_8SVB_MAX_COUNT 8
+
+static const uint8_t *findLogStart(const uint8_t *data, size_t size, size_t from)
+{
+    const size_t markerLength = strlen(LOG_START_MARKER);
+
+    for (size_t pos = from; pos + markerLength <= size; pos++) {
+        const uint8_t *found = memchr(data + pos, 'H', size - pos - markerLength + 1);
+        if (!found) {
+            break;
+        }
+        pos = found - data;
+        if (memcmp(found, LOG_START_MARKER, markerLength) == 0) {
+            return found;
+        }
+    }
+
+    return NULL;
+}
+
+int bbLogCount(const uint8_t *data, size_t size)
+{
+    int count = 0;
+
+    for (const uint8_t *start = findLogStart(data, size, 0); start; start = findLogStart(data, size, start - data + 1)) {
+        count++;
+    }
+
+    return count;
+}
+
+static char *copyString(const char *start, size_t length)
+{
+    char *copy = malloc(length + 1);
+    memcpy(copy, start, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+const char *bbLogHeader(const bbLog_t *log, const char *name)
+{
+    for (int i = 0; i < log->headerCount; i++) {
+        if (strcmp(log->headerNames[i], name) == 0) {
+            return log->headerValues[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int headerInt(const bbLog_t *log, const char *name, int defaultValue)
+{
+    const char *value = bbLogHeader(log, name);
+
+    return value ? atoi(value) : defaultValue;
+}
+
+// Comma separated list of numbers, returns how many were found
+static int parseNumberList(const char *list, uint8_t *values, int maxCount)
+{
+    int count = 0;
+
+    while (list && *list && count < maxCount) {
+        values[count++] = atoi(list);
+        list = strchr(list, ',');
+        if (list) {
+            list++;
+        }
+    }
+
+    return count;
+}
+
+static bool parseFieldDefs(bbLog_t *log, char frameType, bbFieldDefs_t *defs, bool withNames)
+{
+    char name[32];
+
+    if (withNames) {
+        snprintf(name, sizeof(name), "Field %c name", frameType);
+        const char *names = bbLogHeader(log, name);
+        if (!names) {
+            return false;
+        }
+        while (*names && defs->count < BB_MAX_FIELDS) {
+            const char *comma = strchr(names, ',');
+            const size_t length = comma ? (size_t)(comma - names) : strlen(names);
+            defs->names[defs->count++] = copyString(names, length);
+            names += length + (comma ? 1 : 0);
+        }
+
+        snprintf(name, sizeof(name), "Field %c signed", frameType);
+        parseNumberList(bbLogHeader(log, name), defs->isSigned, defs->count);
+    }
+
+    snprintf(name, sizeof(name), "Field %c predictor", frameType);
+    const int predictors = parseNumberList(bbLogHeader(log, name), defs->predictor, defs->count);
+    snprintf(name, sizeof(name), "Field %c encoding", frameType);
+    const int encodings = parseNumberList(bbLogHeader(log, name), defs->encoding, defs->count);
+
+    return predictors == defs->count && encodings == defs->count;
+}
+
+bool bbLogOpen(bbLog_t *log, const uint8_t *data, size_t size, int index)
+{
+    memset(log, 0, sizeof(*log));
+
+    const uint8_t *start = findLogStart(data, size, 0);
+    for (int i = 0; start && i < index; i++) {
+        start = findLogStart(data, size, start - data + 1);
+    }
+    if (!start) {
+        return false;
+    }
+
+    // a log runs up to the start of the next one
+    const uint8_t *next = findLogStart(data, size, start - data + 1);
+    log->data = start;
+    log->size = next ? (size_t)(next - start) : size - (start - data);
+
+    while (log->pos + 2 < log->size && log->data[log->pos] == 'H' && log->data[log->pos + 1] == ' ') {
+        const char *line = (const char *)log->data + log->pos + 2;
+        const char *lineEnd = memchr(line, '\n', log->size - log->pos - 2);
+        if (!lineEnd) {
+            break;
+        }
+        const char *colon = memchr(line, ':', lineEnd - line);
+        if (colon && log->headerCount < BB_MAX_HEADERS) {
+            log->headerNames[log->headerCount] = copyString(line, colon - line);
+            log->headerValues[log->headerCount] = copyString(colon + 1, lineEnd - colon - 1);
+            log->headerCount++;
+        }
+        log->pos = (const uint8_t *)lineEnd + 1 - log->data;
+    }
+
+    if (!parseFieldDefs(log, 'I', &log->intraFields, true)) {
+        bbLogClose(log);
+        return false;
+    }
+    // inter frames have the same fields as intra frames, with their own predictors and encodings
+    log->interFields.count = log->intraFields.count;
+    if (!parseFieldDefs(log, 'P', &log->interFields, false)) {
+        bbLogClose(log);
+        return false;
+    }
+    log->timeField = bbLogFieldIndex(log, "time");
+    log->motor0Field = bbLogFieldIndex(log, "motor[0]");
+    parseFieldDefs(log, 'S', &log->slowFields, true);
+    parseFieldDefs(log, 'G', &log->gpsFields, true);
+    parseFieldDefs(log, 'H', &log->gpsHomeFields, true);
+
+    // old logs write the P interval as a fraction of the loops logged
+    const char *pInterval = bbLogHeader(log, "P interval");
+    const char *slash = pInterval ? strchr(pInterval, '/') : NULL;
+    if (slash) {
+        log->pInterval = MAX(atoi(slash + 1) / MAX(atoi(pInterval), 1), 1);
+    } else {
+        log->pInterval = MAX(headerInt(log, "P interval", 1), 1);
+    }
+    log->minthrottle = headerInt(log, "minthrottle", 0);
+    log->motorOutputLow = headerInt(log, "motorOutput", 0);
+    log->vbatref = headerInt(log, "vbatref", 0);
+
+    return true;
+}
+
+static void freeFieldDefs(bbFieldDefs_t *defs)
+{
+    for (int i = 0; i < defs->count; i++) {
+        free(defs->names[i]);
+    }
+}
+
+void bbLogClose(bbLog_t *log)
+{
+    for (int i = 0; i < log->headerCount; i++) {
+        free(log->headerNames[i]);
+        free(log->headerValues[i]);
+    }
+    freeFieldDefs(&log->intraFields);
+    freeFieldDefs(&log->slowFields);
+    freeFieldDefs(&log->gpsFields);
+    freeFieldDefs(&log->gpsHomeFields);
+
+    memset(log, 0, sizeof(*log));
+}
+
+int bbLogFieldIndex(const bbLog_t *log, const char *name)
+{
+    for (int i = 0; i < log->intraFields.count; i++) {
+        if (strcmp(log->intraFields.names[i], name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Readers of the encodings in blackbox_encoding.c, past the end of the log they return zero and set eof
+
+static uint8_t readByte(bbLog_t *log)
+{
+    if (log->pos >= log->size) {
+        log->eof = true;
+        return 0;
+    }
+
+    return log->data[log->pos++];
+}
+
+static int32_t signExtend(uint32_t value, int bits)
+{
+    const int shift = 32 - bits;
+
+    return (int32_t)(value << shift) >> shift;
+}
+
+static uint32_t readUnsignedVB(bbLog_t *log, bool *ok)
+{
+    uint32_t value = 0;
+
+    // 32 bits take at most 5 bytes of 7 bits
+    for (int shift = 0; shift < 35; shift += 7) {
+        const uint8_t c = readByte(log);
+        value |= (uint32_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            return value;
+        }
+    }
+
+    *ok = false;
+    return 0;
+}
+
+static int32_t readSignedVB(bbLog_t *log, bool *ok)
+{
+    const uint32_t value = readUnsignedVB(log, ok);
+
+    // zigzag decode
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static int32_t readLittleEndian(bbLog_t *log, int bytes)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint32_t)readByte(log) << (8 * i);
+    }
+
+    return signExtend(value, 8 * bytes);
+}
+
+static void readTag2_3S32(bbLog_t *log, int32_t *values)
+{
+    const uint8_t lead = readByte(log);
+
+    switch (lead >> 6) {
+    case 0: // 2 bits per field
+        values[0] = signExtend((lead >> 4) & 0x03, 2);
+        values[1] = signExtend((lead >> 2) & 0x03, 2);
+        values[2] = signExtend(lead & 0x03, 2);
+        break;
+    case 1: { // 4 bits per field
+        values[0] = signExtend(lead & 0x0F, 4);
+        const uint8_t c = readByte(log);
+        values[1] = signExtend(c >> 4, 4);
+        values[2] = signExtend(c & 0x0F, 4);
+        break;
+    }
+    case 2: // 6 bits per field
+        values[0] = signExtend(lead & 0x3F, 6);
+        values[1] = signExtend(readByte(log) & 0x3F, 6);
+        values[2] = signExtend(readByte(log) & 0x3F, 6);
+        break;
+    case 3: { // 8, 16, 24 or 32 bits per field, the first field's size in the low bits
+        uint8_t selector = lead;
+        for (int x = 0; x < 3; x++, selector >>= 2) {
+            values[x] = readLittleEndian(log, (selector & 0x03) + 1);
+        }
+        break;
+    }
+    }
+}
+
+static void readTag2_3SVariable(bbLog_t *log, int32_t *values)
+{
+    const uint8_t lead = readByte(log);
+
+    switch (lead >> 6) {
+    case 0: // 2 bits per field
+        values[0] = signExtend((lead >> 4) & 0x03, 2);
+        values[1] = signExtend((lead >> 2) & 0x03, 2);
+        values[2] = signExtend(lead & 0x03, 2);
+        break;
+    case 1: { // 5, 5 and 4 bits
+        const uint8_t c = readByte(log);
+        values[0] = signExtend((lead >> 1) & 0x1F, 5);
+        values[1] = signExtend(((lead & 0x01) << 4) | (c >> 4), 5);
+        values[2] = signExtend(c & 0x0F, 4);
+        break;
+    }
+    case 2: { // 8, 7 and 7 bits
+        const uint8_t c1 = readByte(log);
+        const uint8_t c2 = readByte(log);
+        values[0] = signExtend(((lead & 0x3F) << 2) | (c1 >> 6), 8);
+        values[1] = signExtend(((c1 & 0x3F) << 1) | (c2 >> 7), 7);
+        values[2] = signExtend(c2 & 0x7F, 7);
+        break;
+    }
+    case 3: {
+        uint8_t selector = lead;
+        for (int x = 0; x < 3; x++, selector >>= 2) {
+            values[x] = readLittleEndian(log, (selector & 0x03) + 1);
+        }
+        break;
+    }
+    }
+}
+
+static void readTag8_4S16(bbLog_t *log, int32_t *values)
+{
+    uint8_t selector = readByte(log);
+    // the encoder packs fields on nibble boundaries, high nibble first
+    bool midByte = false;
+    uint8_t current = 0;
+
+    for (int x = 0; x < 4; x++, selector >>= 2) {
+        switch (selector & 0x03) {
+        case 0:
+            values[x] = 0;
+            break;
+        case 1: // 4 bits
+            if (!midByte) {
+                current = readByte(log);
+                values[x] = signExtend(current >> 4, 4);
+            } else {
+                values[x] = signExtend(current & 0x0F, 4);
+            }
+            midByte = !midByte;
+            break;
+        case 2: // 8 bits
+            if (!midByte) {
+                values[x] = (int8_t)readByte(log);
+            } else {
+                const uint8_t high = current & 0x0F;
+                current = readByte(log);
+                values[x] = (int8_t)((high << 4) | (current >> 4));
+            }
+            break;
+        case 3: // 16 bits
+            if (!midByte) {
+                const uint8_t high = readByte(log);
+                values[x] = (int16_t)((high << 8) | readByte(log));
+            } else {
+                const uint8_t high = current & 0x0F;
+                const uint8_t middle = readByte(log);
+                current = readByte(log);
+                values[x] = (int16_t)((high << 12) | (middle << 4) | (current >> 4));
+            }
+            break;
+        }
+    }
+}
+
+static void readTag8_8SVB(bbLog_t *log, int32_t *values, int count, bool *ok)
+{
+    if (count == 1) {
+        values[0] = readSignedVB(log, ok);
+        return;
+    }
+
+    uint8_t header = readByte(log);
+    for (int i = 0; i < count; i++, header >>= 1) {
+        values[i] = (header & 0x01) ? readSignedVB(log, ok) : 0;
+    }
+}
+
+// Read the encoded values of one frame, before the predictors are applied
+static bool readFieldValues(bbLog_t *log, const bbFieldDefs_t *defs, int32_t *values)
+{
+    bool ok = true;
+    int32_t group[TAG8_8SVB_MAX_COUNT];
+
+    for (int i = 0; i < defs->count && ok; ) {
+        int groupCount = 1;
+
+        switch (defs->encoding[i]) {
+        case FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB:
+            group[0] = readSignedVB(log, &ok);
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_UNSIGNED_VB:
+            group[0] = (int32_t)readUnsignedVB(log, &ok);
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_NEG_14BIT:
+            group[0] = -signExtend(readUnsignedVB(log, &ok), 14);
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_TAG8_4S16:
+            readTag8_4S16(log, group);
+            groupCount = 4;
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32:
+            readTag2_3S32(log, group);
+            groupCount = 3;
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_TAG2_3SVARIABLE:
+            readTag2_3SVariable(log, group);
+            groupCount = 3;
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB:
+            // the encoder groups up to 8 neighbouring fields
+            while (groupCount < TAG8_8SVB_MAX_COUNT && i + groupCount < defs->count
+                && defs->encoding[i + groupCount] == FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB) {
+                groupCount++;
+            }
+            readTag8_8SVB(log, group, groupCount, &ok);
+            break;
+        case FLIGHT_LOG_FIELD_ENCODING_NULL:
+            group[0] = 0;
+            break;
+        default:
+            return false;
+        }
+
+        for (int j = 0; j < groupCount && i < defs->count; j++) {
+            values[i++] = group[j];
+        }
+    }
+
+    return ok && !log->eof;
+}
+
+static bool readMainFrame(bbLog_t *log, bool intra, int32_t *current)
+{
+    const bbFieldDefs_t *defs = intra ? &log->intraFields : &log->interFields;
+    const int32_t *previous = log->mainHistory[0];
+    const int32_t *previous2 = log->mainHistory[1];
+
+    if (!readFieldValues(log, defs, current)) {
+        return false;
+    }
+
+    const int motor0 = log->motor0Field;
+
+    for (int i = 0; i < defs->count; i++) {
+        switch (defs->predictor[i]) {
+        case FLIGHT_LOG_FIELD_PREDICTOR_0:
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS:
+            current[i] += previous[i];
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_STRAIGHT_LINE:
+            current[i] += 2 * previous[i] - previous2[i];
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_AVERAGE_2:
+            current[i] += (previous[i] + previous2[i]) / 2;
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_MINTHROTTLE:
+            current[i] += log->minthrottle;
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_MOTOR_0:
+            if (motor0 < 0 || motor0 >= i) {
+                return false;
+            }
+            current[i] += current[motor0];
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_INC:
+            current[i] = previous[i] + log->pInterval;
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_1500:
+            current[i] += 1500;
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_VBATREF:
+            current[i] += log->vbatref;
+            break;
+        case FLIGHT_LOG_FIELD_PREDICTOR_MINMOTOR:
+            current[i] += log->motorOutputLow;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool readEvent(bbLog_t *log)
+{
+    bool ok = true;
+
+    switch (readByte(log)) {
+    case FLIGHT_LOG_EVENT_SYNC_BEEP:
+    case FLIGHT_LOG_EVENT_DISARM:
+        readUnsignedVB(log, &ok);
+        break;
+    case FLIGHT_LOG_EVENT_FLIGHTMODE:
+        readUnsignedVB(log, &ok);
+        readUnsignedVB(log, &ok);
+        break;
+    case FLIGHT_LOG_EVENT_INFLIGHT_ADJUSTMENT:
+        if (readByte(log) & FLIGHT_LOG_EVENT_INFLIGHT_ADJUSTMENT_FUNCTION_FLOAT_VALUE_FLAG) {
+            readLittleEndian(log, 4);
+        } else {
+            readSignedVB(log, &ok);
+        }
+        break;
+    case FLIGHT_LOG_EVENT_LOGGING_RESUME:
+        readUnsignedVB(log, &ok);
+        readUnsignedVB(log, &ok);
+        // the next main frame is an intra frame
+        log->mainValid = false;
+        break;
+    case FLIGHT_LOG_EVENT_LOG_END: {
+        const size_t length = strlen(LOG_END_MESSAGE) + 1;
+        if (log->pos + length > log->size || memcmp(log->data + log->pos, LOG_END_MESSAGE, length) != 0) {
+            return false;
+        }
+        log->pos += length;
+        log->ended = true;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    return ok && !log->eof;
+}
+
+static bool isFrameStart(const bbLog_t *log, size_t pos)
+{
+    return pos >= log->size || strchr("IPESGH", log->data[pos]);
+}
+
+bool bbLogNextMainFrame(bbLog_t *log, int32_t *values)
+{
+    int32_t current[BB_MAX_FIELDS];
+    bool resyncing = false;
+
+    while (!log->ended && log->pos < log->size) {
+        const size_t frameStart = log->pos;
+        const uint8_t frameType = readByte(log);
+        bool ok;
+
+        switch (frameType) {
+        case 'I':
+        case 'P':
+            ok = readMainFrame(log, frameType == 'I', current);
+            break;
+        case 'S':
+            ok = readFieldValues(log, &log->slowFields, current);
+            break;
+        case 'G':
+            ok = readFieldValues(log, &log->gpsFields, current);
+            break;
+        case 'H':
+            ok = readFieldValues(log, &log->gpsHomeFields, current);
+            break;
+        case 'E':
+            ok = readEvent(log);
+            break;
+        default:
+            ok = false;
+            break;
+        }
+
+        if (log->eof) {
+            // the log was cut off in the middle of a frame
+            return false;
+        }
+
+        // frames have no checksum, so a frame only counts if the next one starts where it ends
+        ok = ok && (log->ended || isFrameStart(log, log->pos));
+
+        if (ok && (frameType == 'I' || frameType == 'P')) {
+            const bool intra = frameType == 'I';
+            const uint32_t time = log->timeField >= 0 ? (uint32_t)current[log->timeField] : 0;
+
+            if (!intra && !log->mainValid) {
+                // no history to predict from until the next intra frame
+                continue;
+            }
+            if (log->mainValid && (int32_t)(time - log->lastMainTime) < 0) {
+                ok = false;
+            } else {
+                memcpy(log->mainHistory[1], intra ? current : log->mainHistory[0], sizeof(log->mainHistory[1]));
+                memcpy(log->mainHistory[0], current, sizeof(log->mainHistory[0]));
+                log->mainValid = true;
+                log->lastMainTime = time;
+                if (intra) {
+                    log->intraFrames++;
+                } else {
+                    log->interFrames++;
+                }
+
+                memcpy(values, current, log->intraFields.count * sizeof(values[0]));
+                return true;
+            }
+        }
+
+        if (!ok) {
+            // skip a byte at a time to the next frame that decodes, main frames wait for an intra frame
+            if (!resyncing) {
+                log->corruptFrames++;
+                resyncing = true;
+            }
+            log->mainValid = false;
+            log->pos = frameStart + 1;
+        } else {
+            resyncing = false;
+        }
+    }
+
+    return false;
+}
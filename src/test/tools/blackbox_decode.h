@@ -0,0 +1,94 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Decoder for the blackbox log format written by blackbox/blackbox.c.
+//
+// The field names, predictors and encodings are read from the log's own
+// header, using the FLIGHT_LOG_FIELD_* values of blackbox_fielddefs.h, so
+// any firmware's field selection decodes. Corrupt frames are skipped and the
+// main stream picks up again at the next intra frame.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BB_MAX_FIELDS       128
+#define BB_MAX_HEADERS      512
+
+typedef struct bbFieldDefs_s {
+    int count;
+    char *names[BB_MAX_FIELDS];
+    uint8_t isSigned[BB_MAX_FIELDS];
+    uint8_t predictor[BB_MAX_FIELDS];
+    uint8_t encoding[BB_MAX_FIELDS];
+} bbFieldDefs_t;
+
+typedef struct bbLog_s {
+    int headerCount;
+    char *headerNames[BB_MAX_HEADERS];
+    char *headerValues[BB_MAX_HEADERS];
+
+    // main intra (I) frames, inter (P) frames share the names and signedness
+    bbFieldDefs_t intraFields;
+    bbFieldDefs_t interFields;
+    bbFieldDefs_t slowFields;
+    bbFieldDefs_t gpsFields;
+    bbFieldDefs_t gpsHomeFields;
+
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    bool eof;
+    bool ended;
+
+    int timeField;
+    int motor0Field;
+    int32_t mainHistory[2][BB_MAX_FIELDS];     // last and second last main frames
+    bool mainValid;
+    int32_t gpsHome[2];
+    uint32_t lastMainTime;
+
+    // from the header
+    int pInterval;
+    int32_t minthrottle;
+    int32_t motorOutputLow;
+    int32_t vbatref;
+
+    // statistics
+    uint32_t intraFrames;
+    uint32_t interFrames;
+    uint32_t corruptFrames;
+} bbLog_t;
+
+// Count the logs in a file, a flash dump holds one per arming
+int bbLogCount(const uint8_t *data, size_t size);
+// Parse the header of the index'th log, the data must outlive the bbLog_t
+bool bbLogOpen(bbLog_t *log, const uint8_t *data, size_t size, int index);
+void bbLogClose(bbLog_t *log);
+
+const char *bbLogHeader(const bbLog_t *log, const char *name);
+// Index of a main frame field, eg. "gyroADC[0]", or -1
+int bbLogFieldIndex(const bbLog_t *log, const char *name);
+
+// Decode up to the next main frame and copy its fields, returns false at the end of the log
+bool bbLogNextMainFrame(bbLog_t *log, int32_t *values);
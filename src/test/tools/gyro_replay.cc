@@ -0,0 +1,778 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Replays the gyro of a blackbox log through the real gyro filters.
+//
+// The unfiltered gyro of each logged frame is fed through the virtual gyro
+// into sensors/gyro.c at the logged loop rate, with the RPM filter following
+// the logged eRPM and the dynamic lowpass the logged throttle, so that filter
+// settings can be compared on a recorded flight without flying it again.
+// The filter settings are taken from the log header and can be changed with
+// -s, using the CLI names.
+//
+// usage: gyro_replay [-l log] [-s setting=value]... [-o trace.csv] [-p spectrum.csv] [-n fft size] log.bbl
+//
+// It prints the noise removed and the delay added on each axis, and the cost
+// of every filter stage. The trace has the replayed and the logged gyro of
+// every frame and the spectrum a Welch estimate of the noise before and after
+// filtering, in dB of (deg/s)^2/Hz.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <algorithm>
+#include <complex>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "build/debug.h"
+
+    #include "common/axis.h"
+    #include "common/filter.h"
+    #include "common/maths.h"
+
+    #include "drivers/accgyro/accgyro_virtual.h"
+    #include "drivers/dshot.h"
+    #include "drivers/sensor.h"
+
+    #include "fc/parameter_names.h"
+
+    #include "flight/dyn_notch_filter.h"
+    #include "flight/rpm_filter.h"
+
+    #include "io/beeper.h"
+
+    #include "pg/dyn_notch.h"
+    #include "pg/motor.h"
+    #include "pg/pg.h"
+    #include "pg/rpm_filter.h"
+
+    #include "scheduler/scheduler.h"
+
+    #include "sensors/gyro.h"
+    #include "sensors/gyro_init.h"
+    #include "sensors/sensors.h"
+
+    #include "blackbox_decode.h"
+
+    extern gyroDev_t * const gyroDevPtr;
+}
+
+#include "../bench/benchmark.h"
+
+#define DEFAULT_FFT_SIZE            1024
+#define NOISE_BAND_MIN_HZ           100     // noise is what the filters remove above this
+#define MAX_DELAY_MS                20
+
+// as in mixer.c
+#define DYN_LPF_THROTTLE_STEPS              100
+#define DYN_LPF_THROTTLE_UPDATE_DELAY_US    5000
+
+#define ERPM_PER_LSB                100.0f
+#define SECONDS_PER_MINUTE          60.0f
+
+typedef struct replayFrame_s {
+    uint32_t timeUs;
+    float gyroRaw[XYZ_AXIS_COUNT];          // deg/s
+    float gyroLogged[XYZ_AXIS_COUNT];       // filtered by the firmware, deg/s
+    float throttle;                         // 0..1, as the mixer gives it to the dynamic lowpass
+    uint16_t erpm[MAX_SUPPORTED_MOTORS];    // eRPM / 100
+} replayFrame_t;
+
+typedef struct replayLog_s {
+    std::vector<replayFrame_t> frames;
+    int sampleRateHz;
+    int motorCount;
+    bool hasRpm;
+    bool hasLoggedFilteredGyro;
+} replayLog_t;
+
+typedef struct replaySetting_s {
+    const char *name;           // CLI name
+    const char *header;         // blackbox header holding it
+    int headerIndex;            // position in a comma separated header
+    size_t size;
+    void *(*field)(void);
+} replaySetting_t;
+
+#define SETTING(name, header, headerIndex, config, member) \
+    { name, header, headerIndex, sizeof(((config ## _t *)0)->member), [] () -> void * { return &config ## Mutable()->member; } }
+
+static const replaySetting_t replaySettings[] = {
+    SETTING(PARAM_NAME_GYRO_LPF1_TYPE,          PARAM_NAME_GYRO_LPF1_TYPE,          0, gyroConfig, gyro_lpf1_type),
+    SETTING(PARAM_NAME_GYRO_LPF1_STATIC_HZ,     PARAM_NAME_GYRO_LPF1_STATIC_HZ,     0, gyroConfig, gyro_lpf1_static_hz),
+    SETTING("gyro_lpf1_dyn_min_hz",             "gyro_lpf1_dyn_hz",                 0, gyroConfig, gyro_lpf1_dyn_min_hz),
+    SETTING("gyro_lpf1_dyn_max_hz",             "gyro_lpf1_dyn_hz",                 1, gyroConfig, gyro_lpf1_dyn_max_hz),
+    SETTING("gyro_lpf1_dyn_expo",               "gyro_lpf1_dyn_expo",               0, gyroConfig, gyro_lpf1_dyn_expo),
+    SETTING(PARAM_NAME_GYRO_LPF2_TYPE,          PARAM_NAME_GYRO_LPF2_TYPE,          0, gyroConfig, gyro_lpf2_type),
+    SETTING(PARAM_NAME_GYRO_LPF2_STATIC_HZ,     PARAM_NAME_GYRO_LPF2_STATIC_HZ,     0, gyroConfig, gyro_lpf2_static_hz),
+    SETTING("gyro_notch1_hz",                   "gyro_notch_hz",                    0, gyroConfig, gyro_soft_notch_hz_1),
+    SETTING("gyro_notch2_hz",                   "gyro_notch_hz",                    1, gyroConfig, gyro_soft_notch_hz_2),
+    SETTING("gyro_notch1_cutoff",               "gyro_notch_cutoff",                0, gyroConfig, gyro_soft_notch_cutoff_1),
+    SETTING("gyro_notch2_cutoff",               "gyro_notch_cutoff",                1, gyroConfig, gyro_soft_notch_cutoff_2),
+    SETTING(PARAM_NAME_DYN_NOTCH_MAX_HZ,        PARAM_NAME_DYN_NOTCH_MAX_HZ,        0, dynNotchConfig, dyn_notch_max_hz),
+    SETTING(PARAM_NAME_DYN_NOTCH_COUNT,         PARAM_NAME_DYN_NOTCH_COUNT,         0, dynNotchConfig, dyn_notch_count),
+    SETTING(PARAM_NAME_DYN_NOTCH_Q,             PARAM_NAME_DYN_NOTCH_Q,             0, dynNotchConfig, dyn_notch_q),
+    SETTING(PARAM_NAME_DYN_NOTCH_MIN_HZ,        PARAM_NAME_DYN_NOTCH_MIN_HZ,        0, dynNotchConfig, dyn_notch_min_hz),
+    SETTING(PARAM_NAME_DSHOT_BIDIR,             PARAM_NAME_DSHOT_BIDIR,             0, motorConfig, dev.useDshotTelemetry),
+    SETTING(PARAM_NAME_MOTOR_POLES,             PARAM_NAME_MOTOR_POLES,             0, motorConfig, motorPoleCount),
+    SETTING(PARAM_NAME_RPM_FILTER_HARMONICS,    PARAM_NAME_RPM_FILTER_HARMONICS,    0, rpmFilterConfig, rpm_filter_harmonics),
+    SETTING(PARAM_NAME_RPM_FILTER_WEIGHTS,      PARAM_NAME_RPM_FILTER_WEIGHTS,      0, rpmFilterConfig, rpm_filter_weights[0]),
+    SETTING(PARAM_NAME_RPM_FILTER_WEIGHTS,      PARAM_NAME_RPM_FILTER_WEIGHTS,      1, rpmFilterConfig, rpm_filter_weights[1]),
+    SETTING(PARAM_NAME_RPM_FILTER_WEIGHTS,      PARAM_NAME_RPM_FILTER_WEIGHTS,      2, rpmFilterConfig, rpm_filter_weights[2]),
+    SETTING(PARAM_NAME_RPM_FILTER_Q,            PARAM_NAME_RPM_FILTER_Q,            0, rpmFilterConfig, rpm_filter_q),
+    SETTING(PARAM_NAME_RPM_FILTER_MIN_HZ,       PARAM_NAME_RPM_FILTER_MIN_HZ,       0, rpmFilterConfig, rpm_filter_min_hz),
+    SETTING(PARAM_NAME_RPM_FILTER_FADE_RANGE_HZ, PARAM_NAME_RPM_FILTER_FADE_RANGE_HZ, 0, rpmFilterConfig, rpm_filter_fade_range_hz),
+    SETTING(PARAM_NAME_RPM_FILTER_LPF_HZ,       PARAM_NAME_RPM_FILTER_LPF_HZ,       0, rpmFilterConfig, rpm_filter_lpf_hz),
+};
+
+static int replayMotorCount;
+static float replayThrottle;
+static float replayMotorHz[MAX_SUPPORTED_MOTORS];
+static pt1Filter_t motorHzLpf[MAX_SUPPORTED_MOTORS];
+static timeUs_t lastDynLpfUpdateUs;
+static int dynLpfPreviousQuantizedThrottle;
+
+static void settingSet(const replaySetting_t *setting, long value)
+{
+    void *field = setting->field();
+    if (setting->size == sizeof(uint8_t)) {
+        *(uint8_t *)field = constrain(value, 0, UINT8_MAX);
+    } else {
+        *(uint16_t *)field = constrain(value, 0, UINT16_MAX);
+    }
+}
+
+// The index'th value of a comma separated list, or NULL
+static const char *listValue(const char *list, int index)
+{
+    for (int i = 0; list && i < index; i++) {
+        list = strchr(list, ',');
+        list = list ? list + 1 : NULL;
+    }
+    return list;
+}
+
+// The settings the log was recorded with
+static void applyLogSettings(const bbLog_t *log)
+{
+    for (const replaySetting_t &setting : replaySettings) {
+        const char *value = listValue(bbLogHeader(log, setting.header), setting.headerIndex);
+        if (value) {
+            settingSet(&setting, atol(value));
+        }
+    }
+
+    // there is no header for a filter the firmware was built without, so it was off
+    if (!bbLogHeader(log, PARAM_NAME_DYN_NOTCH_COUNT)) {
+        dynNotchConfigMutable()->dyn_notch_count = 0;
+    }
+    if (!bbLogHeader(log, PARAM_NAME_RPM_FILTER_HARMONICS)) {
+        rpmFilterConfigMutable()->rpm_filter_harmonics = 0;
+    }
+}
+
+static bool applySettingOverrides(const std::vector<const char *> &overrides)
+{
+    for (const char *override : overrides) {
+        char name[64];
+        const char *equals = strchr(override, '=');
+        if (!equals || (size_t)(equals - override) >= sizeof(name)) {
+            fprintf(stderr, "-s %s: expected setting=value\n", override);
+            return false;
+        }
+        memcpy(name, override, equals - override);
+        name[equals - override] = '\0';
+
+        // settings held in a list, like rpm_filter_weights, take the whole list
+        bool found = false;
+        for (const replaySetting_t &setting : replaySettings) {
+            if (strcmp(setting.name, name) == 0) {
+                const char *value = strcmp(setting.name, setting.header) == 0 ? listValue(equals + 1, setting.headerIndex) : equals + 1;
+                if (value) {
+                    settingSet(&setting, atol(value));
+                }
+                found = true;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "-s %s: not a gyro filter setting, one of:", override);
+            const char *previous = "";
+            for (const replaySetting_t &known : replaySettings) {
+                if (strcmp(known.name, previous) != 0) {
+                    fprintf(stderr, " %s", known.name);
+                }
+                previous = known.name;
+            }
+            fprintf(stderr, "\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool loadFile(const char *filename, std::vector<uint8_t> *data)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        perror(filename);
+        return false;
+    }
+
+    uint8_t buffer[65536];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data->insert(data->end(), buffer, buffer + length);
+    }
+
+    fclose(file);
+    return true;
+}
+
+// Decode the frames and set up the configuration from the header, the log is left open for its header
+static bool loadLog(const char *filename, const std::vector<uint8_t> &data, int logNumber, bbLog_t *log, replayLog_t *replay)
+{
+    const int logCount = bbLogCount(data.data(), data.size());
+    if (logNumber < 1 || logNumber > logCount || !bbLogOpen(log, data.data(), data.size(), logNumber - 1)) {
+        fprintf(stderr, "%s: no log %d, the file has %d\n", filename, logNumber, logCount);
+        return false;
+    }
+    if (logCount > 1) {
+        printf("log %d of %d\n", logNumber, logCount);
+    }
+
+    char name[32];
+    int gyroField[XYZ_AXIS_COUNT];
+    int loggedField[XYZ_AXIS_COUNT];
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        snprintf(name, sizeof(name), "gyroUnfilt[%d]", axis);
+        gyroField[axis] = bbLogFieldIndex(log, name);
+        snprintf(name, sizeof(name), "gyroADC[%d]", axis);
+        loggedField[axis] = bbLogFieldIndex(log, name);
+    }
+    replay->hasLoggedFilteredGyro = loggedField[X] >= 0;
+    if (gyroField[X] < 0) {
+        if (loggedField[X] < 0) {
+            fprintf(stderr, "%s: the log has no gyro\n", filename);
+            return false;
+        }
+        fprintf(stderr, "warning: gyroUnfilt is not logged (blackbox_disable_gyrounfilt), replaying the filtered gyro\n");
+        memcpy(gyroField, loggedField, sizeof(gyroField));
+        replay->hasLoggedFilteredGyro = false;
+    }
+
+    int erpmField[MAX_SUPPORTED_MOTORS];
+    replay->motorCount = 0;
+    replay->hasRpm = false;
+    for (int motor = 0; motor < MAX_SUPPORTED_MOTORS; motor++) {
+        snprintf(name, sizeof(name), "eRPM[%d]", motor);
+        erpmField[motor] = bbLogFieldIndex(log, name);
+        snprintf(name, sizeof(name), "motor[%d]", motor);
+        if (erpmField[motor] >= 0 || bbLogFieldIndex(log, name) >= 0) {
+            replay->motorCount = motor + 1;
+        }
+        replay->hasRpm = replay->hasRpm || erpmField[motor] >= 0;
+    }
+    // the throttle the mixer used, x1000
+    const int throttleField = bbLogFieldIndex(log, "setpoint[3]");
+
+    const char *highResolution = bbLogHeader(log, "blackbox_high_resolution");
+    const float gyroScale = (highResolution && atoi(highResolution)) ? 0.1f : 1.0f;
+
+    int32_t values[BB_MAX_FIELDS];
+    while (bbLogNextMainFrame(log, values)) {
+        replayFrame_t frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.timeUs = values[log->timeField];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            frame.gyroRaw[axis] = values[gyroField[axis]] * gyroScale;
+            frame.gyroLogged[axis] = loggedField[axis] >= 0 ? values[loggedField[axis]] * gyroScale : 0.0f;
+        }
+        frame.throttle = throttleField >= 0 ? values[throttleField] / 1000.0f : 0.0f;
+        for (int motor = 0; motor < replay->motorCount; motor++) {
+            frame.erpm[motor] = erpmField[motor] >= 0 ? values[erpmField[motor]] : 0;
+        }
+        replay->frames.push_back(frame);
+    }
+
+    printf("%s: %zu frames, %u intra, %u inter, %u corrupt\n", filename, replay->frames.size(),
+        log->intraFrames, log->interFrames, log->corruptFrames);
+    if (replay->frames.size() < 2) {
+        fprintf(stderr, "%s: not enough frames to replay\n", filename);
+        return false;
+    }
+
+    // the filters are set up for the loop time in the header, as they were in flight, the median frame interval is
+    // only needed without it and skips over gaps from pauses and corrupt frames
+    std::vector<uint32_t> intervals;
+    for (size_t i = 1; i < replay->frames.size(); i++) {
+        intervals.push_back(replay->frames[i].timeUs - replay->frames[i - 1].timeUs);
+    }
+    std::nth_element(intervals.begin(), intervals.begin() + intervals.size() / 2, intervals.end());
+    const uint32_t loggedIntervalUs = MAX(intervals[intervals.size() / 2], 1u);
+
+    const char *looptime = bbLogHeader(log, "looptime");
+    const char *pidDenom = bbLogHeader(log, PARAM_NAME_PID_PROCESS_DENOM);
+    const int intervalUs = looptime ? atoi(looptime) * MAX(pidDenom ? atoi(pidDenom) : 1, 1) * log->pInterval : 0;
+    if (intervalUs > 0) {
+        replay->sampleRateHz = lrintf(1e6f / intervalUs);
+        if (abs((int)loggedIntervalUs - intervalUs) > intervalUs / 20) {
+            fprintf(stderr, "warning: the frames are %uus apart but the filters were set up for %dus, replaying at %dHz\n",
+                loggedIntervalUs, intervalUs, replay->sampleRateHz);
+        }
+    } else {
+        replay->sampleRateHz = lrintf(1e6f / loggedIntervalUs);
+    }
+    if (log->pInterval > 1) {
+        fprintf(stderr, "warning: only every %dth loop is logged, the filters run at %dHz instead of the flight's rate, log with blackbox_sample_rate = 1/1\n",
+            log->pInterval, replay->sampleRateHz);
+    }
+
+    return true;
+}
+
+static void replayConfigure(const replayLog_t &replay)
+{
+    replayMotorCount = replay.motorCount;
+    useDshotTelemetry = replay.hasRpm && motorConfig()->dev.useDshotTelemetry;
+
+    gyroInit();
+    gyro.sampleRateHz = replay.sampleRateHz;
+    gyroSetTargetLooptime(1);
+    gyroInitFilters();
+    // normally called from pidInit()
+    rpmFilterInit(rpmFilterConfig(), gyro.targetLooptime);
+
+    // the motor frequencies are smoothed as in dshot.c
+    for (int motor = 0; motor < replayMotorCount; motor++) {
+        pt1FilterInit(&motorHzLpf[motor], pt1FilterGain(rpmFilterConfig()->rpm_filter_lpf_hz, gyro.targetLooptime * 1e-6f));
+        replayMotorHz[motor] = 0.0f;
+    }
+    lastDynLpfUpdateUs = 0;
+    dynLpfPreviousQuantizedThrottle = -1;
+}
+
+// What the DShot telemetry and the mixer update between two gyro samples
+static void replayFrameInputs(const replayFrame_t &frame)
+{
+    replayThrottle = frame.throttle;
+
+    const float erpmToHz = ERPM_PER_LSB / SECONDS_PER_MINUTE / (motorConfig()->motorPoleCount / 2.0f);
+    for (int motor = 0; motor < replayMotorCount; motor++) {
+        replayMotorHz[motor] = pt1FilterApply(&motorHzLpf[motor], erpmToHz * frame.erpm[motor]);
+    }
+
+    // as updateDynLpfCutoffs() in mixer.c
+    if (cmpTimeUs(frame.timeUs, lastDynLpfUpdateUs) >= DYN_LPF_THROTTLE_UPDATE_DELAY_US) {
+        const int quantizedThrottle = lrintf(frame.throttle * DYN_LPF_THROTTLE_STEPS);
+        if (quantizedThrottle != dynLpfPreviousQuantizedThrottle) {
+            dynLpfGyroUpdate((float)quantizedThrottle / DYN_LPF_THROTTLE_STEPS);
+            dynLpfPreviousQuantizedThrottle = quantizedThrottle;
+            lastDynLpfUpdateUs = frame.timeUs;
+        }
+    }
+}
+
+typedef std::vector<float> trace_t;
+
+typedef struct replayResult_s {
+    trace_t raw[XYZ_AXIS_COUNT];
+    trace_t filtered[XYZ_AXIS_COUNT];
+} replayResult_t;
+
+// The gyro task's work for every logged frame, then the RPM and dynamic notch filters on their own as in the pipeline benchmark
+static void runReplay(const replayLog_t &replay, replayResult_t *result)
+{
+    const size_t count = replay.frames.size();
+
+    benchStage_t stageGyroUpdate("gyroUpdate");
+    benchStage_t stageRpmFilterUpdate("rpmFilterUpdate");
+    benchStage_t stageGyroFiltering("gyroFiltering");
+    benchStage_t stageRpmFilterApply("rpmFilterApply");
+    benchStage_t stageDynNotchFilter("dynNotchPush/Filter");
+    benchStage_t stageDynNotchUpdate("dynNotchUpdate");
+
+    stageGyroUpdate.reserve(count);
+    stageRpmFilterUpdate.reserve(count);
+    stageGyroFiltering.reserve(count);
+    stageRpmFilterApply.reserve(count);
+    stageDynNotchFilter.reserve(count);
+    stageDynNotchUpdate.reserve(count);
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        result->raw[axis].reserve(count);
+        result->filtered[axis].reserve(count);
+    }
+
+    replayConfigure(replay);
+    for (const replayFrame_t &frame : replay.frames) {
+        replayFrameInputs(frame);
+
+        int16_t counts[XYZ_AXIS_COUNT];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            counts[axis] = constrain(lrintf(frame.gyroRaw[axis] / gyroDevPtr->scale), INT16_MIN, INT16_MAX);
+        }
+        virtualGyroSet(gyroDevPtr, counts[X], counts[Y], counts[Z]);
+
+        stageGyroUpdate.time([] { gyroUpdate(); });
+        stageRpmFilterUpdate.time([] { rpmFilterUpdate(); });
+        stageGyroFiltering.time([&] { gyroFiltering(frame.timeUs); });
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            result->raw[axis].push_back(gyro.gyroADC[axis]);
+            result->filtered[axis].push_back(gyro.gyroADCf[axis]);
+        }
+    }
+
+    replayConfigure(replay);
+    float sink = 0.0f;
+    for (const replayFrame_t &frame : replay.frames) {
+        replayFrameInputs(frame);
+
+        float gyroADCf[XYZ_AXIS_COUNT];
+        memcpy(gyroADCf, frame.gyroRaw, sizeof(gyroADCf));
+
+        rpmFilterUpdate();
+        stageRpmFilterApply.time([&] { rpmFilterApply(gyroADCf); });
+        stageDynNotchFilter.time([&] {
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                dynNotchPush(axis, gyroADCf[axis]);
+                gyroADCf[axis] = dynNotchFilter(axis, gyroADCf[axis]);
+            }
+        });
+        stageDynNotchUpdate.time([] { dynNotchUpdate(); });
+
+        sink += gyroADCf[X] + gyroADCf[Y] + gyroADCf[Z];
+    }
+
+    char title[160];
+    snprintf(title, sizeof(title), "gyro %dHz, %d motors, %d RPM harmonics%s, %d dynamic notches",
+        gyro.sampleRateHz, replayMotorCount, rpmFilterConfig()->rpm_filter_harmonics,
+        useDshotTelemetry ? "" : " (no eRPM)", dynNotchConfig()->dyn_notch_count);
+    benchPrintHeader(title);
+    benchPrintStage(stageGyroUpdate);
+    benchPrintStage(stageRpmFilterUpdate);
+    benchPrintStage(stageGyroFiltering);
+    benchPrintStage(stageRpmFilterApply);
+    benchPrintStage(stageDynNotchFilter);
+    benchPrintStage(stageDynNotchUpdate);
+
+    // keep the isolated filter outputs alive
+    if (sink == 12345.0f) {
+        printf("\n");
+    }
+}
+
+static void fft(std::vector<std::complex<double>> &data)
+{
+    const size_t n = data.size();
+
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+
+    for (size_t length = 2; length <= n; length <<= 1) {
+        const std::complex<double> step = std::polar(1.0, -2.0 * M_PI / length);
+        for (size_t start = 0; start < n; start += length) {
+            std::complex<double> twiddle = 1.0;
+            for (size_t k = 0; k < length / 2; k++) {
+                const std::complex<double> even = data[start + k];
+                const std::complex<double> odd = data[start + k + length / 2] * twiddle;
+                data[start + k] = even + odd;
+                data[start + k + length / 2] = even - odd;
+                twiddle *= step;
+            }
+        }
+    }
+}
+
+// One sided power spectral density in (deg/s)^2/Hz, averaged over Hann windows overlapping by half
+static std::vector<double> welch(const trace_t &trace, size_t fftSize, int sampleRateHz)
+{
+    std::vector<double> window(fftSize);
+    double windowPower = 0.0;
+    for (size_t i = 0; i < fftSize; i++) {
+        window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / fftSize);
+        windowPower += window[i] * window[i];
+    }
+
+    std::vector<double> psd(fftSize / 2 + 1, 0.0);
+    std::vector<std::complex<double>> segment(fftSize);
+    int segments = 0;
+    for (size_t start = 0; start + fftSize <= trace.size(); start += fftSize / 2) {
+        double mean = 0.0;
+        for (size_t i = 0; i < fftSize; i++) {
+            mean += trace[start + i];
+        }
+        mean /= fftSize;
+        for (size_t i = 0; i < fftSize; i++) {
+            segment[i] = (trace[start + i] - mean) * window[i];
+        }
+        fft(segment);
+        for (size_t bin = 0; bin < psd.size(); bin++) {
+            psd[bin] += std::norm(segment[bin]);
+        }
+        segments++;
+    }
+
+    for (size_t bin = 0; bin < psd.size(); bin++) {
+        const double oneSided = (bin == 0 || bin == fftSize / 2) ? 1.0 : 2.0;
+        psd[bin] *= oneSided / (segments * windowPower * sampleRateHz);
+    }
+    return psd;
+}
+
+static double bandRms(const std::vector<double> &psd, size_t fftSize, int sampleRateHz, float minHz)
+{
+    const double binHz = (double)sampleRateHz / fftSize;
+    double power = 0.0;
+    for (size_t bin = lrint(minHz / binHz); bin < psd.size(); bin++) {
+        power += psd[bin] * binHz;
+    }
+    return sqrt(power);
+}
+
+// Lag of the filtered trace behind the raw one in samples, from the peak of their cross correlation
+static float delaySamples(const trace_t &raw, const trace_t &filtered, int maxLag)
+{
+    const size_t count = raw.size();
+    if (count <= (size_t)maxLag + 2) {
+        return 0.0f;
+    }
+
+    std::vector<double> correlation(maxLag + 1);
+    for (int lag = 0; lag <= maxLag; lag++) {
+        double sum = 0.0;
+        for (size_t i = 0; i + lag < count; i++) {
+            sum += (double)raw[i] * filtered[i + lag];
+        }
+        correlation[lag] = sum / (count - lag);
+    }
+
+    const int peak = std::max_element(correlation.begin(), correlation.end()) - correlation.begin();
+    if (peak == 0 || peak == maxLag) {
+        return peak;
+    }
+    // parabola through the peak and its neighbours
+    const double before = correlation[peak - 1];
+    const double after = correlation[peak + 1];
+    const double curvature = before - 2 * correlation[peak] + after;
+    return peak + (curvature < 0 ? 0.5 * (before - after) / curvature : 0.0);
+}
+
+static void printSummary(const replayLog_t &replay, const replayResult_t &result, size_t fftSize)
+{
+    static const char *const axisNames[XYZ_AXIS_COUNT] = { "roll", "pitch", "yaw" };
+    const int maxLag = replay.sampleRateHz * MAX_DELAY_MS / 1000;
+
+    printf("\n%-8s %14s %14s %10s %10s %14s\n", "axis", "noise deg/s", "filtered deg/s", "change dB", "delay ms", "vs log deg/s");
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        const double rawNoise = bandRms(welch(result.raw[axis], fftSize, replay.sampleRateHz), fftSize, replay.sampleRateHz, NOISE_BAND_MIN_HZ);
+        const double filteredNoise = bandRms(welch(result.filtered[axis], fftSize, replay.sampleRateHz), fftSize, replay.sampleRateHz, NOISE_BAND_MIN_HZ);
+        const float delayMs = delaySamples(result.raw[axis], result.filtered[axis], maxLag) * 1000.0f / replay.sampleRateHz;
+
+        char versusLog[16] = "-";
+        if (replay.hasLoggedFilteredGyro) {
+            // how far the replay is from what the firmware logged, small when the settings are the logged ones
+            double sum = 0.0;
+            for (size_t i = 0; i < replay.frames.size(); i++) {
+                const double error = result.filtered[axis][i] - replay.frames[i].gyroLogged[axis];
+                sum += error * error;
+            }
+            snprintf(versusLog, sizeof(versusLog), "%.2f", sqrt(sum / replay.frames.size()));
+        }
+
+        printf("%-8s %14.2f %14.2f %10.1f %10.2f %14s\n", axisNames[axis], rawNoise, filteredNoise,
+            20.0 * log10((filteredNoise + 1e-9) / (rawNoise + 1e-9)), delayMs, versusLog);
+    }
+    printf("noise is the rms above %dHz\n", NOISE_BAND_MIN_HZ);
+}
+
+static bool writeTrace(const char *filename, const replayLog_t &replay, const replayResult_t &result)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror(filename);
+        return false;
+    }
+
+    fprintf(file, "time_us,raw_roll,raw_pitch,raw_yaw,filtered_roll,filtered_pitch,filtered_yaw,logged_roll,logged_pitch,logged_yaw\n");
+    for (size_t i = 0; i < replay.frames.size(); i++) {
+        const replayFrame_t &frame = replay.frames[i];
+        fprintf(file, "%u,%.2f,%.2f,%.2f,%.3f,%.3f,%.3f,%.1f,%.1f,%.1f\n", frame.timeUs,
+            result.raw[X][i], result.raw[Y][i], result.raw[Z][i],
+            result.filtered[X][i], result.filtered[Y][i], result.filtered[Z][i],
+            frame.gyroLogged[X], frame.gyroLogged[Y], frame.gyroLogged[Z]);
+    }
+
+    fclose(file);
+    return true;
+}
+
+static bool writeSpectrum(const char *filename, const replayLog_t &replay, const replayResult_t &result, size_t fftSize)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror(filename);
+        return false;
+    }
+
+    std::vector<double> spectra[2 * XYZ_AXIS_COUNT];
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        spectra[axis] = welch(result.raw[axis], fftSize, replay.sampleRateHz);
+        spectra[XYZ_AXIS_COUNT + axis] = welch(result.filtered[axis], fftSize, replay.sampleRateHz);
+    }
+
+    fprintf(file, "frequency_hz,raw_roll,raw_pitch,raw_yaw,filtered_roll,filtered_pitch,filtered_yaw\n");
+    for (size_t bin = 0; bin <= fftSize / 2; bin++) {
+        fprintf(file, "%.1f", (double)bin * replay.sampleRateHz / fftSize);
+        for (const std::vector<double> &spectrum : spectra) {
+            fprintf(file, ",%.1f", 10.0 * log10(spectrum[bin] + 1e-12));
+        }
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int logNumber = 1;
+    std::vector<const char *> overrides;
+    const char *traceFilename = NULL;
+    const char *spectrumFilename = NULL;
+    int fftSize = DEFAULT_FFT_SIZE;
+
+    int opt;
+    bool valid = true;
+    while (valid && (opt = getopt(argc, argv, "l:s:o:p:n:")) != -1) {
+        switch (opt) {
+        case 'l':
+            valid = benchParseCount(optarg, &logNumber);
+            break;
+        case 's':
+            overrides.push_back(optarg);
+            break;
+        case 'o':
+            traceFilename = optarg;
+            break;
+        case 'p':
+            spectrumFilename = optarg;
+            break;
+        case 'n':
+            valid = benchParseCount(optarg, &fftSize);
+            break;
+        default:
+            valid = false;
+            break;
+        }
+    }
+    if (!valid || optind != argc - 1 || fftSize < 16 || (fftSize & (fftSize - 1))) {
+        fprintf(stderr, "usage: %s [-l log] [-s setting=value]... [-o trace.csv] [-p spectrum.csv] [-n fft size] log.bbl\n", argv[0]);
+        fprintf(stderr, "the fft size is a power of two\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> data;
+    static bbLog_t log;
+    replayLog_t replay;
+    if (!loadFile(argv[optind], &data) || !loadLog(argv[optind], data, logNumber, &log, &replay)) {
+        return 1;
+    }
+
+    pgResetAll();
+    applyLogSettings(&log);
+    bbLogClose(&log);
+    if (!applySettingOverrides(overrides)) {
+        return 1;
+    }
+
+    while ((size_t)fftSize > replay.frames.size()) {
+        fftSize /= 2;
+    }
+
+    printf("clock overhead %lluns (subtracted)\n", (unsigned long long)benchClockOverheadNs());
+
+    replayResult_t result;
+    runReplay(replay, &result);
+    printSummary(replay, result, fftSize);
+
+    if (traceFilename && !writeTrace(traceFilename, replay, result)) {
+        return 1;
+    }
+    if (spectrumFilename && !writeSpectrum(spectrumFilename, replay, result, fftSize)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+// STUBS
+
+extern "C" {
+
+uint8_t debugMode;
+int16_t debug[DEBUG16_VALUE_COUNT];
+
+uint8_t detectedSensors[SENSOR_INDEX_COUNT];
+bool useDshotTelemetry;
+
+uint8_t getMotorCount(void) { return replayMotorCount; }
+float getMotorFrequencyHz(uint8_t motorIndex) { return replayMotorHz[motorIndex]; }
+float getMinMotorFrequencyHz(void)
+{
+    float minHz = replayMotorCount ? replayMotorHz[0] : 0.0f;
+    for (int motor = 1; motor < replayMotorCount; motor++) {
+        minHz = MIN(minHz, replayMotorHz[motor]);
+    }
+    return minHz;
+}
+uint8_t calculateThrottlePercentAbs(void) { return lrintf(replayThrottle * 100); }
+// as in pid.c
+float dynLpfCutoffFreq(float throttle, uint16_t dynLpfMin, uint16_t dynLpfMax, uint8_t expo)
+{
+    const float expof = expo / 10.0f;
+    const float curve = throttle * (1 - throttle) * expof + throttle;
+    return (dynLpfMax - dynLpfMin) * curve + dynLpfMin;
+}
+void beeper(beeperMode_e) { }
+void beeperConfirmationBeeps(uint8_t) { }
+void writeEEPROM(void) { }
+void schedulerResetTaskStatistics(taskId_e) { }
+uint32_t micros(void) { return 0; }
+void delay(uint32_t) { }
+timeDelta_t getGyroUpdateRate(void) { return gyro.targetLooptime; }
+
+}
@@ -0,0 +1,213 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "drivers/sdcard.h"
+
+    #include "io/asyncfatfs/asyncfatfs.h"
+
+    // Exposed by AFATFS_DEBUG
+    afatfsOperationStatus_e afatfs_cacheSector(uint32_t physicalSectorIndex, uint8_t **buffer, uint8_t sectorFlags, uint32_t eraseCount);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define AFATFS_CACHE_WRITE 2
+
+typedef struct blockRun_s {
+    uint32_t start;
+    uint32_t count;
+} blockRun_t;
+
+static std::vector<uint32_t> writtenBlocks;
+static std::vector<blockRun_t> blockRuns;
+static sdcardOperationStatus_e writeResult;
+static sdcard_operationCompleteCallback_c writeCallback;
+static uint8_t *writeBuffer;
+static uint32_t multiWriteNextBlock;
+static uint32_t multiWriteBlocksRemain;
+
+static void dirtySector(uint32_t sectorIndex, uint32_t eraseCount = 0)
+{
+    uint8_t *buffer;
+    ASSERT_EQ(AFATFS_OPERATION_SUCCESS, afatfs_cacheSector(sectorIndex, &buffer, AFATFS_CACHE_WRITE, eraseCount));
+}
+
+// The card finishes sending the last sector
+static void completeWrite(void)
+{
+    writeCallback(SDCARD_BLOCK_OPERATION_WRITE, writtenBlocks.back(), writeBuffer, 0);
+}
+
+class AsyncFatfsFlushTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        afatfs_destroy(true);
+        writtenBlocks.clear();
+        blockRuns.clear();
+        writeResult = SDCARD_OPERATION_SUCCESS;
+        writeCallback = NULL;
+        multiWriteBlocksRemain = 0;
+    }
+};
+
+TEST_F(AsyncFatfsFlushTest, OldestSectorFirst)
+{
+    dirtySector(300);
+    dirtySector(200);
+    dirtySector(100);
+
+    EXPECT_TRUE(afatfs_flush());
+
+    EXPECT_EQ(std::vector<uint32_t>({ 300, 200, 100 }), writtenBlocks);
+    EXPECT_TRUE(blockRuns.empty());
+}
+
+TEST_F(AsyncFatfsFlushTest, MultiBlockWriteContinues)
+{
+    // a contiguous file pre-erases its sectors
+    dirtySector(1000, 8);
+    EXPECT_TRUE(afatfs_flush());
+    ASSERT_EQ(1u, blockRuns.size());
+    EXPECT_EQ(1000u, blockRuns[0].start);
+    EXPECT_EQ(8u, blockRuns[0].count);
+
+    // a FAT sector waiting doesn't end the multi-block write
+    dirtySector(50);
+    dirtySector(1001);
+    dirtySector(1002);
+    EXPECT_TRUE(afatfs_flush());
+
+    EXPECT_EQ(std::vector<uint32_t>({ 1000, 1001, 1002, 50 }), writtenBlocks);
+}
+
+TEST_F(AsyncFatfsFlushTest, OlderSectorIsNotHeldBack)
+{
+    dirtySector(1000, 64);
+    EXPECT_TRUE(afatfs_flush());
+
+    // a directory sector waits while the log streams in, the card taking a sector at a time
+    writeResult = SDCARD_OPERATION_IN_PROGRESS;
+    dirtySector(50);
+    for (uint32_t sector = 1001; sector <= 1030; sector++) {
+        dirtySector(sector);
+        EXPECT_FALSE(afatfs_flush());
+        completeWrite();
+    }
+
+    ASSERT_EQ(31u, writtenBlocks.size());
+    for (int i = 0; i <= 16; i++) {
+        EXPECT_EQ(1000u + i, writtenBlocks[i]);
+    }
+    EXPECT_EQ(50u, writtenBlocks[17]);
+    EXPECT_EQ(1017u, writtenBlocks[18]);
+    EXPECT_EQ(1029u, writtenBlocks[30]);
+}
+
+TEST_F(AsyncFatfsFlushTest, FlushWaitsForCard)
+{
+    dirtySector(1000, 8);
+    dirtySector(1001);
+
+    writeResult = SDCARD_OPERATION_IN_PROGRESS;
+    EXPECT_FALSE(afatfs_flush());
+    EXPECT_EQ(std::vector<uint32_t>({ 1000 }), writtenBlocks);
+    EXPECT_FALSE(afatfs_sectorCacheInSync());
+
+    completeWrite();
+    EXPECT_FALSE(afatfs_flush());
+    completeWrite();
+    EXPECT_TRUE(afatfs_flush());
+    EXPECT_TRUE(afatfs_sectorCacheInSync());
+    EXPECT_EQ(std::vector<uint32_t>({ 1000, 1001 }), writtenBlocks);
+}
+
+TEST_F(AsyncFatfsFlushTest, ConsecutiveDirtySectorsAreOneMultiBlockWrite)
+{
+    // without a pre-erase hint
+    for (uint32_t sector = 2000; sector < 2006; sector++) {
+        dirtySector(sector);
+    }
+    dirtySector(3000);
+    dirtySector(3001);
+
+    EXPECT_TRUE(afatfs_flush());
+
+    EXPECT_EQ(std::vector<uint32_t>({ 2000, 2001, 2002, 2003, 2004, 2005, 3000, 3001 }), writtenBlocks);
+
+    // the two at 3000 are too few to be worth it
+    ASSERT_EQ(1u, blockRuns.size());
+    EXPECT_EQ(2000u, blockRuns[0].start);
+    EXPECT_EQ(6u, blockRuns[0].count);
+}
+
+// STUBS
+
+extern "C" {
+
+bool sdcard_readBlock(uint32_t blockIndex, uint8_t *buffer, sdcard_operationCompleteCallback_c callback, uint32_t callbackData)
+{
+    UNUSED(blockIndex);
+    UNUSED(buffer);
+    UNUSED(callback);
+    UNUSED(callbackData);
+    return false;
+}
+
+// Like the drivers, a multi-block write that is asked for again at its next block carries on
+sdcardOperationStatus_e sdcard_beginWriteBlocks(uint32_t blockIndex, uint32_t blockCount)
+{
+    if (multiWriteBlocksRemain == 0 || blockIndex != multiWriteNextBlock) {
+        blockRuns.push_back({ blockIndex, blockCount });
+        multiWriteNextBlock = blockIndex;
+        multiWriteBlocksRemain = blockCount;
+    }
+    return SDCARD_OPERATION_SUCCESS;
+}
+
+sdcardOperationStatus_e sdcard_writeBlock(uint32_t blockIndex, uint8_t *buffer, sdcard_operationCompleteCallback_c callback, uint32_t callbackData)
+{
+    UNUSED(callbackData);
+    writtenBlocks.push_back(blockIndex);
+    if (multiWriteBlocksRemain > 0 && blockIndex == multiWriteNextBlock) {
+        multiWriteNextBlock++;
+        multiWriteBlocksRemain--;
+    } else {
+        multiWriteBlocksRemain = 0;
+    }
+    writeCallback = callback;
+    writeBuffer = buffer;
+    return writeResult;
+}
+
+bool sdcard_poll(void) { return true; }
+void sdcard_setProfilerCallback(sdcard_profilerCallback_c callback) { UNUSED(callback); }
+
+}
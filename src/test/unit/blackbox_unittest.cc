@@ -23,6 +23,7 @@ extern "C" {
     #include "build/debug.h"
 
     #include "blackbox/blackbox.h"
+    #include "blackbox/blackbox_io.h"
     #include "common/utils.h"
 
     #include "pg/pg.h"
@@ -58,6 +59,10 @@ extern "C" {
 
 gyroDev_t gyroDev;
 
+static uint32_t serialTxFree;
+static uint8_t serialTxBuffer[1024];
+static int serialTxLength;
+
 TEST(BlackboxTest, TestInitIntervals)
 {
     blackboxConfigMutable()->sample_rate = 4; // sample_rate = PID loop frequency / 16
@@ -329,6 +334,55 @@ TEST(BlackboxTest, Test_CalculateRates)
 
 }
 
+TEST(BlackboxTest, TestFrameCommitSerial)
+{
+    blackboxConfigMutable()->device = BLACKBOX_DEVICE_SERIAL;
+    serialTxLength = 0;
+    const uint32_t droppedFrames = blackboxGetDroppedFrameCount();
+
+    // nothing reaches the port until the frame is committed
+    serialTxFree = 100;
+    blackboxWrite('P');
+    blackboxWriteString("abc");
+    EXPECT_EQ(0, serialTxLength);
+    blackboxDeviceCommitFrame();
+    EXPECT_EQ(4, serialTxLength);
+    EXPECT_EQ(0, memcmp(serialTxBuffer, "Pabc", 4));
+    EXPECT_EQ(droppedFrames, blackboxGetDroppedFrameCount());
+
+    // a frame that doesn't fit is dropped whole rather than truncated
+    serialTxFree = 3;
+    blackboxWriteString("Pdef");
+    blackboxDeviceCommitFrame();
+    EXPECT_EQ(4, serialTxLength);
+    EXPECT_EQ(droppedFrames + 1, blackboxGetDroppedFrameCount());
+
+    // the largest frame goes out whole, or not at all
+    serialTxFree = BLACKBOX_FRAME_BUFFER_SIZE - 1;
+    for (int i = 0; i < BLACKBOX_FRAME_BUFFER_SIZE; i++) {
+        blackboxWrite('I');
+    }
+    EXPECT_EQ(4, serialTxLength);
+    blackboxDeviceCommitFrame();
+    EXPECT_EQ(4, serialTxLength);
+    EXPECT_EQ(droppedFrames + 2, blackboxGetDroppedFrameCount());
+
+    serialTxFree = BLACKBOX_FRAME_BUFFER_SIZE;
+    for (int i = 0; i < BLACKBOX_FRAME_BUFFER_SIZE; i++) {
+        blackboxWrite('I');
+    }
+    blackboxDeviceCommitFrame();
+    EXPECT_EQ(4 + BLACKBOX_FRAME_BUFFER_SIZE, serialTxLength);
+    EXPECT_EQ(droppedFrames + 2, blackboxGetDroppedFrameCount());
+
+    // and the next frame is unaffected
+    serialTxFree = 100;
+    blackboxWrite('E');
+    blackboxDeviceCommitFrame();
+    EXPECT_EQ(5 + BLACKBOX_FRAME_BUFFER_SIZE, serialTxLength);
+    EXPECT_EQ('E', serialTxBuffer[serialTxLength - 1]);
+}
+
 
 // STUBS
 extern "C" {
@@ -369,7 +423,13 @@ bool isModeActivationConditionPresent(boxId_e) {return false;}
 uint32_t millis(void) {return 0;}
 bool sensors(uint32_t) {return false;}
 void serialWrite(serialPort_t *, uint8_t) {}
-uint32_t serialTxBytesFree(const serialPort_t *) {return 0;}
+void serialWriteBuf(serialPort_t *, const uint8_t *data, int count)
+{
+    memcpy(&serialTxBuffer[serialTxLength], data, count);
+    serialTxLength += count;
+    serialTxFree -= count;
+}
+uint32_t serialTxBytesFree(const serialPort_t *) {return serialTxFree;}
 bool isSerialTransmitBufferEmpty(const serialPort_t *) {return false;}
 bool featureIsEnabled(uint32_t) {return false;}
 void mspSerialReleasePortIfAllocated(serialPort_t *) {}
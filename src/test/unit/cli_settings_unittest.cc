@@ -0,0 +1,102 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include <string>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "build/debug.h"
+
+    #include "common/utils.h"
+
+    #include "cli/settings.h"
+
+    #include "sensors/current.h"
+    #include "sensors/voltage.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// The linear search cliGetSettingIndex() used before the name index
+static uint16_t findByNameLinear(const char *name, size_t length)
+{
+    for (unsigned i = 0; i < valueTableEntryCount; i++) {
+        if (strncasecmp(name, valueTable[i].name, length) == 0 && length == strlen(valueTable[i].name)) {
+            return i;
+        }
+    }
+    return valueTableEntryCount;
+}
+
+TEST(CliSettingsUnittest, TestEveryNameIsFound)
+{
+    for (unsigned i = 0; i < valueTableEntryCount; i++) {
+        const char *name = valueTable[i].name;
+        EXPECT_EQ(findByNameLinear(name, strlen(name)), valueTableFindByName(name, strlen(name))) << name;
+    }
+}
+
+TEST(CliSettingsUnittest, TestCaseInsensitive)
+{
+    for (unsigned i = 0; i < valueTableEntryCount; i++) {
+        std::string name(valueTable[i].name);
+        for (auto &c : name) {
+            c = toupper(c);
+        }
+        EXPECT_EQ(findByNameLinear(name.c_str(), name.length()), valueTableFindByName(name.c_str(), name.length())) << name;
+    }
+}
+
+TEST(CliSettingsUnittest, TestLengthLimitsMatch)
+{
+    // the name is followed by the rest of the command line, only length characters are compared
+    const char *name = valueTable[0].name;
+    const std::string line = std::string(name) + " = 1";
+    EXPECT_EQ(findByNameLinear(name, strlen(name)), valueTableFindByName(line.c_str(), strlen(name)));
+
+    // prefixes and longer names are not matches
+    for (unsigned i = 0; i < valueTableEntryCount; i++) {
+        const std::string longer = std::string(valueTable[i].name) + "_x";
+        EXPECT_EQ(findByNameLinear(longer.c_str(), longer.length()), valueTableFindByName(longer.c_str(), longer.length())) << longer;
+        const size_t shorter = strlen(valueTable[i].name) - 1;
+        EXPECT_EQ(findByNameLinear(valueTable[i].name, shorter), valueTableFindByName(valueTable[i].name, shorter)) << valueTable[i].name;
+    }
+}
+
+TEST(CliSettingsUnittest, TestUnknownName)
+{
+    EXPECT_EQ(valueTableEntryCount, valueTableFindByName("", 0));
+    EXPECT_EQ(valueTableEntryCount, valueTableFindByName("a", 1));
+    EXPECT_EQ(valueTableEntryCount, valueTableFindByName("zzz_not_a_setting", 17));
+}
+
+// STUBS
+extern "C" {
+    const char * const debugModeNames[DEBUG_COUNT] = { 0 };
+    const char * const currentMeterSourceNames[CURRENT_METER_COUNT] = { 0 };
+    const char * const voltageMeterSourceNames[VOLTAGE_METER_COUNT] = { 0 };
+}
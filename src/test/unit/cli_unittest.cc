@@ -98,6 +98,17 @@ extern "C" {
     PG_REGISTER(gpsRescueConfig_t, gpsRescueConfig, PG_GPS_RESCUE, 0);
 
     PG_REGISTER_WITH_RESET_FN(int8_t, unitTestData, PG_RESERVED_FOR_TESTING_1, 0);
+
+    // The indexed lookup in settings.c is tested with the real table in cli_settings_unittest
+    uint16_t valueTableFindByName(const char *name, size_t length)
+    {
+        for (unsigned i = 0; i < ARRAYLEN(valueTable); i++) {
+            if (strncasecmp(name, valueTable[i].name, length) == 0 && length == strlen(valueTable[i].name)) {
+                return i;
+            }
+        }
+        return ARRAYLEN(valueTable);
+    }
 }
 
 #include "unittest_macros.h"
@@ -287,6 +298,7 @@ void beeperOffClearAll(void) {}
 bool parseColor(int, const char *) {return false; }
 bool resetEEPROM(void) { return true; }
 void bufWriterFlush(bufWriter_t *) {}
+int bufWriterFlushUpTo(bufWriter_t *, int) { return 0; }
 void mixerResetDisarmedMotors(void) {}
 
 typedef enum {
@@ -309,6 +321,8 @@ uint8_t getCurrentControlRateProfileIndex(void){ return 1; }
 void changeControlRateProfile(uint8_t) {}
 void resetAllRxChannelRangeConfigurations(rxChannelRangeConfig_t *) {}
 void writeEEPROM() {}
+void finishEepromWrite(void) {}
+void configSnapshotRestoreAbort(void) {}
 serialPortConfig_t *serialFindPortConfigurationMutable(serialPortIdentifier_e) {return NULL; }
 baudRate_e lookupBaudRateIndex(uint32_t){return BAUD_9600; }
 serialPortUsage_t *findSerialPortUsageByIdentifier(serialPortIdentifier_e){ return NULL; }
@@ -21,6 +21,7 @@
 #include <limits.h>
 
 #include <math.h>
+#include <string.h>
 
 extern "C" {
     #include "common/filter.h"
@@ -114,3 +115,35 @@ TEST(FilterUnittest, TestSlewFilter)
     slewFilterApply(&filter, 200.0f);
     EXPECT_EQ(200, filter.state);
 }
+
+TEST(FilterUnittest, TestBiquadCascade)
+{
+    const uint32_t looptimeUs = 125;
+
+    for (int form = BIQUAD_FORM_DF1; form <= BIQUAD_FORM_DF2T; form++) {
+        biquadFilter_t reference[3];
+        biquadFilter_t sections[3];
+        biquadFilterInit(&reference[0], 180.0f, looptimeUs, filterGetNotchQ(180.0f, 120.0f), FILTER_NOTCH, 1.0f);
+        biquadFilterInit(&reference[1], 320.0f, looptimeUs, filterGetNotchQ(320.0f, 260.0f), FILTER_NOTCH, 1.0f);
+        biquadFilterInitLPF(&reference[2], 250.0f, looptimeUs);
+        memcpy(sections, reference, sizeof(sections));
+
+        biquadCascade_t cascade;
+        biquadCascadeInit(&cascade, sections, 3, (biquadFilterForm_e)form);
+
+        // same output as applying each section on its own, for a step and then a sine
+        for (int i = 0; i < 400; i++) {
+            const float input = i < 200 ? 100.0f : 100.0f * sinf(i * 0.3f);
+            float expected = input;
+            for (int s = 0; s < 3; s++) {
+                expected = form == BIQUAD_FORM_DF1 ? biquadFilterApplyDF1(&reference[s], expected) : biquadFilterApply(&reference[s], expected);
+            }
+            EXPECT_FLOAT_EQ(expected, biquadCascadeApply(&cascade, input));
+        }
+    }
+
+    // an empty cascade passes the input through
+    biquadCascade_t cascade;
+    biquadCascadeInit(&cascade, NULL, 0, BIQUAD_FORM_DF2T);
+    EXPECT_FLOAT_EQ(42.0f, biquadCascadeApply(&cascade, 42.0f));
+}
@@ -0,0 +1,302 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "config/config_eeprom.h"
+
+    #include "drivers/system.h"
+
+    #include "pg/pg.h"
+    #include "pg/pg_ids.h"
+
+    typedef struct smallConfig_s {
+        uint32_t value;
+        uint32_t spare;
+    } smallConfig_t;
+
+    typedef struct largeConfig_s {
+        uint8_t table[200];
+    } largeConfig_t;
+
+    PG_DECLARE(smallConfig_t, smallConfig);
+    PG_DECLARE(largeConfig_t, largeConfig);
+
+    PG_REGISTER_WITH_RESET_TEMPLATE(smallConfig_t, smallConfig, PG_RESERVED_FOR_TESTING_1, 0);
+    PG_RESET_TEMPLATE(smallConfig_t, smallConfig,
+        .value = 1,
+    );
+
+    PG_REGISTER(largeConfig_t, largeConfig, PG_RESERVED_FOR_TESTING_2, 0);
+
+    int failureCount;
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// 1024 bytes of config storage with entries padded to the 32 byte streamer buffer: a 226 byte snapshot, then a
+// journal of up to 24 entries for smallConfig
+#define JOURNAL_START           256
+#define SMALL_ENTRY_SIZE        32
+#define LARGE_ENTRY_SIZE        224
+
+static void save(void)
+{
+    writeConfigToEEPROM();
+    EXPECT_TRUE(isEEPROMStructureValid());
+}
+
+// Load into PGs filled with junk, so anything not restored shows
+static void load(void)
+{
+    memset(smallConfigMutable(), 0x5A, sizeof(smallConfig_t));
+    memset(largeConfigMutable(), 0x5A, sizeof(largeConfig_t));
+    EXPECT_TRUE(isEEPROMStructureValid());
+    EXPECT_TRUE(loadEEPROM());
+}
+
+class ConfigJournalTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        failureCount = 0;
+        memset(eepromData, 0xFF, sizeof(eepromData));
+        EXPECT_FALSE(isEEPROMStructureValid());
+
+        pgResetAll();
+        for (unsigned i = 0; i < sizeof(largeConfig_t); i++) {
+            largeConfigMutable()->table[i] = i;
+        }
+        save();
+        load();
+    }
+
+    void TearDown() override
+    {
+        EXPECT_EQ(0, failureCount);
+    }
+};
+
+TEST_F(ConfigJournalTest, FirstSaveWritesSnapshot)
+{
+    EXPECT_TRUE(isEEPROMVersionValid());
+    EXPECT_EQ(JOURNAL_START, getEEPROMConfigSize());
+    EXPECT_EQ(1u, smallConfig()->value);
+    EXPECT_EQ(199, largeConfig()->table[199]);
+}
+
+TEST_F(ConfigJournalTest, UnchangedSaveWritesNothing)
+{
+    uint8_t before[EEPROM_SIZE];
+    memcpy(before, eepromData, sizeof(before));
+
+    save();
+
+    EXPECT_EQ(0, memcmp(before, eepromData, sizeof(before)));
+}
+
+TEST_F(ConfigJournalTest, ChangedGroupIsAppended)
+{
+    uint8_t snapshot[JOURNAL_START];
+    memcpy(snapshot, eepromData, sizeof(snapshot));
+
+    smallConfigMutable()->value = 42;
+    save();
+
+    // only the changed PG is written, after the untouched snapshot
+    EXPECT_EQ(JOURNAL_START + SMALL_ENTRY_SIZE, getEEPROMConfigSize());
+    EXPECT_EQ(0, memcmp(snapshot, eepromData, sizeof(snapshot)));
+
+    load();
+    EXPECT_EQ(42u, smallConfig()->value);
+    EXPECT_EQ(199, largeConfig()->table[199]);
+
+    // and the save after the load has nothing to do
+    save();
+    EXPECT_EQ(JOURNAL_START + SMALL_ENTRY_SIZE, getEEPROMConfigSize());
+}
+
+TEST_F(ConfigJournalTest, LastEntryWins)
+{
+    for (uint32_t value = 10; value < 15; value++) {
+        smallConfigMutable()->value = value;
+        save();
+    }
+    largeConfigMutable()->table[7] = 77;
+    save();
+
+    load();
+    EXPECT_EQ(14u, smallConfig()->value);
+    EXPECT_EQ(77, largeConfig()->table[7]);
+    EXPECT_EQ(8, largeConfig()->table[8]);
+}
+
+TEST_F(ConfigJournalTest, FullJournalIsCompacted)
+{
+    int compactions = 0;
+    uint16_t size = getEEPROMConfigSize();
+
+    for (uint32_t value = 100; value < 160; value++) {
+        smallConfigMutable()->value = value;
+        save();
+
+        EXPECT_LE(getEEPROMConfigSize(), EEPROM_SIZE);
+        if (getEEPROMConfigSize() < size) {
+            // the snapshot was rewritten with the latest value, and the journal emptied
+            EXPECT_EQ(JOURNAL_START, getEEPROMConfigSize());
+            compactions++;
+        }
+        size = getEEPROMConfigSize();
+
+        load();
+        EXPECT_EQ(value, smallConfig()->value);
+    }
+
+    EXPECT_EQ(2, compactions);
+}
+
+TEST_F(ConfigJournalTest, TornEntryIsDiscarded)
+{
+    smallConfigMutable()->value = 2;
+    save();
+    smallConfigMutable()->value = 3;
+    save();
+
+    // the last save was interrupted part way through its entry
+    eepromData[JOURNAL_START + SMALL_ENTRY_SIZE + 8] ^= 0x01;
+
+    load();
+    EXPECT_EQ(2u, smallConfig()->value);
+    EXPECT_EQ(JOURNAL_START + SMALL_ENTRY_SIZE, getEEPROMConfigSize());
+
+    // the torn entry can't be programmed over, so the next save rewrites the snapshot
+    smallConfigMutable()->value = 4;
+    save();
+    EXPECT_EQ(JOURNAL_START, getEEPROMConfigSize());
+
+    load();
+    EXPECT_EQ(4u, smallConfig()->value);
+}
+
+TEST_F(ConfigJournalTest, ZeroedJournalEndIsNotBlank)
+{
+    // storage that isn't erased can't be programmed, even where it holds no entry
+    memset(&eepromData[JOURNAL_START], 0, SMALL_ENTRY_SIZE);
+
+    smallConfigMutable()->value = 6;
+    save();
+    EXPECT_EQ(JOURNAL_START, getEEPROMConfigSize());
+
+    load();
+    EXPECT_EQ(6u, smallConfig()->value);
+}
+
+TEST_F(ConfigJournalTest, CorruptSnapshotIsInvalid)
+{
+    smallConfigMutable()->value = 5;
+    save();
+
+    eepromData[10] ^= 0x01;
+    EXPECT_FALSE(isEEPROMStructureValid());
+}
+
+TEST_F(ConfigJournalTest, BackgroundSaveIsCopiedWhenStarted)
+{
+    largeConfigMutable()->table[3] = 33;
+    EXPECT_TRUE(writeConfigToEEPROMBegin());
+
+    // changes made while the save is being written are left for the next one
+    largeConfigMutable()->table[3] = 34;
+
+    // the entry is programmed 32 bytes at a time
+    int steps = 0;
+    configWriteStatus_e status;
+    while ((status = writeConfigToEEPROMContinue()) == CONFIG_WRITE_IN_PROGRESS) {
+        steps++;
+    }
+    EXPECT_EQ(CONFIG_WRITE_COMPLETE, status);
+    EXPECT_EQ(LARGE_ENTRY_SIZE / 32, steps);
+    EXPECT_EQ(JOURNAL_START + LARGE_ENTRY_SIZE, getEEPROMConfigSize());
+
+    load();
+    EXPECT_EQ(33, largeConfig()->table[3]);
+
+    largeConfigMutable()->table[3] = 34;
+    save();
+    EXPECT_EQ(JOURNAL_START + 2 * LARGE_ENTRY_SIZE, getEEPROMConfigSize());
+
+    load();
+    EXPECT_EQ(34, largeConfig()->table[3]);
+}
+
+TEST_F(ConfigJournalTest, BackgroundSaveFailsUnlessEveryEntryIsStored)
+{
+    largeConfigMutable()->table[4] = 44;
+    EXPECT_TRUE(writeConfigToEEPROMBegin());
+
+    // the first chunk of the entry doesn't read back as it was programmed
+    EXPECT_EQ(CONFIG_WRITE_IN_PROGRESS, writeConfigToEEPROMContinue());
+    EXPECT_EQ(CONFIG_WRITE_IN_PROGRESS, writeConfigToEEPROMContinue());
+    eepromData[JOURNAL_START + 8] ^= 0x01;
+
+    configWriteStatus_e status;
+    while ((status = writeConfigToEEPROMContinue()) == CONFIG_WRITE_IN_PROGRESS);
+    EXPECT_EQ(CONFIG_WRITE_FAILED, status);
+
+    // so the next save rewrites the snapshot
+    save();
+    EXPECT_EQ(JOURNAL_START, getEEPROMConfigSize());
+
+    load();
+    EXPECT_EQ(44, largeConfig()->table[4]);
+}
+
+TEST_F(ConfigJournalTest, BackgroundSaveNeedsJournal)
+{
+    // fill the journal until the large PG no longer fits, so its save has to rewrite the snapshot
+    while (getEEPROMConfigSize() + LARGE_ENTRY_SIZE <= EEPROM_SIZE) {
+        smallConfigMutable()->value++;
+        save();
+    }
+    const uint16_t size = getEEPROMConfigSize();
+
+    largeConfigMutable()->table[0] = 2;
+    EXPECT_FALSE(writeConfigToEEPROMBegin());
+    EXPECT_EQ(size, getEEPROMConfigSize());
+    EXPECT_EQ(CONFIG_WRITE_COMPLETE, writeConfigToEEPROMContinue());
+}
+
+// STUBS
+
+extern "C" {
+
+void failureMode(failureMode_e mode)
+{
+    UNUSED(mode);
+    failureCount++;
+}
+
+}
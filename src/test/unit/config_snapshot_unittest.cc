@@ -0,0 +1,244 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/crc.h"
+    #include "common/maths.h"
+
+    #include "config/config_snapshot.h"
+
+    #include "fc/runtime_config.h"
+
+    #include "pg/pg.h"
+    #include "pg/pg_ids.h"
+
+    typedef struct smallConfig_s {
+        uint32_t value;
+        uint32_t spare;
+    } smallConfig_t;
+
+    typedef struct largeConfig_s {
+        uint8_t table[200];
+    } largeConfig_t;
+
+    PG_DECLARE(smallConfig_t, smallConfig);
+    PG_DECLARE(largeConfig_t, largeConfig);
+
+    PG_REGISTER_WITH_RESET_TEMPLATE(smallConfig_t, smallConfig, PG_RESERVED_FOR_TESTING_1, 1);
+    PG_RESET_TEMPLATE(smallConfig_t, smallConfig,
+        .value = 1,
+    );
+
+    PG_REGISTER(largeConfig_t, largeConfig, PG_RESERVED_FOR_TESTING_2, 0);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+static timeMs_t testTimeMs;
+
+// a 5 byte record header for each PG and a 2 byte CRC
+#define SNAPSHOT_SIZE (5 + sizeof(smallConfig_t) + 5 + sizeof(largeConfig_t) + 2)
+
+class ConfigSnapshotTest : public ::testing::Test {
+protected:
+    uint8_t snapshot[SNAPSHOT_SIZE];
+
+    void SetUp() override
+    {
+        configSnapshotRestoreAbort();
+        pgResetAll();
+        smallConfigMutable()->value = 42;
+        for (unsigned i = 0; i < sizeof(largeConfig_t); i++) {
+            largeConfigMutable()->table[i] = i;
+        }
+
+        ASSERT_EQ(SNAPSHOT_SIZE, configSnapshotSize());
+        ASSERT_EQ((int)SNAPSHOT_SIZE, configSnapshotRead(0, snapshot, sizeof(snapshot)));
+    }
+
+    // Offset of the record header of a PG, which are in the order the linker placed them
+    unsigned recordOffset(pgn_t pgn)
+    {
+        unsigned offset = 0;
+        while (offset < SNAPSHOT_SIZE - 2) {
+            pgn_t recordPgn;
+            uint16_t size;
+            memcpy(&recordPgn, snapshot + offset, sizeof(recordPgn));
+            memcpy(&size, snapshot + offset + 3, sizeof(size));
+            if (recordPgn == pgn) {
+                break;
+            }
+            offset += 5 + size;
+        }
+        return offset;
+    }
+
+    void updateCrc(void)
+    {
+        const uint16_t crc = crc16_ccitt_update(0, snapshot, SNAPSHOT_SIZE - 2);
+        memcpy(snapshot + SNAPSHOT_SIZE - 2, &crc, sizeof(crc));
+    }
+
+    // Restore the snapshot over the defaults in chunks of the given size, returning false at the first one refused
+    bool restoreSnapshot(int chunk)
+    {
+        pgResetAll();
+        if (!configSnapshotRestoreBegin(sizeof(snapshot))) {
+            return false;
+        }
+        for (unsigned offset = 0; offset < sizeof(snapshot); offset += chunk) {
+            const int length = MIN(chunk, (int)(sizeof(snapshot) - offset));
+            if (!configSnapshotRestoreWrite(offset, snapshot + offset, length)) {
+                return false;
+            }
+        }
+        return configSnapshotRestoreIsComplete();
+    }
+};
+
+TEST_F(ConfigSnapshotTest, ChunkedReadMatchesWholeRead)
+{
+    uint8_t chunked[SNAPSHOT_SIZE + 10];
+    memset(chunked, 0xEE, sizeof(chunked));
+
+    for (unsigned offset = 0; offset < sizeof(chunked); offset += 7) {
+        const int length = configSnapshotRead(offset, chunked + offset, 7);
+        EXPECT_EQ(offset < SNAPSHOT_SIZE ? (int)MIN(7u, SNAPSHOT_SIZE - offset) : 0, length);
+    }
+
+    EXPECT_EQ(0, memcmp(snapshot, chunked, SNAPSHOT_SIZE));
+    EXPECT_EQ(0xEE, chunked[SNAPSHOT_SIZE]);
+}
+
+TEST_F(ConfigSnapshotTest, RestoreAppliesAllGroups)
+{
+    for (int chunk = 1; chunk <= (int)SNAPSHOT_SIZE; chunk += 13) {
+        EXPECT_TRUE(restoreSnapshot(chunk));
+
+        EXPECT_EQ(42u, smallConfig()->value);
+        EXPECT_EQ(0u, smallConfig()->spare);
+        EXPECT_EQ(199, largeConfig()->table[199]);
+    }
+}
+
+TEST_F(ConfigSnapshotTest, UnknownGroupIsSkipped)
+{
+    // renumber a record to a PG this firmware doesn't have
+    const pgn_t unknown = PG_RESERVED_FOR_TESTING_3;
+    memcpy(snapshot + recordOffset(PG_RESERVED_FOR_TESTING_1), &unknown, sizeof(unknown));
+    updateCrc();
+
+    EXPECT_TRUE(restoreSnapshot(16));
+    EXPECT_EQ(1u, smallConfig()->value);
+    EXPECT_EQ(199, largeConfig()->table[199]);
+}
+
+TEST_F(ConfigSnapshotTest, VersionMismatchIsRefused)
+{
+    snapshot[recordOffset(PG_RESERVED_FOR_TESTING_1) + 2] = 2;
+    updateCrc();
+
+    EXPECT_FALSE(restoreSnapshot(16));
+}
+
+TEST_F(ConfigSnapshotTest, CorruptSnapshotIsRefused)
+{
+    snapshot[20] ^= 0x01;
+
+    EXPECT_FALSE(restoreSnapshot(16));
+    EXPECT_FALSE(configSnapshotRestoreIsComplete());
+
+    // none of it was applied
+    EXPECT_EQ(1u, smallConfig()->value);
+    EXPECT_EQ(0, largeConfig()->table[199]);
+    EXPECT_FALSE(getArmingDisableFlags() & ARMING_DISABLED_CONFIG_RESTORE);
+}
+
+TEST_F(ConfigSnapshotTest, GroupsAreAppliedTogetherAtTheEnd)
+{
+    pgResetAll();
+    EXPECT_TRUE(configSnapshotRestoreBegin(sizeof(snapshot)));
+    EXPECT_TRUE(getArmingDisableFlags() & ARMING_DISABLED_CONFIG_RESTORE);
+
+    // all the records, but not the CRC
+    EXPECT_TRUE(configSnapshotRestoreWrite(0, snapshot, SNAPSHOT_SIZE - 2));
+    EXPECT_EQ(1u, smallConfig()->value);
+    EXPECT_EQ(0, largeConfig()->table[199]);
+    EXPECT_TRUE(getArmingDisableFlags() & ARMING_DISABLED_CONFIG_RESTORE);
+
+    EXPECT_TRUE(configSnapshotRestoreWrite(SNAPSHOT_SIZE - 2, snapshot + SNAPSHOT_SIZE - 2, 2));
+    EXPECT_TRUE(configSnapshotRestoreIsComplete());
+    EXPECT_EQ(42u, smallConfig()->value);
+    EXPECT_EQ(199, largeConfig()->table[199]);
+    EXPECT_FALSE(getArmingDisableFlags() & ARMING_DISABLED_CONFIG_RESTORE);
+}
+
+TEST_F(ConfigSnapshotTest, StalledRestoreIsAbandoned)
+{
+    pgResetAll();
+    EXPECT_TRUE(configSnapshotRestoreBegin(sizeof(snapshot)));
+    EXPECT_TRUE(configSnapshotRestoreWrite(0, snapshot, 10));
+
+    testTimeMs += 4000;
+    configSnapshotRestoreUpdate(testTimeMs);
+    EXPECT_TRUE(configSnapshotRestoreWrite(10, snapshot + 10, 10));
+    EXPECT_TRUE(getArmingDisableFlags() & ARMING_DISABLED_CONFIG_RESTORE);
+
+    // the timeout runs from the last write
+    testTimeMs += 5001;
+    configSnapshotRestoreUpdate(testTimeMs);
+    EXPECT_FALSE(getArmingDisableFlags() & ARMING_DISABLED_CONFIG_RESTORE);
+    EXPECT_FALSE(configSnapshotRestoreWrite(20, snapshot + 20, SNAPSHOT_SIZE - 20));
+    EXPECT_EQ(1u, smallConfig()->value);
+}
+
+TEST_F(ConfigSnapshotTest, OutOfOrderWriteIsRefused)
+{
+    EXPECT_TRUE(configSnapshotRestoreBegin(sizeof(snapshot)));
+    EXPECT_TRUE(configSnapshotRestoreWrite(0, snapshot, 10));
+
+    EXPECT_FALSE(configSnapshotRestoreWrite(20, snapshot + 20, 10));
+
+    // and the restore is abandoned
+    EXPECT_FALSE(configSnapshotRestoreWrite(10, snapshot + 10, 10));
+    EXPECT_FALSE(getArmingDisableFlags() & ARMING_DISABLED_CONFIG_RESTORE);
+}
+
+TEST_F(ConfigSnapshotTest, TruncatedSnapshotIsRefused)
+{
+    // the size ends part way through the last record
+    EXPECT_TRUE(configSnapshotRestoreBegin(SNAPSHOT_SIZE - 4));
+    EXPECT_FALSE(configSnapshotRestoreWrite(0, snapshot, SNAPSHOT_SIZE - 4));
+}
+
+// STUBS
+extern "C" {
+
+timeMs_t millis(void) { return testTimeMs; }
+void beeperConfirmationBeeps(uint8_t) {}
+
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+extern "C" {
+    #include "common/crc.h"
+    #include "common/streambuf.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// Bitwise CCITT, as crc16_ccitt() was before it became table driven
+static uint16_t crc16CcittBitwise(uint16_t crc, const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int ii = 0; ii < 8; ++ii) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void fillPseudoRandom(uint8_t *data, uint32_t length)
+{
+    uint32_t seed = 0x12345678;
+    for (uint32_t i = 0; i < length; i++) {
+        seed = seed * 1664525 + 1013904223;
+        data[i] = seed >> 24;
+    }
+}
+
+static const uint8_t checkString[] = "123456789";
+
+TEST(CrcTest, CheckValues)
+{
+    EXPECT_EQ(0x31C3, crc16_ccitt_update(0, checkString, 9)); // CRC-16/XMODEM
+    EXPECT_EQ(0xBC, crc8_dvb_s2_update(0, checkString, 9));   // CRC-8/DVB-S2
+    EXPECT_EQ(0xBC, crc8_update(0, checkString, 9, 0xD5));
+
+    uint8_t crc = 0;
+    for (int i = 0; i < 9; i++) {
+        crc = crc8_poly_0xba(crc, checkString[i]);
+    }
+    EXPECT_EQ(0x20, crc);
+}
+
+TEST(CrcTest, TablesMatchBitwise)
+{
+    for (int crc = 0; crc < 256; crc++) {
+        for (int a = 0; a < 256; a++) {
+            EXPECT_EQ(crc8_calc(crc, a, 0xD5), crc8_dvb_s2(crc, a));
+            EXPECT_EQ(crc8_calc(crc, a, 0xBA), crc8_poly_0xba(crc, a));
+        }
+    }
+
+    for (int crc = 0; crc < 65536; crc += 251) {
+        for (int a = 0; a < 256; a++) {
+            const uint8_t byte = a;
+            EXPECT_EQ(crc16CcittBitwise(crc, &byte, 1), crc16_ccitt(crc, a));
+        }
+    }
+}
+
+TEST(CrcTest, BufferUpdateMatchesBitwise)
+{
+    uint8_t data[1031];
+    fillPseudoRandom(data, sizeof(data));
+
+    // every length and alignment around the four byte slices, with non-zero starting values
+    for (uint32_t offset = 0; offset < 4; offset++) {
+        for (uint32_t length = 0; length <= 64; length++) {
+            EXPECT_EQ(crc16CcittBitwise(0xA5C3, data + offset, length), crc16_ccitt_update(0xA5C3, data + offset, length));
+            EXPECT_EQ(crc8_update(0x5A, data + offset, length, 0xD5), crc8_dvb_s2_update(0x5A, data + offset, length));
+        }
+    }
+
+    EXPECT_EQ(crc16CcittBitwise(0, data, sizeof(data)), crc16_ccitt_update(0, data, sizeof(data)));
+    EXPECT_EQ(crc8_update(0, data, sizeof(data), 0xD5), crc8_dvb_s2_update(0, data, sizeof(data)));
+}
+
+TEST(CrcTest, SbufAppend)
+{
+    uint8_t buffer[32];
+    sbuf_t sbuf;
+
+    sbufInit(&sbuf, buffer, buffer + sizeof(buffer));
+    sbufWriteData(&sbuf, checkString, 9);
+    crc16_ccitt_sbuf_append(&sbuf, buffer);
+    EXPECT_EQ(11, sbuf.ptr - buffer);
+    EXPECT_EQ(0xC3, buffer[9]);
+    EXPECT_EQ(0x31, buffer[10]);
+
+    sbufInit(&sbuf, buffer, buffer + sizeof(buffer));
+    sbufWriteData(&sbuf, checkString, 9);
+    crc8_dvb_s2_sbuf_append(&sbuf, buffer);
+    EXPECT_EQ(0xBC, buffer[9]);
+
+    sbufInit(&sbuf, buffer, buffer + sizeof(buffer));
+    sbufWriteData(&sbuf, checkString, 9);
+    crc8_poly_0xba_sbuf_append(&sbuf, buffer);
+    EXPECT_EQ(0x20, buffer[9]);
+}
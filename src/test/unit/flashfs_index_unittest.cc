@@ -0,0 +1,473 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/maths.h"
+
+    #include "drivers/flash/flash.h"
+
+    #include "io/flashfs.h"
+    #include "io/flashfs_index.h"
+
+    #include "pg/pg.h"
+    #include "pg/pg_ids.h"
+
+    PG_REGISTER(flashConfig_t, flashConfig, PG_FLASH_CONFIG, 0);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// A small NOR flash: 14 sectors of FLASHFS followed by the two sectors of the index
+#define SECTOR_SIZE     4096
+#define SECTOR_COUNT    16
+#define FLASHFS_SIZE    ((SECTOR_COUNT - FLASH_PARTITION_FLASHFS_INDEX_SECTORS) * SECTOR_SIZE)
+#define INDEX_ADDRESS   FLASHFS_SIZE
+
+static uint8_t flashData[SECTOR_COUNT * SECTOR_SIZE];
+static int flashEraseCount;
+static int flashChipEraseCount;
+static bool flashReady;
+static uint16_t flashSectors;
+
+static bool slotIsErased(int slot)
+{
+    for (int i = 0; i < 16; i++) {
+        if (flashData[INDEX_ADDRESS + slot * 16 + i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void writeLog(uint32_t length)
+{
+    flashfsIndexLogBegin(flashfsGetOffset());
+
+    uint8_t data[100];
+    for (uint32_t written = 0; written < length; written += sizeof(data)) {
+        memset(data, written & 0x7F, sizeof(data));
+        flashfsWrite(data, MIN((uint32_t)sizeof(data), length - written), true);
+    }
+    flashfsFlushSync();
+
+    const uint32_t logEnd = flashfsGetOffset();
+    flashfsClose();
+    flashfsIndexLogEnd(logEnd);
+
+    // the main task writes the END record once the flash is idle
+    flashfsEraseAsync();
+}
+
+static std::vector<flashfsIndexLog_t> listLogs(void)
+{
+    std::vector<flashfsIndexLog_t> logs;
+    flashfsIndexIterator_t iterator;
+    flashfsIndexLog_t log;
+
+    flashfsIndexIteratorInit(&iterator);
+    while (flashfsIndexIteratorNext(&iterator, &log)) {
+        logs.push_back(log);
+    }
+    return logs;
+}
+
+class FlashfsIndexTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        memset(flashData, 0xFF, sizeof(flashData));
+        flashEraseCount = 0;
+        flashChipEraseCount = 0;
+        flashReady = true;
+        flashSectors = SECTOR_COUNT;
+        flashfsInit();
+    }
+};
+
+TEST_F(FlashfsIndexTest, BlankFlashIsFormatted)
+{
+    EXPECT_TRUE(flashfsIndexIsAvailable());
+    EXPECT_EQ(0u, flashfsGetOffset());
+    EXPECT_TRUE(listLogs().empty());
+}
+
+TEST_F(FlashfsIndexTest, LogsSurviveReboot)
+{
+    writeLog(1000);
+    writeLog(250);
+    writeLog(3000);
+    const uint32_t usedSpace = flashfsGetOffset();
+
+    flashfsInit();
+
+    EXPECT_TRUE(flashfsIndexIsAvailable());
+    EXPECT_EQ(usedSpace, flashfsGetOffset());
+
+    const std::vector<flashfsIndexLog_t> logs = listLogs();
+    ASSERT_EQ(3u, logs.size());
+    EXPECT_EQ(0u, logs[0].start);
+    EXPECT_EQ(1000u, logs[0].end);
+    EXPECT_EQ(1000u, logs[1].start);
+    EXPECT_EQ(1250u, logs[1].end);
+    EXPECT_EQ(1250u, logs[2].start);
+    EXPECT_EQ(4250u, logs[2].end);
+    for (const flashfsIndexLog_t &log : logs) {
+        EXPECT_TRUE(log.indexed);
+    }
+}
+
+TEST_F(FlashfsIndexTest, OpenLogIsClosedAtBoot)
+{
+    writeLog(500);
+
+    // power lost while logging
+    flashfsIndexLogBegin(flashfsGetOffset());
+    uint8_t data[700];
+    memset(data, 0x55, sizeof(data));
+    flashfsWrite(data, sizeof(data), true);
+    flashfsFlushSync();
+
+    flashfsInit();
+
+    // without an END record the free space search decides where the log ends
+    EXPECT_EQ(2048u, flashfsGetOffset());
+
+    const std::vector<flashfsIndexLog_t> logs = listLogs();
+    ASSERT_EQ(2u, logs.size());
+    EXPECT_EQ(500u, logs[1].start);
+    EXPECT_EQ(2048u, logs[1].end);
+    EXPECT_TRUE(logs[1].indexed);
+
+    // and the next log goes after it
+    writeLog(100);
+    flashfsInit();
+    EXPECT_EQ(3u, listLogs().size());
+    EXPECT_EQ(2148u, flashfsGetOffset());
+}
+
+TEST_F(FlashfsIndexTest, DataWrittenWithoutIndexIsUnindexed)
+{
+    writeLog(1000);
+
+    // firmware without the index continues at the next 2048 byte block after a reboot
+    memset(&flashData[2048], 0x42, 3000);
+
+    flashfsInit();
+
+    EXPECT_EQ(6144u, flashfsGetOffset());
+
+    const std::vector<flashfsIndexLog_t> logs = listLogs();
+    ASSERT_EQ(2u, logs.size());
+    EXPECT_TRUE(logs[0].indexed);
+    EXPECT_FALSE(logs[1].indexed);
+    EXPECT_EQ(1000u, logs[1].start);
+    EXPECT_EQ(6144u, logs[1].end);
+}
+
+TEST_F(FlashfsIndexTest, CorruptRecordIsSkipped)
+{
+    writeLog(100);
+    writeLog(100);
+
+    // the END record of the first log, slot 0 is the header and slot 1 its BEGIN
+    flashData[INDEX_ADDRESS + 2 * 16 + 8] ^= 0x01;
+
+    flashfsInit();
+
+    // the first log now runs up to the start of the second
+    const std::vector<flashfsIndexLog_t> logs = listLogs();
+    ASSERT_EQ(2u, logs.size());
+    EXPECT_EQ(0u, logs[0].start);
+    EXPECT_EQ(100u, logs[0].end);
+    EXPECT_EQ(200u, flashfsGetOffset());
+}
+
+TEST_F(FlashfsIndexTest, CompactionKeepsLogs)
+{
+    // two records per log, compaction is due once fewer than 32 of the 256 slots are left
+    const int logCount = 120;
+    for (int i = 0; i < logCount; i++) {
+        writeLog(20);
+    }
+    const int erasesBefore = flashEraseCount;
+
+    flashfsInit();
+
+    EXPECT_EQ(erasesBefore + 1, flashEraseCount);
+    EXPECT_TRUE(flashfsIndexIsAvailable());
+    EXPECT_EQ(logCount * 20u, flashfsGetOffset());
+
+    const std::vector<flashfsIndexLog_t> logs = listLogs();
+    ASSERT_EQ((size_t)logCount, logs.size());
+    for (int i = 0; i < logCount; i++) {
+        EXPECT_EQ(i * 20u, logs[i].start);
+        EXPECT_EQ((i + 1) * 20u, logs[i].end);
+        EXPECT_TRUE(logs[i].indexed);
+    }
+
+    // and the compacted sector is used from then on
+    writeLog(20);
+    flashfsInit();
+    EXPECT_EQ(erasesBefore + 1, flashEraseCount);
+    EXPECT_EQ((size_t)logCount + 1, listLogs().size());
+}
+
+TEST_F(FlashfsIndexTest, CompactionMergesOldestLogs)
+{
+    // more logs than a compacted sector keeps, a few flights between reboots
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 15; i++) {
+            writeLog(8);
+        }
+        flashfsInit();
+    }
+
+    EXPECT_TRUE(flashfsIndexIsAvailable());
+    EXPECT_EQ(300 * 8u, flashfsGetOffset());
+
+    const std::vector<flashfsIndexLog_t> logs = listLogs();
+    ASSERT_GE(logs.size(), 2u);
+    EXPECT_LT(logs.size(), 256u);
+    EXPECT_FALSE(logs[0].indexed);
+    EXPECT_EQ(0u, logs[0].start);
+    EXPECT_EQ(logs[1].start, logs[0].end);
+    EXPECT_EQ(300 * 8u, logs.back().end);
+    EXPECT_TRUE(logs.back().indexed);
+}
+
+TEST_F(FlashfsIndexTest, RecordsWaitForIdleFlash)
+{
+    writeLog(100);
+
+    // arming doesn't wait for the flash, the BEGIN record is programmed once the flash is idle
+    flashReady = false;
+    flashfsIndexLogBegin(flashfsGetOffset());
+    flashfsEraseAsync();
+    EXPECT_TRUE(slotIsErased(3));
+
+    flashReady = true;
+    flashfsEraseAsync();
+    EXPECT_FALSE(slotIsErased(3));
+
+    // and ahead of the data of its log
+    flashfsIndexLogEnd(flashfsGetOffset());
+    flashfsIndexLogBegin(flashfsGetOffset());
+    EXPECT_TRUE(slotIsErased(4));
+    uint8_t data[10] = { 0 };
+    flashfsWrite(data, sizeof(data), true);
+    flashfsFlushSync();
+    EXPECT_FALSE(slotIsErased(4));
+    EXPECT_FALSE(slotIsErased(5));
+}
+
+TEST_F(FlashfsIndexTest, EraseUsesChipErase)
+{
+    writeLog(1000);
+
+    // the volume and the index cover the whole chip
+    flashfsEraseCompletely();
+    EXPECT_EQ(1, flashChipEraseCount);
+    EXPECT_TRUE(flashfsIsReady());
+    EXPECT_TRUE(flashfsIndexIsAvailable());
+    EXPECT_TRUE(listLogs().empty());
+
+    flashfsEraseAsync();
+    flashfsInit();
+    EXPECT_TRUE(flashfsIndexIsAvailable());
+    EXPECT_EQ(0u, flashfsGetOffset());
+    EXPECT_TRUE(listLogs().empty());
+}
+
+TEST_F(FlashfsIndexTest, EraseFormatsIndex)
+{
+    writeLog(1000);
+
+    // a sector beyond the partitions, eg. for the config, so the partitions are erased a sector at a time
+    flashSectors = SECTOR_COUNT + 1;
+    flashfsInit();
+    const int erasesBefore = flashEraseCount;
+
+    flashfsEraseCompletely();
+    EXPECT_FALSE(flashfsIndexIsAvailable());
+    while (!flashfsIsReady()) {
+        flashfsEraseAsync();
+    }
+
+    EXPECT_EQ(0, flashChipEraseCount);
+    EXPECT_EQ(erasesBefore + SECTOR_COUNT, flashEraseCount);
+    EXPECT_TRUE(flashfsIndexIsAvailable());
+    EXPECT_TRUE(listLogs().empty());
+
+    flashfsEraseAsync();
+    flashfsInit();
+    EXPECT_TRUE(flashfsIndexIsAvailable());
+    EXPECT_EQ(0u, flashfsGetOffset());
+    EXPECT_TRUE(listLogs().empty());
+}
+
+TEST_F(FlashfsIndexTest, OverwrittenIndexIsPartOfTheVolume)
+{
+    // logs written by firmware whose FLASHFS partition covered the index sectors too
+    memset(flashData, 0x42, INDEX_ADDRESS + 100);
+
+    flashfsInit();
+
+    // they stay readable
+    EXPECT_FALSE(flashfsIndexIsAvailable());
+    EXPECT_EQ((uint32_t)SECTOR_COUNT * SECTOR_SIZE, flashfsGetSize());
+    EXPECT_EQ(INDEX_ADDRESS + 2048u, flashfsGetOffset());
+
+    // until the next erase gives the sectors back to the index
+    flashfsEraseCompletely();
+    EXPECT_EQ((uint32_t)FLASHFS_SIZE, flashfsGetSize());
+    flashfsEraseAsync();
+    flashfsInit();
+    EXPECT_TRUE(flashfsIndexIsAvailable());
+    EXPECT_EQ((uint32_t)FLASHFS_SIZE, flashfsGetSize());
+    EXPECT_EQ(0u, flashfsGetOffset());
+}
+
+TEST_F(FlashfsIndexTest, BlankIndexIsNotPartOfTheVolume)
+{
+    // logs written before the index was enabled that stop short of its sectors
+    memset(flashData, 0x42, 3 * 2048);
+
+    flashfsInit();
+
+    EXPECT_TRUE(flashfsIndexIsAvailable());
+    EXPECT_EQ((uint32_t)FLASHFS_SIZE, flashfsGetSize());
+    EXPECT_EQ(3 * 2048u, flashfsGetOffset());
+
+    const std::vector<flashfsIndexLog_t> logs = listLogs();
+    ASSERT_EQ(1u, logs.size());
+    EXPECT_FALSE(logs[0].indexed);
+}
+
+// STUBS
+
+extern "C" {
+
+static flashGeometry_t flashGeometry = {
+    .sectors = SECTOR_COUNT,
+    .pageSize = 256,
+    .sectorSize = SECTOR_SIZE,
+    .totalSize = SECTOR_COUNT * SECTOR_SIZE,
+    .pagesPerSector = SECTOR_SIZE / 256,
+    .flashType = FLASH_TYPE_NOR,
+    .jedecId = 0,
+};
+
+static flashPartition_t flashPartitions[] = {
+    { FLASH_PARTITION_TYPE_FLASHFS, 0, SECTOR_COUNT - FLASH_PARTITION_FLASHFS_INDEX_SECTORS - 1 },
+    { FLASH_PARTITION_TYPE_FLASHFS_INDEX, SECTOR_COUNT - FLASH_PARTITION_FLASHFS_INDEX_SECTORS, SECTOR_COUNT - 1 },
+};
+
+static void (*programCallback)(uint32_t arg);
+static uint32_t programAddress;
+
+static void flashProgram(uint32_t address, const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        flashData[address + i] &= data[i];
+    }
+}
+
+const flashGeometry_t *flashGetGeometry(void)
+{
+    flashGeometry.sectors = flashSectors;
+    return &flashGeometry;
+}
+
+flashPartition_t *flashPartitionFindByType(flashPartitionType_e type)
+{
+    for (flashPartition_t &partition : flashPartitions) {
+        if (partition.type == type) {
+            return &partition;
+        }
+    }
+    return NULL;
+}
+
+int flashPartitionCount(void) { return ARRAYLEN(flashPartitions); }
+
+bool flashIsReady(void) { return flashReady; }
+bool flashWaitForReady(void) { return true; }
+void flashFlush(void) {}
+
+void flashEraseCompletely(void)
+{
+    memset(flashData, 0xFF, sizeof(flashData));
+    flashChipEraseCount++;
+}
+
+void flashEraseSector(uint32_t address)
+{
+    memset(&flashData[address - address % SECTOR_SIZE], 0xFF, SECTOR_SIZE);
+    flashEraseCount++;
+}
+
+int flashReadBytes(uint32_t address, uint8_t *buffer, uint32_t length)
+{
+    memcpy(buffer, &flashData[address], length);
+    return length;
+}
+
+void flashReadBytesBegin(uint32_t address, uint8_t *buffer, uint32_t length, void (*callback)(uint32_t length))
+{
+    callback(flashReadBytes(address, buffer, length));
+}
+
+void flashPageProgram(uint32_t address, const uint8_t *data, uint32_t length, void (*callback)(uint32_t length))
+{
+    flashProgram(address, data, length);
+    if (callback) {
+        callback(length);
+    }
+}
+
+void flashPageProgramBegin(uint32_t address, void (*callback)(uint32_t arg))
+{
+    programAddress = address;
+    programCallback = callback;
+}
+
+uint32_t flashPageProgramContinue(const uint8_t **buffers, uint32_t *bufferSizes, uint32_t bufferCount)
+{
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < bufferCount; i++) {
+        flashProgram(programAddress + written, buffers[i], bufferSizes[i]);
+        written += bufferSizes[i];
+    }
+    programCallback(written);
+    return written;
+}
+
+void flashPageProgramFinish(void) {}
+
+}
@@ -0,0 +1,392 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/maths.h"
+
+    #include "drivers/flash/flash.h"
+
+    #include "io/flashfs.h"
+
+    #include "pg/pg.h"
+    #include "pg/pg_ids.h"
+
+    PG_REGISTER(flashConfig_t, flashConfig, PG_FLASH_CONFIG, 0);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// A NOR flash emulated in a temporary file, programming clears bits and erasing sets them
+#define PAGE_SIZE       256
+#define SECTOR_SIZE     4096
+#define SECTOR_COUNT    32
+#define VOLUME_SIZE     (SECTOR_COUNT * SECTOR_SIZE)
+#define ERASE_AHEAD     4
+
+static int flashFd = -1;
+static int flashEraseCount;
+static int flashReadCount;
+
+static void flashFill(uint8_t value)
+{
+    static uint8_t sector[SECTOR_SIZE];
+    memset(sector, value, sizeof(sector));
+    for (int i = 0; i < SECTOR_COUNT; i++) {
+        ASSERT_EQ(SECTOR_SIZE, pwrite(flashFd, sector, SECTOR_SIZE, i * SECTOR_SIZE));
+    }
+}
+
+static uint8_t streamByte(uint32_t position)
+{
+    // never 16 bytes of 0xFF in a row, like blackbox data
+    return (position * 7 + position / 251) & 0xFF;
+}
+
+// Writes the stream the way blackbox does, flushing and erasing ahead between frames
+static void writeStream(uint32_t *position, uint32_t length)
+{
+    uint8_t frame[40];
+    for (uint32_t end = *position + length; *position < end; ) {
+        const uint32_t frameLength = MIN((uint32_t)sizeof(frame), end - *position);
+        for (uint32_t i = 0; i < frameLength; i++) {
+            frame[i] = streamByte((*position)++);
+        }
+        flashfsWrite(frame, frameLength, false);
+
+        flashfsFlushAsync(false);
+        flashfsEraseAhead();
+    }
+    flashfsFlushSync();
+}
+
+static void expectStream(uint32_t from, uint32_t to)
+{
+    uint32_t mismatches = 0;
+    for (uint32_t p = from; p < to; p++) {
+        uint8_t value;
+        flashReadBytes(p % VOLUME_SIZE, &value, 1);
+        mismatches += value != streamByte(p) ? 1 : 0;
+    }
+    EXPECT_EQ(0u, mismatches);
+}
+
+// The most recent data must all be there, the window ahead of the file pointer excepted
+static void expectStreamEndsAtOffset(uint32_t position)
+{
+    const uint32_t kept = VOLUME_SIZE - (ERASE_AHEAD + 1) * SECTOR_SIZE;
+    expectStream(position > kept ? position - kept : 0, position);
+    EXPECT_EQ(position % VOLUME_SIZE, flashfsGetOffset());
+}
+
+class FlashfsRingTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        flashFd = fileno(tmpfile());
+        ASSERT_GE(flashFd, 0);
+        flashEraseCount = 0;
+        flashReadCount = 0;
+        flashConfigMutable()->ringEraseAheadSectors = ERASE_AHEAD;
+    }
+
+    void TearDown() override
+    {
+        close(flashFd);
+    }
+
+    static void eraseAhead(void)
+    {
+        for (int i = 0; i < SECTOR_COUNT && !flashfsEraseAhead(); i++);
+    }
+};
+
+TEST_F(FlashfsRingTest, DirtyChipLogsWithoutFullErase)
+{
+    flashFill(0x42);
+    flashfsInit();
+
+    EXPECT_EQ(0u, flashfsGetOffset());
+    EXPECT_FALSE(flashfsEraseAhead());
+    eraseAhead();
+    EXPECT_TRUE(flashfsEraseAhead());
+    EXPECT_EQ(ERASE_AHEAD, flashEraseCount);
+
+    // three times round the ring
+    uint32_t position = 0;
+    writeStream(&position, 3 * VOLUME_SIZE + 1000);
+
+    EXPECT_FALSE(flashfsIsEOF());
+    expectStreamEndsAtOffset(position);
+
+    // a sector erased for every sector written, plus the window
+    EXPECT_LE(flashEraseCount, (int)(position / SECTOR_SIZE) + ERASE_AHEAD + 1);
+}
+
+TEST_F(FlashfsRingTest, OldestDataIsOverwritten)
+{
+    flashFill(0x42);
+    flashfsInit();
+    eraseAhead();
+
+    uint32_t position = 0;
+    writeStream(&position, VOLUME_SIZE + VOLUME_SIZE / 2);
+    expectStreamEndsAtOffset(position);
+
+    // the window ahead of the file pointer is erased, what follows it is from the first time round
+    const uint32_t offset = flashfsGetOffset();
+    uint8_t value;
+    flashReadBytes(offset, &value, 1);
+    EXPECT_EQ(0xFF, value);
+    const uint32_t afterWindow = offset + (ERASE_AHEAD + 1) * SECTOR_SIZE;
+    expectStream(afterWindow, VOLUME_SIZE);
+}
+
+TEST_F(FlashfsRingTest, RebootContinuesAfterLastData)
+{
+    flashFill(0x42);
+    flashfsInit();
+    eraseAhead();
+
+    uint32_t position = 0;
+    writeStream(&position, VOLUME_SIZE + 5000);
+
+    // the free space search continues on the next 2048 byte block
+    flashfsInit();
+    const uint32_t resumed = ((position + 2047) & ~2047) % VOLUME_SIZE;
+    EXPECT_EQ(resumed, flashfsGetOffset());
+
+    // with at most one more sector to erase to restore the window
+    const int erases = flashEraseCount;
+    eraseAhead();
+    EXPECT_TRUE(flashfsEraseAhead());
+    EXPECT_LE(flashEraseCount, erases + 1);
+
+    const uint32_t lastPosition = position;
+    position = (position + 2047) & ~2047;
+    const uint32_t firstPosition = position;
+    writeStream(&position, 3000);
+
+    EXPECT_EQ(position % VOLUME_SIZE, flashfsGetOffset());
+    expectStream(firstPosition, position);
+    expectStream(lastPosition - 10000, lastPosition);
+}
+
+TEST_F(FlashfsRingTest, BlankChipIsReadyAtOnce)
+{
+    flashFill(0xFF);
+    flashfsInit();
+
+    EXPECT_EQ(0u, flashfsGetOffset());
+    EXPECT_TRUE(flashfsEraseAhead());
+    EXPECT_EQ(0, flashEraseCount);
+}
+
+TEST_F(FlashfsRingTest, LinearModeStopsWhenFull)
+{
+    flashConfigMutable()->ringEraseAheadSectors = 0;
+    flashFill(0xFF);
+    flashfsInit();
+
+    EXPECT_TRUE(flashfsEraseAhead());
+
+    uint32_t position = 0;
+    writeStream(&position, VOLUME_SIZE);
+    EXPECT_TRUE(flashfsIsEOF());
+    EXPECT_EQ(0, flashEraseCount);
+
+    // and nothing more is written
+    writeStream(&position, 1000);
+    uint8_t value;
+    flashReadBytes(0, &value, 1);
+    EXPECT_EQ(streamByte(0), value);
+}
+
+// Reads the stream back through flashfsReadAbs() in pieces which don't line up with the read-ahead buffers
+static void expectStreamRead(uint32_t from, uint32_t to)
+{
+    uint32_t mismatches = 0;
+    uint8_t buffer[100];
+    for (uint32_t p = from; p < to; ) {
+        const int length = flashfsReadAbs(p, buffer, MIN((uint32_t)sizeof(buffer), to - p));
+        ASSERT_GT(length, 0);
+        for (int i = 0; i < length; i++) {
+            mismatches += buffer[i] != streamByte(p + i) ? 1 : 0;
+        }
+        p += length;
+    }
+    EXPECT_EQ(0u, mismatches);
+}
+
+TEST_F(FlashfsRingTest, SequentialReadsAreReadAhead)
+{
+    flashConfigMutable()->ringEraseAheadSectors = 0;
+    flashfsInit();
+    flashfsEraseCompletely();
+
+    uint32_t position = 0;
+    writeStream(&position, 20000);
+
+    // a random read goes straight to the flash
+    flashReadCount = 0;
+    expectStreamRead(12345, 12350);
+    EXPECT_EQ(1, flashReadCount);
+
+    // then each 1K chunk is read once, 12288 to 20479 and the one after the last read
+    flashReadCount = 0;
+    expectStreamRead(12350, 20000);
+    EXPECT_EQ(9, flashReadCount);
+}
+
+TEST_F(FlashfsRingTest, WriteDiscardsReadAhead)
+{
+    flashConfigMutable()->ringEraseAheadSectors = 0;
+    flashfsInit();
+    flashfsEraseCompletely();
+
+    uint32_t position = 0;
+    writeStream(&position, 3000);
+
+    // reading up to the end of the data reads ahead into the erased space after it
+    expectStreamRead(0, 1);
+    expectStreamRead(1, 3000);
+
+    writeStream(&position, 2000);
+    expectStreamRead(3000, 5000);
+}
+
+// STUBS
+
+extern "C" {
+
+static const flashGeometry_t flashGeometry = {
+    .sectors = SECTOR_COUNT,
+    .pageSize = PAGE_SIZE,
+    .sectorSize = SECTOR_SIZE,
+    .totalSize = VOLUME_SIZE,
+    .pagesPerSector = SECTOR_SIZE / PAGE_SIZE,
+    .flashType = FLASH_TYPE_NOR,
+    .jedecId = 0,
+};
+
+static flashPartition_t flashfsPartition = { FLASH_PARTITION_TYPE_FLASHFS, 0, SECTOR_COUNT - 1 };
+
+static void (*programCallback)(uint32_t arg);
+static uint32_t programAddress;
+
+static void flashProgram(uint32_t address, const uint8_t *data, uint32_t length)
+{
+    uint8_t current[PAGE_SIZE];
+    ASSERT_LE(length, sizeof(current));
+    ASSERT_EQ((ssize_t)length, pread(flashFd, current, length, address));
+    for (uint32_t i = 0; i < length; i++) {
+        current[i] &= data[i];
+    }
+    ASSERT_EQ((ssize_t)length, pwrite(flashFd, current, length, address));
+}
+
+const flashGeometry_t *flashGetGeometry(void) { return &flashGeometry; }
+
+flashPartition_t *flashPartitionFindByType(flashPartitionType_e type)
+{
+    return type == FLASH_PARTITION_TYPE_FLASHFS ? &flashfsPartition : NULL;
+}
+
+int flashPartitionCount(void) { return 1; }
+
+// A read started by flashReadBytesBegin() completes when the flash is next waited for, like a DMA transfer
+static void (*readCallback)(uint32_t length);
+static uint32_t readLength;
+
+bool flashIsReady(void) { return true; }
+
+bool flashWaitForReady(void)
+{
+    if (readCallback) {
+        void (*callback)(uint32_t length) = readCallback;
+        readCallback = NULL;
+        callback(readLength);
+    }
+    return true;
+}
+void flashFlush(void) {}
+void flashEraseCompletely(void) { flashFill(0xFF); }
+
+void flashEraseSector(uint32_t address)
+{
+    static uint8_t erased[SECTOR_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+    pwrite(flashFd, erased, SECTOR_SIZE, address - address % SECTOR_SIZE);
+    flashEraseCount++;
+}
+
+int flashReadBytes(uint32_t address, uint8_t *buffer, uint32_t length)
+{
+    flashReadCount++;
+    return pread(flashFd, buffer, length, address);
+}
+
+void flashReadBytesBegin(uint32_t address, uint8_t *buffer, uint32_t length, void (*callback)(uint32_t length))
+{
+    flashWaitForReady();
+    readLength = flashReadBytes(address, buffer, length);
+    readCallback = callback;
+}
+
+void flashPageProgram(uint32_t address, const uint8_t *data, uint32_t length, void (*callback)(uint32_t length))
+{
+    flashProgram(address, data, length);
+    if (callback) {
+        callback(length);
+    }
+}
+
+void flashPageProgramBegin(uint32_t address, void (*callback)(uint32_t arg))
+{
+    programAddress = address;
+    programCallback = callback;
+}
+
+// Like drivers/flash/flash.c, a write stops at the end of the page
+uint32_t flashPageProgramContinue(const uint8_t **buffers, uint32_t *bufferSizes, uint32_t bufferCount)
+{
+    uint32_t space = PAGE_SIZE - programAddress % PAGE_SIZE;
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < bufferCount && space; i++) {
+        const uint32_t length = MIN(bufferSizes[i], space);
+        flashProgram(programAddress + written, buffers[i], length);
+        written += length;
+        space -= length;
+    }
+    programCallback(written);
+    return written;
+}
+
+void flashPageProgramFinish(void) {}
+
+}
@@ -16,9 +16,11 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 extern "C" {
     #include "common/huffman.h"
+    #include "common/maths.h"
 }
 
 #include "unittest_macros.h"
@@ -546,6 +548,114 @@ TEST(HuffmanUnittest, TestHuffmanDecode)
     EXPECT_EQ(0x07, (int)outBuf[7]);
 }
 
+// Mirror of the firmware encoder state, as a configurator would decode a MSP_DATAFLASH_READ reply
+static int huffmanAdaptiveDecodeBuf(uint8_t *outBuf, int outCount, const uint8_t *inBuf, huffmanAdaptive_t *model)
+{
+    int bitPos = 0;
+    for (int n = 0; n < outCount; ++n) {
+        uint16_t code = 0;
+        int codeLen = 0;
+        int value = -1;
+        while (value < 0) {
+            code = (code << 1) | ((inBuf[bitPos >> 3] >> (7 - (bitPos & 7))) & 0x01);
+            ++bitPos;
+            if (++codeLen > HUFFMAN_ADAPTIVE_CODE_LEN_MAX) {
+                return -1;
+            }
+            for (int ii = 0; ii < HUFFMAN_ADAPTIVE_SYMBOL_COUNT; ++ii) {
+                if (model->table[ii].codeLen == codeLen && (model->table[ii].code >> (HUFFMAN_ADAPTIVE_CODE_LEN_MAX - codeLen)) == code) {
+                    value = ii;
+                    break;
+                }
+            }
+        }
+        outBuf[n] = value;
+        huffmanAdaptiveUpdate(model, &outBuf[n], 1);
+    }
+    return bitPos;
+}
+
+static void expectCompleteCode(const huffmanAdaptive_t *model)
+{
+    uint32_t kraftSum = 0;
+    for (int ii = 0; ii < HUFFMAN_ADAPTIVE_SYMBOL_COUNT; ++ii) {
+        EXPECT_GE(model->table[ii].codeLen, 1);
+        EXPECT_LE(model->table[ii].codeLen, HUFFMAN_ADAPTIVE_CODE_LEN_MAX);
+        kraftSum += 1 << (HUFFMAN_ADAPTIVE_CODE_LEN_MAX - model->table[ii].codeLen);
+    }
+    EXPECT_EQ(1 << HUFFMAN_ADAPTIVE_CODE_LEN_MAX, kraftSum);
+}
+
+TEST(HuffmanUnittest, TestHuffmanAdaptiveCode)
+{
+    static huffmanAdaptive_t model;
+    huffmanAdaptiveInit(&model, huffmanTable);
+    expectCompleteCode(&model);
+    // the seed keeps the trained code lengths
+    EXPECT_EQ(huffmanTable[0x00].codeLen, model.table[0x00].codeLen);
+    EXPECT_EQ(huffmanTable[0x01].codeLen, model.table[0x01].codeLen);
+
+    // the code is only rebuilt at block boundaries
+    const huffmanTable_t seedCode = model.table[0xff];
+    uint8_t block[HUFFMAN_ADAPTIVE_BLOCK_SIZE];
+    memset(block, 0xff, sizeof(block));
+    huffmanAdaptiveUpdate(&model, block, HUFFMAN_ADAPTIVE_BLOCK_SIZE - 1);
+    EXPECT_EQ(seedCode.codeLen, model.table[0xff].codeLen);
+    huffmanAdaptiveUpdate(&model, block, 1);
+    EXPECT_LT(model.table[0xff].codeLen, seedCode.codeLen);
+
+    // a single dominant symbol must still leave every other symbol a code of at most 12 bits
+    for (int ii = 0; ii < 32; ++ii) {
+        huffmanAdaptiveUpdate(&model, block, sizeof(block));
+    }
+    expectCompleteCode(&model);
+    EXPECT_EQ(1, model.table[0xff].codeLen);
+}
+
+TEST(HuffmanUnittest, TestHuffmanAdaptiveRoundTrip)
+{
+    #define ADAPTIVE_INBUF_LEN 10000
+    static uint8_t inBuf[ADAPTIVE_INBUF_LEN];
+    static uint8_t encoded[ADAPTIVE_INBUF_LEN];
+    static uint8_t decoded[ADAPTIVE_INBUF_LEN];
+
+    // bytes of small signed varints with a frame marker, loosely like blackbox data
+    uint32_t seed = 1;
+    for (int ii = 0; ii < ADAPTIVE_INBUF_LEN; ++ii) {
+        seed = seed * 1664525 + 1013904223;
+        const int magnitude = (seed >> 24) & 0x0f;
+        inBuf[ii] = (ii % 40 == 0) ? 'I' : ((seed >> 16) & 0x01) ? 2 * magnitude : 2 * magnitude + 1;
+    }
+
+    static huffmanAdaptive_t encoder;
+    huffmanAdaptiveInit(&encoder, huffmanTable);
+    huffmanState_t state = {
+        .outByte = encoded,
+        .bytesWritten = 0,
+        .outBufLen = ADAPTIVE_INBUF_LEN,
+        .outBit = 0x80,
+    };
+    *state.outByte = 0;
+    // same 256 byte chunks as the dataflash read
+    for (int ii = 0; ii < ADAPTIVE_INBUF_LEN; ii += 256) {
+        const int status = huffmanAdaptiveEncodeBufStreaming(&state, &encoder, inBuf + ii, MIN(256, ADAPTIVE_INBUF_LEN - ii));
+        EXPECT_EQ(0, status);
+    }
+    if (state.outBit != 0x80) {
+        ++state.bytesWritten;
+    }
+
+    static huffmanAdaptive_t decoder;
+    huffmanAdaptiveInit(&decoder, huffmanTable);
+    const int bitCount = huffmanAdaptiveDecodeBuf(decoded, ADAPTIVE_INBUF_LEN, encoded, &decoder);
+    EXPECT_EQ(state.bytesWritten, (bitCount + 7) / 8);
+    EXPECT_EQ(0, memcmp(inBuf, decoded, ADAPTIVE_INBUF_LEN));
+
+    // the static table is not tuned to this data, the adaptive code has to beat it
+    const int staticLen = huffmanEncodeBuf(encoded, ADAPTIVE_INBUF_LEN, inBuf, ADAPTIVE_INBUF_LEN, huffmanTable);
+    EXPECT_LT(state.bytesWritten, staticLen);
+}
+
 // STUBS
 
 extern "C" {
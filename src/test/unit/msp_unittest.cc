@@ -0,0 +1,438 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "blackbox/blackbox.h"
+    #include "build/debug.h"
+    #include "build/version.h"
+    #include "common/streambuf.h"
+    #include "config/config.h"
+    #include "config/config_snapshot.h"
+    #include "drivers/accgyro/accgyro.h"
+    #include "drivers/compass/compass.h"
+    #include "drivers/system.h"
+    #include "drivers/transponder_ir.h"
+    #include "fc/controlrate_profile.h"
+    #include "fc/core.h"
+    #include "fc/rc.h"
+    #include "fc/rc_adjustments.h"
+    #include "fc/rc_controls.h"
+    #include "fc/rc_modes.h"
+    #include "fc/runtime_config.h"
+    #include "flight/failsafe.h"
+    #include "flight/imu.h"
+    #include "flight/mixer.h"
+    #include "flight/pid.h"
+    #include "flight/pid_init.h"
+    #include "flight/position.h"
+    #include "flight/servos.h"
+    #include "io/beeper.h"
+    #include "io/gps.h"
+    #include "io/ledstrip.h"
+    #include "io/serial.h"
+    #include "io/transponder_ir.h"
+    #include "msp/msp.h"
+    #include "msp/msp_box.h"
+    #include "msp/msp_build_info.h"
+    #include "msp/msp_protocol.h"
+    #include "msp/msp_protocol_v2_betaflight.h"
+    #include "msp/msp_serial.h"
+    #include "pg/beeper.h"
+    #include "pg/gyrodev.h"
+    #include "pg/motor.h"
+    #include "pg/pg_ids.h"
+    #include "pg/rx.h"
+    #include "rx/rx.h"
+    #include "rx/msp.h"
+    #include "scheduler/scheduler.h"
+    #include "sensors/acceleration.h"
+    #include "sensors/barometer.h"
+    #include "sensors/battery.h"
+    #include "sensors/boardalignment.h"
+    #include "sensors/compass.h"
+    #include "sensors/current.h"
+    #include "sensors/gyro.h"
+    #include "sensors/gyro_init.h"
+    #include "sensors/sensors.h"
+    #include "sensors/voltage.h"
+
+    PG_REGISTER(accelerometerConfig_t, accelerometerConfig, PG_ACCELEROMETER_CONFIG, 0);
+    PG_REGISTER_ARRAY(adjustmentRange_t, MAX_ADJUSTMENT_RANGE_COUNT, adjustmentRanges, PG_ADJUSTMENT_RANGE_CONFIG, 0);
+    PG_REGISTER(armingConfig_t, armingConfig, PG_ARMING_CONFIG, 0);
+    PG_REGISTER(barometerConfig_t, barometerConfig, PG_BAROMETER_CONFIG, 0);
+    PG_REGISTER(batteryConfig_t, batteryConfig, PG_BATTERY_CONFIG, 0);
+    PG_REGISTER(beeperConfig_t, beeperConfig, PG_BEEPER_CONFIG, 0);
+    PG_REGISTER(blackboxConfig_t, blackboxConfig, PG_BLACKBOX_CONFIG, 0);
+    PG_REGISTER(boardAlignment_t, boardAlignment, PG_BOARD_ALIGNMENT, 0);
+    PG_REGISTER(compassConfig_t, compassConfig, PG_COMPASS_CONFIG, 0);
+    PG_REGISTER(currentSensorADCConfig_t, currentSensorADCConfig, PG_CURRENT_SENSOR_ADC_CONFIG, 0);
+    PG_REGISTER_ARRAY(servoMixer_t, MAX_SERVO_RULES, customServoMixers, PG_SERVO_MIXER, 0);
+    PG_REGISTER(failsafeConfig_t, failsafeConfig, PG_FAILSAFE_CONFIG, 0);
+    PG_REGISTER(flight3DConfig_t, flight3DConfig, PG_MOTOR_3D_CONFIG, 0);
+    PG_REGISTER(gpsConfig_t, gpsConfig, PG_GPS_CONFIG, 0);
+    PG_REGISTER(gyroConfig_t, gyroConfig, PG_GYRO_CONFIG, 0);
+    PG_REGISTER_ARRAY(gyroDeviceConfig_t, MAX_GYRODEV_COUNT, gyroDeviceConfig, PG_GYRO_DEVICE_CONFIG, 0);
+    PG_REGISTER(imuConfig_t, imuConfig, PG_IMU_CONFIG, 0);
+    PG_REGISTER(ledStripConfig_t, ledStripConfig, PG_LED_STRIP_CONFIG, 0);
+    PG_REGISTER(ledStripStatusModeConfig_t, ledStripStatusModeConfig, PG_LED_STRIP_STATUS_MODE_CONFIG, 0);
+    PG_REGISTER(mixerConfig_t, mixerConfig, PG_MIXER_CONFIG, 0);
+    PG_REGISTER_ARRAY(modeActivationCondition_t, MAX_MODE_ACTIVATION_CONDITION_COUNT, modeActivationConditions, PG_MODE_ACTIVATION_PROFILE, 0);
+    PG_REGISTER(motorConfig_t, motorConfig, PG_MOTOR_CONFIG, 0);
+    PG_REGISTER(pidConfig_t, pidConfig, PG_PID_CONFIG, 0);
+    PG_REGISTER(pilotConfig_t, pilotConfig, PG_PILOT_CONFIG, 0);
+    PG_REGISTER(rcControlsConfig_t, rcControlsConfig, PG_RC_CONTROLS_CONFIG, 0);
+    PG_REGISTER(rxConfig_t, rxConfig, PG_RX_CONFIG, 0);
+    PG_REGISTER_ARRAY(rxFailsafeChannelConfig_t, MAX_SUPPORTED_RC_CHANNEL_COUNT, rxFailsafeChannelConfigs, PG_RX_FAILSAFE_CHANNEL_CONFIG, 0);
+    PG_REGISTER(serialConfig_t, serialConfig, PG_SERIAL_CONFIG, 0);
+    PG_REGISTER_ARRAY(servoParam_t, MAX_SUPPORTED_SERVOS, servoParams, PG_SERVO_PARAMS, 0);
+    PG_REGISTER(systemConfig_t, systemConfig, PG_SYSTEM_CONFIG, 0);
+    PG_REGISTER(transponderConfig_t, transponderConfig, PG_TRANSPONDER_CONFIG, 0);
+    PG_REGISTER_ARRAY(voltageSensorADCConfig_t, MAX_VOLTAGE_SENSOR_ADC, voltageSensorADCConfig, PG_VOLTAGE_SENSOR_ADC_CONFIG, 0);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define TEST_MSP_DESCRIPTOR 1
+
+static int subscribeCount;
+static uint16_t subscribedIntervalMs;
+static uint8_t subscribedRequest[MSP_PORT_SUBSCRIPTION_SIZE];
+static int subscribedRequestSize;
+
+static int eepromWriteCount;
+static int rcFrameCount;
+static int systemResetCount;
+
+static void resetStubs(void)
+{
+    subscribeCount = 0;
+    subscribedIntervalMs = 0;
+    subscribedRequestSize = 0;
+    eepromWriteCount = 0;
+    rcFrameCount = 0;
+    systemResetCount = 0;
+}
+
+static void writeCommand(sbuf_t *request, uint16_t cmd, const uint8_t *payload, uint8_t payloadSize)
+{
+    sbufWriteU16(request, cmd);
+    sbufWriteU8(request, payloadSize);
+    for (int i = 0; i < payloadSize; i++) {
+        sbufWriteU8(request, payload[i]);
+    }
+}
+
+// Sends MSP2_MULTIPLE_MSP_SUBSCRIBE with the MSP2_MULTIPLE_MSP request built from the commands and their payloads
+static mspResult_e subscribe(uint16_t intervalMs, const uint16_t *cmds, const uint8_t *payload, uint8_t payloadSize, int cmdCount, int *replySize)
+{
+    static uint8_t requestBuf[256];
+    static uint8_t replyBuf[1024];
+
+    sbuf_t request;
+    sbufInit(&request, requestBuf, ARRAYEND(requestBuf));
+    sbufWriteU16(&request, intervalMs);
+    for (int i = 0; i < cmdCount; i++) {
+        writeCommand(&request, cmds[i], payload, payloadSize);
+    }
+
+    mspPacket_t cmd = {
+        .buf = { .ptr = requestBuf, .end = sbufPtr(&request), },
+        .cmd = MSP2_MULTIPLE_MSP_SUBSCRIBE,
+        .result = 0,
+        .flags = 0,
+        .direction = MSP_DIRECTION_REQUEST,
+    };
+    mspPacket_t reply = {
+        .buf = { .ptr = replyBuf, .end = ARRAYEND(replyBuf), },
+        .cmd = -1,
+        .result = 0,
+        .flags = 0,
+        .direction = MSP_DIRECTION_REPLY,
+    };
+    mspPostProcessFnPtr postProcessFn = NULL;
+
+    const mspResult_e result = mspFcProcessCommand(TEST_MSP_DESCRIPTOR, &cmd, &reply, &postProcessFn);
+    EXPECT_EQ(NULL, postProcessFn);
+    *replySize = sbufPtr(&reply.buf) - replyBuf;
+
+    return result;
+}
+
+TEST(MspUnittest, TestSubscribeToReadOnlyCommands)
+{
+    resetStubs();
+
+    // getters with and without arguments
+    static const uint16_t cmds[] = { MSP_API_VERSION, MSP_STATUS, MSP_ANALOG, MSP_BOXIDS, MSP2_GET_TEXT };
+    static const uint8_t payload[] = { MSP2TEXT_CRAFT_NAME };
+    int replySize;
+    EXPECT_EQ(MSP_RESULT_ACK, subscribe(100, cmds, payload, sizeof(payload), ARRAYLEN(cmds), &replySize));
+    EXPECT_EQ(0, replySize);
+
+    EXPECT_EQ(1, subscribeCount);
+    EXPECT_EQ(100, subscribedIntervalMs);
+    EXPECT_EQ((int)ARRAYLEN(cmds) * (2 + 1 + (int)sizeof(payload)), subscribedRequestSize);
+    EXPECT_EQ(MSP_API_VERSION, subscribedRequest[0] | (subscribedRequest[1] << 8));
+}
+
+TEST(MspUnittest, TestSubscribeRejectsCommandsWhichChangeState)
+{
+    static const uint8_t payload[] = { 0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05, 0xe8, 0x03 };
+    static const uint16_t setters[] = {
+        MSP_SET_RAW_RC,
+        MSP_SET_MOTOR,
+        MSP_EEPROM_WRITE,
+        MSP_REBOOT,
+        MSP_RESET_CONF,
+        MSP_SET_ARMING_DISABLED,
+        MSP_ACC_CALIBRATION,
+        MSP2_SET_CONFIG_SNAPSHOT,
+        MSP2_RESET_TASK_HISTOGRAMS,
+        MSP_DATAFLASH_ERASE,
+        MSP_MULTIPLE_MSP,
+        MSP2_MULTIPLE_MSP,
+        MSP2_MULTIPLE_MSP_SUBSCRIBE,
+    };
+
+    for (unsigned i = 0; i < ARRAYLEN(setters); i++) {
+        resetStubs();
+
+        // on its own, and hidden behind a getter
+        const uint16_t cmds[] = { MSP_API_VERSION, setters[i] };
+        int replySize;
+        EXPECT_EQ(MSP_RESULT_ERROR, subscribe(100, &setters[i], payload, sizeof(payload), 1, &replySize));
+        EXPECT_EQ(0, replySize);
+        EXPECT_EQ(MSP_RESULT_ERROR, subscribe(100, cmds, payload, sizeof(payload), ARRAYLEN(cmds), &replySize));
+        EXPECT_EQ(0, replySize);
+
+        EXPECT_EQ(0, subscribeCount);
+        EXPECT_EQ(0, eepromWriteCount);
+        EXPECT_EQ(0, rcFrameCount);
+        EXPECT_EQ(0, systemResetCount);
+    }
+}
+
+TEST(MspUnittest, TestSubscribeRejectsUnknownCommands)
+{
+    resetStubs();
+
+    static const uint16_t cmds[] = { MSP_API_VERSION, 0x7fff };
+    int replySize;
+    EXPECT_EQ(MSP_RESULT_ERROR, subscribe(100, cmds, NULL, 0, ARRAYLEN(cmds), &replySize));
+    EXPECT_EQ(0, subscribeCount);
+}
+
+TEST(MspUnittest, TestCancelSubscription)
+{
+    resetStubs();
+
+    // an empty request cancels
+    int replySize;
+    EXPECT_EQ(MSP_RESULT_ACK, subscribe(0, NULL, NULL, 0, 0, &replySize));
+    EXPECT_EQ(1, subscribeCount);
+    EXPECT_EQ(0, subscribedRequestSize);
+}
+
+TEST(MspUnittest, TestBatchStopsAtReplyWhichDoesNotFit)
+{
+    resetStubs();
+
+    static uint8_t requestBuf[64];
+    sbuf_t request;
+    sbufInit(&request, requestBuf, ARRAYEND(requestBuf));
+    writeCommand(&request, MSP_API_VERSION, NULL, 0);
+    writeCommand(&request, MSP_PIDNAMES, NULL, 0);
+
+    // room for the header and reply of MSP_API_VERSION, but not for MSP_PIDNAMES, then a guard which must be left alone
+    uint8_t replyBuf[5 + 3 + 12 + 16];
+    memset(replyBuf, 0xa5, sizeof(replyBuf));
+    mspPacket_t cmd = {
+        .buf = { .ptr = requestBuf, .end = sbufPtr(&request), },
+        .cmd = MSP2_MULTIPLE_MSP,
+        .result = 0,
+        .flags = 0,
+        .direction = MSP_DIRECTION_REQUEST,
+    };
+    mspPacket_t reply = {
+        .buf = { .ptr = replyBuf, .end = replyBuf + 5 + 3 + 12, },
+        .cmd = -1,
+        .result = 0,
+        .flags = 0,
+        .direction = MSP_DIRECTION_REPLY,
+    };
+
+    EXPECT_EQ(MSP_RESULT_ACK, mspFcProcessCommand(TEST_MSP_DESCRIPTOR, &cmd, &reply, NULL));
+    EXPECT_EQ(5 + 3, sbufPtr(&reply.buf) - replyBuf);
+    EXPECT_EQ(MSP_API_VERSION, replyBuf[0] | (replyBuf[1] << 8));
+    EXPECT_EQ(3, replyBuf[3] | (replyBuf[4] << 8));
+    for (unsigned i = 5 + 3; i < sizeof(replyBuf); i++) {
+        EXPECT_EQ(0xa5, replyBuf[i]);
+    }
+}
+
+// STUBS
+extern "C" {
+
+uint8_t debugMode;
+int16_t debug[DEBUG16_VALUE_COUNT];
+
+const char * const targetName = "UNITTEST";
+const char * const buildDate = "Jan 01 2017";
+const char * const buildTime = "00:00:00";
+const char * const shortGitRevision = "MASTER";
+const char * const buildKey = NULL;
+const char * const releaseName = NULL;
+
+acc_t acc;
+attitudeEulerAngles_t attitude;
+gyro_t gyro;
+mag_t mag;
+int16_t magHold;
+float rcData[MAX_SUPPORTED_RC_CHANNEL_COUNT];
+float motor_disarmed[MAX_SUPPORTED_MOTORS];
+int16_t servo[MAX_SUPPORTED_SERVOS];
+uint8_t detectedSensors[SENSOR_INDEX_COUNT];
+rxRuntimeState_t rxRuntimeState;
+rssiSource_e rssiSource;
+controlRateConfig_t *currentControlRateProfile;
+pidProfile_t *currentPidProfile;
+const char pidNames[] = "ROLL;PITCH;YAW;LEVEL;MAG;";
+
+gpsSolutionData_t gpsSol;
+int16_t GPS_directionToHome;
+uint16_t GPS_distanceToHome;
+uint8_t GPS_numCh;
+uint8_t GPS_svinfo_chn[GPS_SV_MAXSATS_M8N];
+uint8_t GPS_svinfo_cno[GPS_SV_MAXSATS_M8N];
+uint8_t GPS_svinfo_quality[GPS_SV_MAXSATS_M8N];
+uint8_t GPS_svinfo_svid[GPS_SV_MAXSATS_M8N];
+uint8_t GPS_update;
+
+const uint8_t voltageMeterIds[] = { VOLTAGE_METER_ID_BATTERY_1 };
+const uint8_t supportedVoltageMeterCount = ARRAYLEN(voltageMeterIds);
+const uint8_t voltageMeterADCtoIDMap[MAX_VOLTAGE_SENSOR_ADC] = { VOLTAGE_METER_ID_BATTERY_1 };
+const uint8_t currentMeterIds[] = { CURRENT_METER_ID_BATTERY_1 };
+const uint8_t supportedCurrentMeterCount = ARRAYLEN(currentMeterIds);
+const transponderRequirement_t transponderRequirements[TRANSPONDER_PROVIDER_COUNT] = {};
+
+bool mspSerialSubscribe(mspDescriptor_t descriptor, const uint8_t *request, int requestSize, uint16_t intervalMs)
+{
+    EXPECT_EQ(TEST_MSP_DESCRIPTOR, descriptor);
+    subscribeCount++;
+    subscribedIntervalMs = intervalMs;
+    subscribedRequestSize = requestSize;
+    memcpy(subscribedRequest, request, MIN(requestSize, (int)sizeof(subscribedRequest)));
+    return true;
+}
+
+void writeEEPROMInBackground(eepromWriteCallbackFn *) { eepromWriteCount++; }
+void rxMspFrameReceive(const uint16_t *, int) { rcFrameCount++; }
+void systemReset(void) { systemResetCount++; }
+void systemResetToBootloader(bootloaderRequestType_e) { systemResetCount++; }
+
+void accStartCalibration(void) {}
+bool accHasBeenCalibrated(void) { return true; }
+void compassStartCalibration(void) {}
+void activeAdjustmentRangeReset(void) {}
+void applyConfig(void) {}
+void beeperConfirmationBeeps(uint8_t) {}
+int blackboxCalculatePDenom(int, int) { return 1; }
+uint8_t blackboxCalculateSampleRate(uint16_t) { return 0; }
+uint16_t blackboxGetPRatio(void) { return 1; }
+uint8_t blackboxGetRateDenom(void) { return 1; }
+bool blackboxMayEditConfig(void) { return true; }
+void changeControlRateProfile(uint8_t) {}
+void changePidProfile(uint8_t) {}
+bool checkMotorProtocolEnabled(const motorDevConfig_t *, bool *) { return false; }
+int configSnapshotRead(uint32_t, uint8_t *, int) { return 0; }
+bool configSnapshotRestoreBegin(uint32_t) { return false; }
+bool configSnapshotRestoreIsComplete(void) { return false; }
+bool configSnapshotRestoreWrite(uint32_t, const uint8_t *, int) { return false; }
+uint32_t configSnapshotSize(void) { return 0; }
+void copyControlRateProfile(const uint8_t, const uint8_t) {}
+void currentMeterRead(currentMeterId_e, currentMeter_t *currentMeter) { memset(currentMeter, 0, sizeof(*currentMeter)); }
+void voltageMeterRead(voltageMeterId_e, voltageMeter_t *voltageMeter) { memset(voltageMeter, 0, sizeof(*voltageMeter)); }
+void disarm(flightLogDisarmReason_e) {}
+static const box_t boxes[] = { { "DUMMYBOX", 0, 0 } };
+const box_t *findBoxByBoxId(boxId_e) { return &boxes[0]; }
+const box_t *findBoxByPermanentId(uint8_t) { return &boxes[0]; }
+int serializeBoxNameFn(sbuf_t *, const box_t *) { return 0; }
+int serializeBoxPermanentIdFn(sbuf_t *, const box_t *) { return 0; }
+void serializeBoxReply(sbuf_t *dst, int, serializeBoxFn *) { sbufWriteU8(dst, 0); }
+int packFlightModeFlags(boxBitmask_t *) { return 0; }
+void initActiveBoxIds(void) {}
+const serialPortConfig_t *findSerialPortConfig(serialPortFunction_e) { return NULL; }
+serialPortUsage_t *findSerialPortUsageByIdentifier(serialPortIdentifier_e) { return NULL; }
+serialPortConfig_t *serialFindPortConfigurationMutable(serialPortIdentifier_e) { return NULL; }
+bool serialIsPortAvailable(serialPortIdentifier_e) { return false; }
+void serialPassthrough(serialPort_t *, serialPort_t *, serialConsumer *, serialConsumer *) {}
+void finishEepromWrite(void) {}
+bool readEEPROM(void) { return true; }
+bool resetEEPROM(void) { return true; }
+int32_t getAmperage(void) { return 0; }
+int32_t getMAhDrawn(void) { return 0; }
+uint16_t getBatteryVoltage(void) { return 0; }
+uint16_t getLegacyBatteryVoltage(void) { return 0; }
+uint8_t getBatteryCellCount(void) { return 0; }
+batteryState_e getBatteryState(void) { return BATTERY_OK; }
+uint16_t getAverageSystemLoadPercent(void) { return 0; }
+uint8_t getCurrentControlRateProfileIndex(void) { return 0; }
+uint8_t getCurrentPidProfileIndex(void) { return 0; }
+int32_t getEstimatedAltitudeCm(void) { return 0; }
+gyroDetectionFlags_t getGyroDetectionFlags(void) { return GYRO_NONE_MASK; }
+mcuTypeId_e getMcuTypeId(void) { return MCU_TYPE_UNKNOWN; }
+uint8_t getMotorCount(void) { return 4; }
+bool getRebootRequired(void) { return false; }
+void setRebootRequired(void) {}
+uint16_t getRssi(void) { return 0; }
+void setRssiMsp(uint8_t) {}
+timeDelta_t getTaskDeltaTimeUs(taskId_e) { return 0; }
+void schedulerIgnoreTaskStateTime(void) {}
+void gpsSetFixState(bool) {}
+void gyroInitFilters(void) {}
+int16_t gyroRateDps(int) { return 0; }
+void validateAndFixGyroConfig(void) {}
+void initEscEndpoints(void) {}
+void initRcProcessing(void) {}
+void rcControlsInit(void) {}
+void loadCustomServoMixer(void) {}
+void mixerInitProfile(void) {}
+float motorConvertFromExternal(uint16_t) { return 0.0f; }
+void motorShutdown(void) {}
+void pidCopyProfile(uint8_t, uint8_t) {}
+void pidInitConfig(const pidProfile_t *) {}
+void pidInitFilters(const pidProfile_t *) {}
+void resetPidProfile(pidProfile_t *) {}
+void reevaluateLedConfig(void) {}
+bool setModeColor(ledModeIndex_e, int, int) { return false; }
+void sbufWriteBuildInfoFlags(sbuf_t *) {}
+void transponderStopRepeating(void) {}
+void transponderUpdateData(void) {}
+
+}
@@ -120,6 +120,14 @@ typedef struct
 #define MCU_TYPE_ID   99
 #define MCU_TYPE_NAME "UNIT_TEST"
 
+#ifdef CONFIG_IN_RAM
+#define FLASH_PAGE_SIZE 0x400
+#define EEPROM_SIZE     1024
+extern uint8_t eepromData[EEPROM_SIZE];
+#define __config_start (*eepromData)
+#define __config_end (eepromData[EEPROM_SIZE])
+#endif
+
 #include "target.h"
 
 #include "target/common_defaults_post.h"
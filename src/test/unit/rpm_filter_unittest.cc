@@ -0,0 +1,247 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <math.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "build/debug.h"
+
+    #include "common/axis.h"
+    #include "common/filter.h"
+    #include "common/maths.h"
+
+    #include "drivers/dshot.h"
+
+    #include "flight/mixer.h"
+    #include "flight/rpm_filter.h"
+
+    #include "pg/rpm_filter.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define LOOPTIME_US 125
+
+static int motorCount;
+static float motorHz[MAX_SUPPORTED_MOTORS];
+
+// The per-axis, per-motor biquadFilter_t bank the notch bank replaced, as rpmFilterUpdate() and rpmFilterApply()
+// used to run it
+static struct {
+    int numHarmonics;
+    float weights[RPM_FILTER_HARMONICS_MAX];
+    float minHz;
+    float maxHz;
+    float fadeRangeHz;
+    float q;
+    int notchUpdatesPerIteration;
+    int motorIndex;
+    int harmonicIndex;
+    biquadFilter_t notch[XYZ_AXIS_COUNT][MAX_SUPPORTED_MOTORS][RPM_FILTER_HARMONICS_MAX];
+} reference;
+
+static void referenceInit(const rpmFilterConfig_t *config)
+{
+    memset(&reference, 0, sizeof(reference));
+    reference.numHarmonics = config->rpm_filter_harmonics;
+    reference.minHz = config->rpm_filter_min_hz;
+    reference.maxHz = 0.48f * 1e6f / LOOPTIME_US;
+    reference.fadeRangeHz = config->rpm_filter_fade_range_hz;
+    reference.q = config->rpm_filter_q / 100.0f;
+    for (int n = 0; n < RPM_FILTER_HARMONICS_MAX; n++) {
+        reference.weights[n] = constrainf(config->rpm_filter_weights[n] / 100.0f, 0.0f, 1.0f);
+    }
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        for (int motor = 0; motor < motorCount; motor++) {
+            for (int i = 0; i < reference.numHarmonics; i++) {
+                biquadFilterInit(&reference.notch[axis][motor][i], reference.minHz * i, LOOPTIME_US, reference.q, FILTER_NOTCH, 0.0f);
+            }
+        }
+    }
+    const float loopIterationsPerUpdate = 0.001f / (LOOPTIME_US * 1e-6f);
+    reference.notchUpdatesPerIteration = ceilf(motorCount * reference.numHarmonics / loopIterationsPerUpdate);
+}
+
+static void referenceUpdate(void)
+{
+    for (int i = 0; i < reference.notchUpdatesPerIteration; i++) {
+        const int h = reference.harmonicIndex;
+        const int m = reference.motorIndex;
+        if (reference.weights[h] > 0.0f) {
+            biquadFilter_t *roll = &reference.notch[0][m][h];
+            const float frequencyHz = constrainf((h + 1) * motorHz[m], reference.minHz, reference.maxHz);
+            const float marginHz = frequencyHz - reference.minHz;
+            float weight = 1.0f;
+            if (marginHz < reference.fadeRangeHz) {
+                weight *= marginHz / reference.fadeRangeHz;
+            }
+            weight *= reference.weights[h];
+            biquadFilterUpdate(roll, frequencyHz, LOOPTIME_US, reference.q, FILTER_NOTCH, weight);
+            for (int axis = 1; axis < XYZ_AXIS_COUNT; axis++) {
+                biquadFilter_t *dest = &reference.notch[axis][m][h];
+                dest->b0 = roll->b0;
+                dest->b1 = roll->b1;
+                dest->b2 = roll->b2;
+                dest->a1 = roll->a1;
+                dest->a2 = roll->a2;
+                dest->weight = roll->weight;
+            }
+        }
+        reference.harmonicIndex = (h + 1) % reference.numHarmonics;
+        if (reference.harmonicIndex == 0) {
+            reference.motorIndex = (m + 1) % motorCount;
+        }
+    }
+}
+
+static float referenceApply(int axis, float value)
+{
+    for (int i = 0; i < reference.numHarmonics; i++) {
+        if (reference.weights[i] <= 0.0f) {
+            continue;
+        }
+        for (int motor = 0; motor < motorCount; motor++) {
+            value = biquadFilterApplyDF1Weighted(&reference.notch[axis][motor][i], value);
+        }
+    }
+    return value;
+}
+
+static rpmFilterConfig_t testConfig(int harmonics, uint8_t weight0, uint8_t weight1, uint8_t weight2)
+{
+    rpmFilterConfig_t config;
+    memset(&config, 0, sizeof(config));
+    config.rpm_filter_harmonics = harmonics;
+    config.rpm_filter_weights[0] = weight0;
+    config.rpm_filter_weights[1] = weight1;
+    config.rpm_filter_weights[2] = weight2;
+    config.rpm_filter_min_hz = 100;
+    config.rpm_filter_fade_range_hz = 50;
+    config.rpm_filter_q = 500;
+    return config;
+}
+
+// Runs both banks over gyro noise at the motor frequencies and returns the largest difference from sample skip on
+static float maxDifferenceToReference(const rpmFilterConfig_t *config, int sampleCount, bool sweep, int skip)
+{
+    useDshotTelemetry = true;
+    rpmFilterInit(config, LOOPTIME_US);
+    referenceInit(config);
+
+    float maxError = 0.0f;
+    for (int sample = 0; sample < sampleCount; sample++) {
+        const float t = sample * LOOPTIME_US * 1e-6f;
+        for (int motor = 0; motor < motorCount; motor++) {
+            // between 80Hz and 480Hz, so the lowest notches fade in and out
+            motorHz[motor] = 280.0f + 200.0f * (sweep ? sin_approx(0.5f * t + motor * 0.7f) : 0.3f * motor - 0.5f);
+        }
+
+        float gyro[XYZ_AXIS_COUNT];
+        float expected[XYZ_AXIS_COUNT];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyro[axis] = 50.0f * sinf(2.0f * M_PIf * motorHz[axis] * t) + 20.0f * sinf(2.0f * M_PIf * 3 * motorHz[axis + 1] * t) + 10.0f * axis;
+            expected[axis] = gyro[axis];
+        }
+
+        referenceUpdate();
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            expected[axis] = referenceApply(axis, expected[axis]);
+        }
+        rpmFilterUpdate();
+        rpmFilterApply(gyro);
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            EXPECT_TRUE(isfinite(gyro[axis]));
+            if (sample >= skip) {
+                maxError = fmaxf(maxError, fabsf(gyro[axis] - expected[axis]));
+            }
+        }
+    }
+
+    return maxError;
+}
+
+TEST(RpmFilterUnittest, TestNotchBankMatchesPerMotorFilters)
+{
+    // every harmonic weighted, so both banks update the same notch on every loop and give the same output
+    motorCount = 4;
+    rpmFilterConfig_t config = testConfig(3, 100, 100, 80);
+    EXPECT_GT(1e-4f, maxDifferenceToReference(&config, 20000, true, 0));
+
+    motorCount = 8;
+    EXPECT_GT(1e-4f, maxDifferenceToReference(&config, 20000, true, 0));
+
+    config = testConfig(1, 60, 0, 0);
+    EXPECT_GT(1e-4f, maxDifferenceToReference(&config, 20000, true, 0));
+}
+
+TEST(RpmFilterUnittest, TestNotchBankSkipsUnweightedHarmonics)
+{
+    // A harmonic with no weight has no notches in the bank, so the notches are updated sooner than the per-motor
+    // filters did. With the motors at a steady speed both settle on the same coefficients and the same output.
+    motorCount = 4;
+    rpmFilterConfig_t config = testConfig(3, 100, 0, 80);
+    EXPECT_GT(1e-3f, maxDifferenceToReference(&config, 8000, false, 4000));
+    EXPECT_TRUE(isRpmFilterEnabled());
+}
+
+TEST(RpmFilterUnittest, TestDisabled)
+{
+    motorCount = 4;
+
+    // no harmonic has a weight
+    rpmFilterConfig_t config = testConfig(3, 0, 0, 0);
+    useDshotTelemetry = true;
+    rpmFilterInit(&config, LOOPTIME_US);
+    EXPECT_FALSE(isRpmFilterEnabled());
+
+    // no RPM telemetry
+    config = testConfig(3, 100, 100, 80);
+    useDshotTelemetry = false;
+    rpmFilterInit(&config, LOOPTIME_US);
+    EXPECT_FALSE(isRpmFilterEnabled());
+
+    float gyro[XYZ_AXIS_COUNT] = { 1.0f, -2.0f, 3.0f };
+    rpmFilterUpdate();
+    rpmFilterApply(gyro);
+    EXPECT_FLOAT_EQ(1.0f, gyro[0]);
+    EXPECT_FLOAT_EQ(-2.0f, gyro[1]);
+    EXPECT_FLOAT_EQ(3.0f, gyro[2]);
+}
+
+// STUBS
+extern "C" {
+
+uint8_t debugMode;
+int16_t debug[DEBUG16_VALUE_COUNT];
+bool useDshotTelemetry;
+
+uint8_t getMotorCount(void) { return motorCount; }
+float getMotorFrequencyHz(uint8_t motorIndex) { return motorHz[motorIndex]; }
+
+}
@@ -554,3 +554,55 @@ TEST(SchedulerUnittest, TestGyroTask)
     EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask);
 }
 
+
+TEST(SchedulerUnittest, TestTaskHistograms)
+{
+    schedulerInit();
+    taskHistogram_t histogram;
+    EXPECT_TRUE(getTaskHistogram(TASK_FILTER, &histogram));
+    for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+        EXPECT_EQ(0, histogram.executionTimeUs[i]);
+        EXPECT_EQ(0, histogram.startJitterUs[i]);
+    }
+
+    // only the realtime loop keeps histograms
+    EXPECT_FALSE(getTaskHistogram(TASK_ACCEL, &histogram));
+    schedulerExecuteTask(&tasks[TASK_ACCEL], simulatedTime);
+
+    // started 5us late, and runs for 40us
+    const timeDelta_t filterPeriodUs = tasks[TASK_FILTER].attribute->desiredPeriodUs;
+    tasks[TASK_FILTER].lastExecutedAtUs = 1000;
+    simulatedTime = 1000 + filterPeriodUs + 5;
+    schedulerExecuteTask(&tasks[TASK_FILTER], simulatedTime);
+
+    // started 1us early
+    simulatedTime = tasks[TASK_FILTER].lastExecutedAtUs + filterPeriodUs - 1;
+    schedulerExecuteTask(&tasks[TASK_FILTER], simulatedTime);
+
+    EXPECT_TRUE(getTaskHistogram(TASK_FILTER, &histogram));
+    EXPECT_EQ(2, histogram.executionTimeUs[6]);     // [32, 64)
+    EXPECT_EQ(1, histogram.startJitterUs[3]);       // [4, 8)
+    EXPECT_EQ(1, histogram.startJitterUs[1]);       // [1, 2)
+
+    // a task that has not run before has no period, so no jitter
+    tasks[TASK_GYRO].lastExecutedAtUs = 0;
+    schedulerExecuteTask(&tasks[TASK_GYRO], simulatedTime);
+    EXPECT_TRUE(getTaskHistogram(TASK_GYRO, &histogram));
+    EXPECT_EQ(1, histogram.executionTimeUs[4]);     // [8, 16)
+    for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+        EXPECT_EQ(0, histogram.startJitterUs[i]);
+    }
+
+    // anything from 1024us up goes into the last bucket
+    tasks[TASK_FILTER].lastExecutedAtUs = simulatedTime - 100000;
+    schedulerExecuteTask(&tasks[TASK_FILTER], simulatedTime);
+    EXPECT_TRUE(getTaskHistogram(TASK_FILTER, &histogram));
+    EXPECT_EQ(1, histogram.startJitterUs[TASK_HISTOGRAM_BUCKET_COUNT - 1]);
+
+    schedulerResetTaskHistogram(TASK_FILTER);
+    EXPECT_TRUE(getTaskHistogram(TASK_FILTER, &histogram));
+    for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+        EXPECT_EQ(0, histogram.executionTimeUs[i]);
+        EXPECT_EQ(0, histogram.startJitterUs[i]);
+    }
+}
@@ -0,0 +1,206 @@
+/*
+ * This file is part of Betaflight.
+ *
+ * Betaflight is free software. You can redistribute this software
+ * and/or modify this software under the terms of the GNU General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * Betaflight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <math.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/maths.h"
+    #include "common/sdft.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define PEAK_COUNT_MAX 12
+
+// The window and noise sum of STEP_WINDOW and the peak search of STEP_DETECT_PEAKS, as dynNotchProcess() ran them
+// before sdftWinSqPeaks()
+static float referenceWinSqPeaks(const sdft_t *sdft, float *data, sdftPeak_t *peaks, const int peakCount)
+{
+    sdftWinSq(sdft, data);
+
+    float noise = 0.0f;
+    for (int bin = sdft->startBin; bin <= sdft->endBin; bin++) {
+        noise += data[bin];
+    }
+
+    for (int p = 0; p < peakCount; p++) {
+        peaks[p].bin = 0;
+        peaks[p].value = 0.0f;
+    }
+
+    for (int bin = (sdft->startBin + 1); bin < sdft->endBin; bin++) {
+        if ((data[bin] > data[bin - 1]) && (data[bin] > data[bin + 1])) {
+            for (int p = 0; p < peakCount; p++) {
+                if (data[bin] > peaks[p].value) {
+                    for (int k = peakCount - 1; k > p; k--) {
+                        peaks[k] = peaks[k - 1];
+                    }
+                    peaks[p].bin = bin;
+                    peaks[p].value = data[bin];
+                    break;
+                }
+            }
+            bin++;
+        }
+    }
+
+    for (int p = peakCount - 1; p > 0; p--) {
+        for (int k = 0; k < p; k++) {
+            if (peaks[k].bin > peaks[k + 1].bin && peaks[k + 1].bin != 0) {
+                sdftPeak_t temp = peaks[k];
+                peaks[k] = peaks[k + 1];
+                peaks[k + 1] = temp;
+            }
+        }
+    }
+
+    return noise;
+}
+
+static void expectSamePeaks(const sdft_t *sdft, const int peakCount)
+{
+    float referenceData[SDFT_BIN_COUNT];
+    float data[SDFT_BIN_COUNT];
+    sdftPeak_t referencePeaks[PEAK_COUNT_MAX];
+    sdftPeak_t peaks[PEAK_COUNT_MAX];
+
+    const float referenceNoise = referenceWinSqPeaks(sdft, referenceData, referencePeaks, peakCount);
+    const float noise = sdftWinSqPeaks(sdft, data, peaks, peakCount);
+
+    EXPECT_EQ(referenceNoise, noise);
+    for (int bin = sdft->startBin; bin <= sdft->endBin; bin++) {
+        EXPECT_EQ(referenceData[bin], data[bin]);
+    }
+    for (int p = 0; p < peakCount; p++) {
+        EXPECT_EQ(referencePeaks[p].bin, peaks[p].bin);
+        EXPECT_EQ(referencePeaks[p].value, peaks[p].value);
+    }
+}
+
+// Sets the spectrum directly, so that the windowed power of bin i follows power[i]
+static void setSpectrum(sdft_t *sdft, const float *magnitude)
+{
+    for (int bin = 0; bin < SDFT_BIN_COUNT; bin++) {
+        // a complex float is laid out as its real and imaginary parts
+        float *parts = reinterpret_cast<float *>(&sdft->data[bin]);
+        parts[0] = (bin % 2) ? -magnitude[bin] : magnitude[bin];
+        parts[1] = 0.0f;
+    }
+}
+
+TEST(SdftUnittest, TestWinSqPeaksMatchesReferenceOnGyroNoise)
+{
+    static const int peakCounts[] = { 1, 3, 7, 12 };
+
+    for (const int peakCount : peakCounts) {
+        // bins 5 to 32 are the default 100Hz to 600Hz dyn notch range at 8kHz
+        sdft_t sdft;
+        sdftInit(&sdft, 5, 32, 1);
+
+        uint32_t seed = 12345;
+        for (int sample = 0; sample < 4000; sample++) {
+            const float t = sample / 1333.3f;
+            float value = 0.0f;
+            for (int tone = 0; tone < 4; tone++) {
+                // motor tones sweep through the range at different strengths
+                const float hz = 250.0f + 60.0f * tone + 80.0f * sin_approx(0.3f * t + tone);
+                value += (40.0f - 8.0f * tone) * sin_approx(fmodf(2.0f * M_PIf * hz * t, 2.0f * M_PIf) - M_PIf);
+            }
+            seed = seed * 1664525u + 1013904223u;
+            value += ((int32_t)(seed >> 8) % 2000) * 0.01f;
+            sdftPush(&sdft, value);
+
+            expectSamePeaks(&sdft, peakCount);
+        }
+    }
+}
+
+TEST(SdftUnittest, TestWinSqPeaksMatchesReferenceOnEdgeCases)
+{
+    sdft_t sdft;
+    float magnitude[SDFT_BIN_COUNT];
+
+    // whole spectrum, so that the window takes the edge bins as they are
+    sdftInit(&sdft, 0, SDFT_BIN_COUNT - 1, 1);
+
+    // flat, no peaks at all
+    for (int bin = 0; bin < SDFT_BIN_COUNT; bin++) {
+        magnitude[bin] = 1.0f;
+    }
+    setSpectrum(&sdft, magnitude);
+    expectSamePeaks(&sdft, 3);
+
+    // more peaks than wanted, of equal height, where the lower bins win
+    for (int bin = 0; bin < SDFT_BIN_COUNT; bin++) {
+        magnitude[bin] = (bin % 4 == 2) ? 10.0f : 1.0f;
+    }
+    setSpectrum(&sdft, magnitude);
+    expectSamePeaks(&sdft, 3);
+    expectSamePeaks(&sdft, PEAK_COUNT_MAX);
+
+    // fewer peaks than wanted, one on a plateau that is not a peak and one next to the upper edge
+    for (int bin = 0; bin < SDFT_BIN_COUNT; bin++) {
+        magnitude[bin] = 1.0f;
+    }
+    magnitude[6] = 5.0f;
+    magnitude[12] = magnitude[13] = 8.0f;
+    magnitude[20] = 3.0f;
+    magnitude[SDFT_BIN_COUNT - 2] = 6.0f;
+    setSpectrum(&sdft, magnitude);
+    expectSamePeaks(&sdft, 7);
+
+    // peaks rising to the top of a narrow range
+    sdftInit(&sdft, 10, 16, 1);
+    for (int bin = 0; bin < SDFT_BIN_COUNT; bin++) {
+        magnitude[bin] = bin;
+    }
+    magnitude[13] = 20.0f;
+    setSpectrum(&sdft, magnitude);
+    expectSamePeaks(&sdft, 1);
+    expectSamePeaks(&sdft, 3);
+}
+
+TEST(SdftUnittest, TestWinSqPeaksMatchesReferenceAcrossBothHalves)
+{
+    sdft_t sdft;
+    float magnitude[SDFT_BIN_COUNT];
+
+    // sdftWinSqPeaksLow() and sdftWinSqPeaksHigh() split the range in the middle, so move a peak and its
+    // neighbour across that split for every range width from a single bin up
+    for (int endBin = 10; endBin <= 20; endBin++) {
+        sdftInit(&sdft, 10, endBin, 1);
+        for (int peakBin = 9; peakBin <= endBin + 1; peakBin++) {
+            for (int bin = 0; bin < SDFT_BIN_COUNT; bin++) {
+                magnitude[bin] = (bin == peakBin) ? 5.0f : (bin == peakBin + 2) ? 4.0f : 1.0f;
+            }
+            setSpectrum(&sdft, magnitude);
+            expectSamePeaks(&sdft, 1);
+            expectSamePeaks(&sdft, 3);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+#
+# Times CLI commands, eg. `dump all`, on a running SITL over its TCP serial port, then shows the serial task timing.
+#
+#   ./obj/main/betaflight_SITL.elf &
+#   ./src/utils/sitl-cli-dump-time.py "dump all" "diff all"
+
+from argparse import ArgumentParser, ArgumentDefaultsHelpFormatter
+import socket
+import time
+
+PROMPT = b"\r\n# "
+
+
+def read_until_idle(sock, idle_s):
+    data = b""
+    sock.settimeout(idle_s)
+    while True:
+        try:
+            chunk = sock.recv(65536)
+        except socket.timeout:
+            return data
+        if not chunk:
+            return data
+        data += chunk
+
+
+def run(sock, command, idle_s):
+    sock.sendall(command.encode() + b"\r\n")
+    start = time.monotonic()
+    data = b""
+    end = start
+    sock.settimeout(idle_s)
+    # the output is complete once the prompt is followed by no more data
+    while True:
+        try:
+            chunk = sock.recv(65536)
+        except socket.timeout:
+            if data.endswith(PROMPT):
+                return data, end - start
+            raise
+        if not chunk:
+            return data, end - start
+        data += chunk
+        end = time.monotonic()
+
+
+def main():
+    parser = ArgumentParser(description="Time CLI commands on SITL over TCP", formatter_class=ArgumentDefaultsHelpFormatter)
+    parser.add_argument("commands", nargs="*", default=["dump all"], help="CLI commands to time")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=5761, help="TCP port of the UART the CLI is on")
+    parser.add_argument("--idle", type=float, default=0.5, help="seconds without output that end a command")
+    args = parser.parse_args()
+
+    sock = socket.create_connection((args.host, args.port))
+    sock.sendall(b"#\r\n")
+    read_until_idle(sock, args.idle)
+
+    for command in args.commands:
+        data, seconds = run(sock, command, args.idle)
+        print("%s: %d bytes, %d lines in %.3f s (%.1f KB/s)"
+              % (command, len(data), data.count(b"\n"), seconds, len(data) / 1024 / max(seconds, 1e-6)))
+
+    sock.sendall(b"tasks\r\n")
+    for line in read_until_idle(sock, args.idle).decode(errors="replace").splitlines():
+        if "Task list" in line or "SERIAL" in line:
+            print(line)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+#
+# Measures how many state packets per second SITL answers in lockstep, over UDP or the shared memory link, standing in
+# for a simulator that sends a level, still quad's state and waits for each motor packet.
+#
+# It doubles as an example of a simulator's side of the shared memory link, see src/main/target/SITL/shmlink.h.
+#
+#   ./src/utils/sitl-lockstep-rate.py --transport udp
+#   ./src/utils/sitl-lockstep-rate.py --transport shm
+
+from argparse import ArgumentParser, ArgumentDefaultsHelpFormatter
+import ctypes
+import mmap
+import os
+import platform
+import socket
+import struct
+import subprocess
+import time
+
+PORT_PWM = 9002
+PORT_STATE = 9003
+
+FDM_PACKET = struct.Struct("<18d")
+SERVO_PACKET = struct.Struct("<4f")
+
+SHM_LINK_MAGIC = 0x4c485342
+SHM_LINK_VERSION = 1
+HEADER = struct.Struct("<6I")   # magic, version, slots, fdm, servo and raw servo packet sizes
+RING_SIZE = 128                 # head and sleeping, then tail on the next cache line
+RING_FDM = 64
+RING_SERVO = RING_FDM + RING_SIZE
+ITEMS = RING_FDM + 3 * RING_SIZE
+
+SYS_FUTEX = {"x86_64": 202, "aarch64": 98}[platform.machine()]
+FUTEX_WAIT = 0
+FUTEX_WAKE = 1
+
+libc = ctypes.CDLL(None, use_errno=True)
+libc.syscall.restype = ctypes.c_long
+
+
+class Timespec(ctypes.Structure):
+    _fields_ = [("tv_sec", ctypes.c_long), ("tv_nsec", ctypes.c_long)]
+
+
+def state(timestamp):
+    # still and level: 1G up on the accelerometer, in NED, and the identity quaternion
+    return FDM_PACKET.pack(timestamp, 0, 0, 0, 0, 0, -9.80665, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 101325)
+
+
+class UdpLink:
+    def __init__(self, args):
+        self.state = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.pwm = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.pwm.bind(("127.0.0.1", PORT_PWM))
+        # SITL isn't listening yet, so send the first packet until it answers
+        self.pwm.settimeout(0.1)
+        while True:
+            self.state.sendto(state(0), ("127.0.0.1", PORT_STATE))
+            try:
+                self.pwm.recv(SERVO_PACKET.size)
+                break
+            except socket.timeout:
+                pass
+        self.pwm.settimeout(None)
+
+    def step(self, timestamp):
+        self.state.sendto(state(timestamp), ("127.0.0.1", PORT_STATE))
+        return SERVO_PACKET.unpack(self.pwm.recv(SERVO_PACKET.size))
+
+
+def futex(address, op, value, timeout=None):
+    libc.syscall(ctypes.c_long(SYS_FUTEX), ctypes.c_void_p(address), ctypes.c_int(op), ctypes.c_int(value),
+                 ctypes.byref(timeout) if timeout else None, None, ctypes.c_int(0))
+
+
+class Ring:
+    def __init__(self, region, offset, items, item_size, slots):
+        self.region = region
+        self.offset = offset
+        self.items = items
+        self.item_size = item_size
+        self.slots = slots
+        self.head = ctypes.c_uint32.from_buffer(region, offset)
+        self.sleeping = ctypes.c_uint32.from_buffer(region, offset + 4)
+        self.tail = ctypes.c_uint32.from_buffer(region, offset + 64)
+
+    def push(self, data):
+        head = self.head.value
+        while head - self.tail.value == self.slots:
+            time.sleep(0.001)
+        start = self.items + (head % self.slots) * self.item_size
+        self.region[start:start + len(data)] = data
+        self.head.value = (head + 1) & 0xffffffff
+        # Python has no fence to order the store to head before the load of sleeping, so always wake
+        futex(ctypes.addressof(self.head), FUTEX_WAKE, 1)
+
+    def pop(self):
+        tail = self.tail.value
+        while self.head.value == tail:
+            # the futex call orders the store to sleeping before it reads head
+            self.sleeping.value = 1
+            if self.head.value == tail:
+                futex(ctypes.addressof(self.head), FUTEX_WAIT, tail, Timespec(1, 0))
+            self.sleeping.value = 0
+        start = self.items + (tail % self.slots) * self.item_size
+        data = bytes(self.region[start:start + self.item_size])
+        self.tail.value = (tail + 1) & 0xffffffff
+        return data
+
+
+class ShmLink:
+    # SITL takes over a region that is left from an earlier run, so it's removed before SITL starts
+    @staticmethod
+    def remove(args):
+        try:
+            os.unlink(ShmLink.path(args))
+        except FileNotFoundError:
+            pass
+
+    @staticmethod
+    def path(args):
+        return "/dev/shm/" + args.shm.lstrip("/")
+
+    def __init__(self, args):
+        path = ShmLink.path(args)
+        end = time.monotonic() + 10
+        while True:
+            try:
+                with open(path, "r+b") as f:
+                    self.region = mmap.mmap(f.fileno(), 0)
+                magic, version, slots, fdm_size, servo_size, raw_size = HEADER.unpack_from(self.region)
+                if magic == SHM_LINK_MAGIC:
+                    break
+            except (FileNotFoundError, ValueError):
+                pass
+            if time.monotonic() > end:
+                raise TimeoutError("no shared memory link in " + path)
+            time.sleep(0.1)
+
+        if version != SHM_LINK_VERSION or fdm_size != FDM_PACKET.size or servo_size != SERVO_PACKET.size:
+            raise ValueError("unexpected shared memory link version or packet sizes")
+        self.fdm = Ring(self.region, RING_FDM, ITEMS, fdm_size, slots)
+        self.servo = Ring(self.region, RING_SERVO, ITEMS + slots * fdm_size, servo_size, slots)
+        # a bridge that doesn't want the raw PWM packets just leaves that ring full
+        self.step(0)
+
+    def step(self, timestamp):
+        self.fdm.push(state(timestamp))
+        return SERVO_PACKET.unpack(self.servo.pop())
+
+
+def main():
+    parser = ArgumentParser(description="Lockstep packet rate of SITL over UDP or shared memory",
+                            formatter_class=ArgumentDefaultsHelpFormatter)
+    parser.add_argument("--elf", default="obj/main/betaflight_SITL.elf")
+    parser.add_argument("--dir", default="sitl-lockstep", help="work directory, for the config")
+    parser.add_argument("--transport", choices=["udp", "shm"], default="shm")
+    parser.add_argument("--shm", default="/betaflight-sitl", help="shared memory name")
+    parser.add_argument("--rate", type=int, default=8000, help="state packets per simulated second")
+    parser.add_argument("--seconds", type=float, default=5, help="simulated time, after the start")
+    args = parser.parse_args()
+
+    command = [os.path.abspath(args.elf), "--lockstep"]
+    if args.transport == "shm":
+        command += ["--shm", args.shm]
+        ShmLink.remove(args)
+    os.makedirs(args.dir, exist_ok=True)
+    sitl = subprocess.Popen(command, cwd=args.dir, stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+    try:
+        link = UdpLink(args) if args.transport == "udp" else ShmLink(args)
+
+        # the links send the first packet, which sets the time base, then the FC gets a simulated second to start up
+        steps = int(args.seconds * args.rate)
+        timestamp = 1 / args.rate
+        for _ in range(args.rate):
+            link.step(timestamp)
+            timestamp += 1 / args.rate
+
+        start = time.perf_counter()
+        for _ in range(steps):
+            link.step(timestamp)
+            timestamp += 1 / args.rate
+        elapsed = time.perf_counter() - start
+    finally:
+        sitl.kill()
+        sitl.wait()
+
+    print("%s: %d steps in %.2f s, %.0f steps/s, %.1f us per step, %.2fx real time"
+          % (args.transport, steps, elapsed, steps / elapsed, elapsed / steps * 1e6, args.seconds / elapsed))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+#
+# Flies a rate step on SITL's built-in quad model and reports the response, eg. to compare PID or filter settings.
+#
+# It runs SITL in the work directory, configures the motor protocol and an arm switch on AUX1 the first time, then
+# arms, hovers, steps one axis and reads the model's log.
+#
+#   ./src/utils/sitl-physics-step.py --axis roll
+#   ./src/utils/sitl-physics-step.py --axis yaw --cli "set p_yaw = 60"
+
+from argparse import ArgumentParser, ArgumentDefaultsHelpFormatter
+import csv
+import os
+import socket
+import struct
+import subprocess
+import threading
+import time
+
+TCP_PORT = 5761
+RC_PORT = 9004
+MSP_STATUS_EX = 150
+ARM_SWITCH = ["aux 0 0 0 1700 2100 0 0"]
+SETUP = ["set motor_pwm_protocol = PWM"] + ARM_SWITCH
+AXES = {"roll": 0, "pitch": 1, "yaw": 3}
+
+
+def connect(timeout_s=10):
+    end = time.monotonic() + timeout_s
+    while True:
+        try:
+            return socket.create_connection(("127.0.0.1", TCP_PORT))
+        except OSError:
+            if time.monotonic() > end:
+                raise
+            time.sleep(0.1)
+
+
+def cli(commands):
+    sock = connect()
+    sock.settimeout(1)
+    # the port is listening before SITL reads it, so repeat until it answers
+    reply = b""
+    while b"CLI" not in reply:
+        sock.sendall(b"#\r\n")
+        try:
+            reply += sock.recv(65536)
+        except socket.timeout:
+            pass
+    for command in commands:
+        sock.sendall(command.encode() + b"\r\n")
+        time.sleep(0.2)
+    try:
+        while sock.recv(65536):
+            pass
+    except (socket.timeout, ConnectionError):
+        pass
+    sock.close()
+
+
+def arming_disabled(sock):
+    sock.sendall(b"$M<" + bytes([0, MSP_STATUS_EX, MSP_STATUS_EX]))
+    reply = b""
+    while len(reply) < 5 or len(reply) < 6 + reply[3]:
+        reply += sock.recv(256)
+    payload = reply[5:5 + reply[3]]
+    # the flight mode flags are followed by the arming disable flag count and flags
+    mode_bytes = payload[15]
+    return struct.unpack_from("<I", payload, 17 + mode_bytes)[0]
+
+
+class Rc:
+    def __init__(self):
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.channels = [1500, 1500, 1000, 1500, 1000] + [1500] * 11
+        self.running = True
+        self.thread = threading.Thread(target=self.send, daemon=True)
+        self.thread.start()
+
+    def send(self):
+        while self.running:
+            self.sock.sendto(struct.pack("<d16H", time.time(), *self.channels), ("127.0.0.1", RC_PORT))
+            time.sleep(0.01)
+
+
+def fly(args, log):
+    sitl = subprocess.Popen([args.elf, "--physics", "--physics-log", log] + args.sitl_args,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+    rc = Rc()
+    try:
+        if args.cli:
+            # CLI mode blocks arming until it is left, which restarts SITL
+            cli(args.cli + ["save"])
+            sitl.wait()
+            sitl = subprocess.Popen([args.elf, "--physics", "--physics-log", log] + args.sitl_args,
+                                    stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+        msp = connect()
+        while arming_disabled(msp):
+            time.sleep(0.2)
+
+        rc.channels[4] = 1800
+        time.sleep(0.5)
+        rc.channels[2] = args.throttle
+        time.sleep(args.hover)
+        rc.channels[AXES[args.axis]] = 1500 + args.step
+        time.sleep(args.duration)
+        rc.channels[AXES[args.axis]] = 1500
+        time.sleep(0.5)
+        rc.channels[2] = 1000
+        rc.channels[4] = 1000
+        time.sleep(0.2)
+        msp.close()
+        cli(["exit"])
+        sitl.wait(10)
+    finally:
+        rc.running = False
+        if sitl.poll() is None:
+            sitl.kill()
+
+
+def analyse(args, log):
+    column = args.axis + "_rate"
+    rows = [row for row in csv.DictReader(open(log)) if row["altitude"]]
+    times = [int(row["time_us"]) / 1e6 for row in rows]
+    rates = [float(row[column]) for row in rows]
+
+    # the step starts where the rate last left the hover drift before it got well under way, and is measured against
+    # its mean over the second half
+    start = next(i for i, rate in enumerate(rates) if abs(rate) > 30 and float(rows[i]["altitude"]) > 0.1)
+    while start > 0 and abs(rates[start - 1]) > 5:
+        start -= 1
+    # the start is found a little after the stick moved, so stop short of it coming back
+    end = next(i for i in range(start, len(rows)) if times[i] > times[start] + args.duration * 0.9)
+    half = [rates[i] for i in range(start, end) if times[i] > times[start] + args.duration / 2]
+    target = sum(half) / len(half)
+
+    def first(fraction):
+        return next(times[i] for i in range(start, end) if rates[i] / target >= fraction)
+
+    peak = max(rates[start:end], key=lambda rate: rate / target)
+    settled = times[start]
+    for i in range(start, end):
+        if abs(rates[i] - target) > 0.05 * abs(target):
+            settled = times[i]
+
+    print("%s step: %.0f deg/s" % (args.axis, target))
+    print("rise time 10-90%%: %.1f ms" % ((first(0.9) - first(0.1)) * 1e3))
+    print("overshoot: %.1f %%" % ((peak / target - 1) * 100))
+    print("settled within 5%% after: %.1f ms" % ((settled - times[start]) * 1e3))
+
+
+def main():
+    parser = ArgumentParser(description="Step response of SITL's built-in quad model",
+                            formatter_class=ArgumentDefaultsHelpFormatter)
+    parser.add_argument("--elf", default="obj/main/betaflight_SITL.elf")
+    parser.add_argument("--dir", default="sitl-physics", help="work directory, keeps the config between runs")
+    parser.add_argument("--axis", choices=AXES.keys(), default="roll")
+    parser.add_argument("--step", type=int, default=200, help="stick deflection, us")
+    parser.add_argument("--duration", type=float, default=0.5, help="seconds the stick is held")
+    parser.add_argument("--hover", type=float, default=1.5, help="seconds in the air before the step")
+    parser.add_argument("--throttle", type=int, default=1500, help="climbs slowly, so the quad is clear of the ground for the step")
+    parser.add_argument("--cli", action="append", default=[], help="CLI command to run before flying, repeatable")
+    parser.add_argument("sitl_args", nargs="*", help="more SITL options, after --")
+    args = parser.parse_args()
+
+    args.elf = os.path.abspath(args.elf)
+    os.makedirs(args.dir, exist_ok=True)
+    os.chdir(args.dir)
+    if not os.path.exists("eeprom.bin"):
+        args.cli = SETUP + args.cli
+
+    log = "physics.csv"
+    fly(args, log)
+    analyse(args, log)
+
+
+if __name__ == "__main__":
+    main()